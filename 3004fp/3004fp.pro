@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -8,19 +8,72 @@ CONFIG += c++11
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Uncomment to compile out all PUMP_TRACE_SCOPE latency instrumentation.
+#DEFINES += PUMP_NO_INSTRUMENTATION
+
 SOURCES += \
+    ArrowIpc.cpp \
+    BasalDelivery.cpp \
     BolusManager.cpp \
     CGMManager.cpp \
+    CgmFusion.cpp \
+    CgmResampler.cpp \
+    EnsemblePredictor.cpp \
+    GlucoseColumns.cpp \
+    GlucoseKalmanFilter.cpp \
+    GlucoseSeriesStore.cpp \
+    GoldenTrace.cpp \
+    Instrumentation.cpp \
+    MpcBasalController.cpp \
+    PhysiologicalModel.cpp \
+    ProfileCalibration.cpp \
+    ProfileSensitivity.cpp \
+    PumpJournal.cpp \
+    PumpStages.cpp \
+    RunExport.cpp \
     SafetyController.cpp \
+    Scenario.cpp \
+    SimulationWorker.cpp \
+    Telemetry.cpp \
+    TickArena.cpp \
+    TickPipeline.cpp \
     UserProfile.cpp \
+    WhatIfExplorer.cpp \
     main.cpp \
     mainwindow.cpp
 
 HEADERS += \
+    ArrowIpc.h \
+    BasalDelivery.h \
     BolusManager.h \
     CGMManager.h \
+    CgmFusion.h \
+    CgmResampler.h \
+    Dual.h \
+    EnsemblePredictor.h \
+    GlucoseColumns.h \
+    GlucoseKalmanFilter.h \
+    GlucoseSeriesStore.h \
+    GoldenTrace.h \
+    Instrumentation.h \
+    InsulinUnits.h \
+    MpcBasalController.h \
+    PhysiologicalModel.h \
+    ProfileCalibration.h \
+    ProfileSensitivity.h \
+    PumpJournal.h \
+    PumpStages.h \
+    RunExport.h \
     SafetyController.h \
+    Scenario.h \
+    SimulationWorker.h \
+    Telemetry.h \
+    TickArena.h \
+    TickPipeline.h \
+    TripleBuffer.h \
     UserProfile.h \
+    Vectorize.h \
+    WhatIfExplorer.h \
     mainwindow.h
 
 FORMS += \
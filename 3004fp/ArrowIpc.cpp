@@ -0,0 +1,388 @@
+#include "ArrowIpc.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+const quint32 kContinuation = 0xFFFFFFFF;
+const qint16 kMetadataV5 = 4;
+
+// Schema.fbs / Message.fbs enum values
+enum MessageHeader : quint8 { SchemaHeader = 1, RecordBatchHeader = 3 };
+enum TypeId : quint8 { IntType = 2, FloatingPointType = 3, BoolType = 6, TimestampType = 10 };
+enum Precision : qint16 { Single = 1, Double = 2 };
+enum TimeUnit : qint16 { Millisecond = 1 };
+
+int padding8(qint64 size) {
+    return int((8 - (size & 7)) & 7);
+}
+
+// Minimal FlatBuffers builder. Like the reference one it builds back to
+// front: children are written before the tables that point at them, and an
+// offset is the distance of an object from the end of the buffer.
+class FlatBuilder {
+public:
+    quint32 offset() const { return quint32(m_data.size()); }
+
+    template <typename T> void prepend(T value) {
+        align(int(sizeof(T)), int(sizeof(T)));
+        char bytes[sizeof(T)];
+        qToLittleEndian<T>(value, bytes);
+        m_data.prepend(bytes, int(sizeof(T)));
+    }
+
+    // Prepends a reference to an object built earlier
+    void prependOffset(quint32 target) {
+        align(4, 4);
+        prepend(quint32(offset() + 4 - target));
+    }
+
+    quint32 createString(const QString &text) {
+        const QByteArray utf8 = text.toUtf8();
+        align(utf8.size() + 1, 4);
+        m_data.prepend('\0');
+        m_data.prepend(utf8);
+        prepend(quint32(utf8.size()));
+        return offset();
+    }
+
+    quint32 createOffsetVector(const QVector<quint32> &targets) {
+        align(targets.size() * 4, 4);
+        for (int i = targets.size() - 1; i >= 0; --i) {
+            prependOffset(targets[i]);
+        }
+        prepend(quint32(targets.size()));
+        return offset();
+    }
+
+    // 'structs' holds 'count' 8-byte-aligned structs in order
+    quint32 createStructVector(const QByteArray &structs, int count) {
+        align(structs.size(), 8);
+        align(structs.size(), 4);
+        m_data.prepend(structs);
+        prepend(quint32(count));
+        return offset();
+    }
+
+    void startTable() {
+        m_fields.clear();
+        m_tableEnd = offset();
+    }
+    template <typename T> void addField(int slot, T value) {
+        prepend(value);
+        m_fields.append({slot, offset()});
+    }
+    void addOffsetField(int slot, quint32 target) {
+        prependOffset(target);
+        m_fields.append({slot, offset()});
+    }
+
+    // Writes the table's vtable in front of it
+    quint32 endTable() {
+        prepend(qint32(0));                       // Patched to point at the vtable
+        const quint32 table = offset();
+
+        int slotCount = 0;
+        for (const Field &field : m_fields) {
+            slotCount = qMax(slotCount, field.slot + 1);
+        }
+        QVector<quint16> entries(slotCount, 0);
+        for (const Field &field : m_fields) {
+            entries[field.slot] = quint16(table - field.offset);
+        }
+        for (int i = slotCount - 1; i >= 0; --i) {
+            prepend(entries[i]);
+        }
+        prepend(quint16(table - m_tableEnd));
+        prepend(quint16(4 + 2 * slotCount));
+
+        const qint32 toVtable = qint32(offset() - table);
+        qToLittleEndian<qint32>(toVtable, m_data.data() + (m_data.size() - table));
+        return table;
+    }
+
+    // Root reference in front; the size is a multiple of 8 so the message body stays aligned
+    QByteArray finish(quint32 root) {
+        align(4, 8);
+        prependOffset(root);
+        return m_data;
+    }
+
+private:
+    struct Field {
+        int slot;
+        quint32 offset;
+    };
+
+    // Pads so that after 'size' more bytes the buffer is 'alignment'-aligned from its end
+    void align(int size, int alignment) {
+        const int pad = int((alignment - ((m_data.size() + size) % alignment)) % alignment);
+        if (pad > 0) {
+            m_data.prepend(QByteArray(pad, '\0'));
+        }
+    }
+
+    QByteArray m_data;
+    QVector<Field> m_fields;
+    quint32 m_tableEnd = 0;
+};
+
+// Field's type table; returns the union type id
+quint8 buildType(FlatBuilder &fb, ArrowField::Type type, quint32 *table) {
+    switch (type) {
+    case ArrowField::Bool:
+        fb.startTable();
+        *table = fb.endTable();
+        return BoolType;
+    case ArrowField::Int8:
+    case ArrowField::Int32:
+    case ArrowField::Int64:
+        fb.startTable();
+        fb.addField(0, qint32(8 * ArrowField::byteWidth(type)));   // bitWidth
+        fb.addField(1, quint8(1));                                  // is_signed
+        *table = fb.endTable();
+        return IntType;
+    case ArrowField::Float32:
+    case ArrowField::Float64:
+        fb.startTable();
+        fb.addField(0, qint16(type == ArrowField::Float32 ? Single : Double));
+        *table = fb.endTable();
+        return FloatingPointType;
+    case ArrowField::TimestampMs: {
+        const quint32 timezone = fb.createString("UTC");
+        fb.startTable();
+        fb.addField(0, qint16(Millisecond));
+        fb.addOffsetField(1, timezone);
+        *table = fb.endTable();
+        return TimestampType;
+    }
+    }
+    return 0;
+}
+
+quint32 buildSchema(FlatBuilder &fb, const QVector<ArrowField> &schema) {
+    QVector<quint32> fields;
+    for (const ArrowField &field : schema) {
+        const quint32 name = fb.createString(field.name);
+        quint32 type = 0;
+        const quint8 typeId = buildType(fb, field.type, &type);
+        const quint32 children = fb.createOffsetVector(QVector<quint32>());
+        fb.startTable();
+        fb.addOffsetField(0, name);
+        fb.addField(1, quint8(0));          // nullable
+        fb.addField(2, typeId);             // type_type
+        fb.addOffsetField(3, type);
+        fb.addOffsetField(5, children);
+        fields.append(fb.endTable());
+    }
+    const quint32 fieldVector = fb.createOffsetVector(fields);
+    fb.startTable();
+    fb.addField(0, qint16(0));              // Little endian
+    fb.addOffsetField(1, fieldVector);
+    return fb.endTable();
+}
+
+QByteArray buildMessage(FlatBuilder &fb, MessageHeader headerType, quint32 header, qint64 bodyLength) {
+    fb.startTable();
+    fb.addField(3, bodyLength);
+    fb.addOffsetField(2, header);
+    fb.addField(0, kMetadataV5);
+    fb.addField(1, quint8(headerType));
+    return fb.finish(fb.endTable());
+}
+
+void appendLittleEndian(QByteArray *out, qint64 value) {
+    char bytes[8];
+    qToLittleEndian<qint64>(value, bytes);
+    out->append(bytes, 8);
+}
+
+}
+
+int ArrowField::byteWidth(Type type) {
+    switch (type) {
+    case Bool: return 0;
+    case Int8: return 1;
+    case Int32: return 4;
+    case Float32: return 4;
+    case Int64: return 8;
+    case Float64: return 8;
+    case TimestampMs: return 8;
+    }
+    return 0;
+}
+
+ArrowBatch::ArrowBatch(const QVector<ArrowField> &schema, int capacity)
+    : m_schema(schema),
+      m_capacity(capacity)
+{
+    m_columns.resize(schema.size());
+    for (int i = 0; i < schema.size(); ++i) {
+        const int width = ArrowField::byteWidth(schema[i].type);
+        m_columns[i] = QByteArray(width > 0 ? capacity * width : (capacity + 7) / 8, '\0');
+    }
+}
+
+void ArrowBatch::setRows(int rows) {
+    m_rows = qBound(0, rows, m_capacity);
+}
+
+void ArrowBatch::clear() {
+    m_rows = 0;
+    for (int i = 0; i < m_schema.size(); ++i) {
+        if (m_schema[i].type == ArrowField::Bool) {
+            m_columns[i].fill('\0');
+        }
+    }
+}
+
+void ArrowBatch::setBool(int column, int row, bool value) {
+    Q_ASSERT(m_schema[column].type == ArrowField::Bool);
+    char &byte = m_columns[column].data()[row >> 3];
+    const char bit = char(1 << (row & 7));
+    byte = value ? char(byte | bit) : char(byte & ~bit);
+}
+
+qint64 ArrowBatch::dataBytes(int column) const {
+    const int width = ArrowField::byteWidth(m_schema[column].type);
+    return width > 0 ? qint64(m_rows) * width : (m_rows + 7) / 8;
+}
+
+ArrowFileWriter::~ArrowFileWriter() {
+    if (isOpen()) {
+        QString error;
+        close(&error);
+    }
+}
+
+bool ArrowFileWriter::open(const QString &path, const QVector<ArrowField> &schema, QString *error) {
+    m_file.close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = QString("cannot write %1: %2").arg(path, m_file.errorString());
+        return false;
+    }
+    m_schema = schema;
+    m_blocks.clear();
+    m_rows = 0;
+
+    FlatBuilder fb;
+    const QByteArray metadata = buildMessage(fb, SchemaHeader, buildSchema(fb, schema), 0);
+    Block block;
+    if (m_file.write(kMagic, sizeof(kMagic)) != qint64(sizeof(kMagic)) || !writeMessage(metadata, &block, error)) {
+        if (error->isEmpty()) *error = QString("cannot write %1").arg(path);
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool ArrowFileWriter::write(const ArrowBatch &batch, QString *error) {
+    if (!isOpen()) {
+        *error = "Arrow file is not open";
+        return false;
+    }
+    if (batch.rows() == 0) return true;
+
+    // Per column: one field node, then its (empty) validity and data buffers
+    QByteArray nodes;
+    QByteArray buffers;
+    qint64 bodyLength = 0;
+    for (int i = 0; i < m_schema.size(); ++i) {
+        appendLittleEndian(&nodes, batch.rows());
+        appendLittleEndian(&nodes, 0);
+        appendLittleEndian(&buffers, bodyLength);
+        appendLittleEndian(&buffers, 0);
+        const qint64 bytes = batch.dataBytes(i);
+        appendLittleEndian(&buffers, bodyLength);
+        appendLittleEndian(&buffers, bytes);
+        bodyLength += bytes + padding8(bytes);
+    }
+
+    FlatBuilder fb;
+    const quint32 bufferVector = fb.createStructVector(buffers, 2 * m_schema.size());
+    const quint32 nodeVector = fb.createStructVector(nodes, m_schema.size());
+    fb.startTable();
+    fb.addField(0, qint64(batch.rows()));
+    fb.addOffsetField(1, nodeVector);
+    fb.addOffsetField(2, bufferVector);
+    const QByteArray metadata = buildMessage(fb, RecordBatchHeader, fb.endTable(), bodyLength);
+
+    Block block;
+    if (!writeMessage(metadata, &block, error)) return false;
+    static const char zeros[8] = {};
+    for (int i = 0; i < m_schema.size(); ++i) {
+        const qint64 bytes = batch.dataBytes(i);
+        if (m_file.write(batch.data(i), bytes) != bytes || m_file.write(zeros, padding8(bytes)) != padding8(bytes)) {
+            *error = QString("cannot write %1: %2").arg(m_file.fileName(), m_file.errorString());
+            return false;
+        }
+    }
+    block.bodyLength = bodyLength;
+    m_blocks.append(block);
+    m_rows += batch.rows();
+    return true;
+}
+
+bool ArrowFileWriter::close(QString *error) {
+    if (!isOpen()) return true;
+
+    QByteArray blocks;
+    for (const Block &block : m_blocks) {
+        appendLittleEndian(&blocks, block.offset);
+        char length[8] = {};
+        qToLittleEndian<qint32>(block.metadataLength, length);
+        blocks.append(length, 8);
+        appendLittleEndian(&blocks, block.bodyLength);
+    }
+    FlatBuilder fb;
+    const quint32 batches = fb.createStructVector(blocks, m_blocks.size());
+    const quint32 dictionaries = fb.createStructVector(QByteArray(), 0);
+    const quint32 schema = buildSchema(fb, m_schema);
+    fb.startTable();
+    fb.addOffsetField(1, schema);
+    fb.addOffsetField(2, dictionaries);
+    fb.addOffsetField(3, batches);
+    fb.addField(0, kMetadataV5);
+    const QByteArray footer = fb.finish(fb.endTable());
+
+    QByteArray tail;
+    char word[4];
+    qToLittleEndian<quint32>(kContinuation, word);
+    tail.append(word, 4);
+    tail.append(4, '\0');                   // End of stream
+    tail.append(footer);
+    qToLittleEndian<qint32>(footer.size(), word);
+    tail.append(word, 4);
+    tail.append(kMagic, 6);
+
+    const bool ok = m_file.write(tail) == tail.size() && m_file.flush();
+    if (!ok) {
+        *error = QString("cannot write %1: %2").arg(m_file.fileName(), m_file.errorString());
+    }
+    m_file.close();
+    return ok;
+}
+
+// Encapsulated message: continuation marker, metadata size, metadata padded to 8
+bool ArrowFileWriter::writeMessage(const QByteArray &metadata, Block *block, QString *error) {
+    QByteArray prefix;
+    char word[4];
+    qToLittleEndian<quint32>(kContinuation, word);
+    prefix.append(word, 4);
+    const int padded = metadata.size() + padding8(8 + metadata.size());
+    qToLittleEndian<qint32>(padded, word);
+    prefix.append(word, 4);
+
+    block->offset = m_file.pos();
+    block->metadataLength = 8 + padded;
+    block->bodyLength = 0;
+    static const char zeros[8] = {};
+    const int pad = padded - metadata.size();
+    if (m_file.write(prefix) != 8 || m_file.write(metadata) != metadata.size() || m_file.write(zeros, pad) != pad) {
+        *error = QString("cannot write %1: %2").arg(m_file.fileName(), m_file.errorString());
+        return false;
+    }
+    return true;
+}
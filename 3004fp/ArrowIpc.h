@@ -0,0 +1,94 @@
+#ifndef ARROWIPC_H
+#define ARROWIPC_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+// One column of an Arrow table. Columns never contain nulls.
+struct ArrowField {
+    enum Type : quint8 { Bool, Int8, Int32, Int64, Float32, Float64, TimestampMs };
+
+    QString name;
+    Type type = Float64;
+
+    // Bytes per value; 0 for Bool, which is stored as bits
+    static int byteWidth(Type type);
+};
+
+// Column buffers of one record batch, in Arrow's memory layout, so the
+// writer sends them to the file as they are. Fill values through column<T>()
+// (setBool() for Bool columns) for rows below rows().
+class ArrowBatch {
+public:
+    ArrowBatch() {}
+    ArrowBatch(const QVector<ArrowField> &schema, int capacity);
+
+    const QVector<ArrowField> &schema() const { return m_schema; }
+    int capacity() const { return m_capacity; }
+    int rows() const { return m_rows; }
+
+    // Rows the next write() takes; at most capacity()
+    void setRows(int rows);
+
+    // Back to zero rows with Bool columns cleared
+    void clear();
+
+    template <typename T> T *column(int index) {
+        Q_ASSERT(ArrowField::byteWidth(m_schema[index].type) == int(sizeof(T)));
+        return reinterpret_cast<T *>(m_columns[index].data());
+    }
+    void setBool(int column, int row, bool value);
+
+    const char *data(int column) const { return m_columns[column].constData(); }
+    qint64 dataBytes(int column) const;
+
+private:
+    QVector<ArrowField> m_schema;
+    QVector<QByteArray> m_columns;
+    int m_capacity = 0;
+    int m_rows = 0;
+};
+
+// Streams record batches into an Arrow IPC file (the Feather v2 format), readable
+// by pyarrow, pandas, polars, DuckDB and R's arrow package.
+//
+// Layout: "ARROW1", the schema message, one message per batch, the end-of-stream
+// marker, then a footer indexing every batch. Messages are FlatBuffers built
+// here, so there is no dependency on the Arrow libraries. Batch bodies are the
+// column buffers written straight from the ArrowBatch, padded to 8 bytes.
+class ArrowFileWriter {
+public:
+    ~ArrowFileWriter();
+
+    bool open(const QString &path, const QVector<ArrowField> &schema, QString *error);
+    bool isOpen() const { return m_file.isOpen(); }
+
+    // Appends the batch's rows; does nothing for an empty batch
+    bool write(const ArrowBatch &batch, QString *error);
+
+    // Writes the footer; a file that is never closed cannot be read
+    bool close(QString *error);
+
+    int batchCount() const { return m_blocks.size(); }
+    qint64 rowCount() const { return m_rows; }
+
+private:
+    // Index entry of one message in the footer
+    struct Block {
+        qint64 offset;
+        qint32 metadataLength;
+        qint64 bodyLength;
+    };
+
+    bool writeMessage(const QByteArray &metadata, Block *block, QString *error);
+
+    QFile m_file;
+    QVector<ArrowField> m_schema;
+    QVector<Block> m_blocks;
+    qint64 m_rows = 0;
+};
+
+#endif // ARROWIPC_H
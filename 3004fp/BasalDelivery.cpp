@@ -0,0 +1,71 @@
+#include "BasalDelivery.h"
+
+namespace {
+
+// Rates are whole 0.001 u/h, never negative
+qint32 rateTicks(double unitsPerHour) {
+    return qMax(0, InsulinUnits::fromUnits(unitsPerHour).ticks());
+}
+
+}
+
+void BasalScheduler::resize(int count, int minute) {
+    const int previous = m_rate.size();
+    m_rate.resize(count);
+    m_tempRate.resize(count);
+    m_tempEnd.resize(count);
+    m_clock.resize(count);
+    m_carry.resize(count);
+    m_pulses.resize(count);
+    for (int pump = previous; pump < count; ++pump) {
+        m_rate[pump] = 0;
+        restart(pump, minute);
+    }
+}
+
+void BasalScheduler::restart(int pump, int minute) {
+    m_tempRate[pump] = 0;
+    m_tempEnd[pump] = minute;
+    m_clock[pump] = minute;
+    m_carry[pump] = 0;
+    m_pulses[pump] = 0;
+}
+
+void BasalScheduler::setRate(int pump, double unitsPerHour) {
+    m_rate[pump] = rateTicks(unitsPerHour);
+}
+
+void BasalScheduler::setTempBasal(int pump, double unitsPerHour, int minutes) {
+    m_tempRate[pump] = rateTicks(unitsPerHour);
+    m_tempEnd[pump] = m_clock[pump] + qMax(0, minutes);
+}
+
+double BasalScheduler::activeRate(int pump) const {
+    return InsulinUnits::fromTicks(tempBasalActive(pump) ? m_tempRate[pump] : m_rate[pump]).toUnits();
+}
+
+int BasalScheduler::advance(int pump, int minute) {
+    const qint32 from = m_clock[pump];
+    if (minute <= from) return 0;
+
+    // The temp basal's share of the interval, then the programmed rate for the rest
+    const qint32 tempUntil = qBound(from, m_tempEnd[pump], qint32(minute));
+    const qint64 amount = m_carry[pump] + qint64(m_tempRate[pump]) * (tempUntil - from)
+                          + qint64(m_rate[pump]) * (minute - tempUntil);
+
+    const qint64 pulses = amount / kPulseRateMinutes;
+    m_carry[pump] = amount - pulses * kPulseRateMinutes;
+    m_clock[pump] = minute;
+    m_pulses[pump] += quint64(pulses);
+    return int(pulses);
+}
+
+void BasalScheduler::advance(const int *minutes, int *pulses, int count) {
+    for (int pump = 0; pump < count; ++pump) {
+        pulses[pump] = advance(pump, minutes[pump]);
+    }
+}
+
+InsulinUnits BasalScheduler::carry(int pump) const {
+    return InsulinUnits::fromTicks(m_carry[pump] / 60);
+}
@@ -0,0 +1,62 @@
+#ifndef BASALDELIVERY_H
+#define BASALDELIVERY_H
+
+#include <QVector>
+#include <QtGlobal>
+#include "InsulinUnits.h"
+
+// Basal delivery for any number of pumps from one scheduler.
+//
+// Each pump runs its programmed rate, or a temp basal rate until the temp
+// basal ends. advance() integrates the running rate over the minutes since
+// the pump's last advance, in exact integers (0.001 u/h times minutes), and
+// turns the amount into micro-pulses of one pump step (0.05 u). Whatever is
+// left below a pulse carries over to the next advance, so 0.3 u/h gives a
+// pulse every 10 minutes and no fraction is lost when the rate changes.
+// Pumps are rows of flat arrays advanced by their owner's clock (the
+// pipeline's tick), so thousands of pumps need no timers of their own.
+class BasalScheduler {
+public:
+    // One pulse in accumulator units: (0.001 u/h) x minutes
+    static const qint64 kPulseRateMinutes = qint64(InsulinUnits::kPumpStepTicks) * 60;
+
+    // New pumps start at 'minute' with a zero rate
+    void resize(int count, int minute = 0);
+    int pumpCount() const { return m_rate.size(); }
+
+    // Restarts a pump's clock at 'minute', dropping its carry and temp basal
+    void restart(int pump, int minute);
+
+    // Programmed rate in u/h (negative is zero); runs from the pump's last advance
+    void setRate(int pump, double unitsPerHour);
+    double rate(int pump) const { return InsulinUnits::fromTicks(m_rate[pump]).toUnits(); }
+
+    // Runs 'unitsPerHour' for 'minutes' from the pump's last advance, replacing any temp basal
+    void setTempBasal(int pump, double unitsPerHour, int minutes);
+    void cancelTempBasal(int pump) { m_tempEnd[pump] = m_clock[pump]; }
+    bool tempBasalActive(int pump) const { return m_tempEnd[pump] > m_clock[pump]; }
+    int tempBasalRemaining(int pump) const { return qMax(0, m_tempEnd[pump] - m_clock[pump]); }
+
+    // Rate running at the pump's clock (u/h)
+    double activeRate(int pump) const;
+
+    // Moves the pump's clock to 'minute' and returns the pulses due since its last advance
+    int advance(int pump, int minute);
+
+    // Advances pumps [0, count) to their minutes; pulses[i] receives pump i's count
+    void advance(const int *minutes, int *pulses, int count);
+
+    int clock(int pump) const { return m_clock[pump]; }
+    InsulinUnits carry(int pump) const;      // Below one pulse, rounded down to 0.001 u
+    quint64 pulses(int pump) const { return m_pulses[pump]; }   // Since the pump (re)started
+
+private:
+    QVector<qint32> m_rate;                  // Programmed, 0.001 u/h
+    QVector<qint32> m_tempRate;              // 0.001 u/h
+    QVector<qint32> m_tempEnd;               // Minute the temp basal ends; at or before the clock if none
+    QVector<qint32> m_clock;                 // Minute of the last advance
+    QVector<qint64> m_carry;                 // Accumulated below one pulse, (0.001 u/h) x minutes
+    QVector<quint64> m_pulses;
+};
+
+#endif // BASALDELIVERY_H
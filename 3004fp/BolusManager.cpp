@@ -1,4 +1,7 @@
 #include "BolusManager.h"
+#include "InsulinUnits.h"
+#include "Instrumentation.h"
+#include "PumpJournal.h"
 
 BolusManager::BolusManager() {
     bolusInProgress = false;
@@ -12,17 +15,21 @@ double BolusManager::getTotalBolus() const {
 
 // Computes insulin bolus based on inputs and stores result
 BolusResult BolusManager::calculateBolus(double carbs, double bg, double ICR, double CF, double targetBG, double IOB, double immediateFrac, int hours) {
+    PUMP_TRACE_SCOPE("bolus.calculateBolus");
+    const BolusTerms<double> terms = bolusTerms(carbs, bg, ICR, CF, targetBG, IOB);
     BolusResult result;
-    result.carbBolus = carbs / ICR;
-    result.correctionBolus = (bg - targetBG) / CF;
-    result.totalBolus = result.carbBolus + result.correctionBolus;
-    result.finalBolus = result.totalBolus - IOB;
+    result.carbBolus = terms.carbBolus;
+    result.correctionBolus = terms.correctionBolus;
+    result.totalBolus = terms.totalBolus;
+    result.finalBolus = terms.finalBolus;
 
-    if (result.finalBolus < 0)
-        result.finalBolus = 0;
-
-    result.immediateBolus = immediateFrac * result.finalBolus;
-    result.extendedBolus = result.finalBolus - result.immediateBolus;
+    // The pump delivers whole 0.05 u steps; both parts are rounded down so
+    // together they never exceed the calculated dose
+    const InsulinUnits finalDose = InsulinUnits::fromUnits(result.finalBolus).toPumpStep();
+    const InsulinUnits immediateDose = finalDose.scaled(immediateFrac).toPumpStep();
+    result.finalBolus = finalDose.toUnits();
+    result.immediateBolus = immediateDose.toUnits();
+    result.extendedBolus = (finalDose - immediateDose).toUnits();
     result.hourlyRate = (hours > 0) ? result.extendedBolus / hours : 0;
 
     lastResult = result;
@@ -61,6 +68,10 @@ QString BolusManager::deliverBolus(const BolusResult& result, bool extended) {
         bolusInProgress = false;
     }
 
+    if (m_journal) {
+        m_journal->record(JournalEvent::make(JournalEvent::BolusStarted, partialDelivered, extended ? result.extendedBolus : 0.0,
+                                             extended ? result.hourlyRate : 0.0, bolusInProgress));
+    }
     return log;
 }
 
@@ -71,6 +82,9 @@ QString BolusManager::cancelBolus() {
     }
 
     bolusInProgress = false;
+    if (m_journal) {
+        m_journal->record(JournalEvent::make(JournalEvent::BolusCancelled, partialDelivered));
+    }
     QDateTime cancelTime = QDateTime::currentDateTime();
     QString log;
     log += "Bolus delivery cancelled at " + cancelTime.toString("hh:mm:ss") + "\n";
@@ -82,3 +96,10 @@ QString BolusManager::cancelBolus() {
 double BolusManager::updateIOB(double currentIOB, double deliveredAmount) {
     return currentIOB + deliveredAmount;
 }
+
+// Restores delivery state recovered from the journal
+void BolusManager::restoreState(const PumpState &state) {
+    bolusInProgress = state.bolusInProgress;
+    partialDelivered = state.partialDelivered;
+    startTime = QDateTime::fromMSecsSinceEpoch(state.bolusStartMs);
+}
@@ -3,6 +3,10 @@
 
 #include <QString>
 #include <QDateTime>
+#include <QtGlobal>
+
+class PumpJournal;
+struct PumpState;
 
 // Struct to store results of a bolus calculation
 struct BolusResult {
@@ -17,6 +21,15 @@ struct BolusResult {
     QString toString(int hours = 3) const;  // String summary of result
 };
 
+// The calculator's terms before rounding to the pump step
+template <typename T>
+struct BolusTerms {
+    T carbBolus;
+    T correctionBolus;
+    T totalBolus;
+    T finalBolus;            // After IOB, never negative
+};
+
 // Handles bolus calculation and delivery logic
 class BolusManager {
 public:
@@ -27,6 +40,11 @@ public:
     // Calculates bolus based on inputs like carbs, BG, ICR, CF, etc.
     BolusResult calculateBolus(double carbs, double bg, double ICR, double CF, double targetBG, double IOB, double immediateFrac = 0.6, int hours = 3);
 
+    // The formula behind calculateBolus(); T is double, or Dual for gradients with respect to the settings
+    template <typename T>
+    static BolusTerms<T> bolusTerms(const T &carbs, const T &bg, const T &ICR, const T &CF, const T &targetBG,
+                                    const T &IOB);
+
     // Simulates insulin delivery, optionally with extended delivery
     QString deliverBolus(const BolusResult& result, bool extended = false);
 
@@ -39,11 +57,29 @@ public:
     // Returns the result of the last bolus calculation
     BolusResult getLastResult() const { return lastResult; }
 
+    // Journal deliveries and cancellations from now on (not owned; may be null)
+    void setJournal(PumpJournal *journal) { m_journal = journal; }
+
+    // Take over delivery state recovered from the journal
+    void restoreState(const PumpState &state);
+
 private:
     bool bolusInProgress;      // Indicates if bolus is active
     double partialDelivered;   // Tracks how much was delivered
     QDateTime startTime;       // Timestamp for bolus start
     BolusResult lastResult;    // Stores last calculation result
+    PumpJournal *m_journal = nullptr;
 };
 
+template <typename T>
+BolusTerms<T> BolusManager::bolusTerms(const T &carbs, const T &bg, const T &ICR, const T &CF, const T &targetBG,
+                                       const T &IOB) {
+    BolusTerms<T> terms;
+    terms.carbBolus = carbs / ICR;
+    terms.correctionBolus = (bg - targetBG) / CF;
+    terms.totalBolus = terms.carbBolus + terms.correctionBolus;
+    terms.finalBolus = qMax(T(0.0), terms.totalBolus - IOB);
+    return terms;
+}
+
 #endif // BOLUSMANAGER_H
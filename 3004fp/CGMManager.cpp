@@ -1,75 +1,201 @@
 #include "CGMManager.h"
 #include <QDebug>
+#include <cmath>
+#include "Instrumentation.h"
+#include "PumpJournal.h"
 
 CGMManager::CGMManager(BolusManager* bolusManager) :
     m_bolusManager(bolusManager),
     m_lowGlucoseThreshold(3.9),  // Default 3.9 mmol/L (70 mg/dL)
     m_highGlucoseThreshold(10.0), // Default 10.0 mmol/L (180 mg/dL)
-    m_lastAdjustmentTime(0)
+    m_lastAdjustmentTime(0),
+    m_sensorMinute(0.0),
+    m_hasSensorTime(false),
+    m_alertState(0),
+    m_journal(nullptr)
 {
+    m_grid.interval = m_resampler.settings().intervalMinutes;
 }
 
-void CGMManager::addReading(double glucoseLevel) {
-    GlucoseReading reading;
-    reading.timestamp = QDateTime::currentDateTime();
-    reading.value = glucoseLevel;
-    reading.isAlarm = checkAlerts(glucoseLevel);
+void CGMManager::addReading(double glucoseLevel, double minutesSinceLast) {
+    addReadingAt(m_hasSensorTime ? m_sensorMinute + minutesSinceLast : 0.0, glucoseLevel);
+}
+
+void CGMManager::addReadingAt(double sensorMinute, double glucoseLevel) {
+    addReadingAt(sensorMinute, glucoseLevel, m_filter.settings().measurementVariance, 0);
+}
+
+int CGMManager::addSource(const QString &name, double errorSd, CgmFusion::Kind kind) {
+    return m_fusion.addSource(name, errorSd, kind);
+}
+
+void CGMManager::addSourceReading(int source, double sensorMinute, double glucoseLevel) {
+    m_fused.clear();
+    m_fusion.push(source, sensorMinute, glucoseLevel, &m_fused);
+    m_fusion.poll(&m_fused);
+    addFusedReadings();
+}
 
-    m_readings.append(reading);
+void CGMManager::flushSources() {
+    m_fused.clear();
+    m_fusion.finish(&m_fused);
+    addFusedReadings();
+}
 
-    // Keep only recent readings (e.g., last 24 hours)
-    while (m_readings.size() > 288) { // 288 readings = 24 hours @ 5 min intervals
-        m_readings.removeFirst();
+void CGMManager::resetFilter() {
+    m_filter.reset();
+    if (m_journal) {
+        m_journal->record(JournalEvent::make(JournalEvent::CgmFilterReset));
     }
 }
 
-QVector<QPair<double, double>> CGMManager::getGlucoseHistory(int minutes) const {
-    QVector<QPair<double, double>> history;
-    QDateTime currentTime = QDateTime::currentDateTime();
-    QDateTime cutoffTime = currentTime.addSecs(-minutes * 60);
-
-    for (const auto& reading : m_readings) {
-        if (reading.timestamp >= cutoffTime) {
-            // Time in minutes since start (x-axis), Glucose value (y-axis)
-            double timeInMinutes = cutoffTime.secsTo(reading.timestamp) / 60.0;
-            history.append(qMakePair(timeInMinutes, reading.value));
+// Replays the recovered window with journaling off; a day of readings is
+// enough for the filter and grid to match the ones that were lost
+void CGMManager::restoreState(const PumpState &state) {
+    PumpJournal *journal = m_journal;
+    m_journal = nullptr;
+
+    m_readings.clear();
+    m_filter.reset();
+    m_resampler.reset();
+    m_grid.clear();
+    m_fusion.reset();
+    m_hasSensorTime = false;
+    m_alertState = 0;
+    m_lowGlucoseThreshold = state.lowGlucoseThreshold;
+    m_highGlucoseThreshold = state.highGlucoseThreshold;
+
+    for (const PumpState::Reading &reading : state.readings) {
+        if (reading.resetBefore) m_filter.reset();
+        addReadingAt(reading.minute, reading.glucose, reading.variance, reading.sources);
+        if (!m_readings.isEmpty()) {
+            m_readings.timeMs.last() = reading.timeMs;
         }
     }
+    if (state.filterResetPending) m_filter.reset();
 
-    return history;
+    m_journal = journal;
 }
 
-double CGMManager::calculateGlucoseRateOfChange(int minutesBack) const {
-    if (m_readings.size() < 2) {
-        return 0.0; // Not enough data
+void CGMManager::addFusedReadings() {
+    for (const FusedReading &fused : m_fused) {
+        addReadingAt(fused.minute, fused.glucose, fused.variance, fused.sources);
+    }
+}
+
+void CGMManager::addReadingAt(double sensorMinute, double glucoseLevel, double variance, quint32 sources) {
+    PUMP_TRACE_SCOPE("cgm.addReading");
+    if (m_journal) {
+        JournalEvent event = JournalEvent::make(JournalEvent::CgmReading, sensorMinute, glucoseLevel, variance);
+        event.sources = sources;
+        m_journal->record(event);
+    }
+
+    // Out-of-order readings only go to the resampler; the filter runs forward in time
+    const double sinceLast = m_hasSensorTime ? sensorMinute - m_sensorMinute : 0.0;
+    m_gridPoints.clear();
+    m_resampler.push(sensorMinute, glucoseLevel, &m_gridPoints);
+    for (const ResampledPoint &point : m_gridPoints) {
+        m_grid.append(point);
+    }
+    m_grid.trim(288);
+    if (sinceLast < 0.0) {
+        return;
     }
+    m_sensorMinute = sensorMinute;
+    m_hasSensorTime = true;
 
-    QDateTime currentTime = QDateTime::currentDateTime();
-    QDateTime cutoffTime = currentTime.addSecs(-minutesBack * 60);
+    m_filter.update(glucoseLevel, sinceLast, variance);
 
-    QVector<GlucoseReading> recentReadings;
-    for (const auto& reading : m_readings) {
-        if (reading.timestamp >= cutoffTime) {
-            recentReadings.append(reading);
+    const double filtered = m_filter.glucose();
+    const bool isAlarm = checkAlerts(filtered);  // Filtered, so sensor jitter does not flap alerts
+
+    // Alerts are journaled when they start and clear, not on every reading
+    const quint8 alertState = !isAlarm ? 0 : (filtered <= m_lowGlucoseThreshold ? 1 : 2);
+    if (alertState != m_alertState) {
+        m_alertState = alertState;
+        if (m_journal) {
+            m_journal->record(JournalEvent::make(JournalEvent::CgmAlert, filtered, 0.0, 0.0, alertState));
         }
     }
 
-    if (recentReadings.size() < 2) {
-        return 0.0;
+    const quint8 flags = alertState == 1 ? GlucoseColumns::Alarm | GlucoseColumns::Low
+                       : alertState == 2 ? GlucoseColumns::Alarm | GlucoseColumns::High : 0;
+    m_readings.append(sensorMinute, float(glucoseLevel), float(filtered), float(m_filter.trend()),
+                      float(m_filter.variance()), sources, flags, QDateTime::currentMSecsSinceEpoch());
+
+    // Keep at least the last 24 hours (288 readings at 5 min) and at most 48; trimmed in
+    // batches so appends stay O(1)
+    m_readings.trim(288);
+}
+
+int CGMManager::historyStart(int minutes, double *cutoff) const {
+    *cutoff = m_grid.endMinute() - minutes;
+    return qMax(0, int(std::ceil((*cutoff - m_grid.startMinute) / m_grid.interval)));
+}
+
+QVector<QPair<double, double>> CGMManager::getGlucoseHistory(int minutes) const {
+    QVector<QPair<double, double>> history;
+    if (m_grid.size() == 0) {
+        return history;
     }
 
-    // Calculate linear regression to find trend
+    double cutoff;
+    const int first = historyStart(minutes, &cutoff);
+    history.reserve(m_grid.size() - first);
+
+    for (int i = first; i < m_grid.size(); ++i) {
+        if (m_grid.flags[i] == ResampledPoint::Gap) continue;
+        // Time in minutes since start (x-axis), Glucose value (y-axis)
+        history.append(qMakePair(m_grid.minuteAt(i) - cutoff, m_grid.glucose[i]));
+    }
+
+    return history;
+}
+
+ArenaArray<QPair<double, double>> CGMManager::getGlucoseHistory(TickArena &arena, int minutes) const {
+    if (m_grid.size() == 0) {
+        return ArenaArray<QPair<double, double>>();
+    }
+
+    double cutoff;
+    const int first = historyStart(minutes, &cutoff);
+    ArenaArray<QPair<double, double>> history(arena, m_grid.size() - first);
+    for (int i = first; i < m_grid.size(); ++i) {
+        if (m_grid.flags[i] == ResampledPoint::Gap) continue;
+        history.append(qMakePair(m_grid.minuteAt(i) - cutoff, m_grid.glucose[i]));
+    }
+    return history;
+}
+
+double CGMManager::calculateGlucoseRateOfChange(int minutesBack) const {
+    PUMP_TRACE_SCOPE("cgm.calculateGlucoseRateOfChange");
+    if (m_grid.size() < 2) {
+        return 0.0; // Not enough data
+    }
+
+    const int last = m_grid.size() - 1;
+    const int first = qMax(0, last - int(minutesBack / m_grid.interval));
+
+    // Calculate linear regression to find trend; x is the grid index, so the
+    // points are evenly spaced and gaps are simply left out
     double sumX = 0, sumY = 0, sumXY = 0, sumX2 = 0;
-    int n = recentReadings.size();
+    int n = 0;
 
-    for (int i = 0; i < n; i++) {
-        double x = cutoffTime.secsTo(recentReadings[i].timestamp) / 60.0; // x in minutes
-        double y = recentReadings[i].value;
+    for (int i = first; i <= last; i++) {
+        if (m_grid.flags[i] == ResampledPoint::Gap) continue;
+        double x = (i - first) * m_grid.interval; // x in minutes
+        double y = m_grid.glucose[i];
 
         sumX += x;
         sumY += y;
         sumXY += x * y;
         sumX2 += x * x;
+        n++;
+    }
+
+    if (n < 2) {
+        return 0.0;
     }
 
     // Slope = (n*sumXY - sumX*sumY) / (n*sumX2 - sumX^2)
@@ -86,7 +212,7 @@ double CGMManager::calculateInsulinAdjustment(double currentGlucose, double targ
     // 2. Rate of change of glucose
 
     double glucoseDiff = currentGlucose - targetGlucose;
-    double rateOfChange = calculateGlucoseRateOfChange();
+    double rateOfChange = m_filter.isInitialized() ? m_filter.trend() : calculateGlucoseRateOfChange();
 
     // Basic adjustment for current glucose level
     double adjustment = glucoseDiff / insulinSensitivity;
@@ -146,8 +272,26 @@ QVector<QPair<double, double>> CGMManager::predictGlucoseLevels(double currentGl
                                                               double carbsOnBoard,
                                                               double basalRate,
                                                               int timeSpanMinutes) {
-    QVector<QPair<double, double>> predictions;
+    PUMP_TRACE_SCOPE("cgm.predictGlucoseLevels");
+    QVector<QPair<double, double>> predictions(predictionPoints(timeSpanMinutes));
+    fillPredictions(predictions.data(), currentGlucose, insulinOnBoard, carbsOnBoard, basalRate, timeSpanMinutes);
+    return predictions;
+}
+
+ArenaArray<QPair<double, double>> CGMManager::predictGlucoseLevels(TickArena &arena, double currentGlucose,
+                                                                 double insulinOnBoard, double carbsOnBoard,
+                                                                 double basalRate, int timeSpanMinutes) {
+    PUMP_TRACE_SCOPE("cgm.predictGlucoseLevels");
+    const int count = predictionPoints(timeSpanMinutes);
+    ArenaArray<QPair<double, double>> predictions(arena, count);
+    predictions.resize(count);
+    fillPredictions(predictions.data(), currentGlucose, insulinOnBoard, carbsOnBoard, basalRate, timeSpanMinutes);
+    return predictions;
+}
 
+// Writes predictionPoints(timeSpanMinutes) points, one every 5 minutes from now
+void CGMManager::fillPredictions(QPair<double, double> *out, double currentGlucose, double insulinOnBoard,
+                                 double carbsOnBoard, double basalRate, int timeSpanMinutes) {
     // Simplified model parameters
     double insulinSensitivity = 2.0; // mmol/L drop per unit insulin
     double carbSensitivity = 0.2;    // mmol/L rise per gram carbs
@@ -157,7 +301,7 @@ QVector<QPair<double, double>> CGMManager::predictGlucoseLevels(double currentGl
     double glucose = currentGlucose;
 
     // Add initial glucose level
-    predictions.append(qMakePair(currentTime, glucose));
+    *out++ = qMakePair(currentTime, glucose);
 
     // Predict for every 5 minutes
     for (int i = 5; i <= timeSpanMinutes; i += 5) {
@@ -179,27 +323,29 @@ QVector<QPair<double, double>> CGMManager::predictGlucoseLevels(double currentGl
         glucose += carbEffect - insulinEffect - basalEffect;
 
         // Add prediction point
-        predictions.append(qMakePair(static_cast<double>(i), glucose));
+        *out++ = qMakePair(static_cast<double>(i), glucose);
     }
-
-    return predictions;
 }
 
 // Sets the thresholds for low and high glucose alerts
 void CGMManager::setAlerts(double lowGlucoseThreshold, double highGlucoseThreshold) {
     m_lowGlucoseThreshold = lowGlucoseThreshold;
     m_highGlucoseThreshold = highGlucoseThreshold;
+    if (m_journal) {
+        m_journal->record(JournalEvent::make(JournalEvent::CgmAlertsChanged, lowGlucoseThreshold, highGlucoseThreshold));
+    }
 }
 
 // Checks whether the current glucose value triggers a low or high alert
 bool CGMManager::checkAlerts(double currentGlucose) {
+    PUMP_TRACE_SCOPE("cgm.checkAlerts");
     bool isAlert = false;
 
     if (currentGlucose <= m_lowGlucoseThreshold) {
-        qDebug() << "LOW GLUCOSE ALERT: " << currentGlucose << " mmol/L";
+        qCDebug(lcTick) << "LOW GLUCOSE ALERT: " << currentGlucose << " mmol/L";
         isAlert = true;
     } else if (currentGlucose >= m_highGlucoseThreshold) {
-        qDebug() << "HIGH GLUCOSE ALERT: " << currentGlucose << " mmol/L";
+        qCDebug(lcTick) << "HIGH GLUCOSE ALERT: " << currentGlucose << " mmol/L";
         isAlert = true;
     }
 
@@ -209,13 +355,37 @@ bool CGMManager::checkAlerts(double currentGlucose) {
 // Returns the most recent glucose reading, or a default if no readings exist
 CGMManager::GlucoseReading CGMManager::getLatestReading() const {
     if (!m_readings.isEmpty()) {
-        return m_readings.last();
+        const int last = m_readings.size() - 1;
+        GlucoseReading reading;
+        reading.timestamp = QDateTime::fromMSecsSinceEpoch(m_readings.timeMs[last]);
+        reading.value = m_readings.glucose[last];
+        reading.isAlarm = m_readings.flags[last] & GlucoseColumns::Alarm;
+        reading.filtered = m_readings.filtered[last];
+        reading.trend = m_readings.trend[last];
+        reading.variance = m_readings.variance[last];
+        reading.sources = m_readings.sources[last];
+        return reading;
     } else {
         // Return default reading if history is empty
         GlucoseReading empty;
         empty.timestamp = QDateTime::currentDateTime();
         empty.value = 0.0;
         empty.isAlarm = false;
+        empty.filtered = 0.0;
+        empty.trend = 0.0;
+        empty.variance = 0.0;
+        empty.sources = 0;
         return empty;
     }
 }
+
+GlucoseSummary CGMManager::summarizeReadings(int minutes) const {
+    PUMP_TRACE_SCOPE("cgm.summarizeReadings");
+    if (m_readings.isEmpty()) {
+        return GlucoseSummary();
+    }
+    const int last = m_readings.size() - 1;
+    const int first = m_readings.indexAtMinute(m_readings.minuteAt(last) - minutes);
+    return m_readings.summarize(first, last, GlucoseColumns::Filtered,
+                                float(m_lowGlucoseThreshold), float(m_highGlucoseThreshold));
+}
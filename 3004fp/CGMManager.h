@@ -5,24 +5,70 @@
 #include <QVector>
 #include <QPair>
 #include "BolusManager.h"
+#include "GlucoseKalmanFilter.h"
+#include "CgmResampler.h"
+#include "CgmFusion.h"
+#include "GlucoseColumns.h"
+#include "TickArena.h"
+
+class PumpJournal;
+struct PumpState;
 
 // Manages CGM data and insulin adjustment logic
 class CGMManager {
 public:
     CGMManager(BolusManager* bolusManager);
 
-    // Structure to represent a CGM reading
+    static const int kReadingIntervalMinutes = 5;   // Nominal CGM sample period
+
+    // One CGM reading, unpacked from the history columns
     struct GlucoseReading {
         QDateTime timestamp;
-        double value;   // Glucose level in mmol/L
-        bool isAlarm;   // True if value triggers alarm
+        double value;     // Raw glucose level in mmol/L
+        bool isAlarm;     // True if the filtered value triggers alarm
+        double filtered;  // Kalman-filtered glucose (mmol/L)
+        double trend;     // Filtered rate of change (mmol/L per minute)
+        double variance;  // Variance of the filtered glucose
+        quint32 sources;  // Fusion sources behind this reading (bit per source, 0 = direct)
     };
 
-    // Add a new CGM reading
-    void addReading(double glucoseLevel);
+    // Add a new CGM reading taken 'minutesSinceLast' after the previous one
+    void addReading(double glucoseLevel, double minutesSinceLast = kReadingIntervalMinutes);
+
+    // Add a reading stamped with sensor time (minutes); may be irregular, repeated or slightly late
+    void addReadingAt(double sensorMinute, double glucoseLevel);
+
+    // Register an input stream for fused ingestion; errorSd is its accuracy (mmol/L)
+    int addSource(const QString &name, double errorSd, CgmFusion::Kind kind = CgmFusion::Continuous);
+
+    // Queue a timestamped reading from a registered source; fused readings are added as they settle
+    void addSourceReading(int source, double sensorMinute, double glucoseLevel);
+
+    // Add everything still queued in the fusion (end of a replay)
+    void flushSources();
+
+    const CgmFusion &fusion() const { return m_fusion; }
+
+    // Restart the filter (e.g. new sensor session); history is kept
+    void resetFilter();
+
+    // Journal readings, filter resets and alert settings from now on (not owned; may be null)
+    void setJournal(PumpJournal *journal) { m_journal = journal; }
+
+    // Rebuild history, filter and grid from the readings recovered from the journal.
+    // Readings still queued in the fusion when the journal was written are not in it.
+    void restoreState(const PumpState &state);
+
+    // Filter state after the latest reading
+    const GlucoseKalmanFilter &filter() const { return m_filter; }
 
-    // Return glucose history for the last 'minutes' (default 60)
+    // Readings resampled onto the uniform 5-minute grid (sensor time)
+    const ResampledSeries &resampledHistory() const { return m_grid; }
+    const CgmResampler &resampler() const { return m_resampler; }
+
+    // Return resampled glucose history for the last 'minutes' (default 60), gaps left out
     QVector<QPair<double, double>> getGlucoseHistory(int minutes = 60) const;
+    ArenaArray<QPair<double, double>> getGlucoseHistory(TickArena &arena, int minutes = 60) const;
 
     // Calculate insulin adjustment based on current CGM data
     double calculateInsulinAdjustment(double currentGlucose, double targetGlucose,
@@ -39,6 +85,11 @@ public:
                                                         double basalRate,
                                                         int timeSpanMinutes = 60);
 
+    // The same in the tick arena, for the pipeline stages
+    ArenaArray<QPair<double, double>> predictGlucoseLevels(TickArena &arena, double currentGlucose,
+                                                           double insulinOnBoard, double carbsOnBoard,
+                                                           double basalRate, int timeSpanMinutes = 60);
+
     // Configure alert thresholds for high and low glucose
     void setAlerts(double lowGlucoseThreshold, double highGlucoseThreshold);
 
@@ -48,15 +99,40 @@ public:
     // Return the latest CGM reading
     GlucoseReading getLatestReading() const;
 
+    // At least the last 24 hours of readings (up to 48 h between trims), packed column by column
+    const GlucoseColumns &readings() const { return m_readings; }
+
+    // Statistics of the filtered glucose over the last 'minutes' of readings, against the alert thresholds
+    GlucoseSummary summarizeReadings(int minutes = 24 * 60) const;
+
+    // Calculate CGM glucose trend over time (mmol/L per minute)
+    double calculateGlucoseRateOfChange(int minutesBack = 15) const;
+
 private:
+    void addFusedReadings();
+    void addReadingAt(double sensorMinute, double glucoseLevel, double variance, quint32 sources);
+
+    // Shared by the QVector and arena versions: first grid index of the history window
+    int historyStart(int minutes, double *cutoff) const;
+    static int predictionPoints(int timeSpanMinutes) { return qMax(0, timeSpanMinutes) / 5 + 1; }
+    static void fillPredictions(QPair<double, double> *out, double currentGlucose, double insulinOnBoard,
+                                double carbsOnBoard, double basalRate, int timeSpanMinutes);
+
     BolusManager* m_bolusManager;          // Reference to bolus logic
-    QVector<GlucoseReading> m_readings;    // List of recent CGM readings
+    GlucoseColumns m_readings;             // Recent CGM readings (24 h)
+    GlucoseKalmanFilter m_filter;          // Runs on every reading
     double m_lowGlucoseThreshold;          // Hypo alert threshold
     double m_highGlucoseThreshold;         // Hyper alert threshold
     double m_lastAdjustmentTime;           // Timestamp for last insulin adjustment
-
-    // Calculate CGM glucose trend over time
-    double calculateGlucoseRateOfChange(int minutesBack = 15) const;
+    CgmResampler m_resampler;              // Aligns readings onto m_grid
+    ResampledSeries m_grid;                // Dense 5-minute history
+    QVector<ResampledPoint> m_gridPoints;  // Scratch for points completed by one reading
+    double m_sensorMinute;                 // Sensor time of the latest reading
+    bool m_hasSensorTime;
+    CgmFusion m_fusion;                    // Merges the registered sources
+    QVector<FusedReading> m_fused;         // Scratch for readings settled by one push
+    quint8 m_alertState;                   // Of the latest reading: 0 none, 1 low, 2 high
+    PumpJournal *m_journal;                // Optional
 };
 
 #endif // CGMMANAGER_H
@@ -0,0 +1,172 @@
+#include "CgmFusion.h"
+#include <algorithm>
+#include <limits>
+
+int CgmFusion::addSource(const QString &name, double errorSd, Kind kind) {
+    if (m_sources.size() >= kMaxSources) {
+        return -1;
+    }
+    Source source;
+    source.name = name;
+    source.kind = kind;
+    m_sources.append(source);
+    setSourceError(m_sources.size() - 1, errorSd);
+    m_heap.reserve(m_sources.size());
+    return m_sources.size() - 1;
+}
+
+void CgmFusion::setSourceError(int source, double errorSd) {
+    m_sources[source].variance = qMax(errorSd * errorSd, 1e-6);
+}
+
+void CgmFusion::reset() {
+    for (Source &source : m_sources) {
+        source.head = 0;
+        source.count = 0;
+        source.seen = false;
+        source.stats = SourceStats();
+    }
+    m_heap.clear();
+    m_hasNewest = false;
+    m_hasReleased = false;
+    m_windowCount = 0;
+}
+
+bool CgmFusion::later(int a, int b) const {
+    const double ma = m_sources[a].front().minute;
+    const double mb = m_sources[b].front().minute;
+    return ma > mb || (ma == mb && a > b);
+}
+
+void CgmFusion::push(int source, double minute, double glucose, QVector<FusedReading> *out) {
+    Source &s = m_sources[source];
+    s.stats.received++;
+
+    if (s.seen && minute < s.lastMinute) {
+        s.stats.outOfOrder++;
+        return;
+    }
+    if (m_hasReleased && minute < m_releasedMinute) {
+        s.stats.late++;
+        return;
+    }
+
+    // A full ring forces its oldest reading (and anything earlier) out
+    if (s.count == kQueueCapacity) {
+        release(s.front().minute, out);
+    }
+
+    s.ring[(s.head + s.count) % kQueueCapacity] = { minute, glucose };
+    s.count++;
+    s.lastMinute = minute;
+    s.seen = true;
+
+    if (s.count == 1) {
+        m_heap.append(source);
+        std::push_heap(m_heap.begin(), m_heap.end(), [this](int a, int b) { return later(a, b); });
+    }
+
+    if (!m_hasNewest || minute > m_newestMinute) {
+        m_newestMinute = minute;
+        m_hasNewest = true;
+    }
+}
+
+void CgmFusion::poll(QVector<FusedReading> *out) {
+    if (!m_hasNewest) {
+        return;
+    }
+
+    // Safe up to the slowest continuous source, but never more than maxWait behind
+    double limit = m_newestMinute;
+    for (const Source &s : m_sources) {
+        if (s.kind == Continuous) {
+            limit = qMin(limit, s.seen ? s.lastMinute : -std::numeric_limits<double>::infinity());
+        }
+    }
+    limit = qMax(limit, m_newestMinute - m_settings.maxWaitMinutes);
+
+    release(limit, out);
+    if (m_windowCount > 0 && m_windowStart + m_settings.windowMinutes < limit) {
+        closeWindow(out);
+    }
+}
+
+void CgmFusion::finish(QVector<FusedReading> *out) {
+    release(std::numeric_limits<double>::infinity(), out);
+    closeWindow(out);
+}
+
+void CgmFusion::release(double limit, QVector<FusedReading> *out) {
+    auto order = [this](int a, int b) { return later(a, b); };
+    while (!m_heap.isEmpty()) {
+        const int index = m_heap.first();
+        Source &s = m_sources[index];
+        if (s.front().minute > limit) {
+            break;
+        }
+
+        std::pop_heap(m_heap.begin(), m_heap.end(), order);
+        m_heap.removeLast();
+
+        const Sample sample = s.front();
+        s.head = (s.head + 1) % kQueueCapacity;
+        s.count--;
+        if (s.count > 0) {
+            m_heap.append(index);
+            std::push_heap(m_heap.begin(), m_heap.end(), order);
+        }
+
+        m_releasedMinute = sample.minute;
+        m_hasReleased = true;
+        accumulate(index, sample, out);
+    }
+}
+
+void CgmFusion::accumulate(int source, const Sample &sample, QVector<FusedReading> *out) {
+    if (m_windowCount > 0 && sample.minute > m_windowStart + m_settings.windowMinutes) {
+        closeWindow(out);
+    }
+    if (m_windowCount == 0) {
+        m_windowStart = sample.minute;
+        m_windowWeight = 0.0;
+        m_windowMinute = 0.0;
+        m_windowGlucose = 0.0;
+        m_windowSources = 0;
+    }
+
+    const double weight = 1.0 / m_sources[source].variance;
+    if (!(m_windowSources & (1u << source))) {
+        m_sourceWeight[source] = 0.0;
+    }
+    m_windowWeight += weight;
+    m_windowMinute += weight * sample.minute;
+    m_windowGlucose += weight * sample.glucose;
+    m_windowSources |= 1u << source;
+    m_sourceWeight[source] += weight;
+    m_windowCount++;
+}
+
+void CgmFusion::closeWindow(QVector<FusedReading> *out) {
+    if (m_windowCount == 0) {
+        return;
+    }
+
+    FusedReading fused;
+    fused.minute = m_windowMinute / m_windowWeight;
+    fused.glucose = m_windowGlucose / m_windowWeight;
+    fused.variance = 1.0 / m_windowWeight;
+    fused.sources = m_windowSources;
+    fused.count = m_windowCount;
+
+    double best = 0.0;
+    for (int i = 0; i < m_sources.size(); ++i) {
+        if ((m_windowSources & (1u << i)) && m_sourceWeight[i] > best) {
+            best = m_sourceWeight[i];
+            fused.primary = i;
+        }
+    }
+
+    out->append(fused);
+    m_windowCount = 0;
+}
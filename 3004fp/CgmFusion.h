@@ -0,0 +1,125 @@
+#ifndef CGMFUSION_H
+#define CGMFUSION_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+// One output of the fusion: the readings of all sources that fell into the
+// same window, weighted by the inverse of each source's error variance
+struct FusedReading {
+    double minute = 0.0;      // Weighted mean time of the contributing readings
+    double glucose = 0.0;     // mmol/L
+    double variance = 0.0;    // Of the fused value
+    quint32 sources = 0;      // Bit i set if source i contributed
+    int primary = -1;         // Source with the largest weight
+    int count = 0;            // Readings fused
+};
+
+// Merges timestamped glucose streams from several sources (primary CGM,
+// backup sensor, fingerstick calibrations, ...) into one series.
+//
+// Each source keeps its pending readings in a fixed ring, so memory is
+// constant per stream. Readings leave the rings in time order through a
+// binary heap over the sources' oldest readings (k-way merge), once no
+// continuous source can still deliver something earlier: every continuous
+// source has reached that time, or the reading is maxWaitMinutes behind the
+// newest one seen. Calibration sources are sporadic and never hold the
+// merge back. Merged readings within windowMinutes of the first one in a
+// window are fused into one FusedReading.
+//
+// Live data goes through push() then poll(); replayed data can be pushed in
+// any interleaving and drained with finish().
+class CgmFusion {
+public:
+    static const int kMaxSources = 32;
+    static const int kQueueCapacity = 64;    // Pending readings per source
+
+    enum Kind {
+        Continuous,     // Regular sensor stream; the merge waits for it
+        Calibration     // Occasional readings (fingersticks)
+    };
+
+    struct Settings {
+        double windowMinutes = 2.5;
+        double maxWaitMinutes = 10.0;        // Longest a silent continuous source can delay the others
+    };
+
+    struct SourceStats {
+        quint64 received = 0;
+        quint64 outOfOrder = 0;              // Older than the source's previous reading; dropped
+        quint64 late = 0;                    // Behind readings already released; dropped
+    };
+
+    CgmFusion() {}
+    explicit CgmFusion(const Settings &settings) : m_settings(settings) {}
+
+    // Registers a source with its error standard deviation (mmol/L); returns its index or -1
+    int addSource(const QString &name, double errorSd, Kind kind = Continuous);
+
+    int sourceCount() const { return m_sources.size(); }
+    QString sourceName(int source) const { return m_sources[source].name; }
+    const SourceStats &sourceStats(int source) const { return m_sources[source].stats; }
+
+    // Changes a source's error standard deviation
+    void setSourceError(int source, double errorSd);
+
+    // Queues a reading; a source must deliver its own readings in time order
+    void push(int source, double minute, double glucose, QVector<FusedReading> *out);
+
+    // Appends every fused reading that can no longer change
+    void poll(QVector<FusedReading> *out);
+
+    // Releases everything still queued (end of a replay)
+    void finish(QVector<FusedReading> *out);
+
+    // Drops queued readings and per-source time; sources stay registered
+    void reset();
+
+private:
+    struct Sample {
+        double minute;
+        double glucose;
+    };
+
+    struct Source {
+        QString name;
+        Kind kind = Continuous;
+        double variance = 1.0;
+        Sample ring[kQueueCapacity];
+        int head = 0;
+        int count = 0;
+        double lastMinute = 0.0;
+        bool seen = false;
+        SourceStats stats;
+
+        const Sample &front() const { return ring[head]; }
+    };
+
+    // Heap order: earliest front reading on top, lower index first on ties
+    bool later(int a, int b) const;
+
+    // Merges queued readings up to 'limit' minutes into the open window
+    void release(double limit, QVector<FusedReading> *out);
+    void accumulate(int source, const Sample &sample, QVector<FusedReading> *out);
+    void closeWindow(QVector<FusedReading> *out);
+
+    Settings m_settings;
+    QVector<Source> m_sources;
+    QVector<int> m_heap;                     // Sources with queued readings
+    double m_newestMinute = 0.0;
+    bool m_hasNewest = false;
+    double m_releasedMinute = 0.0;           // Time of the last merged reading
+    bool m_hasReleased = false;
+
+    // Open fusion window
+    int m_windowCount = 0;
+    double m_windowStart = 0.0;
+    double m_windowWeight = 0.0;
+    double m_windowMinute = 0.0;             // Weighted sums
+    double m_windowGlucose = 0.0;
+    quint32 m_windowSources = 0;
+    double m_sourceWeight[kMaxSources] = {};
+};
+
+#endif // CGMFUSION_H
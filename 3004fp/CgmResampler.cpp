@@ -0,0 +1,134 @@
+#include "CgmResampler.h"
+#include <QtMath>
+#include <cmath>
+#include <limits>
+
+void ResampledSeries::append(const ResampledPoint &point) {
+    const double expected = glucose.isEmpty() ? point.minute : endMinute() + interval;
+    if (glucose.isEmpty() || std::fabs(point.minute - expected) > 1e-6) {
+        clear();
+        startMinute = point.minute;
+    }
+    glucose.append(point.glucose);
+    flags.append(point.flag);
+}
+
+void ResampledSeries::trim(int maxPoints) {
+    if (glucose.size() < 2 * maxPoints) return;
+    const int drop = glucose.size() - maxPoints;
+    glucose.remove(0, drop);
+    flags.remove(0, drop);
+    startMinute += drop * interval;
+}
+
+void ResampledSeries::clear() {
+    glucose.clear();
+    flags.clear();
+}
+
+void CgmResampler::setSettings(const Settings &settings) {
+    m_settings = settings;
+    m_settings.lookahead = qBound(0, m_settings.lookahead, int(kMaxLookahead));
+    reset();
+}
+
+void CgmResampler::reset() {
+    m_stats = Stats();
+    m_pendingCount = 0;
+    m_hasPrevious = false;
+}
+
+void CgmResampler::push(double minute, double glucose, QVector<ResampledPoint> *out) {
+    m_stats.readings++;
+
+    // Anything older than the last processed reading can no longer be placed
+    if (m_hasPrevious && minute < m_previous.minute - m_settings.duplicateMinutes) {
+        m_stats.late++;
+        return;
+    }
+
+    // Insert into the reorder buffer, newest last
+    int slot = m_pendingCount;
+    while (slot > 0 && m_pending[slot - 1].minute > minute) {
+        m_pending[slot] = m_pending[slot - 1];
+        --slot;
+    }
+    m_pending[slot] = { minute, glucose };
+    m_pendingCount++;
+
+    if (m_pendingCount > m_settings.lookahead) {
+        Sample oldest = m_pending[0];
+        for (int i = 1; i < m_pendingCount; ++i) {
+            m_pending[i - 1] = m_pending[i];
+        }
+        m_pendingCount--;
+        process(oldest, out);
+    }
+}
+
+void CgmResampler::flush(QVector<ResampledPoint> *out) {
+    for (int i = 0; i < m_pendingCount; ++i) {
+        process(m_pending[i], out);
+    }
+    m_pendingCount = 0;
+}
+
+// First grid point at or after the reading, less the jitter tolerance
+void CgmResampler::startGrid(const Sample &sample) {
+    const double interval = m_settings.intervalMinutes;
+    m_nextGrid = std::ceil((sample.minute - m_settings.jitterMinutes) / interval) * interval;
+    m_previous = sample;
+    m_hasPrevious = true;
+}
+
+void CgmResampler::process(const Sample &sample, QVector<ResampledPoint> *out) {
+    const double interval = m_settings.intervalMinutes;
+    const double jitter = m_settings.jitterMinutes;
+
+    if (!m_hasPrevious) {
+        startGrid(sample);
+    } else {
+        const double span = sample.minute - m_previous.minute;
+        if (span <= m_settings.duplicateMinutes) {
+            m_stats.duplicates++;
+            return;
+        }
+        if (span > m_settings.restartMinutes) {
+            // Finish the grid point the previous reading can still claim, then start over
+            if (m_nextGrid - m_previous.minute <= jitter) {
+                out->append({ m_nextGrid, m_previous.glucose, ResampledPoint::Measured });
+            }
+            m_stats.restarts++;
+            startGrid(sample);
+        }
+    }
+
+    // Emit every grid point up to this reading; later ones wait for the next reading
+    while (m_nextGrid <= sample.minute) {
+        ResampledPoint point;
+        point.minute = m_nextGrid;
+
+        const bool first = m_previous.minute == sample.minute;
+        const double sincePrevious = m_nextGrid - m_previous.minute;
+        const double untilSample = sample.minute - m_nextGrid;
+        const double span = sample.minute - m_previous.minute;
+
+        if (first || untilSample <= jitter || sincePrevious <= jitter) {
+            point.flag = ResampledPoint::Measured;
+            point.glucose = (first || untilSample <= sincePrevious) ? sample.glucose : m_previous.glucose;
+        } else if (span <= m_settings.maxInterpolationMinutes) {
+            point.flag = ResampledPoint::Interpolated;
+            point.glucose = m_previous.glucose + (sample.glucose - m_previous.glucose) * (sincePrevious / span);
+            m_stats.interpolated++;
+        } else {
+            point.flag = ResampledPoint::Gap;
+            point.glucose = std::numeric_limits<double>::quiet_NaN();
+            m_stats.gaps++;
+        }
+
+        out->append(point);
+        m_nextGrid += interval;
+    }
+
+    m_previous = sample;
+}
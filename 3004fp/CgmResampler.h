@@ -0,0 +1,111 @@
+#ifndef CGMRESAMPLER_H
+#define CGMRESAMPLER_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// One point of the uniform grid
+struct ResampledPoint {
+    enum Flag : quint8 {
+        Measured,       // A reading within the jitter tolerance of the grid time
+        Interpolated,   // Linear between the readings around a short gap
+        Gap             // No reading close enough; glucose is NaN
+    };
+
+    double minute = 0.0;     // Grid time (sensor minutes, multiple of the interval)
+    double glucose = 0.0;    // mmol/L, NaN for Gap
+    Flag flag = Measured;
+};
+
+// Dense resampled history: point i is at startMinute + i * interval.
+// Values and flags are separate arrays so kernels can run over them directly;
+// Gap entries hold NaN and must be skipped using the flags.
+struct ResampledSeries {
+    double startMinute = 0.0;
+    double interval = 5.0;
+    QVector<double> glucose;
+    QVector<quint8> flags;
+
+    int size() const { return glucose.size(); }
+    double minuteAt(int index) const { return startMinute + index * interval; }
+    double endMinute() const { return glucose.isEmpty() ? startMinute : minuteAt(glucose.size() - 1); }
+
+    // Appends a grid point; a point that does not follow the last one starts the series over
+    void append(const ResampledPoint &point);
+
+    // Drops the oldest points once the series is twice 'maxPoints' long, keeping 'maxPoints'
+    void trim(int maxPoints);
+
+    void clear();
+};
+
+// Streaming resampler from irregular CGM readings to a uniform grid.
+//
+// Readings may arrive with timestamp jitter, duplicates, out of order (up to
+// 'lookahead' readings late) and with gaps. Each grid point is emitted once
+// the readings on both sides of it are known:
+//   - Measured if the nearest of them is within jitterMinutes,
+//   - Interpolated if they are at most maxInterpolationMinutes apart,
+//   - Gap otherwise.
+// Readings within duplicateMinutes of the previous one are dropped, and a
+// gap longer than restartMinutes starts a new grid instead of emitting Gaps.
+// State is a fixed-size reorder buffer plus the previous reading; every
+// reading is handled once.
+class CgmResampler {
+public:
+    static const int kMaxLookahead = 16;
+
+    struct Settings {
+        double intervalMinutes = 5.0;
+        double jitterMinutes = 1.5;
+        double duplicateMinutes = 0.5;
+        double maxInterpolationMinutes = 20.0;
+        double restartMinutes = 24 * 60.0;
+        int lookahead = 0;                   // Readings held back for reordering (0..kMaxLookahead)
+    };
+
+    struct Stats {
+        quint64 readings = 0;
+        quint64 duplicates = 0;
+        quint64 late = 0;                    // Arrived after a later reading had been processed
+        quint64 interpolated = 0;
+        quint64 gaps = 0;
+        quint64 restarts = 0;
+    };
+
+    CgmResampler() {}
+    explicit CgmResampler(const Settings &settings) { setSettings(settings); }
+
+    void setSettings(const Settings &settings);
+    const Settings &settings() const { return m_settings; }
+    const Stats &stats() const { return m_stats; }
+
+    // Adds a reading and appends any grid points it completes to 'out'
+    void push(double minute, double glucose, QVector<ResampledPoint> *out);
+
+    // Processes the held-back readings (end of an import)
+    void flush(QVector<ResampledPoint> *out);
+
+    void reset();
+
+private:
+    struct Sample {
+        double minute;
+        double glucose;
+    };
+
+    void process(const Sample &sample, QVector<ResampledPoint> *out);
+    void startGrid(const Sample &sample);
+
+    Settings m_settings;
+    Stats m_stats;
+
+    Sample m_pending[kMaxLookahead + 1];     // Sorted by time
+    int m_pendingCount = 0;
+
+    bool m_hasPrevious = false;
+    Sample m_previous = { 0.0, 0.0 };
+    double m_nextGrid = 0.0;
+};
+
+#endif // CGMRESAMPLER_H
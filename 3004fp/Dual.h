@@ -0,0 +1,109 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+
+// A value together with its derivatives with respect to N inputs
+// (forward-mode automatic differentiation).
+//
+// Code written for a template arithmetic type runs unchanged on double or on
+// Dual<N>; with Dual<N>, every result also carries its exact partial
+// derivatives, so one pass yields the whole gradient instead of N + 1 runs
+// with finite differences. Inputs are made with variable(value, i), and
+// everything else with plain doubles, which convert to constants.
+// Comparisons look at values only, so branches (and qMax/qMin) pick the
+// same side as the double code and differentiate that side.
+template <int N>
+class Dual {
+public:
+    Dual() : m_value(0.0) { clearDerivatives(); }
+    Dual(double value) : m_value(value) { clearDerivatives(); }
+
+    // The i-th input, with derivative 1 along itself
+    static Dual variable(double value, int index) {
+        Dual x(value);
+        x.m_d[index] = 1.0;
+        return x;
+    }
+
+    double value() const { return m_value; }
+    double derivative(int index) const { return m_d[index]; }
+
+    Dual &operator+=(const Dual &b) {
+        m_value += b.m_value;
+        for (int i = 0; i < N; ++i) m_d[i] += b.m_d[i];
+        return *this;
+    }
+    Dual &operator-=(const Dual &b) {
+        m_value -= b.m_value;
+        for (int i = 0; i < N; ++i) m_d[i] -= b.m_d[i];
+        return *this;
+    }
+    Dual &operator*=(const Dual &b) {
+        for (int i = 0; i < N; ++i) m_d[i] = m_d[i] * b.m_value + m_value * b.m_d[i];
+        m_value *= b.m_value;
+        return *this;
+    }
+    Dual &operator/=(const Dual &b) {
+        const double inverse = 1.0 / b.m_value;
+        m_value *= inverse;
+        for (int i = 0; i < N; ++i) m_d[i] = (m_d[i] - m_value * b.m_d[i]) * inverse;
+        return *this;
+    }
+
+    Dual operator-() const {
+        Dual r(-m_value);
+        for (int i = 0; i < N; ++i) r.m_d[i] = -m_d[i];
+        return r;
+    }
+
+    friend Dual operator+(Dual a, const Dual &b) { return a += b; }
+    friend Dual operator-(Dual a, const Dual &b) { return a -= b; }
+    friend Dual operator*(Dual a, const Dual &b) { return a *= b; }
+    friend Dual operator/(Dual a, const Dual &b) { return a /= b; }
+
+    friend bool operator<(const Dual &a, const Dual &b) { return a.m_value < b.m_value; }
+    friend bool operator>(const Dual &a, const Dual &b) { return a.m_value > b.m_value; }
+    friend bool operator<=(const Dual &a, const Dual &b) { return a.m_value <= b.m_value; }
+    friend bool operator>=(const Dual &a, const Dual &b) { return a.m_value >= b.m_value; }
+
+    // Chain rule for a function with value f and derivative df at this value
+    Dual apply(double f, double df) const {
+        Dual r(f);
+        for (int i = 0; i < N; ++i) r.m_d[i] = df * m_d[i];
+        return r;
+    }
+
+private:
+    void clearDerivatives() {
+        for (int i = 0; i < N; ++i) m_d[i] = 0.0;
+    }
+
+    double m_value;
+    double m_d[N];
+};
+
+// Found by argument-dependent lookup, so templates call exp(x) after "using std::exp"
+template <int N>
+Dual<N> exp(const Dual<N> &x) {
+    const double e = std::exp(x.value());
+    return x.apply(e, e);
+}
+
+template <int N>
+Dual<N> log(const Dual<N> &x) {
+    return x.apply(std::log(x.value()), 1.0 / x.value());
+}
+
+template <int N>
+Dual<N> sqrt(const Dual<N> &x) {
+    const double root = std::sqrt(x.value());
+    return x.apply(root, root > 0.0 ? 0.5 / root : 0.0);
+}
+
+// Value of a double or Dual, for code templated on either
+inline double valueOf(double x) { return x; }
+template <int N>
+double valueOf(const Dual<N> &x) { return x.value(); }
+
+#endif // DUAL_H
@@ -0,0 +1,166 @@
+#include "EnsemblePredictor.h"
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include "Instrumentation.h"
+#include "Vectorize.h"
+
+namespace {
+// Chart range; the ensemble itself is not clamped
+const double kDisplayMin = 2.2;
+const double kDisplayMax = 22.2;
+
+// Fraction of a subcutaneous dose that has acted after t minutes
+// (two-compartment absorption with time-to-peak tau)
+double actedFraction(double t, double tau) {
+    return 1.0 - (1.0 + t / tau) * std::exp(-t / tau);
+}
+
+// Log-normal sigma for a multiplier with mean 1 and the given coefficient of variation
+double logNormalSigma(double variation) {
+    return std::sqrt(std::log(1.0 + variation * variation));
+}
+
+double displayValue(double glucose) {
+    return qBound(kDisplayMin, glucose, kDisplayMax);
+}
+}
+
+EnsembleGlucosePredictor::EnsembleGlucosePredictor() {
+    setSettings(Settings());
+}
+
+void EnsembleGlucosePredictor::setSettings(const Settings &settings) {
+    m_settings = settings;
+    const int lanes = kLanes;
+    m_settings.samples = (qMax(lanes, m_settings.samples) + lanes - 1) / lanes * lanes;
+    m_rng.seed(m_settings.seed);
+    m_spareValid = false;
+
+    for (int k = 0; k < kSteps; ++k) {
+        m_insulinActed[k] = actedFraction((k + 1) * kStepMinutes, m_settings.insulinActionMinutes);
+    }
+
+    const int n = m_settings.samples;
+    m_start.fill(0.0, n);
+    m_insulinGain.fill(0.0, n);
+    m_carbGain.fill(0.0, n);
+    m_carbRate.fill(0.0, n);
+    m_carbDecay.fill(0.0, n);
+    m_drift.fill(0.0, n);
+    m_decay.fill(0.0, n);
+    m_trajectories.fill(0.0, n * kSteps);
+    m_scratch.fill(0.0, n);
+}
+
+// Standard normal via Box-Muller, using both values of each pair
+double EnsembleGlucosePredictor::gaussian() {
+    if (m_spareValid) {
+        m_spareValid = false;
+        return m_spare;
+    }
+    double u1 = qMax(1e-12, m_rng.generateDouble());
+    double u2 = m_rng.generateDouble();
+    double radius = std::sqrt(-2.0 * std::log(u1));
+    m_spare = radius * std::sin(2.0 * M_PI * u2);
+    m_spareValid = true;
+    return radius * std::cos(2.0 * M_PI * u2);
+}
+
+// Draws each sample's sensor error, sensitivity, absorption time and drift
+void EnsembleGlucosePredictor::drawSamples(const GlucoseEstimate &estimate) {
+    const int n = m_settings.samples;
+    const double isf = qMax(0.0, estimate.correctionFactor);
+    const double carbSensitivity = estimate.carbRatio > 0.0 ? isf / estimate.carbRatio : 0.0;
+    const double iob = qMax(0.0, estimate.insulinOnBoard);
+    const double cob = qMax(0.0, estimate.carbsOnBoard);
+    const double startSd = estimate.variance > 0.0 ? std::sqrt(estimate.variance) : m_settings.sensorNoise;
+    const double driftPerStep = m_settings.driftPerHour * kStepMinutes / 60.0;
+    const double sensitivitySigma = logNormalSigma(m_settings.sensitivityVariation);
+    const double carbSigma = logNormalSigma(m_settings.carbAbsorptionVariation);
+
+    for (int i = 0; i < n; ++i) {
+        double sensitivity = std::exp(sensitivitySigma * gaussian() - 0.5 * sensitivitySigma * sensitivitySigma);
+        double carbTime = m_settings.carbAbsorptionMinutes
+                        * std::exp(carbSigma * gaussian() - 0.5 * carbSigma * carbSigma);
+
+        m_start[i] = estimate.glucose + startSd * gaussian();
+        m_insulinGain[i] = sensitivity * isf * iob;
+        m_carbGain[i] = sensitivity * carbSensitivity * cob;
+        m_carbRate[i] = kStepMinutes / carbTime;
+        m_carbDecay[i] = std::exp(-m_carbRate[i]);
+        m_drift[i] = driftPerStep * gaussian();
+    }
+}
+
+// Advances every sample one step at a time; exp(-k * rate) is carried as a
+// running product so the step loop has no transcendental calls
+void EnsembleGlucosePredictor::project() {
+    const int n = m_settings.samples;
+    const double *start = m_start.constData();
+    const double *insulinGain = m_insulinGain.constData();
+    const double *carbGain = m_carbGain.constData();
+    const double *carbRate = m_carbRate.constData();
+    const double *carbDecay = m_carbDecay.constData();
+    const double *drift = m_drift.constData();
+    double *decay = m_decay.data();
+
+    std::fill(decay, decay + n, 1.0);
+    for (int k = 0; k < kSteps; ++k) {
+        const double acted = m_insulinActed[k];
+        const double step = k + 1;
+        double *out = m_trajectories.data() + k * n;
+        for (int block = 0; block < n; block += kLanes) {
+            PUMP_VECTORIZE_LOOP
+            for (int lane = 0; lane < kLanes; ++lane) {
+                const int i = block + lane;
+                decay[i] *= carbDecay[i];
+                double absorbed = 1.0 - (1.0 + step * carbRate[i]) * decay[i];
+                out[i] = start[i] - insulinGain[i] * acted + carbGain[i] * absorbed + drift[i] * step;
+            }
+        }
+    }
+}
+
+GlucosePrediction EnsembleGlucosePredictor::predict(const SensorReading &reading, const GlucoseEstimate &estimate,
+                                                    TickArena &arena) {
+    PUMP_TRACE_SCOPE("predict.ensemble");
+    drawSamples(estimate);
+    project();
+
+    GlucosePrediction prediction;
+    const int n = m_settings.samples;
+    const int low = qRound(0.1 * (n - 1));
+    const int mid = qRound(0.5 * (n - 1));
+    const int high = qRound(0.9 * (n - 1));
+    const double now = reading.simMinutes;
+
+    prediction.curve = ArenaArray<QPointF>(arena, kSteps + 1);
+    prediction.lowerBand = ArenaArray<QPointF>(arena, kSteps + 1);
+    prediction.upperBand = ArenaArray<QPointF>(arena, kSteps + 1);
+    prediction.curve.append(QPointF(now, estimate.glucose));
+    prediction.lowerBand.append(QPointF(now, estimate.glucose));
+    prediction.upperBand.append(QPointF(now, estimate.glucose));
+
+    for (int k = 0; k < kSteps; ++k) {
+        // Select the median, then each outer percentile within its half
+        const double *row = m_trajectories.constData() + k * n;
+        std::copy(row, row + n, m_scratch.begin());
+        double *values = m_scratch.data();
+        std::nth_element(values, values + mid, values + n);
+        std::nth_element(values, values + low, values + mid);
+        std::nth_element(values + mid + 1, values + high, values + n);
+
+        double time = now + (k + 1) * kStepMinutes;
+        prediction.curve.append(QPointF(time, displayValue(values[mid])));
+        prediction.lowerBand.append(QPointF(time, displayValue(values[low])));
+        prediction.upperBand.append(QPointF(time, displayValue(values[high])));
+
+        if ((k + 1) * kStepMinutes == 30) {
+            prediction.predicted30min = values[mid];
+            prediction.predicted30minLow = values[low];
+        }
+    }
+
+    return prediction;
+}
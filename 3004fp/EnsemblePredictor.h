@@ -0,0 +1,72 @@
+#ifndef ENSEMBLEPREDICTOR_H
+#define ENSEMBLEPREDICTOR_H
+
+#include <QVector>
+#include <QRandomGenerator>
+#include "TickPipeline.h"
+
+// Predict (alternative): Monte Carlo ensemble of BG trajectories.
+//
+// Every reading it draws 'samples' trajectories, each with its own
+//   - sensor error (true BG = estimate + N(0, estimate variance or sensorNoise^2)),
+//   - insulin sensitivity (log-normal around the correction factor),
+//   - carb absorption time (log-normal around carbAbsorptionMinutes),
+//   - unmodelled drift (N(0, driftPerHour) mmol/L per hour),
+// and projects IOB and COB through two-compartment absorption curves out to
+// 60 minutes. Samples are stored one array per quantity and advanced a whole
+// step at a time, so the inner loop over samples vectorises.
+//
+// The 50th percentile is the chart line and predicted30min; the 10th/90th
+// percentiles are the chart band, and the 10th percentile at 30 minutes is
+// the value low-glucose suspend acts on.
+class EnsembleGlucosePredictor : public PredictStage {
+public:
+    static const int kSteps = 12;            // 5-minute steps out to 60 minutes
+    static const int kStepMinutes = 5;
+    static const int kLanes = 8;             // Samples per vectorised block
+
+    struct Settings {
+        int samples = 256;                   // Trajectories per reading (rounded up to kLanes)
+        double sensorNoise = 0.3;            // SD of BG error when the estimate has no variance
+        double sensitivityVariation = 0.25;  // Coefficient of variation of insulin sensitivity
+        double carbAbsorptionMinutes = 40.0; // Median carb time to peak
+        double carbAbsorptionVariation = 0.3;
+        double insulinActionMinutes = 55.0;  // Insulin time to peak
+        double driftPerHour = 0.5;           // SD of unmodelled BG drift (mmol/L per hour)
+        quint32 seed = 1;
+    };
+
+    EnsembleGlucosePredictor();
+
+    void setSettings(const Settings &settings);
+    const Settings &settings() const { return m_settings; }
+
+    GlucosePrediction predict(const SensorReading &reading, const GlucoseEstimate &estimate,
+                              TickArena &arena) override;
+
+private:
+    void drawSamples(const GlucoseEstimate &estimate);
+    void project();
+    double gaussian();
+
+    Settings m_settings;
+    QRandomGenerator m_rng;
+    bool m_spareValid = false;               // Box-Muller produces pairs
+    double m_spare = 0.0;
+
+    double m_insulinActed[kSteps];           // Fraction of IOB acted by each step
+
+    // Per-sample draws, one array per quantity
+    QVector<double> m_start;                 // True BG at t = 0
+    QVector<double> m_insulinGain;           // BG drop if all IOB acted (mmol/L)
+    QVector<double> m_carbGain;              // BG rise if all COB absorbed (mmol/L)
+    QVector<double> m_carbRate;              // Step length / carb time to peak
+    QVector<double> m_carbDecay;             // exp(-m_carbRate)
+    QVector<double> m_drift;                 // mmol/L per step
+
+    QVector<double> m_decay;                 // Running exp(-k * m_carbRate)
+    QVector<double> m_trajectories;          // Step-major: step k of sample i at (k - 1) * samples + i
+    QVector<double> m_scratch;               // Percentile selection
+};
+
+#endif // ENSEMBLEPREDICTOR_H
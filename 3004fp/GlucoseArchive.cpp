@@ -0,0 +1,346 @@
+#include "GlucoseArchive.h"
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Bit i set where glucose[i] is past the threshold, for 64 readings
+template <bool Below>
+quint64 compareWord(const float *glucose, float threshold) {
+#ifdef __SSE2__
+    const __m128 limit = _mm_set1_ps(threshold);
+    quint64 bits = 0;
+    for (int i = 0; i < 64; i += 4) {
+        const __m128 values = _mm_loadu_ps(glucose + i);
+        const __m128 mask = Below ? _mm_cmplt_ps(values, limit) : _mm_cmpgt_ps(values, limit);
+        bits |= quint64(_mm_movemask_ps(mask)) << i;
+    }
+    return bits;
+#else
+    quint64 bits = 0;
+    for (int i = 0; i < 64; ++i) {
+        bits |= quint64(Below ? glucose[i] < threshold : glucose[i] > threshold) << i;
+    }
+    return bits;
+#endif
+}
+
+// The same for the last, partial word of a series
+quint64 compareTail(const float *glucose, int count, float threshold, bool below) {
+    quint64 bits = 0;
+    for (int i = 0; i < count; ++i) {
+        bits |= quint64(below ? glucose[i] < threshold : glucose[i] > threshold) << i;
+    }
+    return bits;
+}
+
+// Bits [from, to) of a 64-bit word
+quint64 bitRange(int from, int to) {
+    if (from >= to) return 0;
+    const quint64 upper = to >= 64 ? ~quint64(0) : (quint64(1) << to) - 1;
+    return upper & ~((quint64(1) << from) - 1);
+}
+
+// Joins runs of matching readings into episodes as the blocks go by
+class EpisodeBuilder {
+public:
+    EpisodeBuilder(int patient, const ArchiveQuery &query, const qint64 *timeMs, const float *glucose,
+                   QVector<GlucoseEpisode> *out)
+        : m_query(query), m_timeMs(timeMs), m_glucose(glucose), m_out(out) {
+        m_episode.patient = patient;
+    }
+
+    // Readings [first, first + count) all match
+    void addRun(int first, int count) {
+        const int end = first + count;
+        const bool below = m_query.comparison == ArchiveQuery::Below;
+        float extreme = m_episode.extreme;
+        int readings = m_episode.readings;
+        for (int i = first; i < end; ++i) {
+            const qint64 gap = m_timeMs[i] - (i > 0 ? m_timeMs[i - 1] : 0);
+            if (!m_open || i != m_last + 1 || gap > m_query.maxGapMs) {
+                m_episode.endMs = m_last >= 0 ? m_timeMs[m_last] : 0;
+                m_episode.extreme = extreme;
+                m_episode.readings = readings;
+                finish();
+                m_open = true;
+                m_episode.startMs = m_timeMs[i];
+                extreme = m_glucose[i];
+                readings = 0;
+            }
+            extreme = below ? qMin(extreme, m_glucose[i]) : qMax(extreme, m_glucose[i]);
+            readings++;
+            m_last = i;
+        }
+        m_episode.endMs = m_timeMs[end - 1];
+        m_episode.extreme = extreme;
+        m_episode.readings = readings;
+    }
+
+    void finish() {
+        if (m_open && m_episode.durationMs() >= m_query.minDurationMs) {
+            m_out->append(m_episode);
+        }
+        m_open = false;
+    }
+
+private:
+    const ArchiveQuery &m_query;
+    const qint64 *m_timeMs;
+    const float *m_glucose;
+    QVector<GlucoseEpisode> *m_out;
+    GlucoseEpisode m_episode;
+    bool m_open = false;
+    int m_last = -1;
+};
+
+// Queries a contiguous range of the patient list on a pool thread
+class ShardJob : public QRunnable {
+public:
+    ShardJob(const GlucoseArchive *archive, const ArchiveQuery *query, const int *patients, int count,
+             bool buildEpisodes, QVector<GlucoseEpisode> *episodes, ArchiveQueryStats *stats)
+        : m_archive(archive), m_query(query), m_patients(patients), m_count(count),
+          m_buildEpisodes(buildEpisodes), m_episodes(episodes), m_stats(stats) {}
+
+    void run() override {
+        for (int i = 0; i < m_count; ++i) {
+            m_archive->queryPatient(m_patients[i], *m_query, m_buildEpisodes ? m_episodes : nullptr, m_stats);
+        }
+    }
+
+private:
+    const GlucoseArchive *m_archive;
+    const ArchiveQuery *m_query;
+    const int *m_patients;
+    int m_count;
+    bool m_buildEpisodes;
+    QVector<GlucoseEpisode> *m_episodes;
+    ArchiveQueryStats *m_stats;
+};
+
+}
+
+void ArchiveQueryStats::add(const ArchiveQueryStats &other) {
+    blocks += other.blocks;
+    skippedBlocks += other.skippedBlocks;
+    fullBlocks += other.fullBlocks;
+    bitmapBlocks += other.bitmapBlocks;
+    scannedReadings += other.scannedReadings;
+    matchingReadings += other.matchingReadings;
+}
+
+float GlucoseArchive::alarmThreshold(AlarmLevel level) {
+    static const float thresholds[AlarmLevelCount] = {3.0f, 3.9f, 10.0f, 13.9f};
+    return thresholds[level];
+}
+
+ArchiveQuery::Comparison GlucoseArchive::alarmComparison(AlarmLevel level) {
+    return level <= Low ? ArchiveQuery::Below : ArchiveQuery::Above;
+}
+
+int GlucoseArchive::addPatient() {
+    m_patients.append(Series());
+    return m_patients.size() - 1;
+}
+
+bool GlucoseArchive::append(int patient, qint64 timeMs, float glucose) {
+    Series &series = m_patients[patient];
+    if (std::isnan(glucose) || (!series.timeMs.isEmpty() && timeMs < series.timeMs.last())) return false;
+
+    const int index = series.glucose.size();
+    if (index % kBlockReadings == 0) {
+        ZoneMap zone;
+        zone.firstMs = timeMs;
+        zone.minGlucose = glucose;
+        zone.maxGlucose = glucose;
+        series.zones.append(zone);
+        for (int level = 0; level < AlarmLevelCount; ++level) {
+            series.alarms[level].resize(series.alarms[level].size() + kWordsPerBlock);
+        }
+    }
+    series.timeMs.append(timeMs);
+    series.glucose.append(glucose);
+
+    ZoneMap &zone = series.zones.last();
+    zone.lastMs = timeMs;
+    zone.minGlucose = qMin(zone.minGlucose, glucose);
+    zone.maxGlucose = qMax(zone.maxGlucose, glucose);
+
+    for (int level = 0; level < AlarmLevelCount; ++level) {
+        const float threshold = alarmThreshold(AlarmLevel(level));
+        if (alarmComparison(AlarmLevel(level)) == ArchiveQuery::Below ? glucose < threshold : glucose > threshold) {
+            series.alarms[level][index / 64] |= quint64(1) << (index % 64);
+        }
+    }
+    return true;
+}
+
+qint64 GlucoseArchive::readingCount() const {
+    qint64 total = 0;
+    for (const Series &series : m_patients) {
+        total += series.glucose.size();
+    }
+    return total;
+}
+
+qint64 GlucoseArchive::newestMs() const {
+    qint64 newest = 0;
+    for (const Series &series : m_patients) {
+        if (!series.timeMs.isEmpty()) {
+            newest = qMax(newest, series.timeMs.last());
+        }
+    }
+    return newest;
+}
+
+QVector<GlucoseEpisode> GlucoseArchive::episodes(const ArchiveQuery &query, ArchiveQueryStats *stats) const {
+    return run(query, true, stats);
+}
+
+qint64 GlucoseArchive::countReadings(const ArchiveQuery &query, ArchiveQueryStats *stats) const {
+    ArchiveQueryStats total;
+    run(query, false, &total);
+    if (stats) {
+        *stats = total;
+    }
+    return total.matchingReadings;
+}
+
+QVector<GlucoseEpisode> GlucoseArchive::run(const ArchiveQuery &query, bool buildEpisodes,
+                                            ArchiveQueryStats *stats) const {
+    QVector<int> patients = query.patients;
+    if (patients.isEmpty()) {
+        patients.resize(m_patients.size());
+        for (int i = 0; i < patients.size(); ++i) {
+            patients[i] = i;
+        }
+    }
+
+    // Shards of whole patients, each with its own results, merged in order
+    const int threads = query.threads > 0 ? query.threads : QThread::idealThreadCount();
+    const int shardCount = qBound(1, threads, qMax(1, patients.size()));
+    QVector<QVector<GlucoseEpisode>> shardEpisodes(shardCount);
+    QVector<ArchiveQueryStats> shardStats(shardCount);
+
+    if (shardCount == 1) {
+        ShardJob(this, &query, patients.constData(), patients.size(), buildEpisodes,
+                 &shardEpisodes[0], &shardStats[0]).run();
+    } else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(shardCount);
+        for (int shard = 0; shard < shardCount; ++shard) {
+            const int first = int(qint64(patients.size()) * shard / shardCount);
+            const int last = int(qint64(patients.size()) * (shard + 1) / shardCount);
+            pool.start(new ShardJob(this, &query, patients.constData() + first, last - first, buildEpisodes,
+                                    &shardEpisodes[shard], &shardStats[shard]));
+        }
+        pool.waitForDone();
+    }
+
+    QVector<GlucoseEpisode> episodes = shardEpisodes[0];
+    ArchiveQueryStats total = shardStats[0];
+    for (int shard = 1; shard < shardCount; ++shard) {
+        episodes += shardEpisodes[shard];
+        total.add(shardStats[shard]);
+    }
+    if (stats) {
+        *stats = total;
+    }
+    return episodes;
+}
+
+void GlucoseArchive::queryPatient(int patient, const ArchiveQuery &query, QVector<GlucoseEpisode> *episodes,
+                                  ArchiveQueryStats *stats) const {
+    ArchiveQueryStats ignored;
+    if (!stats) stats = &ignored;
+
+    const Series &series = m_patients[patient];
+    const bool below = query.comparison == ArchiveQuery::Below;
+    const float threshold = query.threshold;
+
+    int alarmLevel = -1;
+    for (int level = 0; level < AlarmLevelCount; ++level) {
+        if (alarmComparison(AlarmLevel(level)) == query.comparison && alarmThreshold(AlarmLevel(level)) == threshold) {
+            alarmLevel = level;
+        }
+    }
+
+    EpisodeBuilder builder(patient, query, series.timeMs.constData(), series.glucose.constData(), episodes);
+    const qint64 *times = series.timeMs.constData();
+    const int size = series.glucose.size();
+
+    // First block that ends inside the range; zone maps are in time order
+    const auto firstZone = std::lower_bound(series.zones.begin(), series.zones.end(), query.fromMs,
+                                            [](const ZoneMap &zone, qint64 ms) { return zone.lastMs < ms; });
+    for (int block = int(firstZone - series.zones.begin()); block < series.zones.size(); ++block) {
+        const ZoneMap &zone = series.zones[block];
+        if (zone.firstMs > query.toMs) break;
+        stats->blocks++;
+
+        const bool none = below ? zone.minGlucose >= threshold : zone.maxGlucose <= threshold;
+        if (none) {
+            stats->skippedBlocks++;
+            if (episodes) builder.finish();
+            continue;
+        }
+        const bool all = below ? zone.maxGlucose < threshold : zone.minGlucose > threshold;
+
+        // Readings of the block inside the time range
+        const int blockStart = block * kBlockReadings;
+        const int blockEnd = qMin(size, blockStart + kBlockReadings);
+        int from = blockStart;
+        int to = blockEnd;
+        if (zone.firstMs < query.fromMs) {
+            from = int(std::lower_bound(times + blockStart, times + blockEnd, query.fromMs) - times);
+        }
+        if (zone.lastMs > query.toMs) {
+            to = int(std::upper_bound(times + blockStart, times + blockEnd, query.toMs) - times);
+        }
+
+        if (all) {
+            stats->fullBlocks++;
+        } else if (alarmLevel >= 0) {
+            stats->bitmapBlocks++;
+        }
+
+        for (int word = from / 64; word * 64 < to; ++word) {
+            const int base = word * 64;
+            quint64 bits;
+            if (all) {
+                bits = ~quint64(0);
+            } else if (alarmLevel >= 0) {
+                bits = series.alarms[alarmLevel][word];
+            } else if (base + 64 <= size) {
+                bits = below ? compareWord<true>(series.glucose.constData() + base, threshold)
+                             : compareWord<false>(series.glucose.constData() + base, threshold);
+                stats->scannedReadings += 64;
+            } else {
+                bits = compareTail(series.glucose.constData() + base, size - base, threshold, below);
+                stats->scannedReadings += size - base;
+            }
+            bits &= bitRange(qMax(from - base, 0), qMin(to - base, 64));
+            stats->matchingReadings += qPopulationCount(bits);
+
+            if (!episodes) continue;
+            // Runs of set bits, each extending or starting an episode
+            int position = 0;
+            while (bits) {
+                const int zeros = int(qCountTrailingZeroBits(bits));
+                bits >>= zeros;
+                position += zeros;
+                const int ones = int(qCountTrailingZeroBits(~bits));
+                builder.addRun(base + position, ones);
+                bits = ones == 64 ? 0 : bits >> ones;
+                position += ones;
+            }
+        }
+    }
+    if (episodes) builder.finish();
+}
@@ -0,0 +1,115 @@
+#ifndef GLUCOSEARCHIVE_H
+#define GLUCOSEARCHIVE_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <limits>
+
+// What a query looks for: readings on one side of a threshold within a time range
+struct ArchiveQuery {
+    enum Comparison { Below, Above };
+
+    qint64 fromMs = std::numeric_limits<qint64>::min();   // Inclusive, ms since epoch
+    qint64 toMs = std::numeric_limits<qint64>::max();     // Inclusive
+    Comparison comparison = Below;
+    float threshold = 3.0f;            // mmol/L; strictly below or above
+    qint64 minDurationMs = 0;          // Episodes shorter than this are dropped
+    qint64 maxGapMs = 10 * 60000;      // A longer pause between matching readings ends an episode
+    QVector<int> patients;             // Empty for every patient
+    int threads = 0;                   // Patient shards run in parallel; 0 for one per core
+};
+
+// Consecutive matching readings of one patient
+struct GlucoseEpisode {
+    int patient = 0;
+    qint64 startMs = 0;                // First matching reading
+    qint64 endMs = 0;                  // Last matching reading
+    float extreme = 0.0f;              // Lowest reading for Below, highest for Above
+    int readings = 0;
+
+    qint64 durationMs() const { return endMs - startMs; }
+};
+
+// Where a query's time went
+struct ArchiveQueryStats {
+    qint64 blocks = 0;                 // Blocks overlapping the time range
+    qint64 skippedBlocks = 0;          // Ruled out by their zone map
+    qint64 fullBlocks = 0;             // Matching throughout, by their zone map
+    qint64 bitmapBlocks = 0;           // Answered from an alarm bitmap
+    qint64 scannedReadings = 0;        // Compared against the threshold
+    qint64 matchingReadings = 0;
+
+    void add(const ArchiveQueryStats &other);
+};
+
+// Append-only CGM archive for many patients, indexed for threshold queries
+// ("hypos under 3.0 for over 15 minutes last month, every patient").
+//
+// Each patient's readings are stored as time and glucose columns split into
+// blocks of kBlockReadings. Every block has a zone map (time range and
+// glucose min/max) and, for the standard alarm thresholds, a bitmap of the
+// readings past them. A query skips blocks outside its time range or whose
+// zone map rules them in or out entirely, takes the bitmap when its
+// threshold is an alarm level, and otherwise compares the block's readings
+// four at a time (SSE2). Episodes are built from the resulting match bits,
+// and patients are split into shards queried on a thread pool.
+//
+// Queries are const and may run concurrently; appends must not overlap them.
+class GlucoseArchive {
+public:
+    static const int kBlockReadings = 1024;
+    static const int kWordsPerBlock = kBlockReadings / 64;
+
+    // Levels with a bitmap per block: the consensus time-below/above-range bounds
+    enum AlarmLevel { UrgentLow, Low, High, VeryHigh, AlarmLevelCount };
+    static float alarmThreshold(AlarmLevel level);
+    static ArchiveQuery::Comparison alarmComparison(AlarmLevel level);
+
+    struct ZoneMap {
+        qint64 firstMs = 0;
+        qint64 lastMs = 0;
+        float minGlucose = 0.0f;
+        float maxGlucose = 0.0f;
+    };
+
+    // Returns the new patient's index
+    int addPatient();
+    int patientCount() const { return m_patients.size(); }
+
+    // Readings must arrive in time order for each patient; NaN and earlier readings are refused
+    bool append(int patient, qint64 timeMs, float glucose);
+
+    int readingCount(int patient) const { return m_patients[patient].glucose.size(); }
+    qint64 readingCount() const;
+    const QVector<ZoneMap> &zoneMaps(int patient) const { return m_patients[patient].zones; }
+
+    // Time of the newest reading of any patient, 0 if there are none
+    qint64 newestMs() const;
+
+    // Episodes of each patient in time order, patients in query order
+    QVector<GlucoseEpisode> episodes(const ArchiveQuery &query, ArchiveQueryStats *stats = nullptr) const;
+
+    // Matching readings, ignoring the duration and gap settings
+    qint64 countReadings(const ArchiveQuery &query, ArchiveQueryStats *stats = nullptr) const;
+
+    // One patient's part of a query; the shards call this
+    void queryPatient(int patient, const ArchiveQuery &query, QVector<GlucoseEpisode> *episodes,
+                      ArchiveQueryStats *stats) const;
+
+    void clear() { m_patients.clear(); }
+
+private:
+    struct Series {
+        QVector<qint64> timeMs;
+        QVector<float> glucose;
+        QVector<ZoneMap> zones;
+        QVector<quint64> alarms[AlarmLevelCount];   // kWordsPerBlock words per block; bit i of word w is reading 64w + i
+    };
+
+    // Runs queryPatient() over the query's patients in parallel shards
+    QVector<GlucoseEpisode> run(const ArchiveQuery &query, bool buildEpisodes, ArchiveQueryStats *stats) const;
+
+    QVector<Series> m_patients;
+};
+
+#endif // GLUCOSEARCHIVE_H
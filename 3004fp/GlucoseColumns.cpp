@@ -0,0 +1,150 @@
+#include "GlucoseColumns.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void GlucoseColumns::append(double sensorMinute, float glucoseValue, float filteredValue, float trendValue,
+                            float varianceValue, quint32 sourceBits, quint8 flagBits, qint64 wallMs) {
+    if (isEmpty()) minuteBase = sensorMinute;
+    minute.append(float(sensorMinute - minuteBase));
+    glucose.append(glucoseValue);
+    filtered.append(filteredValue);
+    trend.append(trendValue);
+    variance.append(varianceValue);
+    timeMs.append(wallMs);
+    sources.append(sourceBits);
+    flags.append(flagBits);
+}
+
+void GlucoseColumns::trim(int maxReadings) {
+    if (size() < 2 * maxReadings) return;
+    const int drop = size() - maxReadings;
+    minute.remove(0, drop);
+    glucose.remove(0, drop);
+    filtered.remove(0, drop);
+    trend.remove(0, drop);
+    variance.remove(0, drop);
+    timeMs.remove(0, drop);
+    sources.remove(0, drop);
+    flags.remove(0, drop);
+
+    // Rebase on the oldest kept reading
+    const float first = minute[0];
+    minuteBase += first;
+    for (float &offset : minute) {
+        offset -= first;
+    }
+}
+
+void GlucoseColumns::clear() {
+    minuteBase = 0.0;
+    minute.clear();
+    glucose.clear();
+    filtered.clear();
+    trend.clear();
+    variance.clear();
+    timeMs.clear();
+    sources.clear();
+    flags.clear();
+}
+
+int GlucoseColumns::indexAtMinute(double sensorMinute) const {
+    const float offset = float(sensorMinute - minuteBase);
+    const float *begin = minute.constData();
+    return int(std::lower_bound(begin, begin + minute.size(), offset) - begin);
+}
+
+GlucoseSummary GlucoseColumns::summarize(int first, int last, Column column, float low, float high) const {
+    GlucoseSummary summary;
+    first = qMax(0, first);
+    last = qMin(last, size() - 1);
+    if (first > last) return summary;
+
+    const float *y = (column == Raw ? glucose : filtered).constData();
+    const float *x = minute.constData();
+    const float x0 = x[first];
+    const int n = last - first + 1;
+
+    // x is minutes since the first reading of the window, so the sums stay well conditioned
+    double sumX = 0, sumY = 0, sumXY = 0, sumX2 = 0, sumY2 = 0;
+    float lowest = y[first], highest = y[first];
+    int below = 0, above = 0;
+    int i = first;
+
+#ifdef __SSE2__
+    // Each register of four floats is widened to two pairs of doubles before the products
+    __m128d sx = _mm_setzero_pd(), sy = _mm_setzero_pd(), sxy = _mm_setzero_pd();
+    __m128d sx2 = _mm_setzero_pd(), sy2 = _mm_setzero_pd();
+    __m128 vmin = _mm_set1_ps(lowest), vmax = _mm_set1_ps(highest);
+    __m128i countBelow = _mm_setzero_si128(), countAbove = _mm_setzero_si128();
+    const __m128 origin = _mm_set1_ps(x0), lowLimit = _mm_set1_ps(low), highLimit = _mm_set1_ps(high);
+
+    for (; i + 4 <= last + 1; i += 4) {
+        const __m128 vx = _mm_sub_ps(_mm_loadu_ps(x + i), origin);
+        const __m128 vy = _mm_loadu_ps(y + i);
+        const __m128d xl = _mm_cvtps_pd(vx), xh = _mm_cvtps_pd(_mm_movehl_ps(vx, vx));
+        const __m128d yl = _mm_cvtps_pd(vy), yh = _mm_cvtps_pd(_mm_movehl_ps(vy, vy));
+
+        sx = _mm_add_pd(sx, _mm_add_pd(xl, xh));
+        sy = _mm_add_pd(sy, _mm_add_pd(yl, yh));
+        sxy = _mm_add_pd(sxy, _mm_add_pd(_mm_mul_pd(xl, yl), _mm_mul_pd(xh, yh)));
+        sx2 = _mm_add_pd(sx2, _mm_add_pd(_mm_mul_pd(xl, xl), _mm_mul_pd(xh, xh)));
+        sy2 = _mm_add_pd(sy2, _mm_add_pd(_mm_mul_pd(yl, yl), _mm_mul_pd(yh, yh)));
+
+        vmin = _mm_min_ps(vmin, vy);
+        vmax = _mm_max_ps(vmax, vy);
+        // Compare masks are -1 per matching lane
+        countBelow = _mm_sub_epi32(countBelow, _mm_castps_si128(_mm_cmplt_ps(vy, lowLimit)));
+        countAbove = _mm_sub_epi32(countAbove, _mm_castps_si128(_mm_cmpgt_ps(vy, highLimit)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sx);  sumX = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sy);  sumY = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sxy); sumXY = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sx2); sumX2 = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sy2); sumY2 = lanes[0] + lanes[1];
+
+    float extremes[4];
+    _mm_storeu_ps(extremes, vmin);
+    lowest = std::min(std::min(extremes[0], extremes[1]), std::min(extremes[2], extremes[3]));
+    _mm_storeu_ps(extremes, vmax);
+    highest = std::max(std::max(extremes[0], extremes[1]), std::max(extremes[2], extremes[3]));
+
+    qint32 counts[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(counts), countBelow);
+    below = counts[0] + counts[1] + counts[2] + counts[3];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(counts), countAbove);
+    above = counts[0] + counts[1] + counts[2] + counts[3];
+#endif
+
+    for (; i <= last; ++i) {
+        const double vx = x[i] - x0;
+        const double vy = y[i];
+        sumX += vx;
+        sumY += vy;
+        sumXY += vx * vy;
+        sumX2 += vx * vx;
+        sumY2 += vy * vy;
+        lowest = std::min(lowest, y[i]);
+        highest = std::max(highest, y[i]);
+        below += y[i] < low;
+        above += y[i] > high;
+    }
+
+    summary.count = n;
+    summary.mean = sumY / n;
+    summary.sd = std::sqrt(qMax(0.0, sumY2 / n - summary.mean * summary.mean));
+    summary.min = lowest;
+    summary.max = highest;
+    summary.below = below;
+    summary.above = above;
+
+    const double denominator = n * sumX2 - sumX * sumX;
+    if (n >= 2 && denominator > 0.0) {
+        summary.slope = (n * sumXY - sumX * sumY) / denominator;
+    }
+    return summary;
+}
@@ -0,0 +1,70 @@
+#ifndef GLUCOSECOLUMNS_H
+#define GLUCOSECOLUMNS_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Statistics of a window of readings
+struct GlucoseSummary {
+    int count = 0;
+    double mean = 0.0;
+    double sd = 0.0;                 // Population standard deviation
+    double min = 0.0;
+    double max = 0.0;
+    double slope = 0.0;              // Least-squares trend, mmol/L per minute (0 below two readings)
+    int below = 0;                   // Strictly below the low limit
+    int above = 0;                   // Strictly above the high limit
+
+    double percentBelow() const { return count > 0 ? 100.0 * below / count : 0.0; }
+    double percentAbove() const { return count > 0 ? 100.0 * above / count : 0.0; }
+    double percentInRange() const { return count > 0 ? 100.0 * (count - below - above) / count : 0.0; }
+};
+
+// Recent readings of one CGM, stored column by column.
+//
+// A reading is packed into 33 bytes spread over the columns (the previous
+// record was 56 bytes plus its QDateTime), and a scan over time and glucose
+// touches 8 bytes per reading instead of 56. Every column is contiguous, so
+// window statistics and regression run four readings at a time (SSE2).
+// Sensor time is kept as float minutes relative to minuteBase, which moves
+// up when old readings are trimmed so the offsets stay small enough for
+// float precision; wall-clock time is kept for display and the audit trail.
+struct GlucoseColumns {
+    enum Flag : quint8 {
+        Alarm = 0x1,                 // Filtered value triggered an alert
+        Low = 0x2,                   // ... at or below the low threshold
+        High = 0x4                   // ... at or above the high threshold
+    };
+    enum Column { Raw, Filtered };
+
+    double minuteBase = 0.0;
+    QVector<float> minute;           // Sensor minutes since minuteBase, non-decreasing
+    QVector<float> glucose;          // Raw reading, mmol/L
+    QVector<float> filtered;         // Kalman-filtered glucose, mmol/L
+    QVector<float> trend;            // Filtered rate of change, mmol/L per minute
+    QVector<float> variance;         // Of the filtered glucose
+    QVector<qint64> timeMs;          // Wall clock, ms since epoch
+    QVector<quint32> sources;        // Fusion sources (bit per source, 0 = direct)
+    QVector<quint8> flags;
+
+    int size() const { return glucose.size(); }
+    bool isEmpty() const { return glucose.isEmpty(); }
+    double minuteAt(int index) const { return minuteBase + minute[index]; }
+
+    // Sensor minutes must not go backwards
+    void append(double sensorMinute, float glucoseValue, float filteredValue, float trendValue,
+                float varianceValue, quint32 sourceBits, quint8 flagBits, qint64 wallMs);
+
+    // Drops the oldest readings once there are twice 'maxReadings', keeping 'maxReadings'
+    void trim(int maxReadings);
+
+    void clear();
+
+    // First reading at or after the sensor minute (size() if none)
+    int indexAtMinute(double sensorMinute) const;
+
+    // Readings [first, last] of a column, with the time in range counted against low/high
+    GlucoseSummary summarize(int first, int last, Column column, float low = 3.9f, float high = 10.0f) const;
+};
+
+#endif // GLUCOSECOLUMNS_H
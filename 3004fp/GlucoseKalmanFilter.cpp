@@ -0,0 +1,97 @@
+#include "GlucoseKalmanFilter.h"
+
+void GlucoseKalmanFilter::initialize(double glucose) {
+    for (int i = 0; i < kStates; ++i) {
+        m_x[i] = 0.0;
+        for (int j = 0; j < kStates; ++j) {
+            m_p[i][j] = 0.0;
+        }
+    }
+    m_x[Glucose] = glucose;
+    m_p[Glucose][Glucose] = m_settings.measurementVariance;
+    m_p[Velocity][Velocity] = m_settings.initialVelocityVariance;
+    m_p[Acceleration][Acceleration] = m_settings.initialAccelerationVariance;
+    m_innovation = 0.0;
+    m_initialized = true;
+}
+
+// x = F x,  P = F P F^T + Q  with F the constant-acceleration transition
+void GlucoseKalmanFilter::predict(double dt) {
+    const double half = 0.5 * dt * dt;
+    const double F[kStates][kStates] = {
+        { 1.0, dt, half },
+        { 0.0, 1.0, dt },
+        { 0.0, 0.0, 1.0 },
+    };
+
+    double x[kStates];
+    for (int i = 0; i < kStates; ++i) {
+        x[i] = 0.0;
+        for (int k = 0; k < kStates; ++k) {
+            x[i] += F[i][k] * m_x[k];
+        }
+    }
+
+    double fp[kStates][kStates];
+    for (int i = 0; i < kStates; ++i) {
+        for (int j = 0; j < kStates; ++j) {
+            double sum = 0.0;
+            for (int k = 0; k < kStates; ++k) {
+                sum += F[i][k] * m_p[k][j];
+            }
+            fp[i][j] = sum;
+        }
+    }
+
+    // Discretised white-jerk noise
+    const double q = m_settings.jerkDensity;
+    const double dt2 = dt * dt;
+    const double dt3 = dt2 * dt;
+    const double Q[kStates][kStates] = {
+        { q * dt3 * dt2 / 20.0, q * dt2 * dt2 / 8.0, q * dt3 / 6.0 },
+        { q * dt2 * dt2 / 8.0,  q * dt3 / 3.0,       q * dt2 / 2.0 },
+        { q * dt3 / 6.0,        q * dt2 / 2.0,       q * dt },
+    };
+
+    for (int i = 0; i < kStates; ++i) {
+        m_x[i] = x[i];
+        for (int j = 0; j < kStates; ++j) {
+            double sum = 0.0;
+            for (int k = 0; k < kStates; ++k) {
+                sum += fp[i][k] * F[j][k];
+            }
+            m_p[i][j] = sum + Q[i][j];
+        }
+    }
+}
+
+void GlucoseKalmanFilter::update(double glucose, double minutes, double measurementVariance) {
+    if (!m_initialized || minutes > m_settings.maxGapMinutes) {
+        initialize(glucose);
+        m_p[Glucose][Glucose] = measurementVariance;
+        return;
+    }
+    if (minutes > 0.0) {
+        predict(minutes);
+    }
+
+    // H = [1 0 0]: S = P00 + R, K = P[:,0] / S
+    m_innovation = glucose - m_x[Glucose];
+    const double s = m_p[Glucose][Glucose] + measurementVariance;
+    double gain[kStates];
+    for (int i = 0; i < kStates; ++i) {
+        gain[i] = m_p[i][Glucose] / s;
+        m_x[i] += gain[i] * m_innovation;
+    }
+
+    // P = (I - K H) P
+    double firstRow[kStates];
+    for (int j = 0; j < kStates; ++j) {
+        firstRow[j] = m_p[Glucose][j];
+    }
+    for (int i = 0; i < kStates; ++i) {
+        for (int j = 0; j < kStates; ++j) {
+            m_p[i][j] -= gain[i] * firstRow[j];
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef GLUCOSEKALMANFILTER_H
+#define GLUCOSEKALMANFILTER_H
+
+// Kalman filter for a CGM signal with state [glucose, velocity, acceleration]
+// (mmol/L, mmol/L/min, mmol/L/min^2) and a constant-acceleration model driven
+// by white jerk noise.
+//
+// Dimensions are fixed at compile time and the state lives in plain arrays,
+// so an update is a few dozen multiply-adds with no allocation. The CGM
+// measures glucose only, so the innovation is a scalar and no matrix is
+// inverted.
+class GlucoseKalmanFilter {
+public:
+    static const int kStates = 3;
+    enum State { Glucose, Velocity, Acceleration };
+
+    struct Settings {
+        double measurementVariance = 0.03;   // Sensor noise (±0.3 mmol/L uniform)
+        double jerkDensity = 1e-6;           // Process noise spectral density (mmol/L/min^3)^2 * min
+        double initialVelocityVariance = 0.01;
+        double initialAccelerationVariance = 1e-4;
+        double maxGapMinutes = 30.0;         // Longer gaps restart the filter
+    };
+
+    GlucoseKalmanFilter() {}
+    explicit GlucoseKalmanFilter(const Settings &settings) : m_settings(settings) {}
+
+    void setSettings(const Settings &settings) { m_settings = settings; }
+    const Settings &settings() const { return m_settings; }
+
+    // Forgets all state; the next update() starts from that reading
+    void reset() { m_initialized = false; }
+
+    // Advances 'minutes' and folds in one reading
+    void update(double glucose, double minutes) { update(glucose, minutes, m_settings.measurementVariance); }
+
+    // Same, for a reading whose error variance differs from the sensor's (e.g. fused or fingerstick)
+    void update(double glucose, double minutes, double measurementVariance);
+
+    bool isInitialized() const { return m_initialized; }
+    double glucose() const { return m_x[Glucose]; }
+    double trend() const { return m_x[Velocity]; }             // mmol/L per minute
+    double acceleration() const { return m_x[Acceleration]; }
+    double variance() const { return m_p[Glucose][Glucose]; }  // Of the filtered glucose
+    double innovation() const { return m_innovation; }         // Last reading minus its prediction
+
+private:
+    void initialize(double glucose);
+    void predict(double dt);
+
+    Settings m_settings;
+    bool m_initialized = false;
+    double m_x[kStates] = {};
+    double m_p[kStates][kStates] = {};
+    double m_innovation = 0.0;
+};
+
+#endif // GLUCOSEKALMANFILTER_H
@@ -0,0 +1,194 @@
+#include "GlucoseSeriesStore.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const int kBaseBucketSize = 8;        // Raw points per bucket in the finest level
+const int kLevelFactor = 4;           // Each level is 4x coarser than the previous
+const int kMaxPointsPerLevel = 4096;  // Add a coarser level once this is exceeded
+
+bool lessX(const QPointF& p, double x) { return p.x() < x; }
+bool greaterX(double x, const QPointF& p) { return x < p.x(); }
+}
+
+GlucoseSeriesStore::GlucoseSeriesStore() {
+}
+
+// Folds a new point into every level, flushing buckets as they fill
+void GlucoseSeriesStore::append(double x, double y) {
+    const QPointF point(x, y);
+    m_raw.append(point);
+
+    for (Level& level : m_levels) {
+        if (level.pending == 0) {
+            level.minPoint = point;
+            level.maxPoint = point;
+        } else {
+            if (y < level.minPoint.y()) level.minPoint = point;
+            if (y > level.maxPoint.y()) level.maxPoint = point;
+        }
+
+        if (++level.pending == level.bucketSize) {
+            pushBucket(level.points, level.minPoint, level.maxPoint);
+            level.pending = 0;
+        }
+    }
+
+    // Keep the coarsest level small enough to serve any zoom level
+    int coarsestSize = m_levels.isEmpty() ? m_raw.size() : m_levels.last().points.size();
+    if (coarsestSize > kMaxPointsPerLevel) {
+        addLevel();
+    }
+}
+
+// Clears raw data and all decimation levels
+void GlucoseSeriesStore::clear() {
+    m_raw.clear();
+    m_levels.clear();
+}
+
+// Builds the next coarser level from the raw data (happens O(log n) times)
+void GlucoseSeriesStore::addLevel() {
+    Level level;
+    level.bucketSize = m_levels.isEmpty() ? kBaseBucketSize
+                                          : m_levels.last().bucketSize * kLevelFactor;
+    level.pending = 0;
+    level.points.reserve(2 * (m_raw.size() / level.bucketSize + 1));
+
+    for (const QPointF& point : m_raw) {
+        if (level.pending == 0) {
+            level.minPoint = point;
+            level.maxPoint = point;
+        } else {
+            if (point.y() < level.minPoint.y()) level.minPoint = point;
+            if (point.y() > level.maxPoint.y()) level.maxPoint = point;
+        }
+
+        if (++level.pending == level.bucketSize) {
+            pushBucket(level.points, level.minPoint, level.maxPoint);
+            level.pending = 0;
+        }
+    }
+
+    m_levels.append(level);
+}
+
+// Appends a bucket's min and max point in x order (once if identical)
+void GlucoseSeriesStore::pushBucket(QVector<QPointF>& out, const QPointF& a, const QPointF& b) {
+    if (a.x() == b.x() && a.y() == b.y()) {
+        out.append(a);
+    } else if (a.x() <= b.x()) {
+        out.append(a);
+        out.append(b);
+    } else {
+        out.append(b);
+        out.append(a);
+    }
+}
+
+// Copies points within [xMin, xMax] plus one neighbour on each side so the
+// line still reaches the edges of the plot
+void GlucoseSeriesStore::sliceRange(const QVector<QPointF>& src, double xMin, double xMax,
+                                    QVector<QPointF>& out) {
+    auto first = std::lower_bound(src.begin(), src.end(), xMin, lessX);
+    auto last = std::upper_bound(src.begin(), src.end(), xMax, greaterX);
+
+    if (first != src.begin()) --first;
+    if (last != src.end()) ++last;
+
+    out.reserve(out.size() + static_cast<int>(last - first));
+    for (auto it = first; it != last; ++it) {
+        out.append(*it);
+    }
+}
+
+// Picks the finest level that fits the pixel budget, then LTTB-reduces it
+QVector<QPointF> GlucoseSeriesStore::visiblePoints(double xMin, double xMax, int maxPoints) const {
+    QVector<QPointF> visible;
+    if (m_raw.isEmpty() || xMax < xMin) {
+        return visible;
+    }
+    if (maxPoints < 3) maxPoints = 3;
+
+    auto countInRange = [xMin, xMax](const QVector<QPointF>& points) {
+        auto first = std::lower_bound(points.begin(), points.end(), xMin, lessX);
+        auto last = std::upper_bound(points.begin(), points.end(), xMax, greaterX);
+        return static_cast<int>(last - first);
+    };
+
+    // Raw data is used as long as it is within twice the pixel budget
+    const Level* source = nullptr;
+    if (countInRange(m_raw) > 2 * maxPoints) {
+        for (const Level& level : m_levels) {
+            source = &level;
+            if (countInRange(level.points) <= 2 * maxPoints) break;
+        }
+    }
+
+    if (!source) {
+        sliceRange(m_raw, xMin, xMax, visible);
+    } else {
+        sliceRange(source->points, xMin, xMax, visible);
+
+        // Include the still-open bucket so the newest readings are visible
+        if (source->pending > 0 && source->minPoint.x() <= xMax) {
+            pushBucket(visible, source->minPoint, source->maxPoint);
+        }
+    }
+
+    if (visible.size() > maxPoints) {
+        return lttb(visible, maxPoints);
+    }
+    return visible;
+}
+
+// Largest-Triangle-Three-Buckets: keeps the first and last point and, for each
+// bucket in between, the point forming the largest triangle with its neighbours
+QVector<QPointF> GlucoseSeriesStore::lttb(const QVector<QPointF>& points, int threshold) {
+    const int n = points.size();
+    if (threshold >= n || threshold < 3) {
+        return points;
+    }
+
+    QVector<QPointF> sampled;
+    sampled.reserve(threshold);
+    sampled.append(points.first());
+
+    const double bucketWidth = static_cast<double>(n - 2) / (threshold - 2);
+    int a = 0;
+
+    for (int i = 0; i < threshold - 2; ++i) {
+        // Average of the next bucket acts as the third triangle vertex
+        int nextStart = static_cast<int>(std::floor((i + 1) * bucketWidth)) + 1;
+        int nextEnd = qMin(static_cast<int>(std::floor((i + 2) * bucketWidth)) + 1, n);
+        double avgX = 0.0, avgY = 0.0;
+        for (int j = nextStart; j < nextEnd; ++j) {
+            avgX += points[j].x();
+            avgY += points[j].y();
+        }
+        int nextCount = qMax(1, nextEnd - nextStart);
+        avgX /= nextCount;
+        avgY /= nextCount;
+
+        int start = static_cast<int>(std::floor(i * bucketWidth)) + 1;
+        int end = static_cast<int>(std::floor((i + 1) * bucketWidth)) + 1;
+
+        const QPointF& pa = points[a];
+        double maxArea = -1.0;
+        int chosen = start;
+        for (int j = start; j < end; ++j) {
+            double area = std::fabs((pa.x() - avgX) * (points[j].y() - pa.y())
+                                    - (pa.x() - points[j].x()) * (avgY - pa.y()));
+            if (area > maxArea) {
+                maxArea = area;
+                chosen = j;
+            }
+        }
+
+        sampled.append(points[chosen]);
+        a = chosen;
+    }
+
+    sampled.append(points.last());
+    return sampled;
+}
@@ -0,0 +1,50 @@
+#ifndef GLUCOSESERIESSTORE_H
+#define GLUCOSESERIESSTORE_H
+
+#include <QVector>
+#include <QPointF>
+
+// Multi-resolution store for the glucose chart.
+// Keeps every raw point plus coarser min/max levels that are built
+// incrementally as readings arrive, so the chart can pull roughly one
+// point per pixel for any visible range (hours, 14 days, 90 days).
+class GlucoseSeriesStore {
+public:
+    GlucoseSeriesStore();
+
+    // Append a reading; x (minutes) must not decrease between calls
+    void append(double x, double y);
+
+    // Remove all stored points and levels
+    void clear();
+
+    // Number of raw points stored
+    int size() const { return m_raw.size(); }
+
+    // Points covering [xMin, xMax], decimated to about maxPoints using
+    // the closest min/max level followed by LTTB
+    QVector<QPointF> visiblePoints(double xMin, double xMax, int maxPoints) const;
+
+    // Largest-Triangle-Three-Buckets downsampling of a sorted series
+    static QVector<QPointF> lttb(const QVector<QPointF>& points, int threshold);
+
+private:
+    // One decimation level: each full bucket contributes its min and max point
+    struct Level {
+        int bucketSize;            // Raw points per bucket
+        QVector<QPointF> points;   // Flushed min/max points in x order
+        QPointF minPoint;          // Lowest point of the open bucket
+        QPointF maxPoint;          // Highest point of the open bucket
+        int pending;               // Raw points in the open bucket
+    };
+
+    QVector<QPointF> m_raw;        // Every reading as received
+    QVector<Level> m_levels;       // Coarser levels, finest first
+
+    void addLevel();
+    static void pushBucket(QVector<QPointF>& out, const QPointF& a, const QPointF& b);
+    static void sliceRange(const QVector<QPointF>& src, double xMin, double xMax,
+                           QVector<QPointF>& out);
+};
+
+#endif // GLUCOSESERIESSTORE_H
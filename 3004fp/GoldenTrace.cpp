@@ -0,0 +1,357 @@
+#include "GoldenTrace.h"
+#include <QDataStream>
+#include <QFile>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <cmath>
+#include <limits>
+#include "BolusManager.h"
+#include "CGMManager.h"
+#include "EnsemblePredictor.h"
+#include "MpcBasalController.h"
+#include "PumpStages.h"
+#include "SafetyController.h"
+#include "Scenario.h"
+
+namespace {
+const int kHeaderBytes = 4 + 2 + 1 + 1 + 4 + 4;
+const int kTickBytes = 4 + 4 + 1 + 1 + 4 + 4 + 2 + 6 * 4 + 4 * 4 + 1 + 1 + 3 * 4;
+
+// Sense stage that hands back recorded readings and the inputs seen with them
+class TraceSensor : public SenseStage {
+public:
+    const TraceTick *tick = nullptr;
+
+    SensorReading sense(PatientState &patient) override {
+        patient.simMinutes = tick->simMinutes;
+        patient.glucose = tick->glucose;
+        patient.initialReadingPending = false;
+        patient.inputs.insulinOnBoard = tick->insulinOnBoard;
+        patient.inputs.carbsOnBoard = tick->carbsOnBoard;
+        patient.inputs.basalRate = tick->basalRate;
+        patient.inputs.correctionFactor = tick->correctionFactor;
+        patient.inputs.carbRatio = tick->carbRatio;
+        patient.inputs.targetBG = tick->targetBG;
+        patient.refillPending = tick->actions & TraceTick::RefillAction;
+        patient.profileChanged = tick->actions & TraceTick::ProfileAction;
+        patient.scenarioBolus = tick->scenarioBolus;
+        patient.tempBasalPending = tick->actions & TraceTick::TempBasalAction;
+        patient.tempBasalRate = tick->tempBasalRate;
+        patient.tempBasalMinutes = tick->tempBasalMinutes;
+
+        SensorReading reading;
+        reading.simMinutes = tick->simMinutes;
+        reading.glucose = tick->glucose;
+        reading.initial = tick->initial != 0;
+        return reading;
+    }
+};
+
+// Render stage appending every tick to a trace
+class TraceCapture : public RenderStage {
+public:
+    GoldenTrace *trace = nullptr;
+    quint8 actions = 0;              // Scenario actions pending when the tick started
+    double scenarioBolus = 0.0;
+
+    void render(const PatientState &patient, const TickFrame &frame) override {
+        trace->ticks.append(GoldenTrace::capture(patient, frame, actions, scenarioBolus));
+    }
+};
+
+// Decision and delivery stages of one run; everything is private to the calling thread
+struct ReplayRig {
+    BolusManager bolusManager;
+    CGMManager cgmManager;
+    SafetyController controller;
+    CgmHistoryEstimator estimator;
+    LinearGlucosePredictor linearPredictor;
+    EnsembleGlucosePredictor ensemblePredictor;
+    ThresholdBasalController thresholdController;
+    MpcBasalController mpcController;
+    PumpDelivery delivery;
+    TickPipeline pipeline;
+    PatientState patient;
+    TickFrame frame;
+
+    ReplayRig(const GoldenTrace &trace, SenseStage *sense, RenderStage *render)
+        : cgmManager(&bolusManager),
+          estimator(&cgmManager),
+          linearPredictor(&cgmManager),
+          delivery(&controller)
+    {
+        pipeline.setSenseStage(sense);
+        pipeline.setEstimateStage(&estimator);
+        if (trace.predictor == GoldenTrace::EnsemblePredictor) {
+            pipeline.setPredictStage(&ensemblePredictor);
+        } else {
+            pipeline.setPredictStage(&linearPredictor);
+        }
+        if (trace.controller == GoldenTrace::MpcController) {
+            pipeline.setControlStage(&mpcController);
+        } else {
+            pipeline.setControlStage(&thresholdController);
+        }
+        pipeline.setDeliverStage(&delivery);
+        pipeline.setRenderStage(render);
+
+        controller.setBasalRate(trace.startBasalRate);
+        patient.deliveredBasalRate = trace.startBasalRate;
+
+        // Solves end on convergence or sweep count only, so a busy machine cannot change a decision
+        MpcBasalController::Settings mpc = mpcController.settings();
+        mpc.budgetNs = std::numeric_limits<int>::max();
+        mpcController.setSettings(mpc);
+    }
+};
+
+// Replays and compares one file into its result slot
+class VerifyJob : public QRunnable {
+public:
+    VerifyJob(const QString &path, const TraceTolerance &tolerance, TraceDiff *result)
+        : m_path(path), m_tolerance(tolerance), m_result(result) {}
+
+    void run() override {
+        GoldenTrace recorded;
+        QString error;
+        if (!recorded.load(m_path, &error)) {
+            m_result->error = error;
+        } else {
+            *m_result = GoldenReplay::compare(recorded, GoldenReplay::replay(recorded), m_tolerance);
+        }
+        m_result->path = m_path;
+    }
+
+private:
+    QString m_path;
+    TraceTolerance m_tolerance;
+    TraceDiff *m_result;
+};
+
+void writeTick(QDataStream &out, const TraceTick &t) {
+    out << t.simMinutes << t.glucose << t.initial << t.actions << t.scenarioBolus
+        << t.tempBasalRate << t.tempBasalMinutes
+        << t.insulinOnBoard << t.carbsOnBoard << t.basalRate << t.correctionFactor << t.carbRatio << t.targetBG
+        << t.estimate << t.trend << t.predicted30 << t.predicted30Low
+        << t.alert << t.basalAction << t.recommendedCorrection << t.autoCorrection << t.pumpBasalRate;
+}
+
+void readTick(QDataStream &in, TraceTick &t) {
+    in >> t.simMinutes >> t.glucose >> t.initial >> t.actions >> t.scenarioBolus
+       >> t.tempBasalRate >> t.tempBasalMinutes
+       >> t.insulinOnBoard >> t.carbsOnBoard >> t.basalRate >> t.correctionFactor >> t.carbRatio >> t.targetBG
+       >> t.estimate >> t.trend >> t.predicted30 >> t.predicted30Low
+       >> t.alert >> t.basalAction >> t.recommendedCorrection >> t.autoCorrection >> t.pumpBasalRate;
+}
+
+void setupStream(QDataStream &stream) {
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+}
+}
+
+quint8 GoldenTrace::pendingActions(const PatientState &patient) {
+    return (patient.refillPending ? TraceTick::RefillAction : 0)
+           | (patient.profileChanged ? TraceTick::ProfileAction : 0)
+           | (patient.tempBasalPending ? TraceTick::TempBasalAction : 0);
+}
+
+TraceTick GoldenTrace::capture(const PatientState &patient, const TickFrame &frame,
+                               quint8 actions, double scenarioBolus) {
+    TraceTick tick;
+    tick.simMinutes = frame.reading.simMinutes;
+    tick.glucose = float(frame.reading.glucose);
+    tick.initial = frame.reading.initial ? 1 : 0;
+    tick.actions = actions;
+    tick.scenarioBolus = float(scenarioBolus);
+    if (actions & TraceTick::TempBasalAction) {
+        // The deliver stage clears only the pending flag
+        tick.tempBasalRate = float(patient.tempBasalRate);
+        tick.tempBasalMinutes = quint16(qBound(0, patient.tempBasalMinutes, 65535));
+    }
+    tick.insulinOnBoard = float(frame.estimate.insulinOnBoard);
+    tick.carbsOnBoard = float(frame.estimate.carbsOnBoard);
+    tick.basalRate = float(frame.estimate.basalRate);
+    tick.correctionFactor = float(frame.estimate.correctionFactor);
+    tick.carbRatio = float(frame.estimate.carbRatio);
+    tick.targetBG = float(patient.inputs.targetBG);
+
+    tick.estimate = float(frame.estimate.glucose);
+    tick.trend = float(frame.estimate.trend);
+    tick.predicted30 = float(frame.prediction.predicted30min);
+    tick.predicted30Low = float(frame.prediction.predicted30minLow);
+    tick.alert = quint8(frame.decision.alert);
+    tick.basalAction = quint8(frame.decision.basalAction);
+    tick.recommendedCorrection = float(frame.decision.recommendedCorrection);
+    tick.autoCorrection = float(frame.decision.autoCorrection);
+    tick.pumpBasalRate = float(patient.deliveredBasalRate);
+    return tick;
+}
+
+bool GoldenTrace::save(const QString &path, QString *error) const {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *error = QString("cannot write %1").arg(path);
+        return false;
+    }
+    QDataStream out(&file);
+    setupStream(out);
+    out << kMagic << kVersion << quint8(controller) << quint8(predictor) << startBasalRate
+        << quint32(ticks.size());
+    for (const TraceTick &tick : ticks) {
+        writeTick(out, tick);
+    }
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        *error = QString("cannot write %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool GoldenTrace::load(const QString &path, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("cannot open %1").arg(path);
+        return false;
+    }
+    QDataStream in(&file);
+    setupStream(in);
+
+    quint32 magic = 0, count = 0;
+    quint16 version = 0;
+    quint8 controllerValue = 0, predictorValue = 0;
+    in >> magic >> version >> controllerValue >> predictorValue >> startBasalRate >> count;
+    if (in.status() != QDataStream::Ok || magic != kMagic) {
+        *error = QString("%1 is not a golden trace").arg(path);
+        return false;
+    }
+    if (version != kVersion) {
+        *error = QString("%1 has unsupported version %2").arg(path).arg(version);
+        return false;
+    }
+    if (file.size() != kHeaderBytes + qint64(count) * kTickBytes) {
+        *error = QString("%1 is truncated").arg(path);
+        return false;
+    }
+
+    controller = controllerValue == MpcController ? MpcController : ThresholdController;
+    predictor = predictorValue == EnsemblePredictor ? EnsemblePredictor : LinearPredictor;
+    ticks.resize(int(count));
+    for (TraceTick &tick : ticks) {
+        readTick(in, tick);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+GoldenTrace GoldenReplay::record(const CompiledScenario &scenario, GoldenTrace::Controller controller,
+                                 GoldenTrace::Predictor predictor) {
+    GoldenTrace trace;
+    trace.controller = controller;
+    trace.predictor = predictor;
+
+    SimulatedCgmSensor sensor;
+    TraceCapture capture;
+    capture.trace = &trace;
+    ReplayRig rig(trace, &sensor, &capture);
+
+    ScenarioPlayer player;
+    rig.patient.glucose = 7.0;
+    rig.patient.initialReadingPending = true;
+    player.start(&scenario, rig.patient);
+    trace.startBasalRate = float(rig.controller.getBasalRate());
+
+    const int ticks = scenario.durationMinutes / 5;
+    trace.ticks.reserve(ticks + 1);
+    for (int tick = 0; tick <= ticks; ++tick) {
+        player.advance(rig.patient);
+        capture.actions = GoldenTrace::pendingActions(rig.patient);
+        capture.scenarioBolus = rig.patient.scenarioBolus;
+        rig.pipeline.run(&rig.patient, &rig.frame, 1);
+    }
+    return trace;
+}
+
+GoldenTrace GoldenReplay::replay(const GoldenTrace &recorded) {
+    GoldenTrace result;
+    result.controller = recorded.controller;
+    result.predictor = recorded.predictor;
+    result.startBasalRate = recorded.startBasalRate;
+    result.ticks.reserve(recorded.ticks.size());
+
+    TraceSensor sensor;
+    TraceCapture capture;
+    capture.trace = &result;
+    ReplayRig rig(recorded, &sensor, &capture);
+
+    for (const TraceTick &tick : recorded.ticks) {
+        sensor.tick = &tick;
+        capture.actions = tick.actions;
+        capture.scenarioBolus = tick.scenarioBolus;
+        rig.pipeline.run(&rig.patient, &rig.frame, 1);
+    }
+    return result;
+}
+
+TraceDiff GoldenReplay::compare(const GoldenTrace &expected, const GoldenTrace &actual,
+                                const TraceTolerance &tolerance) {
+    TraceDiff diff;
+    diff.ticks = expected.ticks.size();
+    if (actual.ticks.size() != expected.ticks.size()) {
+        diff.mismatches = qAbs(actual.ticks.size() - expected.ticks.size());
+        diff.firstTick = qMin(actual.ticks.size(), expected.ticks.size());
+        diff.firstField = "tick count";
+        diff.expected = expected.ticks.size();
+        diff.actual = actual.ticks.size();
+    }
+
+    const int n = qMin(actual.ticks.size(), expected.ticks.size());
+    for (int i = 0; i < n; ++i) {
+        const TraceTick &e = expected.ticks[i];
+        const TraceTick &a = actual.ticks[i];
+        const struct {
+            const char *name;
+            double expected;
+            double actual;
+            double tolerance;
+        } fields[] = {
+            { "estimate", e.estimate, a.estimate, tolerance.glucose },
+            { "trend", e.trend, a.trend, tolerance.trend },
+            { "predicted30", e.predicted30, a.predicted30, tolerance.glucose },
+            { "predicted30Low", e.predicted30Low, a.predicted30Low, tolerance.glucose },
+            { "alert", double(e.alert), double(a.alert), 0.0 },
+            { "basalAction", double(e.basalAction), double(a.basalAction), 0.0 },
+            { "recommendedCorrection", e.recommendedCorrection, a.recommendedCorrection, tolerance.insulin },
+            { "autoCorrection", e.autoCorrection, a.autoCorrection, tolerance.insulin },
+            { "pumpBasalRate", e.pumpBasalRate, a.pumpBasalRate, tolerance.insulin },
+        };
+
+        bool mismatch = false;
+        for (const auto &field : fields) {
+            if (std::fabs(field.expected - field.actual) <= field.tolerance) continue;
+            if (!mismatch && (diff.firstTick < 0 || i < diff.firstTick)) {
+                diff.firstTick = i;
+                diff.firstField = field.name;
+                diff.expected = field.expected;
+                diff.actual = field.actual;
+            }
+            mismatch = true;
+        }
+        if (mismatch) diff.mismatches++;
+    }
+    return diff;
+}
+
+QVector<TraceDiff> GoldenReplay::verify(const QStringList &paths, const TraceTolerance &tolerance, int threads) {
+    QVector<TraceDiff> results(paths.size());
+
+    QThreadPool pool;
+    if (threads > 0) {
+        pool.setMaxThreadCount(threads);
+    }
+    for (int i = 0; i < paths.size(); ++i) {
+        pool.start(new VerifyJob(paths[i], tolerance, &results[i]));
+    }
+    pool.waitForDone();
+    return results;
+}
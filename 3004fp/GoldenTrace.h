@@ -0,0 +1,113 @@
+#ifndef GOLDENTRACE_H
+#define GOLDENTRACE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include "TickPipeline.h"
+
+struct CompiledScenario;
+
+// One recorded tick: what the decision stages were given and what they decided
+struct TraceTick {
+    enum Action : quint8 { RefillAction = 1, ProfileAction = 2, TempBasalAction = 4 };
+
+    // Inputs
+    qint32 simMinutes = 0;
+    float glucose = 0.0f;            // CGM reading
+    quint8 initial = 0;
+    quint8 actions = 0;              // Scenario actions handed to the deliver stage
+    float scenarioBolus = 0.0f;
+    float tempBasalRate = 0.0f;      // TempBasalAction: u/h ...
+    quint16 tempBasalMinutes = 0;    // ... for this long (0 cancels)
+    float insulinOnBoard = 0.0f;     // Patient inputs after the sense stage
+    float carbsOnBoard = 0.0f;
+    float basalRate = 0.0f;
+    float correctionFactor = 0.0f;
+    float carbRatio = 0.0f;
+    float targetBG = 0.0f;
+
+    // Outputs
+    float estimate = 0.0f;
+    float trend = 0.0f;
+    float predicted30 = 0.0f;
+    float predicted30Low = 0.0f;
+    quint8 alert = 0;                // ControlDecision::GlucoseAlert
+    quint8 basalAction = 0;          // ControlDecision::BasalAction
+    float recommendedCorrection = 0.0f;
+    float autoCorrection = 0.0f;
+    float pumpBasalRate = 0.0f;      // After delivery
+};
+
+// Full input/output trace of one run, stored as a little-endian binary
+// file: a header followed by fixed 74-byte tick records.
+struct GoldenTrace {
+    // Decision stages the run used; replay builds the same ones
+    enum Controller : quint8 { ThresholdController, MpcController };
+    enum Predictor : quint8 { LinearPredictor, EnsemblePredictor };
+
+    static const quint32 kMagic = 0x43525450;   // "PTRC"
+    static const quint16 kVersion = 1;
+
+    Controller controller = ThresholdController;
+    Predictor predictor = LinearPredictor;
+    float startBasalRate = 1.0f;     // Pump basal before the first tick
+    QVector<TraceTick> ticks;
+
+    // Scenario actions pending for the deliver stage, taken before the tick runs
+    static quint8 pendingActions(const PatientState &patient);
+
+    // Fills a tick from the pipeline's view of it
+    static TraceTick capture(const PatientState &patient, const TickFrame &frame,
+                             quint8 actions, double scenarioBolus);
+
+    bool save(const QString &path, QString *error) const;
+    bool load(const QString &path, QString *error);
+};
+
+// Allowed differences when comparing outputs; discrete fields must match exactly
+struct TraceTolerance {
+    double glucose = 0.05;           // Estimate and predictions (mmol/L)
+    double trend = 0.002;            // mmol/L per minute
+    double insulin = 0.01;           // Corrections (units) and basal (u/h)
+};
+
+// Outcome of comparing a replay against its recording
+struct TraceDiff {
+    QString path;
+    QString error;                   // Set if the trace could not be loaded
+    int ticks = 0;
+    int mismatches = 0;              // Ticks with at least one field out of tolerance
+    int firstTick = -1;
+    QString firstField;
+    double expected = 0.0;
+    double actual = 0.0;
+
+    bool passed() const { return error.isEmpty() && mismatches == 0; }
+};
+
+// Headless record/replay of the tick pipeline for regression checks.
+//
+// Replay feeds the recorded readings and inputs through fresh estimate,
+// predict, control and deliver stages (no timer, no UI, no random plant)
+// as fast as they run, so a change to thresholds, predictions or dosing
+// shows up as a difference against the recorded outputs.
+class GoldenReplay {
+public:
+    // Runs a scenario on the linear plant and records it
+    static GoldenTrace record(const CompiledScenario &scenario, GoldenTrace::Controller controller,
+                              GoldenTrace::Predictor predictor);
+
+    // Replays a recording; the result has the same inputs and freshly computed outputs
+    static GoldenTrace replay(const GoldenTrace &recorded);
+
+    static TraceDiff compare(const GoldenTrace &expected, const GoldenTrace &actual,
+                             const TraceTolerance &tolerance);
+
+    // Loads, replays and compares every file on a thread pool; results in input order
+    static QVector<TraceDiff> verify(const QStringList &paths, const TraceTolerance &tolerance,
+                                     int threads = 0);
+};
+
+#endif // GOLDENTRACE_H
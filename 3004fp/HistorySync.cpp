@@ -0,0 +1,477 @@
+#include "HistorySync.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+// Fixed-width fields and LEB128 varints; zigzag maps signed deltas to small unsigned values
+class Writer {
+public:
+    explicit Writer(QByteArray *out) : m_out(out) {}
+
+    template <typename T> void put(T value) {
+        char bytes[sizeof(T)];
+        qToLittleEndian<T>(value, bytes);
+        m_out->append(bytes, int(sizeof(T)));
+    }
+    void putVarint(quint64 value) {
+        while (value >= 0x80) {
+            m_out->append(char(value | 0x80));
+            value >>= 7;
+        }
+        m_out->append(char(value));
+    }
+    void putSigned(qint64 value) {
+        putVarint((quint64(value) << 1) ^ quint64(value >> 63));
+    }
+
+private:
+    QByteArray *m_out;
+};
+
+// ok() turns false on reading past the end or an over-long varint
+class Reader {
+public:
+    Reader(const char *data, int size) : m_data(data), m_size(size) {}
+
+    template <typename T> T get() {
+        if (m_pos + int(sizeof(T)) > m_size) {
+            m_ok = false;
+            return T();
+        }
+        const T value = qFromLittleEndian<T>(m_data + m_pos);
+        m_pos += int(sizeof(T));
+        return value;
+    }
+    quint64 getVarint() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_pos >= m_size) break;
+            const quint8 byte = quint8(m_data[m_pos++]);
+            value |= quint64(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        m_ok = false;
+        return 0;
+    }
+    qint64 getSigned() {
+        const quint64 value = getVarint();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+    QByteArray rest() {
+        const QByteArray bytes(m_data + m_pos, m_size - m_pos);
+        m_pos = m_size;
+        return bytes;
+    }
+    bool atEnd() const { return m_pos == m_size; }
+    bool ok() const { return m_ok; }
+
+private:
+    const char *m_data;
+    int m_size;
+    int m_pos = 0;
+    bool m_ok = true;
+};
+
+// Wire units
+const double kMinuteScale = 60.0;     // Sensor time in seconds
+const double kGlucoseScale = 100.0;   // 0.01 mmol/L
+const double kUnitsScale = 1000.0;    // 0.001 u
+
+// Values the next record is stored relative to; starts from zero in every batch
+struct DeltaState {
+    quint32 sequence = 0;
+    qint64 timeMs = 0;
+    qint64 second = 0;
+    qint64 centiMmol = 0;
+};
+
+QByteArray failure(const QString &reason) {
+    return HistoryProtocol::frame(HistoryProtocol::Failure, reason.toUtf8());
+}
+
+// Runs one device's sync on a pool thread
+class SyncJob : public QRunnable {
+public:
+    SyncJob(const QString &serverName, const QString &serial, quint32 cursor, int batchRecords,
+            HistorySyncClient::Result *result)
+        : m_serverName(serverName), m_serial(serial), m_cursor(cursor), m_batchRecords(batchRecords),
+          m_result(result) {}
+
+    void run() override {
+        *m_result = HistorySyncClient::sync(m_serverName, m_serial, m_cursor, m_batchRecords);
+    }
+
+private:
+    QString m_serverName;
+    QString m_serial;
+    quint32 m_cursor;
+    int m_batchRecords;
+    HistorySyncClient::Result *m_result;
+};
+
+}
+
+bool HistoryRecord::fromJournal(const JournalEvent &event, HistoryRecord *record) {
+    record->sequence = event.sequence;
+    record->timeMs = event.timeMs;
+    record->code = 0;
+    record->a = event.a;
+    record->b = 0.0;
+
+    switch (event.type) {
+    case JournalEvent::CgmReading:
+        record->type = Reading;
+        record->b = event.b;
+        return true;
+    case JournalEvent::BolusStarted:
+    case JournalEvent::BolusInterrupted:
+        record->b = event.b;
+        // Fall through
+    case JournalEvent::BolusCancelled:
+        record->type = Bolus;
+        record->code = quint8(event.type);
+        return true;
+    case JournalEvent::CgmAlert:
+        record->type = Alert;
+        record->code = event.flag;
+        return true;
+    default:
+        return false;
+    }
+}
+
+QByteArray HistoryProtocol::frame(FrameType type, const QByteArray &payload) {
+    QByteArray body;
+    body.reserve(payload.size() + 1);
+    body.append(char(type));
+    body.append(payload);
+
+    QByteArray out;
+    out.reserve(body.size() + 6);
+    Writer writer(&out);
+    writer.put(quint32(body.size()));
+    out.append(body);
+    writer.put(qChecksum(body.constData(), uint(body.size())));
+    return out;
+}
+
+bool HistoryProtocol::takeFrame(QByteArray *buffer, FrameType *type, QByteArray *payload, QString *error) {
+    if (buffer->size() < 4) return false;
+    const quint32 length = qFromLittleEndian<quint32>(buffer->constData());
+    if (length < 1 || length > quint32(kMaxFrameBytes)) {
+        *error = QString("bad frame length %1").arg(length);
+        return false;
+    }
+    const int total = 4 + int(length) + 2;
+    if (buffer->size() < total) return false;
+
+    const char *body = buffer->constData() + 4;
+    if (qFromLittleEndian<quint16>(body + length) != qChecksum(body, length)) {
+        *error = "frame checksum mismatch";
+        return false;
+    }
+    const quint8 frameType = quint8(body[0]);
+    if (frameType > Failure) {
+        *error = QString("unknown frame type %1").arg(frameType);
+        return false;
+    }
+    *type = FrameType(frameType);
+    *payload = QByteArray(body + 1, int(length) - 1);
+    buffer->remove(0, total);
+    return true;
+}
+
+QByteArray HistoryProtocol::encodeBatch(const HistoryRecord *records, int count, quint32 cursor) {
+    QByteArray payload;
+    payload.reserve(6 + count * 10);
+    Writer out(&payload);
+    out.put(cursor);
+    out.put(quint16(count));
+
+    DeltaState last;
+    for (int i = 0; i < count; ++i) {
+        const HistoryRecord &record = records[i];
+        out.putVarint(record.sequence - last.sequence);
+        out.putSigned(record.timeMs - last.timeMs);
+        payload.append(char(record.type | (record.code << 2)));
+        last.sequence = record.sequence;
+        last.timeMs = record.timeMs;
+
+        switch (record.type) {
+        case HistoryRecord::Reading: {
+            const qint64 second = qRound64(record.a * kMinuteScale);
+            const qint64 centiMmol = qRound64(record.b * kGlucoseScale);
+            out.putSigned(second - last.second);
+            out.putSigned(centiMmol - last.centiMmol);
+            last.second = second;
+            last.centiMmol = centiMmol;
+            break;
+        }
+        case HistoryRecord::Bolus:
+            out.putSigned(qRound64(record.a * kUnitsScale));
+            out.putSigned(qRound64(record.b * kUnitsScale));
+            break;
+        case HistoryRecord::Alert:
+            out.putSigned(qRound64(record.a * kGlucoseScale) - last.centiMmol);
+            break;
+        }
+    }
+    return payload;
+}
+
+bool HistoryProtocol::decodeBatch(const QByteArray &payload, QVector<HistoryRecord> *records, quint32 *cursor) {
+    Reader in(payload.constData(), payload.size());
+    const quint32 batchCursor = in.get<quint32>();
+    const int count = in.get<quint16>();
+    if (!in.ok()) return false;
+
+    const int first = records->size();
+    records->reserve(first + count);
+    DeltaState last;
+    for (int i = 0; i < count && in.ok(); ++i) {
+        HistoryRecord record;
+        record.sequence = last.sequence + quint32(in.getVarint());
+        record.timeMs = last.timeMs + in.getSigned();
+        const quint8 tag = in.get<quint8>();
+        record.type = HistoryRecord::Type(tag & 3);
+        record.code = tag >> 2;
+        last.sequence = record.sequence;
+        last.timeMs = record.timeMs;
+
+        switch (record.type) {
+        case HistoryRecord::Reading:
+            last.second += in.getSigned();
+            last.centiMmol += in.getSigned();
+            record.a = last.second / kMinuteScale;
+            record.b = last.centiMmol / kGlucoseScale;
+            break;
+        case HistoryRecord::Bolus:
+            record.a = in.getSigned() / kUnitsScale;
+            record.b = in.getSigned() / kUnitsScale;
+            break;
+        case HistoryRecord::Alert:
+            record.a = (last.centiMmol + in.getSigned()) / kGlucoseScale;
+            break;
+        default:
+            records->resize(first);
+            return false;
+        }
+        records->append(record);
+    }
+    if (!in.ok() || !in.atEnd()) {
+        records->resize(first);
+        return false;
+    }
+    *cursor = batchCursor;
+    return true;
+}
+
+bool DeviceHistory::loadJournal(const QString &directory, QString *error) {
+    QVector<JournalEvent> events;
+    if (!PumpJournal::readEvents(directory, &events, error)) return false;
+
+    if (serial.isEmpty()) {
+        serial = QFileInfo(directory).fileName();
+    }
+    records.clear();
+    records.reserve(events.size());
+    HistoryRecord record;
+    for (const JournalEvent &event : events) {
+        if (HistoryRecord::fromJournal(event, &record)) {
+            records.append(record);
+        }
+    }
+    return true;
+}
+
+int DeviceHistory::indexAfter(quint32 cursor) const {
+    const auto it = std::upper_bound(records.begin(), records.end(), cursor,
+                                     [](quint32 value, const HistoryRecord &record) { return value < record.sequence; });
+    return int(it - records.begin());
+}
+
+HistoryDeviceServer::HistoryDeviceServer(QObject *parent)
+    : QObject(parent),
+      m_server(this)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &HistoryDeviceServer::acceptConnections);
+}
+
+void HistoryDeviceServer::addDevice(const DeviceHistory &device) {
+    m_devices.append(device);
+}
+
+bool HistoryDeviceServer::listen(const QString &name, QString *error) {
+    QLocalServer::removeServer(name);
+    if (!m_server.listen(name)) {
+        *error = QString("cannot listen on %1: %2").arg(name, m_server.errorString());
+        return false;
+    }
+    return true;
+}
+
+void HistoryDeviceServer::close() {
+    m_server.close();
+}
+
+void HistoryDeviceServer::acceptConnections() {
+    while (QLocalSocket *client = m_server.nextPendingConnection()) {
+        connect(client, &QLocalSocket::readyRead, this, &HistoryDeviceServer::handleRequests);
+        connect(client, &QLocalSocket::disconnected, client, &QLocalSocket::deleteLater);
+    }
+}
+
+// Partial requests stay in the socket until the whole frame has arrived
+void HistoryDeviceServer::handleRequests() {
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    if (!client) return;
+
+    while (client->bytesAvailable() >= 4) {
+        const QByteArray head = client->peek(4);
+        const quint32 length = qFromLittleEndian<quint32>(head.constData());
+        if (length < 1 || length > quint32(HistoryProtocol::kMaxFrameBytes)) {
+            client->write(failure("bad frame length"));
+            client->disconnectFromServer();
+            return;
+        }
+        if (client->bytesAvailable() < 4 + qint64(length) + 2) return;
+
+        QByteArray buffer = client->read(4 + qint64(length) + 2);
+        HistoryProtocol::FrameType type;
+        QByteArray payload;
+        QString error;
+        if (!HistoryProtocol::takeFrame(&buffer, &type, &payload, &error)) {
+            client->write(failure(error));
+            client->disconnectFromServer();
+            return;
+        }
+        client->write(type == HistoryProtocol::Request ? respond(payload) : failure("expected a request"));
+    }
+}
+
+QByteArray HistoryDeviceServer::respond(const QByteArray &request) const {
+    Reader in(request.constData(), request.size());
+    const quint16 version = in.get<quint16>();
+    const quint32 cursor = in.get<quint32>();
+    const int batchRecords = qMin(int(in.get<quint16>()), HistoryProtocol::kMaxBatchRecords);
+    const QString serial = QString::fromUtf8(in.rest());
+    if (!in.ok() || batchRecords == 0) return failure("malformed request");
+    if (version != HistoryProtocol::kVersion) return failure(QString("unsupported version %1").arg(version));
+
+    const DeviceHistory *device = nullptr;
+    for (const DeviceHistory &candidate : m_devices) {
+        if (serial.isEmpty() || candidate.serial == serial) {
+            device = &candidate;
+            break;
+        }
+    }
+    if (!device) return failure(QString("no device %1").arg(serial));
+
+    QByteArray response;
+    quint32 sentCursor = cursor;
+    for (int i = device->indexAfter(cursor); i < device->records.size(); i += batchRecords) {
+        const int count = qMin(batchRecords, device->records.size() - i);
+        sentCursor = device->records[i + count - 1].sequence;
+        response.append(HistoryProtocol::frame(HistoryProtocol::Batch,
+                                               HistoryProtocol::encodeBatch(&device->records[i], count, sentCursor)));
+    }
+
+    QByteArray done;
+    Writer out(&done);
+    out.put(sentCursor);
+    out.put(device->records.isEmpty() ? quint32(0) : device->records.last().sequence);
+    response.append(HistoryProtocol::frame(HistoryProtocol::Done, done));
+    return response;
+}
+
+HistorySyncClient::Result HistorySyncClient::sync(const QString &serverName, const QString &serial,
+                                                  quint32 cursor, int batchRecords) {
+    QElapsedTimer timer;
+    timer.start();
+    Result result;
+    result.serial = serial;
+    result.cursor = cursor;
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (!socket.waitForConnected(kTimeoutMs)) {
+        result.error = QString("cannot connect to %1: %2").arg(serverName, socket.errorString());
+        return result;
+    }
+
+    QByteArray request;
+    Writer out(&request);
+    out.put(HistoryProtocol::kVersion);
+    out.put(cursor);
+    out.put(quint16(qBound(1, batchRecords, HistoryProtocol::kMaxBatchRecords)));
+    request.append(serial.toUtf8());
+    socket.write(HistoryProtocol::frame(HistoryProtocol::Request, request));
+
+    QByteArray buffer;
+    HistoryProtocol::FrameType type;
+    QByteArray payload;
+    for (;;) {
+        if (!HistoryProtocol::takeFrame(&buffer, &type, &payload, &result.error)) {
+            if (!result.error.isEmpty()) break;
+            if (!socket.waitForReadyRead(kTimeoutMs)) {
+                result.error = QString("sync stopped: %1").arg(socket.errorString());
+                break;
+            }
+            const QByteArray received = socket.readAll();
+            result.wireBytes += received.size();
+            buffer.append(received);
+            continue;
+        }
+
+        if (type == HistoryProtocol::Batch) {
+            quint32 batchCursor = 0;
+            if (!HistoryProtocol::decodeBatch(payload, &result.records, &batchCursor)) {
+                result.error = "malformed batch";
+                break;
+            }
+            result.cursor = batchCursor;
+            result.batches++;
+        } else if (type == HistoryProtocol::Done) {
+            Reader in(payload.constData(), payload.size());
+            const quint32 doneCursor = in.get<quint32>();
+            result.deviceSequence = in.get<quint32>();
+            if (!in.ok()) {
+                result.error = "malformed done";
+            } else if (doneCursor != result.cursor) {
+                result.error = QString("device ended at %1, batches at %2").arg(doneCursor).arg(result.cursor);
+            }
+            break;
+        } else if (type == HistoryProtocol::Failure) {
+            result.error = QString("device: %1").arg(QString::fromUtf8(payload));
+            break;
+        } else {
+            result.error = QString("unexpected frame %1").arg(int(type));
+            break;
+        }
+    }
+    socket.disconnectFromServer();
+    result.elapsedUs = timer.nsecsElapsed() / 1000;
+    return result;
+}
+
+QVector<HistorySyncClient::Result> HistorySyncClient::syncAll(const QString &serverName, const QStringList &serials,
+                                                              const QVector<quint32> &cursors, int threads,
+                                                              int batchRecords) {
+    QVector<Result> results(serials.size());
+
+    QThreadPool pool;
+    if (threads > 0) {
+        pool.setMaxThreadCount(threads);
+    }
+    for (int i = 0; i < serials.size(); ++i) {
+        pool.start(new SyncJob(serverName, serials[i], i < cursors.size() ? cursors[i] : 0, batchRecords,
+                               &results[i]));
+    }
+    pool.waitForDone();
+    return results;
+}
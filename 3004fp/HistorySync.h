@@ -0,0 +1,141 @@
+#ifndef HISTORYSYNC_H
+#define HISTORYSYNC_H
+
+#include <QByteArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+#include "PumpJournal.h"
+
+// One entry of a pump's uploadable history. Taken from the journal, so the
+// journal sequence doubles as the sync cursor.
+struct HistoryRecord {
+    enum Type : quint8 {
+        Reading,        // a = sensor minute, b = mmol/L
+        Bolus,          // code = JournalEvent::Type (started, cancelled, interrupted); a = units, b = extended units
+        Alert           // code = 0 cleared, 1 low, 2 high; a = filtered mmol/L
+    };
+
+    quint32 sequence = 0;
+    qint64 timeMs = 0;
+    Type type = Reading;
+    quint8 code = 0;
+    double a = 0.0;
+    double b = 0.0;
+
+    // False for journal events that are not part of the history (battery, basal, settings)
+    static bool fromJournal(const JournalEvent &event, HistoryRecord *record);
+};
+
+// Framing and record coding shared by the device and the host.
+//
+// Every frame is
+//   u32 body length | u8 frame type | payload | u16 CRC-16 of type and payload
+// with integers little-endian. A Batch payload is
+//   u32 cursor after the batch | u16 record count | records
+// and each record is stored as varint deltas from the previous record in
+// the same batch (sequence, time, sensor minute, glucose), so a batch decodes
+// on its own and a typical 5-minute reading takes about 6 bytes instead of 48.
+// Resolution on the wire: glucose 0.01 mmol/L, sensor time 1 s, insulin 0.001 u.
+namespace HistoryProtocol {
+    enum FrameType : quint8 {
+        Request,        // Host: u16 version, u32 cursor, u16 batch size, UTF-8 device serial
+        Batch,          // Device: records after the cursor
+        Done,           // Device: u32 cursor, u32 device's latest sequence
+        Failure         // Device: UTF-8 reason
+    };
+
+    const quint16 kVersion = 1;
+    const int kMaxFrameBytes = 1 << 20;
+    const int kDefaultBatchRecords = 4096;
+    const int kMaxRecordBytes = 36;      // Sequence 5, time 10, type 1, two values 10 each
+    // Largest batch whose frame is sure to fit in kMaxFrameBytes; larger requests are cut to it
+    const int kMaxBatchRecords = (kMaxFrameBytes - 1 - 6) / kMaxRecordBytes;
+
+    QByteArray frame(FrameType type, const QByteArray &payload);
+
+    // Takes one complete frame off the front of 'buffer'. Returns false if
+    // more bytes are needed; 'error' is set if the stream is corrupt.
+    bool takeFrame(QByteArray *buffer, FrameType *type, QByteArray *payload, QString *error);
+
+    // 'count' records starting at 'records' as a Batch payload
+    QByteArray encodeBatch(const HistoryRecord *records, int count, quint32 cursor);
+    bool decodeBatch(const QByteArray &payload, QVector<HistoryRecord> *records, quint32 *cursor);
+}
+
+// History one emulated device can upload, oldest first
+struct DeviceHistory {
+    QString serial;
+    QVector<HistoryRecord> records;
+
+    // Every history record in a journal directory
+    bool loadJournal(const QString &directory, QString *error);
+
+    // Index of the first record after 'cursor'
+    int indexAfter(quint32 cursor) const;
+};
+
+// Stand-in for pumps answering history uploads over a local socket.
+//
+// One server hosts any number of devices, picked by serial in the request.
+// Each request is answered with Batch frames from the cursor to the end of
+// the history and a closing Done frame, all queued in one write so a
+// connection never waits on another.
+class HistoryDeviceServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit HistoryDeviceServer(QObject *parent = nullptr);
+
+    // Serials must be unique; an empty serial in a request picks the first device
+    void addDevice(const DeviceHistory &device);
+    int deviceCount() const { return m_devices.size(); }
+
+    bool listen(const QString &name, QString *error);
+    void close();
+
+private slots:
+    void acceptConnections();
+    void handleRequests();
+
+private:
+    QByteArray respond(const QByteArray &request) const;
+
+    QLocalServer m_server;
+    QVector<DeviceHistory> m_devices;
+};
+
+// Host side: downloads a device's history from a cursor.
+//
+// Records arrive batch by batch, and the cursor only moves past complete,
+// checksummed batches, so a sync cut short keeps what it got and the next
+// sync from the returned cursor picks up where it stopped.
+class HistorySyncClient {
+public:
+    struct Result {
+        QString serial;
+        quint32 cursor = 0;            // Pass to the next sync
+        quint32 deviceSequence = 0;    // Device's latest sequence (0 if the sync did not finish)
+        int batches = 0;
+        qint64 wireBytes = 0;
+        qint64 elapsedUs = 0;
+        QString error;                 // Empty on success
+        QVector<HistoryRecord> records;
+    };
+
+    static const int kTimeoutMs = 5000;
+
+    static Result sync(const QString &serverName, const QString &serial, quint32 cursor,
+                       int batchRecords = HistoryProtocol::kDefaultBatchRecords);
+
+    // Syncs several devices of one server in parallel; results in input order
+    static QVector<Result> syncAll(const QString &serverName, const QStringList &serials,
+                                   const QVector<quint32> &cursors, int threads = 0,
+                                   int batchRecords = HistoryProtocol::kDefaultBatchRecords);
+};
+
+#endif // HISTORYSYNC_H
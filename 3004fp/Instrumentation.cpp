@@ -0,0 +1,258 @@
+#include "Instrumentation.h"
+#include <QFile>
+#include <QByteArray>
+#include <QDebug>
+#include <QtAlgorithms>
+#include <mutex>
+#include <vector>
+
+namespace Instrumentation {
+
+std::atomic<bool> g_enabled(false);
+std::atomic<bool> g_traceEnabled(false);
+
+namespace {
+const int kMaxSites = 128;                 // Distinct instrumented call sites
+const size_t kMaxTraceEvents = 1000000;    // Trace buffer cap (~32 MB)
+
+struct TraceEvent {
+    const char *name;
+    int64_t startNs;
+    int64_t durationNs;
+    int threadId;
+};
+
+struct Registry {
+    std::mutex mutex;
+    SpanSite *sites[kMaxSites];
+    int siteCount = 0;
+
+    std::mutex traceMutex;
+    std::vector<TraceEvent> events;
+    int64_t traceOriginNs = 0;
+    QString tracePath;
+};
+
+Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+
+// Small stable id per thread for the trace "tid" field
+int currentThreadId() {
+    static std::atomic<int> nextId(1);
+    thread_local int id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+double toMicros(int64_t ns) {
+    return ns / 1000.0;
+}
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+// Maps a value to its log-linear bucket: exact below 128 ns, then 64 sub-buckets per doubling
+int LatencyHistogram::bucketIndex(int64_t valueNs) {
+    if (valueNs < 0) valueNs = 0;
+    if (valueNs < kLinearLimit) {
+        return static_cast<int>(valueNs);
+    }
+
+    int msb = 63 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(valueNs)));
+    int shift = msb - kSubBucketBits;
+    if (shift > kMagnitudes) {
+        return kBucketCount - 1;
+    }
+    int sub = static_cast<int>(valueNs >> shift);   // In [64, 127]
+    return kLinearLimit + (shift - 1) * (1 << kSubBucketBits) + (sub - (1 << kSubBucketBits));
+}
+
+int64_t LatencyHistogram::bucketValue(int index) {
+    if (index < kLinearLimit) {
+        return index;
+    }
+    int offset = index - kLinearLimit;
+    int shift = offset / (1 << kSubBucketBits) + 1;
+    int64_t sub = offset % (1 << kSubBucketBits) + (1 << kSubBucketBits);
+    return (sub << shift) + (int64_t(1) << shift) / 2;
+}
+
+void LatencyHistogram::record(int64_t valueNs) {
+    m_buckets[bucketIndex(valueNs)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(valueNs, std::memory_order_relaxed);
+
+    int64_t currentMax = m_max.load(std::memory_order_relaxed);
+    while (valueNs > currentMax
+           && !m_max.compare_exchange_weak(currentMax, valueNs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double percent) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return qMin(bucketValue(i), maxValue());
+        }
+    }
+    return maxValue();
+}
+
+SpanSite::SpanSite(const char *name) : m_name(name) {
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.siteCount < kMaxSites) {
+        reg.sites[reg.siteCount++] = this;
+    }
+}
+
+void setEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void setTraceEnabled(bool enabled) {
+    Registry &reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.traceMutex);
+        if (enabled && reg.traceOriginNs == 0) {
+            reg.traceOriginNs = nowNs();
+        }
+    }
+    g_traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void recordTraceEvent(const char *name, int64_t startNs, int64_t durationNs) {
+    int threadId = currentThreadId();
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.traceMutex);
+    if (reg.events.size() < kMaxTraceEvents) {
+        reg.events.push_back({name, startNs, durationNs, threadId});
+    }
+}
+
+// PUMP_PROFILE=1 turns on histograms; PUMP_TRACE=file.json also collects trace events
+void configureFromEnvironment() {
+    QByteArray profile = qgetenv("PUMP_PROFILE");
+    QByteArray trace = qgetenv("PUMP_TRACE");
+
+    if (!profile.isEmpty() && profile != "0") {
+        setEnabled(true);
+    }
+    if (!trace.isEmpty()) {
+        registry().tracePath = QString::fromLocal8Bit(trace);
+        setEnabled(true);
+        setTraceEnabled(true);
+    }
+}
+
+QString summary() {
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    QString text = QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+        .arg("span", -36).arg("count", 10).arg("mean us", 10).arg("p50 us", 10)
+        .arg("p90 us", 10).arg("p99 us", 10).arg("p99.9 us", 10).arg("max us", 10);
+
+    for (int i = 0; i < reg.siteCount; ++i) {
+        const LatencyHistogram &h = reg.sites[i]->histogram();
+        if (h.count() == 0) continue;
+
+        text += QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+            .arg(reg.sites[i]->name(), -36)
+            .arg(static_cast<qulonglong>(h.count()), 10)
+            .arg(toMicros(static_cast<int64_t>(h.mean())), 10, 'f', 2)
+            .arg(toMicros(h.percentile(50.0)), 10, 'f', 2)
+            .arg(toMicros(h.percentile(90.0)), 10, 'f', 2)
+            .arg(toMicros(h.percentile(99.0)), 10, 'f', 2)
+            .arg(toMicros(h.percentile(99.9)), 10, 'f', 2)
+            .arg(toMicros(h.maxValue()), 10, 'f', 2);
+    }
+    return text;
+}
+
+void shutdown() {
+    if (!isEnabled()) return;
+
+    qInfo().noquote() << "[Instrumentation] Latency summary:\n" + summary();
+
+    QString path = registry().tracePath;
+    if (!path.isEmpty()) {
+        if (writeChromeTrace(path)) {
+            qInfo() << "[Instrumentation] Trace written to" << path;
+        } else {
+            qWarning() << "[Instrumentation] Could not write trace to" << path;
+        }
+    }
+}
+
+bool writeChromeTrace(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.traceMutex);
+
+    QByteArray json;
+    json.reserve(static_cast<int>(reg.events.size()) * 96 + 64);
+    json += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < reg.events.size(); ++i) {
+        const TraceEvent &event = reg.events[i];
+        if (i) json += ',';
+        json += "{\"name\":\"";
+        json += event.name;
+        json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+        json += QByteArray::number(event.threadId);
+        json += ",\"ts\":";
+        json += QByteArray::number(toMicros(event.startNs - reg.traceOriginNs), 'f', 3);
+        json += ",\"dur\":";
+        json += QByteArray::number(toMicros(event.durationNs), 'f', 3);
+        json += '}';
+    }
+    json += "]}\n";
+
+    return file.write(json) == json.size();
+}
+
+void reset() {
+    Registry &reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (int i = 0; i < reg.siteCount; ++i) {
+            reg.sites[i]->histogram().reset();
+        }
+    }
+    std::lock_guard<std::mutex> lock(reg.traceMutex);
+    reg.events.clear();
+    reg.traceOriginNs = g_traceEnabled.load() ? nowNs() : 0;
+}
+
+} // namespace Instrumentation
+
+Q_LOGGING_CATEGORY(lcTick, "pump.tick", QtInfoMsg)
@@ -0,0 +1,141 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <QLoggingCategory>
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Hot-path latency instrumentation.
+//
+//   void CGMManager::predictGlucoseLevels(...) {
+//       PUMP_TRACE_SCOPE("cgm.predictGlucoseLevels");
+//       ...
+//   }
+//
+// Each call site owns a log-linear (HDR-style, ~1.5% resolution) latency
+// histogram. When profiling is off a scope costs one relaxed atomic load.
+// Optionally every span is also kept as a Chrome/Perfetto trace event.
+// Define PUMP_NO_INSTRUMENTATION to compile all scopes out.
+
+namespace Instrumentation {
+
+// Latency histogram with lock-free recording from any thread
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 6;                       // 64 sub-buckets per power of two
+    static const int kLinearLimit = 2 << kSubBucketBits;       // Values below this are exact
+    static const int kMagnitudes = 40;                         // Up to ~2^46 ns
+    static const int kBucketCount = kLinearLimit + kMagnitudes * (1 << kSubBucketBits);
+
+    LatencyHistogram();
+
+    void record(int64_t valueNs);
+    void reset();
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    int64_t maxValue() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    // Value at the given percentile (0-100), in ns
+    int64_t percentile(double percent) const;
+
+    static int bucketIndex(int64_t valueNs);
+    static int64_t bucketValue(int index);    // Representative (midpoint) value
+
+private:
+    std::atomic<uint64_t> m_buckets[kBucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<int64_t> m_sum;
+    std::atomic<int64_t> m_max;
+};
+
+// One instrumented call site; registers itself on first use
+class SpanSite {
+public:
+    explicit SpanSite(const char *name);
+
+    const char *name() const { return m_name; }
+    LatencyHistogram &histogram() { return m_histogram; }
+
+private:
+    const char *m_name;
+    LatencyHistogram m_histogram;
+};
+
+// Runtime toggles
+void setEnabled(bool enabled);
+void setTraceEnabled(bool enabled);
+
+extern std::atomic<bool> g_enabled;
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool isEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds a completed span to the trace buffer (only while tracing is enabled)
+void recordTraceEvent(const char *name, int64_t startNs, int64_t durationNs);
+
+// Configure from PUMP_PROFILE=1 and PUMP_TRACE=<file.json>
+void configureFromEnvironment();
+
+// Per-span count/mean/p50/p90/p99/p99.9/max table
+QString summary();
+
+// Log summary() and write the trace file if PUMP_TRACE was set
+void shutdown();
+
+// Write collected events as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+bool writeChromeTrace(const QString &path);
+
+// Clear all histograms and trace events
+void reset();
+
+// RAII timer for one span
+class ScopedSpan {
+public:
+    explicit ScopedSpan(SpanSite &site)
+        : m_site(isEnabled() ? &site : nullptr),
+          m_start(m_site ? nowNs() : 0) {}
+
+    ~ScopedSpan() {
+        if (m_site) {
+            int64_t duration = nowNs() - m_start;
+            m_site->histogram().record(duration);
+            if (g_traceEnabled.load(std::memory_order_relaxed)) {
+                recordTraceEvent(m_site->name(), m_start, duration);
+            }
+        }
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    SpanSite *m_site;
+    int64_t m_start;
+};
+
+} // namespace Instrumentation
+
+#define PUMP_TRACE_CONCAT_INNER(a, b) a##b
+#define PUMP_TRACE_CONCAT(a, b) PUMP_TRACE_CONCAT_INNER(a, b)
+
+#ifdef PUMP_NO_INSTRUMENTATION
+#define PUMP_TRACE_SCOPE(name) do {} while (0)
+#else
+#define PUMP_TRACE_SCOPE(name) \
+    static Instrumentation::SpanSite PUMP_TRACE_CONCAT(pumpSpanSite_, __LINE__)(name); \
+    Instrumentation::ScopedSpan PUMP_TRACE_CONCAT(pumpSpan_, __LINE__)(PUMP_TRACE_CONCAT(pumpSpanSite_, __LINE__))
+#endif
+
+// Per-tick diagnostics (readings, decisions, basal changes). Off by default so a
+// steady tick builds no message text; QT_LOGGING_RULES="pump.tick.debug=true" shows them.
+Q_DECLARE_LOGGING_CATEGORY(lcTick)
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,76 @@
+#ifndef INSULINUNITS_H
+#define INSULINUNITS_H
+
+#include <QtGlobal>
+#include <cmath>
+
+// An amount of insulin in whole thousandths of a unit (ticks).
+//
+// Doses, deliveries and the reservoir are kept in this type so sums are
+// exact and fractions of a unit are never truncated away. Arithmetic
+// saturates at the 32-bit range (about ±2.1 million u) instead of wrapping.
+// The pump moves insulin in steps of kPumpStepTicks (0.05 u); toPumpStep()
+// is the part of an amount it can deliver without exceeding it.
+class InsulinUnits {
+public:
+    static const qint32 kTicksPerUnit = 1000;
+    static const qint32 kPumpStepTicks = 50;
+
+    InsulinUnits() : m_ticks(0) {}
+
+    static InsulinUnits fromTicks(qint64 ticks) { return InsulinUnits(saturate(ticks)); }
+    static InsulinUnits fromWholeUnits(int units) { return fromTicks(qint64(units) * kTicksPerUnit); }
+
+    // Nearest tick, halves away from zero; NaN is zero
+    static InsulinUnits fromUnits(double units) {
+        if (std::isnan(units)) return InsulinUnits();
+        const double ticks = std::round(units * kTicksPerUnit);
+        if (ticks >= 2147483647.0) return InsulinUnits(2147483647);
+        if (ticks <= -2147483647.0) return InsulinUnits(-2147483647);
+        return InsulinUnits(qint32(ticks));
+    }
+
+    qint32 ticks() const { return m_ticks; }
+    double toUnits() const { return double(m_ticks) / kTicksPerUnit; }
+    int wholeUnits() const { return m_ticks / kTicksPerUnit; }      // Toward zero
+    bool isZero() const { return m_ticks == 0; }
+
+    // Toward zero to the pump step
+    InsulinUnits toPumpStep() const { return InsulinUnits(m_ticks - m_ticks % kPumpStepTicks); }
+
+    // Nearest pump step, halves away from zero
+    InsulinUnits roundedToPumpStep() const {
+        const qint64 half = m_ticks < 0 ? -kPumpStepTicks / 2 : kPumpStepTicks / 2;
+        const qint64 shifted = qint64(m_ticks) + half;
+        return fromTicks(shifted - shifted % kPumpStepTicks);
+    }
+
+    // This amount times a factor, to the nearest tick (e.g. the immediate share of a split bolus)
+    InsulinUnits scaled(double factor) const { return fromUnits(toUnits() * factor); }
+
+    InsulinUnits operator+(InsulinUnits other) const { return fromTicks(qint64(m_ticks) + other.m_ticks); }
+    InsulinUnits operator-(InsulinUnits other) const { return fromTicks(qint64(m_ticks) - other.m_ticks); }
+    InsulinUnits operator-() const { return fromTicks(-qint64(m_ticks)); }
+    InsulinUnits operator*(int factor) const { return fromTicks(qint64(m_ticks) * factor); }
+    InsulinUnits &operator+=(InsulinUnits other) { return *this = *this + other; }
+    InsulinUnits &operator-=(InsulinUnits other) { return *this = *this - other; }
+
+    bool operator==(InsulinUnits other) const { return m_ticks == other.m_ticks; }
+    bool operator!=(InsulinUnits other) const { return m_ticks != other.m_ticks; }
+    bool operator<(InsulinUnits other) const { return m_ticks < other.m_ticks; }
+    bool operator<=(InsulinUnits other) const { return m_ticks <= other.m_ticks; }
+    bool operator>(InsulinUnits other) const { return m_ticks > other.m_ticks; }
+    bool operator>=(InsulinUnits other) const { return m_ticks >= other.m_ticks; }
+
+private:
+    explicit InsulinUnits(qint32 ticks) : m_ticks(ticks) {}
+
+    // Symmetric, so negating a saturated amount stays in range
+    static qint32 saturate(qint64 ticks) {
+        return ticks > 2147483647 ? 2147483647 : ticks < -2147483647 ? -2147483647 : qint32(ticks);
+    }
+
+    qint32 m_ticks;
+};
+
+#endif // INSULINUNITS_H
@@ -0,0 +1,214 @@
+#include "MpcBasalController.h"
+#include <QtMath>
+#include <cmath>
+
+namespace {
+// Move-block lengths in steps; they sum to kHorizon
+const int kBlockSteps[MpcBasalController::kBlocks] = { 1, 1, 2, 4, 8, 14 };
+
+// Fraction of a subcutaneous dose that has acted after t minutes
+// (two-compartment absorption with time-to-peak tau)
+double actedFraction(double t, double tau) {
+    return 1.0 - (1.0 + t / tau) * std::exp(-t / tau);
+}
+}
+
+MpcBasalController::MpcBasalController() {
+    precompute();
+}
+
+void MpcBasalController::setSettings(const Settings &settings) {
+    m_settings = settings;
+    precompute();
+    m_plans.clear();
+}
+
+// Builds everything that does not depend on the current reading
+void MpcBasalController::precompute() {
+    const double tauI = m_settings.insulinActionMinutes;
+
+    m_blockStart[0] = 0;
+    for (int j = 0; j < kBlocks; ++j) {
+        m_blockStart[j + 1] = m_blockStart[j] + kBlockSteps[j];
+    }
+
+    // BG change at step k (ISF = 1) from 1 u/h held from step 0: each step
+    // delivers 1/12 u, which has partly acted by the end of step k
+    double unitStep[kHorizon + 1];
+    unitStep[0] = 0.0;
+    for (int k = 1; k <= kHorizon; ++k) {
+        double acted = 0.0;
+        for (int m = 0; m < k; ++m) {
+            acted += actedFraction((k - m) * kStepMinutes, tauI);
+        }
+        unitStep[k] = -acted / 12.0;
+    }
+
+    // Block j applies from its start to its end, i.e. a step up minus a delayed step down
+    for (int k = 0; k < kHorizon; ++k) {
+        int step = k + 1;   // Prediction k is at the end of step k
+        for (int j = 0; j < kBlocks; ++j) {
+            int sinceStart = step - m_blockStart[j];
+            int sinceEnd = step - m_blockStart[j + 1];
+            double up = sinceStart > 0 ? unitStep[sinceStart] : 0.0;
+            double down = sinceEnd > 0 ? unitStep[sinceEnd] : 0.0;
+            m_response[k][j] = up - down;
+        }
+        m_insulinDecay[k] = actedFraction(step * kStepMinutes, tauI);
+        m_carbDecay[k] = actedFraction(step * kStepMinutes, m_settings.carbAbsorptionMinutes);
+    }
+
+    for (int a = 0; a < kBlocks; ++a) {
+        for (int b = 0; b < kBlocks; ++b) {
+            double sum = 0.0;
+            for (int k = 0; k < kHorizon; ++k) {
+                sum += m_response[k][a] * m_response[k][b];
+            }
+            m_responseGram[a][b] = sum;
+            m_smoothing[a][b] = 0.0;
+        }
+    }
+
+    // (v_0 - v_prev)^2 + sum (v_j - v_j-1)^2; the v_prev part of the first term is linear
+    m_smoothing[0][0] += 1.0;
+    for (int j = 1; j < kBlocks; ++j) {
+        m_smoothing[j][j] += 1.0;
+        m_smoothing[j - 1][j - 1] += 1.0;
+        m_smoothing[j][j - 1] -= 1.0;
+        m_smoothing[j - 1][j] -= 1.0;
+    }
+}
+
+// BG trajectory if basal stays at the programmed rate
+void MpcBasalController::freeResponse(double glucose, double insulinOnBoard, double carbsOnBoard,
+                                      const SimInputs &inputs, double *response) const {
+    double isf = inputs.correctionFactor;
+    double carbSensitivity = inputs.carbRatio > 0.0 ? isf / inputs.carbRatio : 0.0;
+    for (int k = 0; k < kHorizon; ++k) {
+        response[k] = glucose
+                    - isf * insulinOnBoard * m_insulinDecay[k]
+                    + carbSensitivity * carbsOnBoard * m_carbDecay[k];
+    }
+}
+
+void MpcBasalController::predict(double glucose, double insulinOnBoard, double carbsOnBoard,
+                                 const SimInputs &inputs, const double *plan, double *trajectory) const {
+    freeResponse(glucose, insulinOnBoard, carbsOnBoard, inputs, trajectory);
+    for (int k = 0; k < kHorizon; ++k) {
+        double effect = 0.0;
+        for (int j = 0; j < kBlocks; ++j) {
+            effect += m_response[k][j] * plan[j];
+        }
+        trajectory[k] += inputs.correctionFactor * effect;
+    }
+}
+
+// Projected coordinate descent on the box-constrained QP
+//   min 1/2 v^T H v + f^T v,  lower <= v <= upper
+double MpcBasalController::solve(double glucose, double insulinOnBoard, double carbsOnBoard,
+                                 const SimInputs &inputs, double appliedDeviation, double *plan) {
+    PUMP_TRACE_SCOPE("mpc.solve");
+    const int64_t startNs = Instrumentation::nowNs();
+    const int64_t deadlineNs = startNs + m_settings.budgetNs;
+
+    const double isf = qMax(0.1, inputs.correctionFactor);
+    const double basal = qMax(0.0, inputs.basalRate);
+    const double lower = -basal;
+    const double upper = qMax(0.0, qMin(m_settings.maxBasal, basal * m_settings.maxBasalFactor) - basal);
+    const double r = m_settings.moveWeight;
+    const double s = m_settings.smoothWeight;
+
+    double error[kHorizon];
+    freeResponse(glucose, insulinOnBoard, carbsOnBoard, inputs, error);
+    for (int k = 0; k < kHorizon; ++k) {
+        error[k] -= inputs.targetBG;
+    }
+
+    // H = isf^2 A^T A + r I + s D,  f = isf A^T e - s v_prev e_0
+    double hessian[kBlocks][kBlocks];
+    double linear[kBlocks];
+    for (int a = 0; a < kBlocks; ++a) {
+        double sum = 0.0;
+        for (int k = 0; k < kHorizon; ++k) {
+            sum += m_response[k][a] * error[k];
+        }
+        linear[a] = isf * sum;
+        for (int b = 0; b < kBlocks; ++b) {
+            hessian[a][b] = isf * isf * m_responseGram[a][b] + s * m_smoothing[a][b];
+        }
+        hessian[a][a] += r;
+    }
+    linear[0] -= s * appliedDeviation;
+
+    int sweeps = 0;
+    bool converged = false;
+    while (sweeps < m_settings.maxSweeps) {
+        double largestStep = 0.0;
+        for (int j = 0; j < kBlocks; ++j) {
+            double gradient = linear[j];
+            for (int b = 0; b < kBlocks; ++b) {
+                gradient += hessian[j][b] * plan[b];
+            }
+            double updated = qBound(lower, plan[j] - gradient / hessian[j][j], upper);
+            largestStep = qMax(largestStep, std::fabs(updated - plan[j]));
+            plan[j] = updated;
+        }
+        ++sweeps;
+
+        if (largestStep < m_settings.tolerance) {
+            converged = true;
+            break;
+        }
+        if (Instrumentation::nowNs() >= deadlineNs) {
+            break;
+        }
+    }
+
+    const int64_t elapsed = Instrumentation::nowNs() - startNs;
+    m_latency.record(elapsed);
+    m_stats.solves++;
+    m_stats.lastSweeps = sweeps;
+    m_stats.lastNs = elapsed;
+    if (!converged && sweeps < m_settings.maxSweeps) {
+        m_stats.overBudget++;
+    }
+
+    return plan[0];
+}
+
+void MpcBasalController::beginTick(PatientState *patients, int count) {
+    m_batch = patients;
+    if (m_plans.size() != count * kBlocks) {
+        m_plans.fill(0.0, count * kBlocks);
+    }
+}
+
+ControlDecision MpcBasalController::decide(const PatientState &patient, const GlucoseEstimate &estimate,
+                                           const GlucosePrediction &prediction) {
+    ControlDecision decision = ThresholdBasalController::decide(patient, estimate, prediction);
+
+    const int lane = static_cast<int>(&patient - m_batch);
+    double *plan = m_plans.data() + lane * kBlocks;
+
+    // Shift the previous plan by one step: the first block has been applied
+    for (int j = 0; j + 1 < kBlocks && kBlockSteps[j] == 1; ++j) {
+        plan[j] = plan[j + 1];
+    }
+
+    double applied = patient.deliveredBasalRate - patient.inputs.basalRate;
+    double deviation = solve(estimate.glucose, estimate.insulinOnBoard, estimate.carbsOnBoard,
+                             patient.inputs, applied, plan);
+    double rate = qMax(0.0, patient.inputs.basalRate + deviation);
+    rate = std::round(rate * 20.0) / 20.0;   // Pump resolution 0.05 u/h
+
+    // Low-glucose suspend still overrides the plan
+    decision.basalAdjustment = 0.0;
+    if (rate < 0.05 || prediction.predicted30minLow <= 3.9) {
+        decision.basalAction = ControlDecision::SuspendBasal;
+        decision.basalRate = 0.0;
+    } else {
+        decision.basalAction = ControlDecision::SetBasal;
+        decision.basalRate = rate;
+    }
+    return decision;
+}
@@ -0,0 +1,98 @@
+#ifndef MPCBASALCONTROLLER_H
+#define MPCBASALCONTROLLER_H
+
+#include <QVector>
+#include "PumpStages.h"
+#include "Instrumentation.h"
+
+// Model-predictive basal controller.
+//
+// Every reading it plans basal over the next 2.5 hours (30 five-minute steps)
+// as 6 move blocks of increasing length, minimising
+//
+//     sum_k (BG_k - target)^2 + r * sum_j v_j^2 + s * sum_j (v_j - v_j-1)^2
+//
+// where v_j is the basal deviation (u/h) in block j, subject to
+// 0 <= basal + v_j <= maxBasal. Predicted BG is the free response of the
+// current BG, IOB and COB plus the linear insulin step response of each block.
+//
+// Everything that does not depend on the reading (block step responses,
+// A^T A, smoothing matrix) is built once with compile-time dimensions, so a
+// solve is one 6x30 product plus projected coordinate descent on a 6x6 QP,
+// warm-started from the previous plan. The descent stops when converged or
+// when the per-solve time budget runs out; solve latency is kept in a
+// histogram so the budget can be checked at fleet scale.
+//
+// Alerts, correction recommendations and auto correction are unchanged from
+// ThresholdBasalController; only the basal decision is replaced.
+class MpcBasalController : public ThresholdBasalController {
+public:
+    static const int kHorizon = 30;          // Prediction steps
+    static const int kBlocks = 6;            // Decision variables
+    static const int kStepMinutes = 5;
+
+    struct Settings {
+        double moveWeight = 0.5;             // r: cost of deviating from programmed basal
+        double smoothWeight = 0.5;           // s: cost of changing basal between blocks
+        double maxBasalFactor = 3.0;         // Upper bound as a multiple of programmed basal
+        double maxBasal = 5.0;               // Absolute upper bound (u/h)
+        double insulinActionMinutes = 55.0;  // Absorption time constant for basal and IOB
+        double carbAbsorptionMinutes = 40.0;
+        int budgetNs = 20000;                // Per-solve time budget
+        int maxSweeps = 100;
+        double tolerance = 1e-4;             // u/h change that counts as converged
+    };
+
+    struct SolveStats {
+        quint64 solves = 0;
+        quint64 overBudget = 0;              // Solves stopped by the time budget
+        int lastSweeps = 0;
+        qint64 lastNs = 0;
+    };
+
+    MpcBasalController();
+
+    void setSettings(const Settings &settings);
+    const Settings &settings() const { return m_settings; }
+
+    void beginTick(PatientState *patients, int count) override;
+    ControlDecision decide(const PatientState &patient, const GlucoseEstimate &estimate,
+                           const GlucosePrediction &prediction) override;
+
+    // Plans a basal deviation for each block and returns the first one (u/h).
+    // appliedDeviation is the deviation running now (smoothing anchor);
+    // 'plan' holds the warm start on entry and the solution on exit.
+    double solve(double glucose, double insulinOnBoard, double carbsOnBoard,
+                 const SimInputs &inputs, double appliedDeviation, double *plan);
+
+    const SolveStats &stats() const { return m_stats; }
+    const Instrumentation::LatencyHistogram &solveLatency() const { return m_latency; }
+
+    // Predicted BG at each step for the given plan (for display and tests of the model)
+    void predict(double glucose, double insulinOnBoard, double carbsOnBoard,
+                 const SimInputs &inputs, const double *plan, double *trajectory) const;
+
+private:
+    void precompute();
+    void freeResponse(double glucose, double insulinOnBoard, double carbsOnBoard,
+                      const SimInputs &inputs, double *response) const;
+
+    Settings m_settings;
+
+    // Reading-independent matrices
+    int m_blockStart[kBlocks + 1];                 // Step at which each block begins
+    double m_response[kHorizon][kBlocks];          // BG change per u/h in block j at step k (ISF = 1)
+    double m_responseGram[kBlocks][kBlocks];       // A^T A
+    double m_smoothing[kBlocks][kBlocks];          // Difference penalty D^T D
+    double m_insulinDecay[kHorizon];               // Fraction of IOB acted by step k
+    double m_carbDecay[kHorizon];                  // Fraction of COB absorbed by step k
+
+    // Per-patient warm start; lane = index in the tick's patient array
+    const PatientState *m_batch = nullptr;
+    QVector<double> m_plans;                       // kBlocks per patient
+
+    SolveStats m_stats;
+    Instrumentation::LatencyHistogram m_latency;
+};
+
+#endif // MPCBASALCONTROLLER_H
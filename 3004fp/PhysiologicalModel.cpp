@@ -0,0 +1,329 @@
+#include "PhysiologicalModel.h"
+#include <QRandomGenerator>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include "Vectorize.h"
+
+namespace {
+const double kGlucoseMgPerMmol = 18.0;     // mg/dL per mmol/L
+const double kGlucoseMmolPerGram = 1000.0 / 180.16;
+const double kBodyWeight = 70.0;           // kg, reference adult
+
+// u/h -> mU/min
+double basalToMilliUnitsPerMinute(double basalRate) {
+    return qMax(0.0, basalRate) * 1000.0 / 60.0;
+}
+}
+
+void ModelCohort::reset(const GlucoseModel &model, int count) {
+    m_count = qMax(0, count);
+    m_stride = (m_count + kLanes - 1) / kLanes * kLanes;
+
+    m_states.fill(0.0, model.stateCount() * m_stride);
+    m_insulinRate.fill(0.0, m_stride);
+    m_basalRate.fill(0.0, m_stride);
+    m_insulinAction.fill(1.0, m_stride);
+    m_parameters.resize(model.parameterCount() * m_stride);
+    for (int p = 0; p < model.parameterCount(); ++p) {
+        std::fill_n(parameter(p), m_stride, model.defaultParameter(p));
+    }
+}
+
+// Log-normal scaling keeps parameters positive
+void GlucoseModel::varyParameters(ModelCohort &cohort, int patient, double variation, QRandomGenerator *rng) const {
+    double sigma = std::sqrt(std::log(1.0 + variation * variation));
+    for (int p = 0; p < parameterCount(); ++p) {
+        // Box-Muller standard normal
+        double u1 = qMax(1e-12, rng->generateDouble());
+        double u2 = rng->generateDouble();
+        double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+        cohort.parameter(p)[patient] *= std::exp(sigma * z - 0.5 * sigma * sigma);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Bergman minimal model
+
+double BergmanMinimalModel::defaultParameter(int index) const {
+    switch (index) {
+    case P1: return 0.028;                 // Glucose effectiveness (1/min)
+    case P2: return 0.025;                 // Remote insulin decay (1/min)
+    case P3: return 0.025 * 1.5e-3;        // p2 * insulin sensitivity
+    case N: return 0.09;                   // Plasma insulin clearance (1/min)
+    case VI: return 0.12 * kBodyWeight;    // Insulin distribution volume (L)
+    case VG: return 1.6 * kBodyWeight;     // Glucose distribution volume (dL)
+    case Gb: return 100.0;                 // Basal glucose (mg/dL), set at steady state
+    case Ib: return 10.0;                  // Basal insulin (mU/L), set at steady state
+    case TmaxI: return 55.0;               // Insulin absorption time to peak (min)
+    case TmaxG: return 40.0;               // Carb absorption time to peak (min)
+    case Ag: return 0.8;                   // Carb bioavailability
+    default: return 0.0;
+    }
+}
+
+void BergmanMinimalModel::initializeSteadyState(ModelCohort &cohort, int patient,
+                                                double glucose, double basalRate) const {
+    double u = basalToMilliUnitsPerMinute(basalRate);
+    double tmaxI = cohort.parameter(TmaxI)[patient];
+    double plasmaInsulin = u / (cohort.parameter(N)[patient] * cohort.parameter(VI)[patient]);
+
+    cohort.insulinRate()[patient] = u;
+    cohort.basalRate()[patient] = u;
+    cohort.insulinAction()[patient] = 1.0;
+    cohort.parameter(Gb)[patient] = glucose * kGlucoseMgPerMmol;
+    cohort.parameter(Ib)[patient] = plasmaInsulin;
+
+    cohort.state(G)[patient] = glucose * kGlucoseMgPerMmol;
+    cohort.state(X)[patient] = 0.0;
+    cohort.state(I)[patient] = plasmaInsulin;
+    cohort.state(S1)[patient] = u * tmaxI;
+    cohort.state(S2)[patient] = u * tmaxI;
+    cohort.state(D1)[patient] = 0.0;
+    cohort.state(D2)[patient] = 0.0;
+}
+
+// Works through the cohort one block of kLanes patients at a time
+void BergmanMinimalModel::derivatives(const ModelCohort &cohort, const double *in, double *out) const {
+    const int n = cohort.stride();
+    const double *p = cohort.parameter(0);
+    const double *u = cohort.insulinRate();
+    const double *action = cohort.insulinAction();
+
+    for (int base = 0; base < n; base += ModelCohort::kLanes) {
+        PUMP_VECTORIZE_LOOP
+        for (int i = base; i < base + ModelCohort::kLanes; ++i) {
+            double g = in[G * n + i], xr = in[X * n + i], ins = in[I * n + i];
+            double s1 = in[S1 * n + i], s2 = in[S2 * n + i], d1 = in[D1 * n + i], d2 = in[D2 * n + i];
+            double p1 = p[P1 * n + i];
+            double absorbRateI = 1.0 / p[TmaxI * n + i], absorbRateG = 1.0 / p[TmaxG * n + i];  // 1/min
+
+            double absorbedInsulin = s2 * absorbRateI * action[i];             // mU/min, as it acts
+            double appearance = p[Ag * n + i] * d2 * absorbRateG * 1000.0;     // mg/min
+
+            out[S1 * n + i] = u[i] - s1 * absorbRateI;
+            out[S2 * n + i] = (s1 - s2) * absorbRateI;
+            out[I * n + i] = absorbedInsulin / p[VI * n + i] - p[N * n + i] * ins;
+            out[X * n + i] = -p[P2 * n + i] * xr + p[P3 * n + i] * (ins - p[Ib * n + i]);
+            out[D1 * n + i] = -d1 * absorbRateG;
+            out[D2 * n + i] = (d1 - d2) * absorbRateG;
+            out[G * n + i] = -(p1 + xr) * g + p1 * p[Gb * n + i] + appearance / p[VG * n + i];
+        }
+    }
+}
+
+void BergmanMinimalModel::constrain(ModelCohort &cohort) const {
+    double *g = cohort.state(G);
+    for (int i = 0; i < cohort.stride(); ++i) {
+        g[i] = 10.0 + positivePart(g[i] - 10.0);
+    }
+}
+
+void BergmanMinimalModel::addBolus(ModelCohort &cohort, int patient, double units) const {
+    cohort.state(S1)[patient] += units * 1000.0;
+}
+
+void BergmanMinimalModel::addMeal(ModelCohort &cohort, int patient, double grams) const {
+    cohort.state(D1)[patient] += grams;
+}
+
+double BergmanMinimalModel::glucose(const ModelCohort &cohort, int patient) const {
+    return cohort.state(G)[patient] / kGlucoseMgPerMmol;
+}
+
+double BergmanMinimalModel::insulinOnBoard(const ModelCohort &cohort, int patient) const {
+    double depot = cohort.state(S1)[patient] + cohort.state(S2)[patient];
+    double basalDepot = 2.0 * cohort.basalRate()[patient] * cohort.parameter(TmaxI)[patient];
+    return qMax(0.0, depot - basalDepot) / 1000.0;
+}
+
+double BergmanMinimalModel::carbsOnBoard(const ModelCohort &cohort, int patient) const {
+    return cohort.state(D1)[patient] + cohort.state(D2)[patient];
+}
+
+// ---------------------------------------------------------------------------
+// Hovorka model
+
+double HovorkaModel::defaultParameter(int index) const {
+    switch (index) {
+    case EGP0: return 0.0161 * kBodyWeight;   // Endogenous glucose production (mmol/min), set at steady state
+    case F01: return 0.0097 * kBodyWeight;    // Insulin-independent uptake (mmol/min)
+    case K12: return 0.066;                   // Transfer rate Q2 -> Q1 (1/min)
+    case Ka1: return 0.006;                   // Insulin action deactivation rates (1/min)
+    case Ka2: return 0.06;
+    case Ka3: return 0.03;
+    // Insulin sensitivities at 40% of the published means (~2 mmol/L per unit at 1 u/h basal)
+    case SIT: return 20.5e-4;                 // Sensitivity: transport/distribution (per mU/L)
+    case SID: return 3.3e-4;                  // Sensitivity: disposal (per mU/L)
+    case SIE: return 208e-4;                  // Sensitivity: endogenous production (per mU/L)
+    case Ke: return 0.138;                    // Plasma insulin elimination (1/min)
+    case VI: return 0.12 * kBodyWeight;       // Insulin distribution volume (L)
+    case VG: return 0.16 * kBodyWeight;       // Glucose distribution volume (L)
+    case Ag: return 0.8;                      // Carb bioavailability
+    case TmaxG: return 40.0;                  // Carb absorption time to peak (min)
+    case TmaxI: return 55.0;                  // Insulin absorption time to peak (min)
+    default: return 0.0;
+    }
+}
+
+// Solves the insulin subsystem for the basal rate, then picks EGP0 so that
+// glucose is stationary at the requested level
+void HovorkaModel::initializeSteadyState(ModelCohort &cohort, int patient,
+                                         double glucose, double basalRate) const {
+    double u = basalToMilliUnitsPerMinute(basalRate);
+    double plasmaInsulin = u / (cohort.parameter(Ke)[patient] * cohort.parameter(VI)[patient]);
+    double x1 = cohort.parameter(SIT)[patient] * plasmaInsulin;
+    double x2 = cohort.parameter(SID)[patient] * plasmaInsulin;
+    double x3 = cohort.parameter(SIE)[patient] * plasmaInsulin;
+    double vg = cohort.parameter(VG)[patient];
+    double k12 = cohort.parameter(K12)[patient];
+    double tmaxI = cohort.parameter(TmaxI)[patient];
+
+    double q1 = glucose * vg;
+    double q2 = x1 * q1 / (k12 + x2);
+    double uptake = cohort.parameter(F01)[patient] * qMin(1.0, glucose / 4.5);
+    double renal = glucose > 9.0 ? 0.003 * (glucose - 9.0) * vg : 0.0;
+
+    cohort.parameter(EGP0)[patient] = (uptake + x1 * q1 - k12 * q2 + renal) / qMax(0.05, 1.0 - x3);
+    cohort.insulinRate()[patient] = u;
+    cohort.basalRate()[patient] = u;
+    cohort.insulinAction()[patient] = 1.0;
+
+    cohort.state(Q1)[patient] = q1;
+    cohort.state(Q2)[patient] = q2;
+    cohort.state(S1)[patient] = u * tmaxI;
+    cohort.state(S2)[patient] = u * tmaxI;
+    cohort.state(I)[patient] = plasmaInsulin;
+    cohort.state(X1)[patient] = x1;
+    cohort.state(X2)[patient] = x2;
+    cohort.state(X3)[patient] = x3;
+    cohort.state(D1)[patient] = 0.0;
+    cohort.state(D2)[patient] = 0.0;
+}
+
+void HovorkaModel::derivatives(const ModelCohort &cohort, const double *in, double *out) const {
+    const int n = cohort.stride();
+    const double *p = cohort.parameter(0);
+    const double *u = cohort.insulinRate();
+    const double *action = cohort.insulinAction();
+
+    for (int base = 0; base < n; base += ModelCohort::kLanes) {
+        PUMP_VECTORIZE_LOOP
+        for (int i = base; i < base + ModelCohort::kLanes; ++i) {
+            double q1 = in[Q1 * n + i], q2 = in[Q2 * n + i], s1 = in[S1 * n + i], s2 = in[S2 * n + i];
+            double ins = in[I * n + i], x1 = in[X1 * n + i], x2 = in[X2 * n + i], x3 = in[X3 * n + i];
+            double d1 = in[D1 * n + i], d2 = in[D2 * n + i];
+            double vg = p[VG * n + i], k12 = p[K12 * n + i];
+            double absorbRateI = 1.0 / p[TmaxI * n + i], absorbRateG = 1.0 / p[TmaxG * n + i];  // 1/min
+
+            double g = q1 / vg;                                                    // mmol/L
+            double uptake = p[F01 * n + i] * (g - positivePart(g - 4.5)) / 4.5;   // Insulin-independent (mmol/min)
+            double renal = 0.003 * positivePart(g - 9.0) * vg;                     // Renal excretion (mmol/min)
+            double production = p[EGP0 * n + i] * positivePart(1.0 - x3);          // Endogenous production (mmol/min)
+            double appearance = d2 * absorbRateG;                                  // Gut absorption (mmol/min)
+
+            out[Q1 * n + i] = -uptake - x1 * q1 + k12 * q2 - renal + appearance + production;
+            out[Q2 * n + i] = x1 * q1 - (k12 + x2) * q2;
+            out[S1 * n + i] = u[i] - s1 * absorbRateI;
+            out[S2 * n + i] = (s1 - s2) * absorbRateI;
+            out[I * n + i] = s2 * absorbRateI * action[i] / p[VI * n + i] - p[Ke * n + i] * ins;
+            out[X1 * n + i] = p[Ka1 * n + i] * (p[SIT * n + i] * ins - x1);
+            out[X2 * n + i] = p[Ka2 * n + i] * (p[SID * n + i] * ins - x2);
+            out[X3 * n + i] = p[Ka3 * n + i] * (p[SIE * n + i] * ins - x3);
+            out[D1 * n + i] = -d1 * absorbRateG;
+            out[D2 * n + i] = (d1 - d2) * absorbRateG;
+        }
+    }
+}
+
+void HovorkaModel::constrain(ModelCohort &cohort) const {
+    double *q1 = cohort.state(Q1);
+    double *q2 = cohort.state(Q2);
+    for (int i = 0; i < cohort.stride(); ++i) {
+        q1[i] = positivePart(q1[i]);
+        q2[i] = positivePart(q2[i]);
+    }
+}
+
+void HovorkaModel::addBolus(ModelCohort &cohort, int patient, double units) const {
+    cohort.state(S1)[patient] += units * 1000.0;
+}
+
+void HovorkaModel::addMeal(ModelCohort &cohort, int patient, double grams) const {
+    cohort.state(D1)[patient] += cohort.parameter(Ag)[patient] * grams * kGlucoseMmolPerGram;
+}
+
+double HovorkaModel::glucose(const ModelCohort &cohort, int patient) const {
+    return cohort.state(Q1)[patient] / cohort.parameter(VG)[patient];
+}
+
+double HovorkaModel::insulinOnBoard(const ModelCohort &cohort, int patient) const {
+    double depot = cohort.state(S1)[patient] + cohort.state(S2)[patient];
+    double basalDepot = 2.0 * cohort.basalRate()[patient] * cohort.parameter(TmaxI)[patient];
+    return qMax(0.0, depot - basalDepot) / 1000.0;
+}
+
+double HovorkaModel::carbsOnBoard(const ModelCohort &cohort, int patient) const {
+    double absorbable = cohort.state(D1)[patient] + cohort.state(D2)[patient];
+    return absorbable / (cohort.parameter(Ag)[patient] * kGlucoseMmolPerGram);
+}
+
+// ---------------------------------------------------------------------------
+// RK4 integrator
+
+namespace {
+// out = x + a * k; size is a whole number of lane blocks
+void addScaled(double *out, const double *x, double a, const double *k, int size) {
+    for (int base = 0; base < size; base += ModelCohort::kLanes) {
+        PUMP_VECTORIZE_LOOP
+        for (int i = base; i < base + ModelCohort::kLanes; ++i) {
+            out[i] = x[i] + a * k[i];
+        }
+    }
+}
+}
+
+void Rk4Integrator::step(const GlucoseModel &model, ModelCohort &cohort, double dt) {
+    const int size = model.stateCount() * cohort.stride();
+    if (m_scratch.size() != size) {
+        m_k1.resize(size);
+        m_k2.resize(size);
+        m_k3.resize(size);
+        m_k4.resize(size);
+        m_scratch.resize(size);
+    }
+
+    double *x = cohort.states();
+    double *k1 = m_k1.data(), *k2 = m_k2.data(), *k3 = m_k3.data(), *k4 = m_k4.data();
+    double *tmp = m_scratch.data();
+    const double half = 0.5 * dt;
+
+    model.derivatives(cohort, x, k1);
+    addScaled(tmp, x, half, k1, size);
+
+    model.derivatives(cohort, tmp, k2);
+    addScaled(tmp, x, half, k2, size);
+
+    model.derivatives(cohort, tmp, k3);
+    addScaled(tmp, x, dt, k3, size);
+
+    model.derivatives(cohort, tmp, k4);
+    const double sixth = dt / 6.0;
+    for (int base = 0; base < size; base += ModelCohort::kLanes) {
+        PUMP_VECTORIZE_LOOP
+        for (int i = base; i < base + ModelCohort::kLanes; ++i) {
+            x[i] += sixth * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+        }
+    }
+
+    model.constrain(cohort);
+}
+
+void Rk4Integrator::advance(const GlucoseModel &model, ModelCohort &cohort, double minutes, double maxStep) {
+    if (minutes <= 0.0 || maxStep <= 0.0) return;
+    int steps = qMax(1, static_cast<int>(std::ceil(minutes / maxStep - 1e-9)));
+    double dt = minutes / steps;
+    for (int s = 0; s < steps; ++s) {
+        step(model, cohort, dt);
+    }
+}
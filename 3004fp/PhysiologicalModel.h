@@ -0,0 +1,156 @@
+#ifndef PHYSIOLOGICALMODEL_H
+#define PHYSIOLOGICALMODEL_H
+
+#include <QVector>
+
+class GlucoseModel;
+class QRandomGenerator;
+
+// Structure-of-arrays state for a cohort of virtual patients.
+// Each state variable and parameter is one contiguous array indexed by patient,
+// so a model's derivative loop touches every patient with unit stride and the
+// compiler can vectorise it. Arrays are padded to a multiple of kLanes; padded
+// lanes hold default parameters and are integrated but never read.
+class ModelCohort {
+public:
+    static const int kLanes = 8;
+
+    // Allocates 'count' patients for 'model' with default parameters and zero state
+    void reset(const GlucoseModel &model, int count);
+
+    int size() const { return m_count; }
+    int stride() const { return m_stride; }
+
+    // All states, state-major: state k of patient i is states()[k * stride() + i]
+    double *states() { return m_states.data(); }
+    const double *states() const { return m_states.constData(); }
+
+    double *state(int index) { return m_states.data() + index * m_stride; }
+    const double *state(int index) const { return m_states.constData() + index * m_stride; }
+
+    double *parameter(int index) { return m_parameters.data() + index * m_stride; }
+    const double *parameter(int index) const { return m_parameters.constData() + index * m_stride; }
+
+    // Subcutaneous insulin infusion per patient (mU/min), held constant over a step
+    double *insulinRate() { return m_insulinRate.data(); }
+    const double *insulinRate() const { return m_insulinRate.constData(); }
+
+    // Programmed basal per patient (mU/min); insulin on board counts the depot above it
+    double *basalRate() { return m_basalRate.data(); }
+    const double *basalRate() const { return m_basalRate.constData(); }
+
+    // Factor on absorbed insulin reaching plasma (1 = normal, more while exercising)
+    double *insulinAction() { return m_insulinAction.data(); }
+    const double *insulinAction() const { return m_insulinAction.constData(); }
+
+private:
+    int m_count = 0;
+    int m_stride = 0;
+    QVector<double> m_states;
+    QVector<double> m_parameters;
+    QVector<double> m_insulinRate;
+    QVector<double> m_basalRate;
+    QVector<double> m_insulinAction;
+};
+
+// A glucose-insulin model written as dx/dt = f(x, u) over a whole cohort.
+// Glucose is exchanged in mmol/L, insulin in units, carbohydrate in grams,
+// and time in minutes.
+class GlucoseModel {
+public:
+    virtual ~GlucoseModel() {}
+
+    virtual const char *name() const = 0;
+    virtual int stateCount() const = 0;
+    virtual int parameterCount() const = 0;
+    virtual double defaultParameter(int index) const = 0;
+
+    // Puts a patient at equilibrium at 'glucose' under a constant basal rate (u/h)
+    virtual void initializeSteadyState(ModelCohort &cohort, int patient,
+                                       double glucose, double basalRate) const = 0;
+
+    // Evaluates dx/dt for every lane; x and dx are laid out like ModelCohort::states()
+    virtual void derivatives(const ModelCohort &cohort, const double *x, double *dx) const = 0;
+
+    // Keeps states physically meaningful after an integration step
+    virtual void constrain(ModelCohort &cohort) const { Q_UNUSED(cohort); }
+
+    // Insulin and carbohydrate entering the absorption compartments at once
+    virtual void addBolus(ModelCohort &cohort, int patient, double units) const = 0;
+    virtual void addMeal(ModelCohort &cohort, int patient, double grams) const = 0;
+
+    // Observables for one patient
+    virtual double glucose(const ModelCohort &cohort, int patient) const = 0;        // mmol/L
+    virtual double insulinOnBoard(const ModelCohort &cohort, int patient) const = 0; // Units above programmed basal
+    virtual double carbsOnBoard(const ModelCohort &cohort, int patient) const = 0;   // Grams not yet absorbed
+
+    // Scales each parameter of one patient by a random factor with the given
+    // coefficient of variation, for inter-patient variability
+    void varyParameters(ModelCohort &cohort, int patient, double variation, QRandomGenerator *rng) const;
+};
+
+// Bergman minimal model (glucose, remote insulin action, plasma insulin) with
+// two-compartment subcutaneous insulin and gut absorption added as inputs.
+class BergmanMinimalModel : public GlucoseModel {
+public:
+    enum State { G, X, I, S1, S2, D1, D2, StateCount };                  // mg/dL, 1/min, mU/L, mU, mU, g, g
+    enum Parameter { P1, P2, P3, N, VI, VG, Gb, Ib, TmaxI, TmaxG, Ag, ParameterCount };
+
+    const char *name() const override { return "Bergman minimal"; }
+    int stateCount() const override { return StateCount; }
+    int parameterCount() const override { return ParameterCount; }
+    double defaultParameter(int index) const override;
+
+    void initializeSteadyState(ModelCohort &cohort, int patient, double glucose, double basalRate) const override;
+    void derivatives(const ModelCohort &cohort, const double *x, double *dx) const override;
+    void constrain(ModelCohort &cohort) const override;
+
+    void addBolus(ModelCohort &cohort, int patient, double units) const override;
+    void addMeal(ModelCohort &cohort, int patient, double grams) const override;
+
+    double glucose(const ModelCohort &cohort, int patient) const override;
+    double insulinOnBoard(const ModelCohort &cohort, int patient) const override;
+    double carbsOnBoard(const ModelCohort &cohort, int patient) const override;
+};
+
+// Hovorka (2004) compartment model: two glucose compartments, three insulin
+// action states, renal excretion and insulin-independent uptake.
+class HovorkaModel : public GlucoseModel {
+public:
+    enum State { Q1, Q2, S1, S2, I, X1, X2, X3, D1, D2, StateCount };  // mmol, mmol, mU, mU, mU/L, -, -, -, mmol, mmol
+    enum Parameter { EGP0, F01, K12, Ka1, Ka2, Ka3, SIT, SID, SIE, Ke, VI, VG, Ag, TmaxG, TmaxI, ParameterCount };
+
+    const char *name() const override { return "Hovorka"; }
+    int stateCount() const override { return StateCount; }
+    int parameterCount() const override { return ParameterCount; }
+    double defaultParameter(int index) const override;
+
+    void initializeSteadyState(ModelCohort &cohort, int patient, double glucose, double basalRate) const override;
+    void derivatives(const ModelCohort &cohort, const double *x, double *dx) const override;
+    void constrain(ModelCohort &cohort) const override;
+
+    void addBolus(ModelCohort &cohort, int patient, double units) const override;
+    void addMeal(ModelCohort &cohort, int patient, double grams) const override;
+
+    double glucose(const ModelCohort &cohort, int patient) const override;
+    double insulinOnBoard(const ModelCohort &cohort, int patient) const override;
+    double carbsOnBoard(const ModelCohort &cohort, int patient) const override;
+};
+
+// Classic fixed-step fourth-order Runge-Kutta over the whole cohort.
+// Each stage is one derivative pass plus flat array updates, so the cost per
+// step is four model evaluations regardless of the number of patients.
+class Rk4Integrator {
+public:
+    // Advances every patient by dt minutes
+    void step(const GlucoseModel &model, ModelCohort &cohort, double dt);
+
+    // Advances by 'minutes' using steps of at most maxStep minutes
+    void advance(const GlucoseModel &model, ModelCohort &cohort, double minutes, double maxStep = 1.0);
+
+private:
+    QVector<double> m_k1, m_k2, m_k3, m_k4;
+    QVector<double> m_scratch;
+};
+
+#endif // PHYSIOLOGICALMODEL_H
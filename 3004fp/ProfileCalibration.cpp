@@ -0,0 +1,394 @@
+#include "ProfileCalibration.h"
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "GoldenTrace.h"
+#include "Instrumentation.h"
+#include "InsulinUnits.h"
+#include "WhatIfExplorer.h"
+
+namespace {
+const int kStepMinutes = 5;
+const int kLookbackSteps = 72;       // Insulin and carbs from 6 h before a window still act in it
+const int kSettings = 3;             // Per segment, in this order:
+enum Setting { Basal, CarbRatio, CorrectionFactor };
+const int kChunkWindows = 64;        // Windows summed between early-termination checks
+
+// How much of what the history gave acts within one window, for one segment
+struct WindowTerms {
+    double insulin = 0.0;            // Units (boluses and delivered basal)
+    double need = 0.0;               // Units a 1 u/h basal need would use
+    double carbs = 0.0;              // Grams
+};
+
+// Segment in force at a minute of the day; before the first start it is the last one
+int segmentAt(const QVector<ProfileSegment> &segments, int minuteOfDay) {
+    int segment = segments.size() - 1;
+    for (int s = 0; s < segments.size() && segments[s].startMinute <= minuteOfDay; ++s) {
+        segment = s;
+    }
+    return segment;
+}
+
+// The history compiled into per-window terms, and the cost of candidate settings against it
+class CalibrationProblem {
+public:
+    CalibrationProblem(const CalibrationHistory &history, const QVector<ProfileSegment> &start,
+                       const CalibrationSettings &settings)
+        : m_segments(start.size()), m_prior(settings.prior)
+    {
+        // Log of the start settings, kept away from zero
+        m_origin.resize(m_segments * kSettings);
+        for (int s = 0; s < m_segments; ++s) {
+            m_origin[s * kSettings + Basal] = std::log(qMax(0.05, start[s].basalRate));
+            m_origin[s * kSettings + CarbRatio] = std::log(qMax(1.0, start[s].carbRatio));
+            m_origin[s * kSettings + CorrectionFactor] = std::log(qMax(0.1, start[s].correctionFactor));
+        }
+
+        const QVector<HistoryStep> &steps = history.steps;
+        const int length = qMax(1, settings.windowMinutes / kStepMinutes);
+        const int stride = qMax(1, settings.strideMinutes / kStepMinutes);
+        const double stepHours = kStepMinutes / 60.0;
+
+        QVector<int> segmentOf(steps.size());
+        for (int j = 0; j < steps.size(); ++j) {
+            segmentOf[j] = segmentAt(start, (history.startMinute + j * kStepMinutes) % (24 * 60));
+        }
+
+        // The first 6 hours only serve as lookback
+        for (int a = kLookbackSteps; a + length < steps.size(); a += stride) {
+            const int b = a + length;
+            if (steps[a].glucose <= 0.0f || steps[b].glucose <= 0.0f) continue;
+
+            const int base = m_terms.size();
+            m_terms.resize(base + m_segments);
+            WindowTerms *terms = m_terms.data() + base;
+            for (int j = qMax(0, a - kLookbackSteps); j < b; ++j) {
+                // Boluses and carbs at the start of step j, basal in the middle of it
+                const double t0 = (a - j) * kStepMinutes, t1 = (b - j) * kStepMinutes;
+                const double half = kStepMinutes / 2.0;
+                const double bolusActed = WhatIfExplorer::insulinActed(t1) - WhatIfExplorer::insulinActed(t0);
+                const double basalActed = (WhatIfExplorer::insulinActed(t1 - half) - WhatIfExplorer::insulinActed(t0 - half))
+                                          * stepHours;
+                const double carbsAbsorbed = WhatIfExplorer::carbsAbsorbed(t1) - WhatIfExplorer::carbsAbsorbed(t0);
+
+                WindowTerms &term = terms[segmentOf[j]];
+                term.insulin += steps[j].bolus * bolusActed + steps[j].basalRate * basalActed;
+                term.need += basalActed;
+                term.carbs += steps[j].carbs * carbsAbsorbed;
+            }
+            m_observed.append(steps[b].glucose - steps[a].glucose);
+        }
+    }
+
+    int dimension() const { return m_origin.size(); }
+    int windows() const { return m_observed.size(); }
+    const QVector<double> &origin() const { return m_origin; }
+
+    // Mean squared error of the window changes plus the prior. Stops and
+    // returns the partial sum, flagging 'abandoned', once that exceeds 'bound'.
+    double cost(const double *x, double bound, bool *abandoned) const {
+        double prior = 0.0;
+        for (int i = 0; i < m_origin.size(); ++i) {
+            const double d = x[i] - m_origin[i];
+            prior += d * d;
+        }
+        prior *= m_prior;
+        return prior + squaredError(x, bound - prior, abandoned);
+    }
+
+    // RMS error of the window changes alone
+    double error(const double *x) const {
+        bool abandoned = false;
+        return std::sqrt(squaredError(x, std::numeric_limits<double>::infinity(), &abandoned));
+    }
+
+private:
+    double squaredError(const double *x, double bound, bool *abandoned) const {
+        *abandoned = bound < 0.0;
+        if (*abandoned || m_observed.isEmpty()) return 0.0;
+
+        // Predicted change = sum over segments of cf/icr * carbs - cf * insulin + cf * basal * need
+        QVector<double> coefficients(m_segments * kSettings);
+        for (int s = 0; s < m_segments; ++s) {
+            const double cf = std::exp(x[s * kSettings + CorrectionFactor]);
+            coefficients[s * kSettings + 0] = cf / std::exp(x[s * kSettings + CarbRatio]);
+            coefficients[s * kSettings + 1] = cf;
+            coefficients[s * kSettings + 2] = cf * std::exp(x[s * kSettings + Basal]);
+        }
+
+        const int count = m_observed.size();
+        const double scale = 1.0 / count;
+        double sum = 0.0;
+        for (int w = 0; w < count; ++w) {
+            const WindowTerms *terms = m_terms.constData() + w * m_segments;
+            const double *c = coefficients.constData();
+            double predicted = 0.0;
+            for (int s = 0; s < m_segments; ++s, c += kSettings) {
+                predicted += c[0] * terms[s].carbs - c[1] * terms[s].insulin + c[2] * terms[s].need;
+            }
+            const double e = predicted - m_observed[w];
+            sum += e * e;
+
+            if ((w + 1) % kChunkWindows == 0 && sum * scale > bound) {
+                *abandoned = true;
+                break;
+            }
+        }
+        return sum * scale;
+    }
+
+    int m_segments;
+    double m_prior;
+    QVector<double> m_origin;        // Log of the start settings
+    QVector<WindowTerms> m_terms;    // Window-major, one per segment
+    QVector<double> m_observed;      // Recorded glucose change per window
+};
+
+struct Candidate {
+    QVector<double> x;               // Log settings
+    double cost = 0.0;
+    bool evaluated = false;
+    bool abandoned = false;          // Cost is only a lower bound
+};
+
+// Evaluates one candidate of a batch on the pool
+class CandidateJob : public QRunnable {
+public:
+    CandidateJob(const CalibrationProblem &problem, Candidate *candidate, double bound)
+        : m_problem(problem), m_candidate(candidate), m_bound(bound) {}
+
+    void run() override {
+        m_candidate->cost = m_problem.cost(m_candidate->x.constData(), m_bound, &m_candidate->abandoned);
+        m_candidate->evaluated = true;
+    }
+
+private:
+    const CalibrationProblem &m_problem;
+    Candidate *m_candidate;
+    double m_bound;
+};
+
+// Evaluates candidates against their bounds, all but the first on 'pool' (inline if null)
+void evaluate(const CalibrationProblem &problem, Candidate *const *batch, const double *bounds, int count,
+              QThreadPool *pool, CalibrationResult *result) {
+    for (int i = 1; i < count; ++i) {
+        if (pool) {
+            pool->start(new CandidateJob(problem, batch[i], bounds[i]));
+        } else {
+            CandidateJob(problem, batch[i], bounds[i]).run();
+        }
+    }
+    CandidateJob(problem, batch[0], bounds[0]).run();
+    if (pool) pool->waitForDone();
+
+    result->evaluations += count;
+    for (int i = 0; i < count; ++i) {
+        result->abandoned += batch[i]->abandoned ? 1 : 0;
+    }
+}
+
+// Evaluates one candidate unless a batch already did
+void ensure(const CalibrationProblem &problem, Candidate *candidate, double bound, CalibrationResult *result) {
+    if (candidate->evaluated) return;
+    evaluate(problem, &candidate, &bound, 1, nullptr, result);
+}
+
+// a + t * (b - a)
+QVector<double> along(const QVector<double> &a, const QVector<double> &b, double t) {
+    QVector<double> x(a.size());
+    for (int i = 0; i < a.size(); ++i) x[i] = a[i] + t * (b[i] - a[i]);
+    return x;
+}
+
+Candidate candidateAt(const QVector<double> &x) {
+    Candidate candidate;
+    candidate.x = x;
+    return candidate;
+}
+
+// Runs one history's calibration on the cohort pool
+class CalibrationJob : public QRunnable {
+public:
+    CalibrationJob(const ProfileCalibrator &calibrator, const CalibrationHistory &history,
+                   const QVector<ProfileSegment> &start, const std::atomic<bool> *stop, CalibrationResult *result)
+        : m_calibrator(calibrator), m_history(history), m_start(start), m_stop(stop), m_result(result) {}
+
+    void run() override {
+        *m_result = m_calibrator.calibrate(m_history, m_start, 1, m_stop);
+    }
+
+private:
+    const ProfileCalibrator &m_calibrator;
+    const CalibrationHistory &m_history;
+    const QVector<ProfileSegment> &m_start;
+    const std::atomic<bool> *m_stop;
+    CalibrationResult *m_result;
+};
+}
+
+CalibrationHistory CalibrationHistory::fromTrace(const GoldenTrace &trace) {
+    CalibrationHistory history;
+    if (trace.ticks.isEmpty()) return history;
+    history.startMinute = trace.ticks.first().simMinutes % (24 * 60);
+    history.steps.reserve(trace.ticks.size());
+
+    float carbsOnBoard = 0.0f;
+    for (const TraceTick &tick : trace.ticks) {
+        // Only auto corrections are delivered, in whole pump steps; recommendations are advice
+        const double corrections = InsulinUnits::fromUnits(tick.autoCorrection).toPumpStep().toUnits();
+        HistoryStep step;
+        step.glucose = tick.glucose;
+        step.carbs = qMax(0.0f, tick.carbsOnBoard - carbsOnBoard);
+        step.bolus = tick.scenarioBolus + float(corrections);
+        step.basalRate = tick.pumpBasalRate;
+        history.steps.append(step);
+        carbsOnBoard = tick.carbsOnBoard;
+    }
+    return history;
+}
+
+ProfileCalibrator::ProfileCalibrator(const CalibrationSettings &settings)
+    : m_settings(settings)
+{
+}
+
+// Nelder-Mead (reflection 1, expansion 2, contractions and shrink 0.5) in log-settings space
+CalibrationResult ProfileCalibrator::calibrate(const CalibrationHistory &history, const QVector<ProfileSegment> &start,
+                                               int threads, const std::atomic<bool> *stop) const {
+    PUMP_TRACE_SCOPE("profile.calibrate");
+    CalibrationResult result;
+    result.segments = start;
+    if (start.isEmpty()) return result;
+
+    const CalibrationProblem problem(history, start, m_settings);
+    const int n = problem.dimension();
+    result.windows = problem.windows();
+    result.startError = problem.error(problem.origin().constData());
+    result.error = result.startError;
+    if (result.windows == 0) return result;
+
+    QThreadPool pool;
+    QThreadPool *parallel = nullptr;
+    if (threads > 1) {
+        pool.setMaxThreadCount(threads);
+        parallel = &pool;
+    }
+    const double unbounded = std::numeric_limits<double>::infinity();
+
+    // Start plus one step along each setting
+    QVector<Candidate> simplex(n + 1);
+    QVector<Candidate *> batch(n + 1);
+    QVector<double> bounds(n + 1, unbounded);
+    for (int i = 0; i <= n; ++i) {
+        simplex[i].x = problem.origin();
+        if (i > 0) simplex[i].x[i - 1] += m_settings.initialStep;
+        batch[i] = &simplex[i];
+    }
+    evaluate(problem, batch.constData(), bounds.constData(), n + 1, parallel, &result);
+
+    // The budget counts only the evaluations a single thread makes, so speculative
+    // ones cannot end the search sooner with more threads
+    int searched = n + 1;
+    const auto byCost = [](const Candidate &a, const Candidate &b) { return a.cost < b.cost; };
+    while (searched < m_settings.maxEvaluations) {
+        std::sort(simplex.begin(), simplex.end(), byCost);
+        const double best = simplex[0].cost, second = simplex[n - 1].cost, worst = simplex[n].cost;
+        if (worst - best <= m_settings.tolerance * best) {
+            result.converged = true;
+            break;
+        }
+        if (stop && stop->load(std::memory_order_relaxed)) break;
+        result.iterations++;
+        searched++;
+
+        QVector<double> centroid(n, 0.0);
+        for (int i = 0; i < n; ++i) {
+            for (int k = 0; k < n; ++k) centroid[k] += simplex[i].x[k] / n;
+        }
+        Candidate reflected = candidateAt(along(centroid, simplex[n].x, -1.0));
+        Candidate expanded = candidateAt(along(centroid, simplex[n].x, -2.0));
+        Candidate outside = candidateAt(along(centroid, simplex[n].x, -0.5));
+        Candidate inside = candidateAt(along(centroid, simplex[n].x, 0.5));
+
+        // Only a value below its bound can be accepted; anything above it is stopped early
+        if (parallel) {
+            Candidate *speculative[] = { &reflected, &expanded, &outside, &inside };
+            const double limits[] = { worst, best, worst, worst };
+            evaluate(problem, speculative, limits, 4, parallel, &result);
+        } else {
+            ensure(problem, &reflected, worst, &result);
+        }
+
+        bool shrink = false;
+        if (reflected.cost < best) {
+            ensure(problem, &expanded, reflected.cost, &result);
+            searched++;
+            simplex[n] = expanded.cost < reflected.cost ? expanded : reflected;
+        } else if (reflected.cost < second) {
+            simplex[n] = reflected;
+        } else if (reflected.cost < worst) {
+            ensure(problem, &outside, reflected.cost, &result);
+            searched++;
+            shrink = !(outside.cost <= reflected.cost);
+            if (!shrink) simplex[n] = outside;
+        } else {
+            ensure(problem, &inside, worst, &result);
+            searched++;
+            shrink = !(inside.cost < worst);
+            if (!shrink) simplex[n] = inside;
+        }
+
+        if (shrink) {
+            for (int i = 1; i <= n; ++i) {
+                simplex[i] = candidateAt(along(simplex[0].x, simplex[i].x, 0.5));
+                batch[i - 1] = &simplex[i];
+            }
+            evaluate(problem, batch.constData(), bounds.constData(), n, parallel, &result);
+            searched += n;
+        }
+    }
+
+    std::sort(simplex.begin(), simplex.end(), byCost);
+    const Candidate &found = simplex[0];
+    for (int s = 0; s < start.size(); ++s) {
+        result.segments[s].basalRate = std::exp(found.x[s * kSettings + Basal]);
+        result.segments[s].carbRatio = std::exp(found.x[s * kSettings + CarbRatio]);
+        result.segments[s].correctionFactor = std::exp(found.x[s * kSettings + CorrectionFactor]);
+    }
+    result.error = problem.error(found.x.constData());
+    return result;
+}
+
+QVector<CalibrationResult> ProfileCalibrator::calibrateCohort(const QVector<CalibrationHistory> &histories,
+                                                              const QVector<QVector<ProfileSegment>> &starts,
+                                                              int threads, const std::atomic<bool> *stop) const {
+    QVector<CalibrationResult> results(histories.size());
+    if (starts.isEmpty()) return results;
+
+    QThreadPool pool;
+    if (threads > 0) {
+        pool.setMaxThreadCount(threads);
+    }
+    for (int i = 0; i < histories.size(); ++i) {
+        const QVector<ProfileSegment> &start = starts.size() == 1 ? starts[0] : starts[qMin(i, starts.size() - 1)];
+        pool.start(new CalibrationJob(*this, histories[i], start, stop, &results[i]));
+    }
+    pool.waitForDone();
+    return results;
+}
+
+QVector<ProfileSegment> ProfileCalibrator::segmentsOf(const Profile &profile, const QVector<int> &startMinutes) {
+    QVector<ProfileSegment> segments;
+    for (int minute : startMinutes) {
+        ProfileSegment segment;
+        segment.startMinute = minute;
+        segment.basalRate = profile.basalRate;
+        segment.carbRatio = profile.carbRatio;
+        segment.correctionFactor = profile.correctionFactor;
+        segments.append(segment);
+    }
+    return segments;
+}
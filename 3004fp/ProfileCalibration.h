@@ -0,0 +1,89 @@
+#ifndef PROFILECALIBRATION_H
+#define PROFILECALIBRATION_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <atomic>
+#include "UserProfile.h"
+
+struct GoldenTrace;
+
+// Settings for part of the day, from 'startMinute' until the next segment starts
+struct ProfileSegment {
+    int startMinute = 0;             // Minute of the day (0-1439)
+    double basalRate = 1.0;          // u/h
+    double carbRatio = 10.0;         // Grams per unit
+    double correctionFactor = 2.0;   // mmol/L per unit
+};
+
+// Five minutes of recorded history
+struct HistoryStep {
+    float glucose = 0.0f;            // CGM reading at the start of the step (mmol/L, <= 0 if none)
+    float carbs = 0.0f;              // Eaten at the start of the step (grams)
+    float bolus = 0.0f;              // Units given at the start of the step
+    float basalRate = 0.0f;          // Delivered during the step (u/h)
+};
+
+struct CalibrationHistory {
+    int startMinute = 0;             // Minute of the day of the first step
+    QVector<HistoryStep> steps;
+
+    // Steps from a recorded run: boluses are the meal boluses and auto
+    // corrections delivered, and carbs the rises in carbs on board
+    static CalibrationHistory fromTrace(const GoldenTrace &trace);
+};
+
+struct CalibrationSettings {
+    int windowMinutes = 120;         // Glucose change predicted by each window
+    int strideMinutes = 30;          // Between window starts
+    double prior = 0.01;             // Weight pulling each setting toward its start (per squared log ratio)
+    double initialStep = 0.2;        // Simplex size, as a log ratio (about ±20%)
+    double tolerance = 1e-4;         // Stops once the simplex's costs agree to this fraction
+    int maxEvaluations = 3000;       // As a single thread counts them
+};
+
+struct CalibrationResult {
+    QVector<ProfileSegment> segments;    // Suggested settings
+    int windows = 0;
+    double startError = 0.0;         // RMS error of the predicted window changes (mmol/L) ...
+    double error = 0.0;              // ... with the start and the suggested settings
+    int iterations = 0;
+    int evaluations = 0;
+    int abandoned = 0;               // Evaluations stopped early once they could not be used
+    bool converged = false;
+};
+
+// Suggests basal, ICR and CF per time-of-day segment from recorded history.
+//
+// The history is replayed once through the what-if glucose model into, for
+// every window, how much insulin, basal need and carbs of each segment act
+// within it; a window's predicted glucose change is then linear in those
+// terms for any settings, so evaluating a candidate is one pass over the
+// windows. Nelder-Mead searches the log of the settings, minimising the mean
+// squared error of the predicted changes plus a small pull toward the start.
+// With more than one thread, each step evaluates reflection, expansion and
+// both contractions at once; an evaluation stops early as soon as its partial
+// cost shows it cannot be used. A cohort runs one user per core instead.
+class ProfileCalibrator {
+public:
+    explicit ProfileCalibrator(const CalibrationSettings &settings = CalibrationSettings());
+
+    // 'start' gives the segments (sorted by start minute) and the initial settings.
+    // Returns the best settings so far if 'stop' is set meanwhile.
+    CalibrationResult calibrate(const CalibrationHistory &history, const QVector<ProfileSegment> &start,
+                                int threads = 1, const std::atomic<bool> *stop = nullptr) const;
+
+    // One calibration per history on a thread pool; 'starts' has one entry per
+    // history, or a single one shared by all. Results in input order.
+    QVector<CalibrationResult> calibrateCohort(const QVector<CalibrationHistory> &histories,
+                                               const QVector<QVector<ProfileSegment>> &starts,
+                                               int threads = 0, const std::atomic<bool> *stop = nullptr) const;
+
+    // The profile's settings for each segment start
+    static QVector<ProfileSegment> segmentsOf(const Profile &profile, const QVector<int> &startMinutes);
+
+private:
+    CalibrationSettings m_settings;
+};
+
+#endif // PROFILECALIBRATION_H
@@ -0,0 +1,79 @@
+#include "ProfileSensitivity.h"
+#include <cmath>
+#include "BolusManager.h"
+#include "Instrumentation.h"
+#include "WhatIfExplorer.h"
+
+namespace {
+const double kRangeLow = 3.9;
+const double kRangeHigh = 10.0;
+
+typedef ProfileSensitivity::Value Value;
+
+// 0 well below zero, 1 well above, differentiable in between
+Value logistic(const Value &x) {
+    using std::exp;
+    return Value(1.0) / (Value(1.0) + exp(-x));
+}
+
+ProfileGradient gradientOf(const Value &metric, double value) {
+    ProfileGradient gradient;
+    gradient.value = value;
+    gradient.carbRatio = metric.derivative(ProfileSensitivity::CarbRatio);
+    gradient.correctionFactor = metric.derivative(ProfileSensitivity::CorrectionFactor);
+    gradient.targetBG = metric.derivative(ProfileSensitivity::TargetBG);
+    return gradient;
+}
+}
+
+SensitivityReport ProfileSensitivity::analyze(const Profile &profile, const QVector<MealEpisode> &history,
+                                              const PatientResponse &response, double smoothing) {
+    PUMP_TRACE_SCOPE("profile.sensitivity");
+    SensitivityReport report;
+    report.episodes = history.size();
+    if (history.isEmpty() || profile.carbRatio <= 0.0 || profile.correctionFactor <= 0.0) return report;
+
+    const Value icr = Value::variable(profile.carbRatio, CarbRatio);
+    const Value cf = Value::variable(profile.correctionFactor, CorrectionFactor);
+    const Value target = Value::variable(profile.targetBG, TargetBG);
+    const Value isf(response.insulinSensitivity);
+    const double width = qMax(1e-6, smoothing);
+    const int steps = WhatIfExplorer::kHorizonMinutes / WhatIfExplorer::kStepMinutes;
+
+    Value inRange, hypo;
+    int inRangeCount = 0, hypoCount = 0;
+    QVector<TimedDose<Value>> doses(1);
+
+    for (const MealEpisode &meal : history) {
+        const Value glucose(meal.glucose);
+        const Value insulinOnBoard(meal.insulinOnBoard);
+        doses[0].minute = 0.0;
+        doses[0].units = BolusManager::bolusTerms(Value(meal.carbs), glucose, icr, cf, target,
+                                                  insulinOnBoard).finalBolus;
+        const Value carbRise(response.carbRise * meal.carbs);
+
+        for (int k = 0; k <= steps; ++k) {
+            const Value g = WhatIfExplorer::glucoseAt(double(k * WhatIfExplorer::kStepMinutes), glucose,
+                                                      carbRise, isf, insulinOnBoard, doses);
+            inRange += logistic((g - kRangeLow) / width) * logistic((Value(kRangeHigh) - g) / width);
+            hypo += logistic((Value(kRangeLow) - g) / width);
+
+            const double value = g.value();
+            if (value >= kRangeLow && value <= kRangeHigh) inRangeCount++;
+            if (value < kRangeLow) hypoCount++;
+        }
+    }
+
+    const double readings = double(history.size()) * (steps + 1);
+    report.timeInRange = gradientOf(inRange * Value(100.0 / readings), 100.0 * inRangeCount / readings);
+    report.hypoMinutes = gradientOf(hypo * Value(WhatIfExplorer::kStepMinutes),
+                                    double(hypoCount) * WhatIfExplorer::kStepMinutes);
+    return report;
+}
+
+PatientResponse ProfileSensitivity::responseOf(const Profile &profile) {
+    PatientResponse response;
+    response.insulinSensitivity = profile.correctionFactor;
+    response.carbRise = profile.carbRatio > 0.0 ? profile.correctionFactor / profile.carbRatio : 0.0;
+    return response;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILESENSITIVITY_H
+#define PROFILESENSITIVITY_H
+
+#include <QVector>
+#include "Dual.h"
+#include "UserProfile.h"
+
+// A meal from the patient's history, with what the calculator saw at the time
+struct MealEpisode {
+    double carbs = 0.0;              // Grams
+    double glucose = 0.0;            // BG at the meal (mmol/L)
+    double insulinOnBoard = 0.0;     // Units
+};
+
+// How the patient really responds; the profile's settings try to match it
+struct PatientResponse {
+    double insulinSensitivity = 2.0; // mmol/L per unit
+    double carbRise = 0.2;           // mmol/L per gram
+};
+
+// A metric and its partial derivatives with respect to the profile's settings
+struct ProfileGradient {
+    double value = 0.0;
+    double carbRatio = 0.0;          // Per g/u
+    double correctionFactor = 0.0;   // Per mmol/L/u
+    double targetBG = 0.0;           // Per mmol/L
+};
+
+struct SensitivityReport {
+    int episodes = 0;
+    ProfileGradient timeInRange;     // Percent of all readings within 3.9-10.0 mmol/L
+    ProfileGradient hypoMinutes;     // Minutes below 3.9 mmol/L, all episodes together
+};
+
+// Gradients of outcomes with respect to ICR, CF and target, in one pass.
+//
+// Every meal of the history is bolused with the calculator's formula
+// (BolusManager::bolusTerms) and followed for the what-if horizon through the
+// what-if glucose model (WhatIfExplorer::glucoseAt), both run on
+// Dual<3> values seeded with the three settings. Time in range and hypo
+// minutes count readings, which are step functions of the settings, so their
+// derivatives are taken of a version with logistic edges 'smoothing' mmol/L
+// wide; values are the exact counts. Doses are not rounded to the pump step,
+// for the same reason.
+class ProfileSensitivity {
+public:
+    enum Parameter { CarbRatio, CorrectionFactor, TargetBG, ParameterCount };
+    typedef Dual<ParameterCount> Value;
+
+    static SensitivityReport analyze(const Profile &profile, const QVector<MealEpisode> &history,
+                                     const PatientResponse &response, double smoothing = 0.25);
+
+    // The response a patient would have if the profile matched them exactly
+    static PatientResponse responseOf(const Profile &profile);
+};
+
+#endif // PROFILESENSITIVITY_H
@@ -0,0 +1,546 @@
+#include "PumpJournal.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+const quint32 kJournalMagic = 0x4C4E4A50;    // "PJNL"
+const quint32 kSnapshotMagic = 0x504E5350;   // "PSNP"
+const quint16 kVersion = 1;
+const int kHeaderBytes = 8;
+const int kRecordBytes = 48;
+const char *const kJournalFile = "pump.journal";
+const char *const kSnapshotFile = "pump.snapshot";
+
+// Appends little-endian fields to a buffer
+class Encoder {
+public:
+    explicit Encoder(QByteArray *out) : m_out(out) {}
+
+    template <typename T> void put(T value) {
+        char bytes[sizeof(T)];
+        qToLittleEndian<T>(value, bytes);
+        m_out->append(bytes, int(sizeof(T)));
+    }
+    void putDouble(double value) {
+        quint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put(bits);
+    }
+
+private:
+    QByteArray *m_out;
+};
+
+// Reads little-endian fields; ok() turns false on reading past the end
+class Decoder {
+public:
+    Decoder(const char *data, int size) : m_data(data), m_size(size) {}
+
+    template <typename T> T get() {
+        if (m_pos + int(sizeof(T)) > m_size) {
+            m_ok = false;
+            return T();
+        }
+        const T value = qFromLittleEndian<T>(m_data + m_pos);
+        m_pos += int(sizeof(T));
+        return value;
+    }
+    double getDouble() {
+        const quint64 bits = get<quint64>();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    bool ok() const { return m_ok; }
+
+private:
+    const char *m_data;
+    int m_size;
+    int m_pos = 0;
+    bool m_ok = true;
+};
+
+QByteArray encodeHeader(quint32 magic) {
+    QByteArray header;
+    Encoder out(&header);
+    out.put(magic);
+    out.put(kVersion);
+    out.put(quint16(0));
+    return header;
+}
+
+bool checkHeader(const QByteArray &header, quint32 magic) {
+    Decoder in(header.constData(), header.size());
+    return in.get<quint32>() == magic && in.get<quint16>() == kVersion && in.ok();
+}
+
+// Writes little-endian fields into a fixed buffer, so records are encoded without the heap
+class RecordEncoder {
+public:
+    explicit RecordEncoder(char *out) : m_out(out) {}
+
+    template <typename T> void put(T value) {
+        qToLittleEndian<T>(value, m_out + m_pos);
+        m_pos += int(sizeof(T));
+    }
+    void putDouble(double value) {
+        quint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put(bits);
+    }
+    int size() const { return m_pos; }
+
+private:
+    char *m_out;
+    int m_pos = 0;
+};
+
+// Fills the kRecordBytes at 'record'
+void encodeEvent(const JournalEvent &event, char *record) {
+    RecordEncoder out(record);
+    out.put(event.sequence);
+    out.put(event.timeMs);
+    out.put(quint8(event.type));
+    out.put(event.flag);
+    out.put(quint16(0));
+    out.putDouble(event.a);
+    out.putDouble(event.b);
+    out.putDouble(event.c);
+    out.put(event.sources);
+    out.put(quint16(0));
+    out.put(qChecksum(record, uint(out.size())));
+    Q_ASSERT(out.size() == kRecordBytes);
+}
+
+// False for a torn or corrupt record
+bool decodeEvent(const char *data, JournalEvent *event) {
+    Decoder in(data, kRecordBytes);
+    event->sequence = in.get<quint32>();
+    event->timeMs = in.get<qint64>();
+    const quint8 type = in.get<quint8>();
+    event->flag = in.get<quint8>();
+    in.get<quint16>();
+    event->a = in.getDouble();
+    event->b = in.getDouble();
+    event->c = in.getDouble();
+    event->sources = in.get<quint32>();
+    in.get<quint16>();
+    const quint16 checksum = in.get<quint16>();
+    if (!in.ok() || type > JournalEvent::CgmAlert
+        || checksum != qChecksum(data, kRecordBytes - 2)) {
+        return false;
+    }
+    event->type = JournalEvent::Type(type);
+    return true;
+}
+
+enum SnapshotFlag : quint8 {
+    LowBatteryWarned = 1, LowInsulinWarned = 2, BolusInProgress = 4, FilterResetPending = 8
+};
+
+QByteArray encodeSnapshot(const PumpState &state, qint64 journalOffset) {
+    QByteArray data = encodeHeader(kSnapshotMagic);
+    Encoder out(&data);
+    out.put(state.sequence);
+    out.put(journalOffset);
+    out.put(quint8((state.lowBatteryWarned ? LowBatteryWarned : 0) | (state.lowInsulinWarned ? LowInsulinWarned : 0)
+                   | (state.bolusInProgress ? BolusInProgress : 0)
+                   | (state.filterResetPending ? FilterResetPending : 0)));
+    out.put(qint32(state.batteryLevel));
+    out.put(state.insulinLevel.ticks());
+    out.putDouble(state.basalRate);
+    out.putDouble(state.partialDelivered);
+    out.putDouble(state.extendedUnits);
+    out.put(state.bolusStartMs);
+    out.putDouble(state.lowGlucoseThreshold);
+    out.putDouble(state.highGlucoseThreshold);
+    out.put(quint32(state.readings.size()));
+    for (const PumpState::Reading &reading : state.readings) {
+        out.putDouble(reading.minute);
+        out.putDouble(reading.glucose);
+        out.putDouble(reading.variance);
+        out.put(reading.sources);
+        out.put(quint8(reading.resetBefore));
+        out.put(reading.timeMs);
+    }
+    out.put(qChecksum(data.constData(), uint(data.size())));
+    return data;
+}
+
+bool decodeSnapshot(const QByteArray &data, PumpState *state, qint64 *journalOffset) {
+    if (data.size() < kHeaderBytes + 2 || !checkHeader(data.left(kHeaderBytes), kSnapshotMagic)) {
+        return false;
+    }
+    const int body = data.size() - 2;
+    if (qFromLittleEndian<quint16>(data.constData() + body) != qChecksum(data.constData(), uint(body))) {
+        return false;
+    }
+
+    Decoder in(data.constData() + kHeaderBytes, body - kHeaderBytes);
+    PumpState result;
+    result.sequence = in.get<quint32>();
+    *journalOffset = in.get<qint64>();
+    const quint8 flags = in.get<quint8>();
+    result.lowBatteryWarned = flags & LowBatteryWarned;
+    result.lowInsulinWarned = flags & LowInsulinWarned;
+    result.bolusInProgress = flags & BolusInProgress;
+    result.filterResetPending = flags & FilterResetPending;
+    result.batteryLevel = in.get<qint32>();
+    result.insulinLevel = InsulinUnits::fromTicks(in.get<qint32>());
+    result.basalRate = in.getDouble();
+    result.partialDelivered = in.getDouble();
+    result.extendedUnits = in.getDouble();
+    result.bolusStartMs = in.get<qint64>();
+    result.lowGlucoseThreshold = in.getDouble();
+    result.highGlucoseThreshold = in.getDouble();
+
+    const quint32 count = in.get<quint32>();
+    if (!in.ok() || count > quint32(PumpState::kReadingWindow)) {
+        return false;
+    }
+    result.readings.resize(int(count));
+    for (PumpState::Reading &reading : result.readings) {
+        reading.minute = in.getDouble();
+        reading.glucose = in.getDouble();
+        reading.variance = in.getDouble();
+        reading.sources = in.get<quint32>();
+        reading.resetBefore = in.get<quint8>() != 0;
+        reading.timeMs = in.get<qint64>();
+    }
+    if (!in.ok()) {
+        return false;
+    }
+    *state = result;
+    return true;
+}
+}
+
+JournalEvent JournalEvent::make(Type type, double a, double b, double c, quint8 flag) {
+    JournalEvent event;
+    event.type = type;
+    event.a = a;
+    event.b = b;
+    event.c = c;
+    event.flag = flag;
+    return event;
+}
+
+void PumpState::apply(const JournalEvent &event) {
+    sequence = event.sequence;
+
+    switch (event.type) {
+    case JournalEvent::BatteryChanged:
+        batteryLevel = qRound(event.a);
+        lowBatteryWarned = event.flag != 0;
+        break;
+    case JournalEvent::ReservoirChanged:
+        insulinLevel = InsulinUnits::fromUnits(event.a);
+        lowInsulinWarned = event.flag != 0;
+        break;
+    case JournalEvent::BasalRateChanged:
+        basalRate = event.a;
+        break;
+    case JournalEvent::BolusStarted:
+        bolusInProgress = event.flag != 0;
+        partialDelivered = event.a;
+        extendedUnits = event.b;
+        bolusStartMs = event.timeMs;
+        break;
+    case JournalEvent::BolusCancelled:
+    case JournalEvent::BolusInterrupted:
+        bolusInProgress = false;
+        break;
+    case JournalEvent::CgmReading: {
+        Reading reading;
+        reading.minute = event.a;
+        reading.glucose = event.b;
+        reading.variance = event.c;
+        reading.sources = event.sources;
+        reading.resetBefore = filterResetPending;
+        reading.timeMs = event.timeMs;
+        filterResetPending = false;
+        readings.append(reading);
+        while (readings.size() > kReadingWindow) {
+            readings.removeFirst();
+        }
+        break;
+    }
+    case JournalEvent::CgmFilterReset:
+        filterResetPending = true;
+        break;
+    case JournalEvent::CgmAlertsChanged:
+        lowGlucoseThreshold = event.a;
+        highGlucoseThreshold = event.b;
+        break;
+    case JournalEvent::CgmAlert:
+        break;                               // History only; CGMManager derives it from the readings
+    }
+}
+
+PumpJournal::~PumpJournal() {
+    close();
+}
+
+bool PumpJournal::open(const QString &directory, QString *error) {
+    QMutexLocker locker(&m_mutex);
+    QElapsedTimer timer;
+    timer.start();
+
+    m_file.close();
+    m_directory = directory;
+    m_state = PumpState();
+    m_stats = RecoveryStats();
+    m_sinceSnapshot = 0;
+
+    if (!QDir().mkpath(directory)) {
+        *error = QString("cannot create %1").arg(directory);
+        return false;
+    }
+    m_file.setFileName(QDir(directory).filePath(kJournalFile));
+    // Records are flushed one by one anyway, and a write buffer would allocate
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        *error = QString("cannot open %1: %2").arg(m_file.fileName(), m_file.errorString());
+        return false;
+    }
+
+    if (m_file.size() < kHeaderBytes) {
+        // New journal, or one that died before its header was written
+        const QByteArray header = encodeHeader(kJournalMagic);
+        if (!m_file.resize(0) || m_file.write(header) != kHeaderBytes || !m_file.flush()) {
+            *error = QString("cannot write %1: %2").arg(m_file.fileName(), m_file.errorString());
+            m_file.close();
+            return false;
+        }
+    } else if (!checkHeader(m_file.read(kHeaderBytes), kJournalMagic)) {
+        *error = QString("%1 is not a pump journal").arg(m_file.fileName());
+        m_file.close();
+        return false;
+    }
+
+    // A snapshot ahead of the journal means the journal lost data the snapshot
+    // covers (e.g. power loss before it reached the disk); replay all of it instead
+    qint64 offset = kHeaderBytes;
+    if (!loadSnapshot(&offset) || offset > m_file.size()) {
+        if (m_stats.snapshotSequence > 0) {
+            qWarning() << "[PumpJournal] Snapshot does not match the journal; replaying the full journal";
+        }
+        m_state = PumpState();
+        m_stats.snapshotSequence = 0;
+        offset = kHeaderBytes;
+    }
+
+    m_file.seek(offset);
+    const QByteArray tail = m_file.readAll();
+    int used = 0;
+    JournalEvent event;
+    while (used + kRecordBytes <= tail.size() && decodeEvent(tail.constData() + used, &event)
+           && event.sequence == m_state.sequence + 1) {
+        m_state.apply(event);
+        used += kRecordBytes;
+        m_stats.replayedEvents++;
+    }
+
+    const qint64 end = offset + used;
+    m_stats.droppedBytes = m_file.size() - end;
+    if (m_stats.droppedBytes > 0) {
+        qWarning() << "[PumpJournal] Cutting" << m_stats.droppedBytes << "bytes of torn or corrupt journal tail";
+        m_file.resize(end);
+    }
+    m_file.seek(end);
+    m_sinceSnapshot = m_stats.replayedEvents;
+
+    // Extended delivery does not survive a restart; close it in the audit trail
+    if (m_state.bolusInProgress) {
+        append(JournalEvent::make(JournalEvent::BolusInterrupted, m_state.partialDelivered, m_state.extendedUnits));
+    }
+
+    m_stats.elapsedUs = timer.nsecsElapsed() / 1000;
+    return true;
+}
+
+// Snapshots on the way out so the next open replays nothing
+void PumpJournal::close() {
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) return;
+
+    QString error;
+    if (m_sinceSnapshot > 0 && !writeSnapshot(&error)) {
+        qWarning() << "[PumpJournal] Snapshot failed:" << error;
+    }
+    m_file.close();
+}
+
+bool PumpJournal::isOpen() const {
+    QMutexLocker locker(&m_mutex);
+    return m_file.isOpen();
+}
+
+void PumpJournal::record(JournalEvent event) {
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) return;
+    append(event);
+}
+
+// Caller holds m_mutex
+void PumpJournal::append(JournalEvent event) {
+    event.sequence = m_state.sequence + 1;
+    if (event.timeMs == 0) {
+        event.timeMs = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    // The state only advances once the record is out, so the fold always matches the file
+    char record[kRecordBytes];
+    encodeEvent(event, record);
+    const qint64 start = m_file.pos();
+    if (m_file.write(record, kRecordBytes) != kRecordBytes || !m_file.flush()) {
+        qWarning() << "[PumpJournal] Write failed:" << m_file.errorString();
+        m_file.resize(start);
+        m_file.seek(start);
+        return;
+    }
+    m_state.apply(event);
+
+    if (m_snapshotInterval > 0 && ++m_sinceSnapshot >= m_snapshotInterval) {
+        QString error;
+        if (!writeSnapshot(&error)) {
+            qWarning() << "[PumpJournal] Snapshot failed:" << error;
+        }
+    }
+}
+
+void PumpJournal::setSnapshotInterval(int events) {
+    QMutexLocker locker(&m_mutex);
+    m_snapshotInterval = qMax(0, events);
+}
+
+int PumpJournal::snapshotInterval() const {
+    QMutexLocker locker(&m_mutex);
+    return m_snapshotInterval;
+}
+
+bool PumpJournal::snapshot(QString *error) {
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        *error = "journal is not open";
+        return false;
+    }
+    return writeSnapshot(error);
+}
+
+// Caller holds m_mutex; the journal is flushed, so its position covers every folded event
+bool PumpJournal::writeSnapshot(QString *error) {
+    QSaveFile file(QDir(m_directory).filePath(kSnapshotFile));
+    if (!file.open(QIODevice::WriteOnly)) {
+        *error = QString("cannot open %1: %2").arg(file.fileName(), file.errorString());
+        return false;
+    }
+    file.write(encodeSnapshot(m_state, m_file.pos()));
+    if (!file.commit()) {
+        *error = QString("cannot write %1: %2").arg(file.fileName(), file.errorString());
+        return false;
+    }
+    m_sinceSnapshot = 0;
+    return true;
+}
+
+bool PumpJournal::loadSnapshot(qint64 *offset) {
+    QFile file(QDir(m_directory).filePath(kSnapshotFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    PumpState state;
+    qint64 snapshotOffset = 0;
+    if (!decodeSnapshot(file.readAll(), &state, &snapshotOffset) || snapshotOffset < kHeaderBytes
+        || (snapshotOffset - kHeaderBytes) % kRecordBytes != 0) {
+        qWarning() << "[PumpJournal] Ignoring unreadable snapshot" << file.fileName();
+        return false;
+    }
+    m_state = state;
+    m_stats.snapshotSequence = state.sequence;
+    *offset = snapshotOffset;
+    return true;
+}
+
+PumpState PumpJournal::state() const {
+    QMutexLocker locker(&m_mutex);
+    return m_state;
+}
+
+PumpJournal::RecoveryStats PumpJournal::recoveryStats() const {
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+bool PumpJournal::readEvents(const QString &directory, QVector<JournalEvent> *events, QString *error) {
+    QFile file(QDir(directory).filePath(kJournalFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("cannot open %1: %2").arg(file.fileName(), file.errorString());
+        return false;
+    }
+    if (!checkHeader(file.read(kHeaderBytes), kJournalMagic)) {
+        *error = QString("%1 is not a pump journal").arg(file.fileName());
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    events->clear();
+    events->reserve(data.size() / kRecordBytes);
+    JournalEvent event;
+    for (int used = 0; used + kRecordBytes <= data.size(); used += kRecordBytes) {
+        if (!decodeEvent(data.constData() + used, &event)) break;
+        events->append(event);
+    }
+    return true;
+}
+
+QString PumpJournal::describe(const JournalEvent &event) {
+    QString text;
+    switch (event.type) {
+    case JournalEvent::BatteryChanged:
+        text = QString("Battery %1%").arg(qRound(event.a));
+        break;
+    case JournalEvent::ReservoirChanged:
+        text = QString("Reservoir %1 u").arg(event.a, 0, 'f', 2);
+        break;
+    case JournalEvent::BasalRateChanged:
+        text = QString("Basal rate %1 u/h").arg(event.a, 0, 'f', 2);
+        break;
+    case JournalEvent::BolusStarted:
+        if (event.flag) {
+            text = QString("Extended bolus started: %1 u now, %2 u at %3 u/h")
+                       .arg(event.a, 0, 'f', 2).arg(event.b, 0, 'f', 2).arg(event.c, 0, 'f', 2);
+        } else {
+            text = QString("Bolus delivered: %1 u").arg(event.a, 0, 'f', 2);
+        }
+        break;
+    case JournalEvent::BolusCancelled:
+        text = QString("Bolus cancelled after %1 u").arg(event.a, 0, 'f', 2);
+        break;
+    case JournalEvent::BolusInterrupted:
+        text = QString("Extended bolus interrupted by restart after %1 u; %2 u extended portion not confirmed")
+                   .arg(event.a, 0, 'f', 2).arg(event.b, 0, 'f', 2);
+        break;
+    case JournalEvent::CgmReading:
+        text = QString("CGM %1 mmol/L at sensor minute %2").arg(event.b, 0, 'f', 1).arg(event.a, 0, 'f', 1);
+        break;
+    case JournalEvent::CgmFilterReset:
+        text = "CGM filter reset";
+        break;
+    case JournalEvent::CgmAlertsChanged:
+        text = QString("CGM alerts %1-%2 mmol/L").arg(event.a, 0, 'f', 1).arg(event.b, 0, 'f', 1);
+        break;
+    case JournalEvent::CgmAlert:
+        text = event.flag == 0 ? QString("CGM alert cleared at %1 mmol/L").arg(event.a, 0, 'f', 1)
+                               : QString("%1 glucose alert at %2 mmol/L").arg(event.flag == 1 ? "Low" : "High")
+                                     .arg(event.a, 0, 'f', 1);
+        break;
+    }
+    const QString time = QDateTime::fromMSecsSinceEpoch(event.timeMs).toString("yyyy-MM-dd hh:mm:ss");
+    return QString("#%1 %2 %3").arg(event.sequence).arg(time, text);
+}
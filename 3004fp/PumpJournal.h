@@ -0,0 +1,145 @@
+#ifndef PUMPJOURNAL_H
+#define PUMPJOURNAL_H
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include "InsulinUnits.h"
+
+// One state change, stored as a fixed 48-byte record. Values are the
+// state after the change, so replaying an event never depends on
+// anything but the state it is applied to.
+struct JournalEvent {
+    enum Type : quint8 {
+        BatteryChanged,      // a = level (%), flag = low warning issued
+        ReservoirChanged,    // a = units (exact to 0.001), flag = low warning issued
+        BasalRateChanged,    // a = u/h
+        BolusStarted,        // a = units delivered now, b = extended units, c = extended u/h; flag = extended running
+        BolusCancelled,      // a = units delivered before the cancel
+        BolusInterrupted,    // Extended bolus still running when the process died; a = delivered, b = extended units
+        CgmReading,          // a = sensor minute, b = mmol/L, c = variance, sources = fusion sources
+        CgmFilterReset,
+        CgmAlertsChanged,    // a = low, b = high threshold (mmol/L)
+        CgmAlert             // Alert state changed; a = filtered mmol/L, flag = 0 cleared, 1 low, 2 high
+    };
+
+    quint32 sequence = 0;    // 1-based, gap-free
+    qint64 timeMs = 0;       // Wall clock (ms since epoch), for the audit trail
+    Type type = BatteryChanged;
+    quint8 flag = 0;
+    double a = 0.0;
+    double b = 0.0;
+    double c = 0.0;
+    quint32 sources = 0;
+
+    static JournalEvent make(Type type, double a = 0.0, double b = 0.0, double c = 0.0, quint8 flag = 0);
+};
+
+// Pump state as rebuilt from the journal: the fold of every event so far
+struct PumpState {
+    static const int kReadingWindow = 288;   // CGM readings kept (24 h at 5 min), the least CGMManager keeps
+
+    struct Reading {
+        double minute = 0.0;                 // Sensor time
+        double glucose = 0.0;
+        double variance = 0.0;
+        quint32 sources = 0;
+        bool resetBefore = false;            // Filter was restarted just before this reading
+        qint64 timeMs = 0;
+    };
+
+    quint32 sequence = 0;                    // Last event applied; 0 = nothing journaled yet
+
+    // SafetyController
+    int batteryLevel = 100;
+    bool lowBatteryWarned = false;
+    InsulinUnits insulinLevel = InsulinUnits::fromWholeUnits(100);
+    bool lowInsulinWarned = false;
+    double basalRate = 1.0;
+
+    // BolusManager
+    bool bolusInProgress = false;
+    double partialDelivered = 0.0;
+    double extendedUnits = 0.0;              // Of the bolus in progress
+    qint64 bolusStartMs = 0;
+
+    // CGMManager
+    double lowGlucoseThreshold = 3.9;
+    double highGlucoseThreshold = 10.0;
+    bool filterResetPending = false;         // Reset journaled, no reading since
+    QVector<Reading> readings;               // Oldest first
+
+    void apply(const JournalEvent &event);
+};
+
+// Append-only journal of pump state changes with periodic snapshots.
+//
+// SafetyController, BolusManager and CGMManager record every change here.
+// The journal folds each event into a PumpState and, every
+// kSnapshotInterval events, writes that state to a snapshot file together
+// with the journal offset it covers. Opening the journal loads the
+// snapshot and replays only the events after it, so recovery costs at most
+// one interval of events however long the pump has run. The journal itself
+// is never rewritten, so it stays a complete audit trail.
+//
+// Files in the journal directory:
+//   pump.journal   8-byte header, then 48-byte records, each with a CRC-16
+//   pump.snapshot  Folded state, replaced atomically
+class PumpJournal {
+public:
+    static const int kSnapshotInterval = 1024;
+
+    // Outcome of the last open()
+    struct RecoveryStats {
+        quint32 snapshotSequence = 0;        // 0 if no usable snapshot
+        int replayedEvents = 0;
+        qint64 droppedBytes = 0;             // Torn or corrupt tail cut off the journal
+        qint64 elapsedUs = 0;
+    };
+
+    ~PumpJournal();
+
+    // Opens (creating if needed) the journal in 'directory' and recovers the
+    // state. An extended bolus that was still running is journaled as interrupted.
+    bool open(const QString &directory, QString *error);
+    void close();
+    bool isOpen() const;
+
+    // Stamps, appends and folds an event; snapshots every snapshotInterval() events.
+    // Safe to call from any thread; does nothing while closed. Only the snapshots allocate.
+    void record(JournalEvent event);
+
+    // Events between automatic snapshots (kSnapshotInterval by default; 0 = only snapshot())
+    void setSnapshotInterval(int events);
+    int snapshotInterval() const;
+
+    // Writes a snapshot of the current state now
+    bool snapshot(QString *error);
+
+    // Current state; right after open() this is the recovered state
+    PumpState state() const;
+    RecoveryStats recoveryStats() const;
+
+    // Every event in a journal directory, oldest first (stops at a torn tail)
+    static bool readEvents(const QString &directory, QVector<JournalEvent> *events, QString *error);
+
+    // One-line description for logs and audits
+    static QString describe(const JournalEvent &event);
+
+private:
+    void append(JournalEvent event);
+    bool writeSnapshot(QString *error);
+    bool loadSnapshot(qint64 *offset);
+
+    mutable QMutex m_mutex;
+    QString m_directory;
+    QFile m_file;
+    PumpState m_state;
+    int m_sinceSnapshot = 0;
+    int m_snapshotInterval = kSnapshotInterval;
+    RecoveryStats m_stats;
+};
+
+#endif // PUMPJOURNAL_H
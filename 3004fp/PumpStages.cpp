@@ -0,0 +1,389 @@
+#include "PumpStages.h"
+#include <QRandomGenerator>
+#include <QDebug>
+#include <cmath>
+#include "Instrumentation.h"
+
+// Advances BG by one 5-minute step; the first call after start returns the initial value
+SensorReading SimulatedCgmSensor::sense(PatientState &patient) {
+    SensorReading reading;
+
+    if (patient.initialReadingPending) {
+        patient.initialReadingPending = false;
+        reading.simMinutes = patient.simMinutes;
+        reading.glucose = patient.glucose;
+        reading.initial = true;
+        return reading;
+    }
+
+    double currentBG = patient.glucose;
+
+    // This plant only follows the IOB input: delivered corrections join it, basal pulses are ignored
+    patient.inputs.insulinOnBoard += patient.pendingBolus;
+    patient.pendingBolus = 0.0;
+    patient.pendingBasal = 0.0;
+
+    // Exercise makes insulin act harder and uses up some glucose on its own
+    double insulinEffect = patient.inputs.insulinOnBoard * 0.08 * (1.0 + patient.exerciseIntensity);
+    double carbEffect = patient.inputs.carbsOnBoard * 0.008 - 0.15 * patient.exerciseIntensity;
+
+    // Decay logic
+    patient.inputs.insulinOnBoard = qMax(0.0, patient.inputs.insulinOnBoard - 0.1);
+    patient.inputs.carbsOnBoard = qMax(0.0, patient.inputs.carbsOnBoard - 0.2);
+
+    double randomVariation = ((QRandomGenerator::global()->bounded(60) - 30) * 0.01);
+
+    // Compute new BG value
+    double newBG = currentBG + carbEffect - insulinEffect + randomVariation;
+
+    // Clamp to safe physiological bounds
+    if (newBG < 2.5) newBG = 2.5;
+    if (newBG > 20.0) newBG = 20.0;
+
+    // Advance time (each update = 5 minutes of simulated time)
+    patient.simMinutes += 5;
+    patient.glucose = newBG;
+
+    reading.simMinutes = patient.simMinutes;
+    reading.glucose = patient.sensorBias != 0.0 ? qBound(2.2, newBG + patient.sensorBias, 22.2) : newBG;
+    return reading;
+}
+
+// Advances every patient's lane by one 5-minute step in a single integrator pass
+void PhysiologicalCgmSensor::beginTick(PatientState *patients, int count) {
+    m_batch = patients;
+
+    if (m_cohort.size() != count) {
+        m_cohort.reset(*m_model, count);
+        m_reportedIob.fill(0.0, count);
+        m_reportedCob.fill(0.0, count);
+        for (int i = 0; i < count; ++i) {
+            initializePatient(patients[i], i);
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        PatientState &patient = patients[i];
+        if (patient.initialReadingPending) continue;
+
+        // User-entered IOB/COB above what the model reported last tick is a new bolus/meal;
+        // small differences are spin box rounding, not intake
+        double userInsulin = patient.inputs.insulinOnBoard - m_reportedIob[i];
+        double userCarbs = patient.inputs.carbsOnBoard - m_reportedCob[i];
+        double newInsulin = (userInsulin >= 0.05 ? userInsulin : 0.0) + patient.pendingBolus;
+        if (newInsulin > 0.0) m_model->addBolus(m_cohort, i, newInsulin);
+        if (userCarbs >= 0.5) m_model->addMeal(m_cohort, i, userCarbs);
+        patient.pendingBolus = 0.0;
+
+        // The basal pulses delivered last tick, spread over this step (mU/min). IOB is
+        // measured against the running rate, so the pulses' tick-to-tick jitter is not IOB
+        m_cohort.insulinRate()[i] = patient.pendingBasal * 1000.0 / 5.0;
+        m_cohort.basalRate()[i] = patient.deliveredBasalRate * 1000.0 / 60.0;
+        patient.pendingBasal = 0.0;
+
+        // Exercise makes insulin act harder without adding any to the depot
+        m_cohort.insulinAction()[i] = 1.0 + patient.exerciseIntensity;
+    }
+
+    m_integrator.advance(*m_model, m_cohort, 5.0);
+
+    // Restarted patients begin at equilibrium at their start value
+    for (int i = 0; i < count; ++i) {
+        if (patients[i].initialReadingPending) {
+            initializePatient(patients[i], i);
+        }
+    }
+}
+
+void PhysiologicalCgmSensor::initializePatient(PatientState &patient, int lane) {
+    m_model->initializeSteadyState(m_cohort, lane, patient.glucose, patient.deliveredBasalRate);
+    m_model->addBolus(m_cohort, lane, patient.inputs.insulinOnBoard);
+    m_model->addMeal(m_cohort, lane, patient.inputs.carbsOnBoard);
+    m_reportedIob[lane] = patient.inputs.insulinOnBoard;
+    m_reportedCob[lane] = patient.inputs.carbsOnBoard;
+    patient.pendingBolus = 0.0;
+    // The steady state assumes basal ran before the start, so the first step gets its pulses
+    patient.pendingBasal = patient.deliveredBasalRate * 5.0 / 60.0;
+}
+
+SensorReading PhysiologicalCgmSensor::sense(PatientState &patient) {
+    const int lane = static_cast<int>(&patient - m_batch);
+    SensorReading reading;
+
+    if (patient.initialReadingPending) {
+        patient.initialReadingPending = false;
+        reading.simMinutes = patient.simMinutes;
+        reading.glucose = patient.glucose;
+        reading.initial = true;
+        return reading;
+    }
+
+    double noise = (QRandomGenerator::global()->bounded(60) - 30) * 0.01;
+    double sensed = qBound(2.2, m_model->glucose(m_cohort, lane) + noise, 22.2);   // CGM reporting range
+
+    patient.inputs.insulinOnBoard = std::round(m_model->insulinOnBoard(m_cohort, lane) * 100.0) / 100.0;
+    patient.inputs.carbsOnBoard = std::round(m_model->carbsOnBoard(m_cohort, lane) * 10.0) / 10.0;
+    m_reportedIob[lane] = patient.inputs.insulinOnBoard;
+    m_reportedCob[lane] = patient.inputs.carbsOnBoard;
+
+    patient.simMinutes += 5;
+    patient.glucose = sensed;
+
+    reading.simMinutes = patient.simMinutes;
+    reading.glucose = patient.sensorBias != 0.0 ? qBound(2.2, sensed + patient.sensorBias, 22.2) : sensed;
+    return reading;
+}
+
+GlucoseEstimate CgmHistoryEstimator::estimate(const PatientState &patient, const SensorReading &reading) {
+    // A new session starts the filter from its first reading
+    if (reading.initial) {
+        m_cgmManager->resetFilter();
+    }
+    m_cgmManager->addReading(reading.glucose);
+    const GlucoseKalmanFilter &filter = m_cgmManager->filter();
+
+    GlucoseEstimate estimate;
+    estimate.glucose = filter.glucose();
+    estimate.rawGlucose = reading.glucose;
+    estimate.trend = filter.trend();
+    estimate.variance = filter.variance();
+    estimate.insulinOnBoard = patient.inputs.insulinOnBoard;
+    estimate.carbsOnBoard = patient.inputs.carbsOnBoard;
+    estimate.basalRate = patient.inputs.basalRate;
+    estimate.correctionFactor = patient.inputs.correctionFactor;
+    estimate.carbRatio = patient.inputs.carbRatio;
+    return estimate;
+}
+
+GlucosePrediction LinearGlucosePredictor::predict(const SensorReading &reading, const GlucoseEstimate &estimate,
+                                                  TickArena &arena) {
+    GlucosePrediction prediction;
+    prediction.predicted30min = m_cgmManager->predictGlucoseLevels(arena, estimate.glucose, estimate.insulinOnBoard,
+                                                                   estimate.carbsOnBoard, estimate.basalRate,
+                                                                   30).last().second;
+    prediction.predicted30minLow = prediction.predicted30min;
+
+    // Dashed chart line starting at the latest reading
+    double currentTime = reading.simMinutes;
+    double currentGlucose = estimate.glucose;
+    prediction.curve = ArenaArray<QPointF>(arena, 13);
+    prediction.curve.append(QPointF(currentTime, currentGlucose));
+
+    double insulinDecayRate = 0.15;
+    double carbDecayRate = 0.015;
+
+    for (int i = 5; i <= 60; i += 5) {
+        double timePoint = currentTime + i;
+
+        // Linear decay of insulin & carbs
+        double insulinEffect = estimate.insulinOnBoard * insulinDecayRate * (1.0 - (i / 60.0));
+        double carbEffect = estimate.carbsOnBoard * carbDecayRate * (1.0 - (i / 60.0));
+
+        if (insulinEffect < 0) insulinEffect = 0;
+        if (carbEffect < 0) carbEffect = 0;
+
+        double predictedGlucose = currentGlucose + carbEffect - insulinEffect;
+
+        // Clamp prediction
+        if (predictedGlucose < 2.5)
+            predictedGlucose = 2.5;
+        else if (predictedGlucose > 15.0)
+            predictedGlucose = 15.0;
+
+        prediction.curve.append(QPointF(timePoint, predictedGlucose));
+    }
+
+    return prediction;
+}
+
+ControlDecision ThresholdBasalController::decide(const PatientState &patient, const GlucoseEstimate &estimate,
+                                                 const GlucosePrediction &prediction) {
+    ControlDecision decision;
+    double glucoseLevel = estimate.glucose;
+    double targetBG = patient.inputs.targetBG;
+    double CF = patient.inputs.correctionFactor;
+
+    qCDebug(lcTick) << "[DEBUG] BG =" << glucoseLevel
+             << "| Target BG =" << targetBG
+             << "| CF =" << CF;
+
+    // Alert Label Logic
+    if (glucoseLevel <= 3.9) decision.alert = ControlDecision::LowAlert;
+    else if (glucoseLevel >= 10.0) decision.alert = ControlDecision::HighAlert;
+
+    decision.criticalLow = glucoseLevel <= 2.8;
+    decision.criticalHigh = glucoseLevel >= 15.0;
+
+    // Recommend Correction
+    if (CF > 0.0 && glucoseLevel > targetBG + 2.0) {
+        double correction = (glucoseLevel - targetBG) / CF;
+        decision.recommendedCorrection = std::round(correction * 100.0) / 100.0;
+        qCDebug(lcTick) << "[DEBUG] Triggering Correction | Correction Dose:" << decision.recommendedCorrection;
+    }
+    // Recommend Carbs
+    else if (glucoseLevel < targetBG - 1.0) {
+        qCDebug(lcTick) << "[DEBUG] BG below target - recommending carbs.";
+        decision.recommendCarbs = true;
+    }
+    // No action
+    else {
+        qCDebug(lcTick) << "[DEBUG] BG within acceptable range - no action taken.";
+    }
+
+    // Predictive basal adjustment
+    double predictedBG30min = prediction.predicted30min;
+    if (prediction.predicted30minLow <= 3.9) {
+        decision.basalAction = ControlDecision::SuspendBasal;
+    } else if (predictedBG30min <= 5.0) {
+        decision.basalAction = ControlDecision::DecreaseBasal;
+        decision.basalAdjustment = -0.3;
+    } else if (predictedBG30min >= 8.9) {
+        decision.basalAction = ControlDecision::IncreaseBasal;
+        decision.basalAdjustment = +0.3;
+    }
+
+    // Auto correction at most once an hour of simulated time, net of insulin still on board
+    int minsSinceLastAuto = patient.lastAutoCorrectionMinute >= 0
+                            ? patient.simMinutes - patient.lastAutoCorrectionMinute : 999;
+
+    if (CF > 0.0 && predictedBG30min >= 10.0 && minsSinceLastAuto >= 60) {
+        double correction = (predictedBG30min - targetBG) / CF - estimate.insulinOnBoard;
+        if (correction > 6.0) correction = 6.0;
+        if (correction > 0.0) decision.autoCorrection = correction;
+    }
+
+    return decision;
+}
+
+void PumpDelivery::beginTick(PatientState *patients, int count) {
+    m_batch = patients;
+    const int previous = m_basal.pumpCount();
+    if (previous == count) return;
+
+    m_basal.resize(count);
+    for (int lane = previous; lane < count; ++lane) {
+        // A lane joining mid-run starts pulsing from its current minute
+        m_basal.restart(lane, patients[lane].simMinutes);
+        m_basal.setRate(lane, patients[lane].deliveredBasalRate);
+    }
+}
+
+DeliveryReport PumpDelivery::deliver(PatientState &patient, const TickFrame &frame) {
+    DeliveryReport report;
+    const ControlDecision &decision = frame.decision;
+    double glucoseLevel = frame.reading.glucose;
+    const int simTime = frame.reading.simMinutes;
+    const int lane = static_cast<int>(&patient - m_batch);
+
+    // Basal pulses due since the last tick (none for the reading taken at start)
+    if (frame.reading.initial) {
+        m_basal.restart(lane, simTime);
+        m_basal.setRate(lane, patient.deliveredBasalRate);
+    } else {
+        const int pulses = m_basal.advance(lane, simTime);
+        const InsulinUnits basal = InsulinUnits::fromTicks(InsulinUnits::kPumpStepTicks) * pulses;
+        report.basalUnits = m_controller->deliverInsulin(basal).toUnits();
+        patient.pendingBasal += report.basalUnits;
+    }
+
+    // Scenario actions since the last tick
+    if (patient.refillPending) {
+        patient.refillPending = false;
+        m_controller->refillInsulin();
+        report.addEvent(DeliveryEvent::ReservoirRefilled, simTime);
+    }
+    if (patient.profileChanged) {
+        patient.profileChanged = false;
+        m_controller->setBasalRate(patient.inputs.basalRate);
+        report.addEvent(DeliveryEvent::ProfileSwitched, simTime, patient.inputs.basalRate);
+    }
+    if (patient.tempBasalPending) {
+        patient.tempBasalPending = false;
+        if (patient.tempBasalMinutes > 0) {
+            m_basal.setTempBasal(lane, patient.tempBasalRate, patient.tempBasalMinutes);
+            DeliveryEvent started;
+            started.kind = DeliveryEvent::TempBasalStarted;
+            started.simMinutes = simTime;
+            started.value = m_basal.activeRate(lane);
+            started.amount = patient.tempBasalMinutes;
+            report.addEvent(started);
+        } else {
+            m_basal.cancelTempBasal(lane);
+            report.addEvent(DeliveryEvent::TempBasalCancelled, simTime);
+        }
+    }
+    if (patient.scenarioBolus > 0.0) {
+        // Only what the reservoir gave joins IOB, which both plants take new boluses from
+        const double bolusUnits = m_controller->deliverInsulin(InsulinUnits::fromUnits(patient.scenarioBolus)).toUnits();
+        patient.inputs.insulinOnBoard += bolusUnits;
+        report.addEvent(DeliveryEvent::MealBolus, simTime, bolusUnits);
+        report.mealBolus = bolusUnits;
+        patient.scenarioBolus = 0.0;
+    }
+
+    // The reading's own entry goes after the corrections and warnings it led to
+    DeliveryEvent reading;
+    reading.simMinutes = simTime;
+    reading.value = glucoseLevel;
+
+    // The recommended correction is advice for the user; only the rate-limited auto correction is dosed
+    if (decision.recommendedCorrection > 0.0) {
+        reading.advice = DeliveryEvent::AdviseCorrection;
+        reading.amount = decision.recommendedCorrection;
+    } else if (decision.recommendCarbs) {
+        reading.advice = DeliveryEvent::AdviseCarbs;
+    }
+
+    // CRITICAL warning logs
+    if (decision.criticalLow)
+        report.addEvent(DeliveryEvent::CriticalLow, simTime);
+    if (decision.criticalHigh)
+        report.addEvent(DeliveryEvent::CriticalHigh, simTime);
+
+    // Final event log
+    report.addEvent(reading);
+    qCDebug(lcTick) << "[CGM] LogEntry Created:" << reading.text();
+
+    switch (decision.basalAction) {
+    case ControlDecision::SuspendBasal:
+        // Logged when the suspension starts, not on every tick it lasts
+        if (m_controller->getBasalRate() > 0.0) {
+            m_controller->setBasalRate(0.0);
+            report.addEvent(DeliveryEvent::BasalSuspended, simTime);
+        }
+        break;
+    case ControlDecision::DecreaseBasal:
+        m_controller->adjustBasalRate(decision.basalAdjustment);
+        report.addEvent(DeliveryEvent::BasalDecreased, simTime);
+        break;
+    case ControlDecision::IncreaseBasal:
+        m_controller->adjustBasalRate(decision.basalAdjustment);
+        report.addEvent(DeliveryEvent::BasalIncreased, simTime);
+        break;
+    case ControlDecision::SetBasal:
+        if (std::fabs(decision.basalRate - m_controller->getBasalRate()) >= 0.05) {
+            m_controller->setBasalRate(decision.basalRate);
+            report.addEvent(DeliveryEvent::BasalSet, simTime, decision.basalRate);
+        }
+        break;
+    case ControlDecision::KeepBasal:
+        break;
+    }
+
+    if (decision.autoCorrection > 0.0) {
+        // Whole pump steps only, and no more than the reservoir holds
+        const InsulinUnits dose = InsulinUnits::fromUnits(decision.autoCorrection).toPumpStep();
+        const double correctionUnits = m_controller->deliverInsulin(dose).toUnits();
+        patient.pendingBolus += correctionUnits;
+        report.correctionBolus = correctionUnits;
+
+        patient.lastAutoCorrectionMinute = patient.simMinutes;
+
+        report.addEvent(DeliveryEvent::AutoCorrection, simTime, correctionUnits);
+    }
+
+    // The controller's rate runs from now on, unless a temp basal overrides it
+    m_basal.setRate(lane, m_controller->getBasalRate());
+    patient.deliveredBasalRate = m_basal.activeRate(lane);
+    return report;
+}
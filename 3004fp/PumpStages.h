@@ -0,0 +1,89 @@
+#ifndef PUMPSTAGES_H
+#define PUMPSTAGES_H
+
+#include "TickPipeline.h"
+#include "CGMManager.h"
+#include "SafetyController.h"
+#include "PhysiologicalModel.h"
+#include "BasalDelivery.h"
+
+// Default tick stages reproducing the pump's original behaviour.
+// Each can be replaced on TickPipeline without touching the others.
+
+// Sense: simple linear plant (IOB/COB effect, decay, ±0.3 noise) read by an ideal CGM
+class SimulatedCgmSensor : public SenseStage {
+public:
+    SensorReading sense(PatientState &patient) override;
+};
+
+// Sense (alternative): a GlucoseModel cohort integrated with RK4, one lane per patient.
+// beginTick() feeds each patient's basal, new boluses and new carbs to the model and
+// advances every patient 5 minutes in one batch; sense() reads the patient's lane
+// with ±0.3 mmol/L sensor noise and writes the model's IOB/COB back to the inputs.
+class PhysiologicalCgmSensor : public SenseStage {
+public:
+    explicit PhysiologicalCgmSensor(const GlucoseModel *model) : m_model(model) {}
+
+    void beginTick(PatientState *patients, int count) override;
+    SensorReading sense(PatientState &patient) override;
+
+    const GlucoseModel *model() const { return m_model; }
+    const ModelCohort &cohort() const { return m_cohort; }
+
+private:
+    void initializePatient(PatientState &patient, int lane);
+
+    const GlucoseModel *m_model;
+    ModelCohort m_cohort;
+    Rk4Integrator m_integrator;
+    PatientState *m_batch = nullptr;       // Patients of the current tick; lane = index in this array
+    QVector<double> m_reportedIob;         // IOB/COB written back last tick, to detect user additions
+    QVector<double> m_reportedCob;
+};
+
+// Estimate: records the reading in CGM history and reports the Kalman-filtered BG and trend
+class CgmHistoryEstimator : public EstimateStage {
+public:
+    explicit CgmHistoryEstimator(CGMManager *cgmManager) : m_cgmManager(cgmManager) {}
+    GlucoseEstimate estimate(const PatientState &patient, const SensorReading &reading) override;
+
+private:
+    CGMManager *m_cgmManager;
+};
+
+// Predict: CGMManager model for the 30-minute value, decaying-effect line for the chart
+class LinearGlucosePredictor : public PredictStage {
+public:
+    explicit LinearGlucosePredictor(CGMManager *cgmManager) : m_cgmManager(cgmManager) {}
+    GlucosePrediction predict(const SensorReading &reading, const GlucoseEstimate &estimate,
+                              TickArena &arena) override;
+
+private:
+    CGMManager *m_cgmManager;
+};
+
+// Control: fixed BG thresholds for alerts and corrections, predicted-BG thresholds for basal
+class ThresholdBasalController : public ControlStage {
+public:
+    ControlDecision decide(const PatientState &patient, const GlucoseEstimate &estimate,
+                           const GlucosePrediction &prediction) override;
+};
+
+// Deliver: applies decisions to the SafetyController and writes the event log.
+// Basal is delivered in pump-step pulses by one scheduler lane per patient,
+// at the rate the pump ran since the last tick (a temp basal while one runs).
+class PumpDelivery : public DeliverStage {
+public:
+    explicit PumpDelivery(SafetyController *controller) : m_controller(controller) {}
+    void beginTick(PatientState *patients, int count) override;
+    DeliveryReport deliver(PatientState &patient, const TickFrame &frame) override;
+
+    const BasalScheduler &basal() const { return m_basal; }
+
+private:
+    SafetyController *m_controller;
+    BasalScheduler m_basal;
+    PatientState *m_batch = nullptr;       // Patients of the current tick; lane = index in this array
+};
+
+#endif // PUMPSTAGES_H
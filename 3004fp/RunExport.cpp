@@ -0,0 +1,227 @@
+#include "RunExport.h"
+#include <QDir>
+#include <limits>
+
+namespace {
+
+// Column indices, in schema() order
+enum ReadingColumn { RPatient, RMinute, RTime, RGlucose, RFiltered, RTrend, RVariance, RInitial };
+enum PredictionColumn { PPatient, PMinute, PHorizon, PGlucose, PLower, PUpper };
+enum DecisionColumn {
+    DPatient, DMinute, DAlert, DCriticalLow, DCriticalHigh, DRecommendCarbs, DRecommendedCorrection,
+    DBasalAction, DBasalAdjustment, DBasalRate, DAutoCorrection, DPredicted30, DPredicted30Low,
+    DDeliveredBasalRate, DInsulinOnBoard, DCarbsOnBoard
+};
+enum DoseColumn { OPatient, OMinute, OKind, OUnits, ORate };
+}
+
+RunExporter::RunExporter() {
+    for (int table = 0; table < TableCount; ++table) {
+        m_batches.append(ArrowBatch(schema(Table(table)), kBatchRows));
+    }
+}
+
+RunExporter::~RunExporter() {
+    QString error;
+    close(&error);
+}
+
+QVector<ArrowField> RunExporter::schema(Table table) {
+    switch (table) {
+    case Readings:
+        return {
+            {"patient", ArrowField::Int32},
+            {"minute", ArrowField::Int32},              // Sim minutes since start
+            {"time", ArrowField::TimestampMs},
+            {"glucose", ArrowField::Float64},           // CGM reading (mmol/L)
+            {"filtered", ArrowField::Float64},
+            {"trend", ArrowField::Float64},             // mmol/L per minute
+            {"variance", ArrowField::Float64},
+            {"initial", ArrowField::Bool},
+        };
+    case Predictions:
+        return {
+            {"patient", ArrowField::Int32},
+            {"minute", ArrowField::Int32},              // When the prediction was made
+            {"horizon", ArrowField::Int32},             // Minutes ahead
+            {"glucose", ArrowField::Float64},
+            {"lower", ArrowField::Float64},             // 10th/90th percentile; NaN for point predictors
+            {"upper", ArrowField::Float64},
+        };
+    case Decisions:
+        return {
+            {"patient", ArrowField::Int32},
+            {"minute", ArrowField::Int32},
+            {"alert", ArrowField::Int8},                // ControlDecision::GlucoseAlert
+            {"critical_low", ArrowField::Bool},
+            {"critical_high", ArrowField::Bool},
+            {"recommend_carbs", ArrowField::Bool},
+            {"recommended_correction", ArrowField::Float64},
+            {"basal_action", ArrowField::Int8},         // ControlDecision::BasalAction
+            {"basal_adjustment", ArrowField::Float64},
+            {"basal_rate", ArrowField::Float64},
+            {"auto_correction", ArrowField::Float64},
+            {"predicted_30min", ArrowField::Float64},
+            {"predicted_30min_low", ArrowField::Float64},
+            {"delivered_basal_rate", ArrowField::Float64},
+            {"insulin_on_board", ArrowField::Float64},
+            {"carbs_on_board", ArrowField::Float64},
+        };
+    case Doses:
+        return {
+            {"patient", ArrowField::Int32},
+            {"minute", ArrowField::Int32},
+            {"kind", ArrowField::Int8},                 // RunExporter::DoseKind
+            {"units", ArrowField::Float64},
+            {"rate", ArrowField::Float64},              // u/h for basal, 0 for boluses
+        };
+    case TableCount:
+        break;
+    }
+    return {};
+}
+
+QString RunExporter::fileName(Table table) {
+    static const char *const names[TableCount] = {"readings.arrow", "predictions.arrow", "decisions.arrow", "doses.arrow"};
+    return names[table];
+}
+
+bool RunExporter::open(const QString &directory, qint64 startMs, QString *error) {
+    close(error);
+    error->clear();
+    if (!QDir().mkpath(directory)) {
+        *error = QString("cannot create %1").arg(directory);
+        return false;
+    }
+    for (int table = 0; table < TableCount; ++table) {
+        if (!m_writers[table].open(QDir(directory).filePath(fileName(Table(table))), schema(Table(table)), error)) {
+            for (int opened = 0; opened < table; ++opened) {
+                QString ignored;
+                m_writers[opened].close(&ignored);
+            }
+            return false;
+        }
+        m_batches[table].clear();
+    }
+    m_directory = directory;
+    m_startMs = startMs;
+    m_error.clear();
+    m_open = true;
+    return true;
+}
+
+void RunExporter::appendTick(const PatientState *patients, const TickFrame *frames, int count, int firstPatient) {
+    if (!m_open) return;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    for (int i = 0; i < count; ++i) {
+        const PatientState &patient = patients[i];
+        const TickFrame &frame = frames[i];
+        const qint32 id = firstPatient + i;
+        const qint32 minute = frame.reading.simMinutes;
+
+        ArrowBatch &readings = m_batches[Readings];
+        int row = nextRow(Readings);
+        readings.column<qint32>(RPatient)[row] = id;
+        readings.column<qint32>(RMinute)[row] = minute;
+        readings.column<qint64>(RTime)[row] = m_startMs + qint64(minute) * 60000;
+        readings.column<double>(RGlucose)[row] = frame.reading.glucose;
+        readings.column<double>(RFiltered)[row] = frame.estimate.glucose;
+        readings.column<double>(RTrend)[row] = frame.estimate.trend;
+        readings.column<double>(RVariance)[row] = frame.estimate.variance;
+        readings.setBool(RInitial, row, frame.reading.initial);
+
+        // Bands, when present, share the curve's time points
+        const GlucosePrediction &prediction = frame.prediction;
+        const bool banded = prediction.lowerBand.size() == prediction.curve.size()
+                            && prediction.upperBand.size() == prediction.curve.size();
+        ArrowBatch &predictions = m_batches[Predictions];
+        for (int p = 0; p < prediction.curve.size(); ++p) {
+            row = nextRow(Predictions);
+            predictions.column<qint32>(PPatient)[row] = id;
+            predictions.column<qint32>(PMinute)[row] = minute;
+            predictions.column<qint32>(PHorizon)[row] = qRound(prediction.curve[p].x()) - minute;
+            predictions.column<double>(PGlucose)[row] = prediction.curve[p].y();
+            predictions.column<double>(PLower)[row] = banded ? prediction.lowerBand[p].y() : nan;
+            predictions.column<double>(PUpper)[row] = banded ? prediction.upperBand[p].y() : nan;
+        }
+
+        const ControlDecision &decision = frame.decision;
+        ArrowBatch &decisions = m_batches[Decisions];
+        row = nextRow(Decisions);
+        decisions.column<qint32>(DPatient)[row] = id;
+        decisions.column<qint32>(DMinute)[row] = minute;
+        decisions.column<qint8>(DAlert)[row] = qint8(decision.alert);
+        decisions.setBool(DCriticalLow, row, decision.criticalLow);
+        decisions.setBool(DCriticalHigh, row, decision.criticalHigh);
+        decisions.setBool(DRecommendCarbs, row, decision.recommendCarbs);
+        decisions.column<double>(DRecommendedCorrection)[row] = decision.recommendedCorrection;
+        decisions.column<qint8>(DBasalAction)[row] = qint8(decision.basalAction);
+        decisions.column<double>(DBasalAdjustment)[row] = decision.basalAdjustment;
+        decisions.column<double>(DBasalRate)[row] = decision.basalRate;
+        decisions.column<double>(DAutoCorrection)[row] = decision.autoCorrection;
+        decisions.column<double>(DPredicted30)[row] = prediction.predicted30min;
+        decisions.column<double>(DPredicted30Low)[row] = prediction.predicted30minLow;
+        decisions.column<double>(DDeliveredBasalRate)[row] = patient.deliveredBasalRate;
+        decisions.column<double>(DInsulinOnBoard)[row] = patient.inputs.insulinOnBoard;
+        decisions.column<double>(DCarbsOnBoard)[row] = patient.inputs.carbsOnBoard;
+
+        // Basal pulses delivered since the last tick, with the rate running from now
+        const struct { DoseKind kind; double units; double rate; } doses[] = {
+            {BasalDose, frame.delivery.basalUnits, patient.deliveredBasalRate},
+            {MealBolusDose, frame.delivery.mealBolus, 0.0},
+            {CorrectionBolusDose, frame.delivery.correctionBolus, 0.0},
+        };
+        ArrowBatch &ledger = m_batches[Doses];
+        for (const auto &dose : doses) {
+            if (dose.kind != BasalDose && dose.units <= 0.0) continue;
+            row = nextRow(Doses);
+            ledger.column<qint32>(OPatient)[row] = id;
+            ledger.column<qint32>(OMinute)[row] = minute;
+            ledger.column<qint8>(OKind)[row] = dose.kind;
+            ledger.column<double>(OUnits)[row] = dose.units;
+            ledger.column<double>(ORate)[row] = dose.rate;
+        }
+    }
+}
+
+bool RunExporter::close(QString *error) {
+    if (!m_open) return true;
+    m_open = false;
+
+    for (int table = 0; table < TableCount; ++table) {
+        flush(Table(table));
+        QString closeError;
+        if (!m_writers[table].close(&closeError) && m_error.isEmpty()) {
+            m_error = closeError;
+        }
+    }
+    if (!m_error.isEmpty()) {
+        *error = m_error;
+        return false;
+    }
+    return true;
+}
+
+qint64 RunExporter::rowCount(Table table) const {
+    return m_writers[table].rowCount() + m_batches[table].rows();
+}
+
+int RunExporter::nextRow(Table table) {
+    ArrowBatch &batch = m_batches[table];
+    if (batch.rows() == batch.capacity()) {
+        flush(table);
+    }
+    const int row = batch.rows();
+    batch.setRows(row + 1);
+    return row;
+}
+
+// After a write error the rest of the run is dropped; close() reports it
+void RunExporter::flush(Table table) {
+    ArrowBatch &batch = m_batches[table];
+    if (batch.rows() > 0 && m_error.isEmpty()) {
+        m_writers[table].write(batch, &m_error);
+    }
+    batch.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef RUNEXPORT_H
+#define RUNEXPORT_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include "ArrowIpc.h"
+#include "TickPipeline.h"
+
+// Writes the ticks of a run, for one patient or a whole cohort, as Arrow IPC
+// files for dataframe tools:
+//
+//   readings.arrow     CGM reading and filter output per patient and tick
+//   predictions.arrow  Every point of every prediction curve, with its band
+//   decisions.arrow    Controller output and the inputs it saw
+//   doses.arrow        Dose ledger: basal per tick plus meal and correction boluses
+//
+// Rows are copied from the pipeline's PatientState/TickFrame arrays straight
+// into column buffers and written kBatchRows at a time, so memory stays flat
+// however long or wide the run is.
+class RunExporter {
+public:
+    enum Table { Readings, Predictions, Decisions, Doses, TableCount };
+    enum DoseKind : qint8 { BasalDose, MealBolusDose, CorrectionBolusDose };
+
+    static const int kBatchRows = 65536;
+
+    RunExporter();
+    ~RunExporter();
+
+    // Creates the directory and the four files; 'startMs' (ms since epoch) dates sim minute 0
+    bool open(const QString &directory, qint64 startMs, QString *error);
+    bool isOpen() const { return m_open; }
+
+    // One pipeline tick for 'count' patients, numbered from 'firstPatient'
+    void appendTick(const PatientState *patients, const TickFrame *frames, int count, int firstPatient = 0);
+
+    // Writes what is buffered and the file footers; reports the first write error of the run
+    bool close(QString *error);
+
+    qint64 rowCount(Table table) const;
+    QString directory() const { return m_directory; }
+
+    static QVector<ArrowField> schema(Table table);
+    static QString fileName(Table table);
+
+private:
+    // Row to fill in the table's batch, writing the batch first if it is full
+    int nextRow(Table table);
+    void flush(Table table);
+
+    bool m_open = false;
+    QString m_directory;
+    qint64 m_startMs = 0;
+    ArrowFileWriter m_writers[TableCount];
+    QVector<ArrowBatch> m_batches;
+    QString m_error;
+};
+
+#endif // RUNEXPORT_H
@@ -1,11 +1,14 @@
 #include "SafetyController.h"
 #include <QString>
 #include <QDebug>
+#include "PumpJournal.h"
+#include "Instrumentation.h"
 
 // Constructor initializes battery level and starts timer for simulating battery drain
 SafetyController::SafetyController(QObject *parent)
-    : QObject(parent), batteryLevel(100), lowBatteryWarned(false)
+    : QObject(parent), batteryLevel(100), batteryTimer(this), lowBatteryWarned(false)
 {
+    // Timer is parented so it follows the controller onto the simulation thread
     connect(&batteryTimer, &QTimer::timeout, this, &SafetyController::decreaseBattery);
     batteryTimer.start(1000); // Simulate fast battery depletion (1 second interval)
 }
@@ -22,6 +25,7 @@ void SafetyController::decreaseBattery()
             emit triggerBatteryAlert();
             lowBatteryWarned = true;
         }
+        journalBattery();
 
         // If battery reaches 0, stop timer and signal shutdown
         if (batteryLevel <= 0) {
@@ -37,6 +41,7 @@ void SafetyController::rechargeBattery()
     batteryLevel = 100;
     emit batteryLevelUpdated(batteryLevel);
     lowBatteryWarned = false;
+    journalBattery();
 }
 
 // Global insulin variables simulate shared device state
@@ -45,43 +50,56 @@ bool lowInsulinWarned = false;
 
 // Simulates gradual insulin depletion from basal or bolus delivery
 void SafetyController::decreaseInsulin() {
-    if (insulinLevel > 0) {
-        insulinLevel -= 1;
-        emit insulinLevelUpdated(insulinLevel); // Notify system/UI
+    if (insulinLevel > InsulinUnits()) {
+        insulinLevel = qMax(InsulinUnits(), insulinLevel - InsulinUnits::fromWholeUnits(1));
+        emit insulinLevelUpdated(insulinLevel.wholeUnits()); // Notify system/UI
 
         // Alert user if insulin falls below or equals 50 units
-        if (insulinLevel <= 50 && !lowInsulinWarned) {
+        if (insulinLevel <= InsulinUnits::fromWholeUnits(50) && !lowInsulinWarned) {
             emit triggerLowInsulinAlert();
             lowInsulinWarned = true;
         }
+        journalReservoir();
     }
 }
 
-// Called when insulin is added to the reservoir (e.g., refill)
+// Called with a negative amount when insulin leaves the reservoir (e.g., a manual bolus)
 void SafetyController::registerInsulinDelivery(double amount) {
     if (amount > 0) return;
-    insulinLevel += amount;
-    if (insulinLevel < 0) insulinLevel = 0;
-    emit insulinLevelUpdated(insulinLevel);
+    deliverInsulin(InsulinUnits::fromUnits(-amount));
+}
+
+// Never takes more than the reservoir holds, so the caller learns what was really delivered
+InsulinUnits SafetyController::deliverInsulin(InsulinUnits dose) {
+    if (dose <= InsulinUnits()) return InsulinUnits();
+    const InsulinUnits delivered = qMin(dose, insulinLevel);
+    insulinLevel -= delivered;
+    emit insulinLevelUpdated(insulinLevel.wholeUnits());
 
-    if (insulinLevel <= 20 && !lowInsulinWarned) {
+    if (insulinLevel <= InsulinUnits::fromWholeUnits(20) && !lowInsulinWarned) {
         emit triggerLowInsulinAlert();
         lowInsulinWarned = true;
     }
+    journalReservoir();
+    return delivered;
 }
 
 // Sets the current basal insulin delivery rate (in units/hour)
 void SafetyController::setBasalRate(double rate) {
+    const double previousRate = currentBasalRate;
     currentBasalRate = rate;
-    qDebug() << "[SafetyController] Basal rate set to" << rate << "u/h";
+    journalBasalRate(previousRate);
+    qCDebug(lcTick) << "[SafetyController] Basal rate set to" << rate << "u/h";
 }
 
 // Adjusts the current basal rate by a specified amount, with safety limits
 void SafetyController::adjustBasalRate(double adjustment) {
+    const double previousRate = currentBasalRate;
     currentBasalRate += adjustment;
     if (currentBasalRate < 0.05) currentBasalRate = 0.05;  // Minimum threshold
     if (currentBasalRate > 5.0) currentBasalRate = 5.0;    // Maximum threshold
-    qDebug() << "[SafetyController] Basal rate adjusted by" << adjustment << "->" << currentBasalRate;
+    journalBasalRate(previousRate);
+    qCDebug(lcTick) << "[SafetyController] Basal rate adjusted by" << adjustment << "->" << currentBasalRate;
 }
 
 // Returns the current basal rate
@@ -89,9 +107,47 @@ double SafetyController::getBasalRate() const {
     return currentBasalRate;
 }
 
+// Returns the current battery percentage
+int SafetyController::getBatteryLevel() const {
+    return batteryLevel;
+}
+
+// Returns the current insulin reservoir level in whole units
+int SafetyController::getInsulinLevel() const {
+    return insulinLevel.wholeUnits();
+}
+
 // Refills insulin reservoir to full capacity (200 units) and resets alert flag
 void SafetyController::refillInsulin() {
-    insulinLevel = 200;
-    emit insulinLevelUpdated(insulinLevel);
+    insulinLevel = InsulinUnits::fromWholeUnits(200);
+    emit insulinLevelUpdated(insulinLevel.wholeUnits());
     lowInsulinWarned = false;
+    journalReservoir();
+}
+
+// Restores state recovered from the journal and republishes the levels
+void SafetyController::restoreState(const PumpState &state) {
+    batteryLevel = state.batteryLevel;
+    lowBatteryWarned = state.lowBatteryWarned;
+    insulinLevel = state.insulinLevel;
+    lowInsulinWarned = state.lowInsulinWarned;
+    currentBasalRate = state.basalRate;
+    emit batteryLevelUpdated(batteryLevel);
+    emit insulinLevelUpdated(insulinLevel.wholeUnits());
+}
+
+void SafetyController::journalBattery() {
+    if (!m_journal) return;
+    m_journal->record(JournalEvent::make(JournalEvent::BatteryChanged, batteryLevel, 0.0, 0.0, lowBatteryWarned));
+}
+
+void SafetyController::journalReservoir() {
+    if (!m_journal) return;
+    m_journal->record(JournalEvent::make(JournalEvent::ReservoirChanged, insulinLevel.toUnits(), 0.0, 0.0, lowInsulinWarned));
+}
+
+// The delivery stage re-applies the same rate every tick; only changes are journaled
+void SafetyController::journalBasalRate(double previousRate) {
+    if (!m_journal || currentBasalRate == previousRate) return;
+    m_journal->record(JournalEvent::make(JournalEvent::BasalRateChanged, currentBasalRate));
 }
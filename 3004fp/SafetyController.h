@@ -3,6 +3,10 @@
 
 #include <QObject>
 #include <QTimer>
+#include "InsulinUnits.h"
+
+class PumpJournal;
+struct PumpState;
 
 // Manages safety-related monitoring such as battery and insulin levels
 class SafetyController : public QObject
@@ -13,6 +17,18 @@ public:
     // Constructor initializes safety controller with parent context
     explicit SafetyController(QObject *parent = nullptr);
 
+    // Journal every state change from now on (not owned; null stops journaling)
+    void setJournal(PumpJournal *journal) { m_journal = journal; }
+
+    // Take over battery, reservoir and basal state recovered from the journal
+    void restoreState(const PumpState &state);
+
+    // Take a dose out of the reservoir; returns the part there was insulin for
+    InsulinUnits deliverInsulin(InsulinUnits dose);
+
+    // Exact reservoir contents (getInsulinLevel() is whole units)
+    InsulinUnits getReservoir() const { return insulinLevel; }
+
 signals:
     // Emitted when battery level changes
     void batteryLevelUpdated(int level);
@@ -54,14 +70,26 @@ public slots:
     // Retrieve the current basal rate (u/h)
     double getBasalRate() const;
 
+    // Retrieve the current battery percentage
+    int getBatteryLevel() const;
+
+    // Retrieve the current insulin reservoir level (units)
+    int getInsulinLevel() const;
+
 private:
     int batteryLevel;                 // Current battery percentage
     QTimer batteryTimer;             // Timer to simulate battery drain
     bool lowBatteryWarned;           // Tracks if low battery warning has been issued
 
-    int insulinLevel = 100;          // Initial insulin units
+    InsulinUnits insulinLevel = InsulinUnits::fromWholeUnits(100);   // Initial insulin units
     bool lowInsulinWarned = false;   // Tracks if low insulin warning has been issued
     double currentBasalRate = 1.0;   // Default rate in u/h
+
+    PumpJournal *m_journal = nullptr;
+
+    void journalBattery();
+    void journalReservoir();
+    void journalBasalRate(double previousRate);
 };
 
 #endif // SAFETYCONTROLLER_H
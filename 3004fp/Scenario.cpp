@@ -0,0 +1,340 @@
+#include "Scenario.h"
+#include "InsulinUnits.h"
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+
+namespace {
+const int kMinutesPerDay = 24 * 60;
+const int kMaxDurationMinutes = 366 * kMinutesPerDay;
+
+// "14d", "6h", "90min" or plain minutes; returns -1 if malformed
+int parseLength(const QString &token) {
+    int scale = 1;
+    QString number = token;
+    if (token.endsWith("min")) {
+        number.chop(3);
+    } else if (token.endsWith('h')) {
+        number.chop(1);
+        scale = 60;
+    } else if (token.endsWith('d')) {
+        number.chop(1);
+        scale = kMinutesPerDay;
+    }
+    bool ok = false;
+    double value = number.toDouble(&ok);
+    if (!ok || value < 0.0 || value * scale > kMaxDurationMinutes) return -1;
+    return qRound(value * scale);
+}
+
+// "hh:mm" within one day; returns -1 if malformed
+int parseClock(const QString &token) {
+    QStringList parts = token.split(':');
+    if (parts.size() != 2) return -1;
+    bool okHours = false, okMinutes = false;
+    int hours = parts[0].toInt(&okHours);
+    int minutes = parts[1].toInt(&okMinutes);
+    if (!okHours || !okMinutes || hours < 0 || hours > 23 || minutes < 0 || minutes > 59) return -1;
+    return hours * 60 + minutes;
+}
+
+bool parseNumber(const QString &token, double min, double max, double *value) {
+    bool ok = false;
+    *value = token.toDouble(&ok);
+    return ok && *value >= min && *value <= max;
+}
+
+int findProfile(const QVector<ScenarioProfile> &profiles, const QString &name) {
+    for (int i = 0; i < profiles.size(); ++i) {
+        if (profiles[i].name == name) return i;
+    }
+    return -1;
+}
+
+// Parses "profile <name> key=value..." into 'profile'
+bool parseProfile(const QStringList &tokens, ScenarioProfile *profile, QString *error) {
+    if (tokens.size() < 2) {
+        *error = "profile needs a name";
+        return false;
+    }
+    profile->name = tokens[1];
+    for (int i = 2; i < tokens.size(); ++i) {
+        const int split = tokens[i].indexOf('=');
+        const QString key = tokens[i].left(split);
+        double value = 0.0;
+        if (split <= 0 || !parseNumber(tokens[i].mid(split + 1), 0.0, 1000.0, &value)) {
+            *error = QString("bad profile setting '%1'").arg(tokens[i]);
+            return false;
+        }
+        if (key == "basal") profile->basalRate = value;
+        else if (key == "icr" && value > 0.0) profile->carbRatio = value;
+        else if (key == "cf" && value > 0.0) profile->correctionFactor = value;
+        else if (key == "target") profile->targetBG = value;
+        else {
+            *error = QString("unknown profile setting '%1'").arg(tokens[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parses the event words starting at tokens[first]
+bool parseEvent(const QStringList &tokens, int first, const QVector<ScenarioProfile> &profiles,
+                ScenarioEvent *event, QString *error) {
+    if (first >= tokens.size()) {
+        *error = "missing event";
+        return false;
+    }
+    const QString &kind = tokens[first];
+    const int args = tokens.size() - first - 1;
+    double value = 0.0;
+
+    if (kind == "meal") {
+        if (args < 1 || args > 2 || !parseNumber(tokens[first + 1], 0.0, 500.0, &value)
+            || (args == 2 && tokens[first + 2] != "missed")) {
+            *error = "expected: meal <grams> [missed]";
+            return false;
+        }
+        event->type = args == 2 ? ScenarioEvent::UnbolusedMeal : ScenarioEvent::Meal;
+        event->amount = float(value);
+    } else if (kind == "exercise") {
+        const int length = args >= 1 ? parseLength(tokens[first + 1]) : -1;
+        value = 0.5;
+        if (args < 1 || args > 2 || length <= 0 || length > 0xFFFF
+            || (args == 2 && !parseNumber(tokens[first + 2], 0.0, 1.0, &value))) {
+            *error = "expected: exercise <length> [<intensity 0-1>]";
+            return false;
+        }
+        event->type = ScenarioEvent::Exercise;
+        event->duration = quint16(length);
+        event->amount = float(value);
+    } else if (kind == "sensor-fault") {
+        const int length = args >= 1 ? parseLength(tokens[first + 1]) : -1;
+        if (args != 2 || length <= 0 || length > 0xFFFF || !parseNumber(tokens[first + 2], -20.0, 20.0, &value)) {
+            *error = "expected: sensor-fault <length> <offset mmol/L>";
+            return false;
+        }
+        event->type = ScenarioEvent::SensorFault;
+        event->duration = quint16(length);
+        event->amount = float(value);
+    } else if (kind == "temp-basal") {
+        if (args == 1 && tokens[first + 1] == "off") {
+            event->type = ScenarioEvent::TempBasal;
+            return true;
+        }
+        const int length = args == 2 ? parseLength(tokens[first + 2]) : -1;
+        if (length <= 0 || length > 0xFFFF || !parseNumber(tokens[first + 1], 0.0, 35.0, &value)) {
+            *error = "expected: temp-basal <u/h> <length> | off";
+            return false;
+        }
+        event->type = ScenarioEvent::TempBasal;
+        event->duration = quint16(length);
+        event->amount = float(value);
+    } else if (kind == "profile") {
+        const int index = args == 1 ? findProfile(profiles, tokens[first + 1]) : -1;
+        if (index < 0) {
+            *error = args == 1 ? QString("unknown profile '%1'").arg(tokens[first + 1]) : "expected: profile <name>";
+            return false;
+        }
+        event->type = ScenarioEvent::ProfileSwitch;
+        event->profile = quint8(index);
+    } else if (kind == "refill") {
+        if (args != 0) {
+            *error = "expected: refill";
+            return false;
+        }
+        event->type = ScenarioEvent::Refill;
+    } else {
+        *error = QString("unknown event '%1'").arg(kind);
+        return false;
+    }
+    return true;
+}
+}
+
+bool ScenarioCompiler::compile(const QString &text, CompiledScenario *scenario, QString *error) {
+    static_assert(sizeof(ScenarioEvent) == 12, "ScenarioEvent should stay packed");
+
+    CompiledScenario result;
+    QVector<ScenarioEvent> daily;    // Minute within the day; expanded once the duration is known
+    const QStringList lines = text.split('\n');
+
+    for (int lineIndex = 0; lineIndex < lines.size(); ++lineIndex) {
+        QString line = lines[lineIndex];
+        const int comment = line.indexOf('#');
+        if (comment >= 0) line.truncate(comment);
+        line = line.simplified();
+        if (line.isEmpty()) continue;
+
+        const QStringList tokens = line.split(' ');
+        const QString &keyword = tokens[0];
+        QString message;
+        bool ok = true;
+
+        if (keyword == "name") {
+            result.name = line.mid(5);
+        } else if (keyword == "duration") {
+            result.durationMinutes = tokens.size() == 2 ? parseLength(tokens[1]) : -1;
+            if (result.durationMinutes <= 0) {
+                message = "expected: duration <length>";
+                ok = false;
+            }
+        } else if (keyword == "glucose") {
+            if (tokens.size() != 2 || !parseNumber(tokens[1], 2.0, 30.0, &result.initialGlucose)) {
+                message = "expected: glucose <2-30 mmol/L>";
+                ok = false;
+            }
+        } else if (keyword == "profile") {
+            ScenarioProfile profile;
+            ok = parseProfile(tokens, &profile, &message);
+            if (ok && findProfile(result.profiles, profile.name) >= 0) {
+                message = QString("profile '%1' defined twice").arg(profile.name);
+                ok = false;
+            } else if (ok && result.profiles.size() > 0xFF) {
+                message = "too many profiles";
+                ok = false;
+            }
+            if (ok) result.profiles.append(profile);
+        } else if (keyword == "at" || keyword == "daily") {
+            ScenarioEvent event;
+            int next = 1;
+            int day = 0;
+            if (keyword == "at" && tokens.size() > 1 && tokens[1].endsWith('d')) {
+                const int days = parseLength(tokens[1]);
+                day = days >= 0 ? days / kMinutesPerDay : -1;
+                next++;
+            }
+            const int clock = tokens.size() > next ? parseClock(tokens[next]) : -1;
+            if (day < 0 || clock < 0) {
+                message = QString("expected: %1 <hh:mm> <event>").arg(keyword == "at" ? "at [<day>d]" : "daily");
+                ok = false;
+            } else {
+                event.minute = day * kMinutesPerDay + clock;
+                ok = parseEvent(tokens, next + 1, result.profiles, &event, &message);
+            }
+            if (ok) {
+                if (keyword == "at") result.events.append(event);
+                else daily.append(event);
+            }
+        } else {
+            message = QString("unknown keyword '%1'").arg(keyword);
+            ok = false;
+        }
+
+        if (!ok) {
+            *error = QString("line %1: %2").arg(lineIndex + 1).arg(message);
+            return false;
+        }
+    }
+
+    if (result.durationMinutes <= 0) {
+        *error = "missing duration";
+        return false;
+    }
+    for (const ScenarioEvent &event : result.events) {
+        if (event.minute >= result.durationMinutes) {
+            *error = QString("event at minute %1 is after the end of the scenario").arg(event.minute);
+            return false;
+        }
+    }
+
+    for (const ScenarioEvent &event : daily) {
+        for (int dayStart = 0; dayStart + event.minute < result.durationMinutes; dayStart += kMinutesPerDay) {
+            ScenarioEvent repeated = event;
+            repeated.minute += dayStart;
+            result.events.append(repeated);
+        }
+    }
+    std::stable_sort(result.events.begin(), result.events.end(),
+                     [](const ScenarioEvent &a, const ScenarioEvent &b) { return a.minute < b.minute; });
+    result.events.squeeze();
+
+    *scenario = result;
+    return true;
+}
+
+bool ScenarioCompiler::compileFile(const QString &path, CompiledScenario *scenario, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = QString("cannot open %1").arg(path);
+        return false;
+    }
+    return compile(QTextStream(&file).readAll(), scenario, error);
+}
+
+void ScenarioPlayer::start(const CompiledScenario *scenario, PatientState &patient) {
+    m_scenario = scenario;
+    m_next = 0;
+    if (!scenario->profiles.isEmpty()) {
+        const ScenarioProfile &profile = scenario->profiles.first();
+        patient.inputs.basalRate = profile.basalRate;
+        patient.inputs.carbRatio = profile.carbRatio;
+        patient.inputs.correctionFactor = profile.correctionFactor;
+        patient.inputs.targetBG = profile.targetBG;
+        patient.profileChanged = true;
+    }
+    if (scenario->initialGlucose > 0.0) {
+        patient.glucose = scenario->initialGlucose;
+    }
+    patient.exerciseIntensity = 0.0;
+    patient.sensorBias = 0.0;
+}
+
+void ScenarioPlayer::advance(PatientState &patient) {
+    if (!m_scenario) return;
+
+    if (patient.exerciseIntensity > 0.0 && patient.simMinutes >= patient.exerciseEndMinute) {
+        patient.exerciseIntensity = 0.0;
+    }
+    if (patient.sensorBias != 0.0 && patient.simMinutes >= patient.sensorFaultEndMinute) {
+        patient.sensorBias = 0.0;
+    }
+
+    const QVector<ScenarioEvent> &events = m_scenario->events;
+    while (m_next < events.size() && events[m_next].minute <= patient.simMinutes) {
+        apply(events[m_next], patient);
+        m_next++;
+    }
+}
+
+void ScenarioPlayer::apply(const ScenarioEvent &event, PatientState &patient) {
+    switch (event.type) {
+    case ScenarioEvent::Meal: {
+        // Rounded down to the pump step, as the pump would deliver it; IOB is credited by the
+        // deliver stage with what the reservoir actually gives
+        const double units = InsulinUnits::fromUnits(event.amount / patient.inputs.carbRatio).toPumpStep().toUnits();
+        patient.inputs.carbsOnBoard += event.amount;
+        patient.scenarioBolus += units;
+        break;
+    }
+    case ScenarioEvent::UnbolusedMeal:
+        patient.inputs.carbsOnBoard += event.amount;
+        break;
+    case ScenarioEvent::Exercise:
+        patient.exerciseIntensity = event.amount;
+        patient.exerciseEndMinute = event.minute + event.duration;
+        break;
+    case ScenarioEvent::SensorFault:
+        patient.sensorBias = event.amount;
+        patient.sensorFaultEndMinute = event.minute + event.duration;
+        break;
+    case ScenarioEvent::ProfileSwitch: {
+        const ScenarioProfile &profile = m_scenario->profiles[event.profile];
+        patient.inputs.basalRate = profile.basalRate;
+        patient.inputs.carbRatio = profile.carbRatio;
+        patient.inputs.correctionFactor = profile.correctionFactor;
+        patient.inputs.targetBG = profile.targetBG;
+        patient.profileChanged = true;
+        break;
+    }
+    case ScenarioEvent::Refill:
+        patient.refillPending = true;
+        break;
+    case ScenarioEvent::TempBasal:
+        patient.tempBasalPending = true;
+        patient.tempBasalRate = event.amount;
+        patient.tempBasalMinutes = event.duration;
+        break;
+    }
+}
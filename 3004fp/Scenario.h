@@ -0,0 +1,97 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include "TickPipeline.h"
+
+// One timeline entry; 12 bytes so a multi-week timeline stays in cache
+struct ScenarioEvent {
+    enum Type : quint8 {
+        Meal,               // 'amount' grams, bolused at the current carb ratio
+        UnbolusedMeal,      // 'amount' grams, bolus missed
+        Exercise,           // 'amount' intensity (0-1) for 'duration' minutes
+        SensorFault,        // 'amount' mmol/L added to CGM readings for 'duration' minutes
+        ProfileSwitch,      // To profiles['profile']
+        Refill,             // Reservoir refilled
+        TempBasal           // 'amount' u/h for 'duration' minutes; 0 minutes cancels
+    };
+
+    qint32 minute = 0;      // Since scenario start
+    Type type = Meal;
+    quint8 profile = 0;
+    quint16 duration = 0;   // Minutes
+    float amount = 0.0f;
+};
+
+// Therapy settings a scenario can switch to
+struct ScenarioProfile {
+    QString name;
+    double basalRate = 1.0;          // u/h
+    double carbRatio = 10.0;         // Grams per unit
+    double correctionFactor = 1.0;   // mmol/L per unit
+    double targetBG = 5.5;           // mmol/L
+};
+
+// A scenario file after compilation: events sorted by time (file order on ties)
+struct CompiledScenario {
+    QString name;
+    int durationMinutes = 0;
+    double initialGlucose = 0.0;     // <= 0 keeps the simulation's own start value
+    QVector<ScenarioProfile> profiles;  // The first one is active at start
+    QVector<ScenarioEvent> events;
+};
+
+// Compiles the line-based scenario format:
+//
+//   # comment
+//   name <text>
+//   duration <length>                  e.g. 14d, 6h, 90min
+//   glucose <mmol/L>                   start value
+//   profile <name> basal=<u/h> icr=<g/u> cf=<mmol/L/u> target=<mmol/L>
+//   at [<day>d] <hh:mm> <event>        one-off, day 0 by default
+//   daily <hh:mm> <event>              every day of the scenario
+//
+// with events
+//
+//   meal <grams> [missed]
+//   exercise <length> [<intensity 0-1, default 0.5>]
+//   sensor-fault <length> <offset mmol/L>
+//   temp-basal <u/h> <length> | off
+//   profile <name>
+//   refill
+//
+// All text handling happens here; the simulation only sees the event array.
+class ScenarioCompiler {
+public:
+    // Returns false and sets 'error' (with the line number) on the first problem
+    static bool compile(const QString &text, CompiledScenario *scenario, QString *error);
+
+    // Reads and compiles a scenario file
+    static bool compileFile(const QString &path, CompiledScenario *scenario, QString *error);
+};
+
+// Applies a compiled scenario to one patient as simulated time passes.
+// The player is a cursor into the shared timeline, so any number of
+// patients can replay the same scenario.
+class ScenarioPlayer {
+public:
+    // Starts at the beginning; sets the first profile and start glucose on 'patient'
+    void start(const CompiledScenario *scenario, PatientState &patient);
+
+    // Applies every event due at or before patient.simMinutes and ends expired effects
+    void advance(PatientState &patient);
+
+    bool isActive() const { return m_scenario != nullptr; }
+    bool finished() const { return !m_scenario || m_next >= m_scenario->events.size(); }
+    void stop() { m_scenario = nullptr; }
+
+private:
+    void apply(const ScenarioEvent &event, PatientState &patient);
+
+    const CompiledScenario *m_scenario = nullptr;
+    int m_next = 0;
+};
+
+#endif // SCENARIO_H
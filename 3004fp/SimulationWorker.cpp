@@ -0,0 +1,353 @@
+#include "SimulationWorker.h"
+#include <QRandomGenerator>
+#include <QDebug>
+#include "Instrumentation.h"
+
+namespace {
+const int kReadingTail = 512;   // Readings kept in each snapshot
+const int kLogTail = 256;       // Log entries kept in each snapshot
+}
+
+SimulationWorker::SimulationWorker(SafetyController *controller, QObject *parent)
+    : QObject(parent),
+      m_controller(controller),
+      m_cgmManager(nullptr),
+      m_tickTimer(this),
+      m_estimator(&m_cgmManager),
+      m_predictor(&m_cgmManager),
+      m_delivery(controller),
+      m_bergmanSensor(&m_bergmanModel),
+      m_hovorkaSensor(&m_hovorkaModel),
+      m_telemetry(this)
+{
+    m_pipeline.setSenseStage(&m_sensor);
+    m_pipeline.setEstimateStage(&m_estimator);
+    m_pipeline.setPredictStage(&m_predictor);
+    m_pipeline.setControlStage(&m_basalController);
+    m_pipeline.setDeliverStage(&m_delivery);
+    m_pipeline.setRenderStage(this);
+
+    m_tickTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_tickTimer, &QTimer::timeout, this, &SimulationWorker::tick);
+
+    // Battery and reservoir changes are published even when no run is active
+    connect(m_controller, &SafetyController::batteryLevelUpdated, this, &SimulationWorker::publishSnapshot);
+    connect(m_controller, &SafetyController::insulinLevelUpdated, this, &SimulationWorker::publishSnapshot);
+}
+
+// Resets session state, processes the initial reading and starts the tick timer
+void SimulationWorker::startSimulation(const SimConfig &config) {
+    finishTrace();
+    finishExport();
+    m_durationTicks = config.durationTicks;
+    m_elapsedTicks = 0;
+    m_session++;
+    m_running = true;
+    m_recentReadings.clear();
+    m_readingCount = 0;
+
+    // Use BG input or generate random initial value
+    double initialGlucose = config.initialGlucose;
+    if (initialGlucose <= 0.0) {
+        initialGlucose = 4.0 + (QRandomGenerator::global()->generateDouble() * 6.0); // 4–10 mmol/L
+        initialGlucose = qRound(initialGlucose * 10) / 10.0;
+        qDebug() << "Generated initial glucose:" << initialGlucose;
+    }
+
+    switch (config.plant) {
+    case SimConfig::BergmanPlant: m_pipeline.setSenseStage(&m_bergmanSensor); break;
+    case SimConfig::HovorkaPlant: m_pipeline.setSenseStage(&m_hovorkaSensor); break;
+    case SimConfig::LinearPlant: m_pipeline.setSenseStage(&m_sensor); break;
+    }
+    if (config.prediction == SimConfig::EnsemblePrediction) {
+        m_pipeline.setPredictStage(&m_ensemblePredictor);
+    } else {
+        m_pipeline.setPredictStage(&m_predictor);
+    }
+    if (config.basalControl == SimConfig::MpcControl) {
+        m_pipeline.setControlStage(&m_mpcController);
+    } else {
+        m_pipeline.setControlStage(&m_basalController);
+    }
+
+    // Decision stages start fresh each run, so a recorded trace replays exactly
+    m_ensemblePredictor.setSettings(m_ensemblePredictor.settings());
+    m_mpcController.setSettings(m_mpcController.settings());
+
+    m_tracePath = config.tracePath;
+    m_trace = GoldenTrace();
+    m_trace.controller = config.basalControl == SimConfig::MpcControl ? GoldenTrace::MpcController
+                                                                      : GoldenTrace::ThresholdController;
+    m_trace.predictor = config.prediction == SimConfig::EnsemblePrediction ? GoldenTrace::EnsemblePredictor
+                                                                           : GoldenTrace::LinearPredictor;
+    m_trace.startBasalRate = float(m_controller->getBasalRate());
+
+    if (!config.exportDirectory.isEmpty()) {
+        QString error;
+        if (!m_exporter.open(config.exportDirectory, QDateTime::currentMSecsSinceEpoch(), &error)) {
+            appendLog(QString("Arrow export failed: %1").arg(error));
+        }
+    }
+
+    m_patient.inputs = config.inputs;
+    m_patient.deliveredBasalRate = m_controller->getBasalRate();
+    m_patient.pendingBolus = 0.0;
+    m_patient.pendingBasal = 0.0;
+    m_patient.glucose = initialGlucose;
+    m_patient.simMinutes = 0;
+    m_patient.initialReadingPending = true;
+    m_patient.lastAutoCorrectionMinute = -1;
+
+    m_scenario = config.scenario;
+    if (m_scenario) {
+        m_durationTicks = m_scenario->durationMinutes / 5;
+        m_scenarioPlayer.start(m_scenario.data(), m_patient);
+        initialGlucose = m_patient.glucose;
+    } else {
+        m_scenarioPlayer.stop();
+    }
+
+    // Start at time = 0 minutes: process reading (alerts, logging, etc.)
+    runTick();
+
+    m_tickTimer.start(config.tickIntervalMs); // 1 real second = 5 min simulated
+
+    setStatus("CGM Monitoring: Active", "");
+    appendLog(QString("[%1] CGM Monitoring Started - Initial BG: %2 mmol/L")
+              .arg(QDateTime::currentDateTime().toString("hh:mm:ss"))
+              .arg(initialGlucose, 0, 'f', 1));
+    if (m_scenario) {
+        appendLog(QString("Scenario: %1 (%2 events over %3 h)")
+                  .arg(m_scenario->name.isEmpty() ? QString("unnamed") : m_scenario->name)
+                  .arg(m_scenario->events.size())
+                  .arg(m_scenario->durationMinutes / 60.0, 0, 'f', 1));
+    }
+
+    publishSnapshot();
+}
+
+// Stops the tick timer; the last state stays published
+void SimulationWorker::stopSimulation() {
+    m_tickTimer.stop();
+    m_running = false;
+    finishTrace();
+    finishExport();
+    setStatus("CGM Monitoring: Stopped", m_statusStyle);
+    publishSnapshot();
+}
+
+// Replaces the user-editable values used by subsequent ticks
+void SimulationWorker::setInputs(const SimInputs &inputs) {
+    m_patient.inputs = inputs;
+}
+
+void SimulationWorker::tick() {
+    // Stops simulation after duration has fully passed
+    m_elapsedTicks++;
+    if (m_elapsedTicks > m_durationTicks) {
+        m_tickTimer.stop();
+        m_running = false;
+        finishTrace();
+        finishExport();
+        setStatus("CGM Simulation Complete", m_statusStyle);
+        publishSnapshot();
+        return;
+    }
+
+    runTick();
+    publishSnapshot();
+}
+
+// One pass of sense -> estimate -> predict -> control -> deliver -> render
+void SimulationWorker::runTick() {
+    PUMP_TRACE_SCOPE("sim.tick");
+    m_scenarioPlayer.advance(m_patient);
+    m_tickActions = GoldenTrace::pendingActions(m_patient);
+    m_tickScenarioBolus = m_patient.scenarioBolus;
+    m_pipeline.run(&m_patient, &m_frame, 1);
+}
+
+// Writes the golden trace of the run that just ended, if one was requested
+void SimulationWorker::finishTrace() {
+    if (m_tracePath.isEmpty()) return;
+
+    QString error;
+    if (m_trace.save(m_tracePath, &error)) {
+        appendLog(QString("Golden trace saved: %1 (%2 ticks)").arg(m_tracePath).arg(m_trace.ticks.size()));
+    } else {
+        appendLog(QString("Golden trace not saved: %1").arg(error));
+    }
+    m_tracePath.clear();
+    m_trace.ticks.clear();
+}
+
+// Closes the Arrow files of the run that just ended, if it was exported
+void SimulationWorker::finishExport() {
+    if (!m_exporter.isOpen()) return;
+
+    QString error;
+    if (m_exporter.close(&error)) {
+        appendLog(QString("Run exported: %1 (%2 ticks)").arg(m_exporter.directory())
+                      .arg(m_exporter.rowCount(RunExporter::Readings)));
+    } else {
+        appendLog(QString("Arrow export failed: %1").arg(error));
+    }
+}
+
+// Restores what the journal recovered; a fresh journal leaves the defaults alone
+void SimulationWorker::attachJournal(PumpJournal *journal) {
+    const PumpState state = journal->state();
+    if (state.sequence > 0) {
+        m_controller->restoreState(state);
+        m_cgmManager.restoreState(state);
+        const PumpJournal::RecoveryStats stats = journal->recoveryStats();
+        appendLog(QString("Pump state recovered: %1 events replayed after the snapshot in %2 ms")
+                      .arg(stats.replayedEvents).arg(stats.elapsedUs / 1000.0, 0, 'f', 1));
+    }
+    m_controller->setJournal(journal);
+    m_cgmManager.setJournal(journal);
+    publishSnapshot();
+}
+
+void SimulationWorker::startTelemetry(const QString &name) {
+    QString error;
+    if (m_telemetry.start(name, TelemetryServer::kDefaultSlots, &error)) {
+        appendLog(QString("Telemetry: publishing on %1").arg(name));
+    } else {
+        appendLog(QString("Telemetry: %1").arg(error));
+    }
+    publishSnapshot();
+}
+
+// A reading and a prediction every tick; basal changes and alerts only when they happen
+void SimulationWorker::publishTelemetry(const TickFrame &frame) {
+    TelemetryRecord record;
+    record.timeMs = QDateTime::currentMSecsSinceEpoch();
+    record.simMinutes = frame.reading.simMinutes;
+
+    record.kind = TelemetryRecord::Reading;
+    record.values[0] = float(frame.estimate.rawGlucose);
+    record.values[1] = float(frame.estimate.glucose);
+    record.values[2] = float(frame.estimate.trend);
+    record.values[3] = float(frame.estimate.variance);
+    m_telemetry.publish(record);
+
+    record.kind = TelemetryRecord::Prediction;
+    record.values[0] = float(frame.prediction.predicted30min);
+    record.values[1] = float(frame.prediction.predicted30minLow);
+    record.values[2] = frame.prediction.curve.isEmpty() ? 0.0f : float(frame.prediction.curve.last().y());
+    record.values[3] = 0.0f;
+    m_telemetry.publish(record);
+
+    const double basalRate = m_controller->getBasalRate();
+    if (basalRate != m_telemetryBasalRate) {
+        record.kind = TelemetryRecord::BasalChange;
+        record.code = quint8(frame.decision.basalAction);
+        record.values[0] = float(basalRate);
+        record.values[1] = float(qMax(m_telemetryBasalRate, 0.0));
+        record.values[2] = 0.0f;
+        m_telemetry.publish(record);
+        m_telemetryBasalRate = basalRate;
+    }
+
+    // An alert starting, changing or clearing (NoAlert)
+    const quint8 flags = (frame.decision.criticalLow ? TelemetryRecord::CriticalLow : 0)
+                       | (frame.decision.criticalHigh ? TelemetryRecord::CriticalHigh : 0);
+    const int alertState = int(frame.decision.alert) | (flags << 8);
+    if (alertState != m_telemetryAlert) {
+        record.kind = TelemetryRecord::Alert;
+        record.code = quint8(frame.decision.alert);
+        record.flags = flags;
+        record.values[0] = float(frame.estimate.glucose);
+        record.values[1] = 0.0f;
+        m_telemetry.publish(record);
+        m_telemetryAlert = alertState;
+    }
+}
+
+// Render stage: status, readings, prediction line and log entries for the UI
+void SimulationWorker::render(const PatientState &patient, const TickFrame &frame) {
+    switch (frame.decision.alert) {
+    case ControlDecision::LowAlert:
+        setStatus("ALERT: Low Glucose", "color: red; font-weight: bold;");
+        break;
+    case ControlDecision::HighAlert:
+        setStatus("ALERT: High Glucose", "color: red; font-weight: bold;");
+        break;
+    case ControlDecision::NoAlert:
+        setStatus("CGM Monitoring: Active", "");
+        break;
+    }
+
+    appendReading(frame.reading.simMinutes, frame.reading.glucose);
+    if (!m_tracePath.isEmpty()) {
+        m_trace.ticks.append(GoldenTrace::capture(patient, frame, m_tickActions, m_tickScenarioBolus));
+    }
+    if (m_exporter.isOpen()) {
+        m_exporter.appendTick(&patient, &frame, 1);
+    }
+    if (m_telemetry.isRunning()) {
+        publishTelemetry(frame);
+    }
+    m_estimate = frame.estimate;
+    m_prediction = frame.prediction.curve.toVector();
+    m_predictionLow = frame.prediction.lowerBand.toVector();
+    m_predictionHigh = frame.prediction.upperBand.toVector();
+
+    for (const QString &entry : frame.delivery.logEntries()) {
+        appendLog(entry);
+    }
+}
+
+void SimulationWorker::appendReading(double time, double glucoseLevel) {
+    m_recentReadings.append(QPointF(time, glucoseLevel));
+    if (m_recentReadings.size() > kReadingTail) {
+        m_recentReadings.removeFirst();
+    }
+    m_readingCount++;
+}
+
+void SimulationWorker::appendLog(const QString &entry) {
+    m_recentLogs.append(entry);
+    if (m_recentLogs.size() > kLogTail) {
+        m_recentLogs.removeFirst();
+    }
+    m_logCount++;
+}
+
+void SimulationWorker::setStatus(const QString &text, const QString &style) {
+    m_statusText = text;
+    m_statusStyle = style;
+}
+
+// Copies the current state into the back buffer and hands it to the UI.
+// Containers are implicitly shared, so this does not deep-copy the tails.
+void SimulationWorker::publishSnapshot() {
+    PUMP_TRACE_SCOPE("sim.publishSnapshot");
+    SimSnapshot &snapshot = m_snapshots.back();
+    snapshot.session = m_session;
+    snapshot.running = m_running;
+    snapshot.simMinutes = m_patient.simMinutes;
+    snapshot.glucose = m_patient.glucose;
+    snapshot.filteredGlucose = m_estimate.glucose;
+    snapshot.glucoseTrend = m_estimate.trend;
+    snapshot.glucoseVariance = m_estimate.variance;
+    snapshot.insulinOnBoard = m_patient.inputs.insulinOnBoard;
+    snapshot.carbsOnBoard = m_patient.inputs.carbsOnBoard;
+    snapshot.basalRate = m_controller->getBasalRate();
+    snapshot.batteryLevel = m_controller->getBatteryLevel();
+    snapshot.reservoirLevel = m_controller->getInsulinLevel();
+    snapshot.statusText = m_statusText;
+    snapshot.statusStyle = m_statusStyle;
+    snapshot.recentReadings = m_recentReadings;
+    snapshot.readingCount = m_readingCount;
+    snapshot.prediction = m_prediction;
+    snapshot.predictionLow = m_predictionLow;
+    snapshot.predictionHigh = m_predictionHigh;
+    snapshot.recentLogs = m_recentLogs;
+    snapshot.logCount = m_logCount;
+    for (int stage = 0; stage < TickPipeline::StageCount; ++stage) {
+        snapshot.stageLastNs[stage] = m_pipeline.timing(static_cast<TickPipeline::Stage>(stage)).lastNs;
+    }
+    m_snapshots.publish();
+}
@@ -0,0 +1,183 @@
+#ifndef SIMULATIONWORKER_H
+#define SIMULATIONWORKER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QDateTime>
+#include <QVector>
+#include <QPointF>
+#include <QStringList>
+#include <QSharedPointer>
+#include "CGMManager.h"
+#include "SafetyController.h"
+#include "TripleBuffer.h"
+#include "TickPipeline.h"
+#include "PumpStages.h"
+#include "MpcBasalController.h"
+#include "EnsemblePredictor.h"
+#include "Scenario.h"
+#include "GoldenTrace.h"
+#include "PumpJournal.h"
+#include "Telemetry.h"
+#include "RunExport.h"
+
+// Parameters for starting a CGM simulation run
+struct SimConfig {
+    // Glucose dynamics the sense stage simulates
+    enum Plant { LinearPlant, BergmanPlant, HovorkaPlant };
+    // How basal is adjusted each reading
+    enum BasalControl { ThresholdControl, MpcControl };
+    // How BG is forecast from each reading
+    enum Prediction { LinearPrediction, EnsemblePrediction };
+
+    SimInputs inputs;
+    Plant plant = LinearPlant;
+    BasalControl basalControl = ThresholdControl;
+    Prediction prediction = LinearPrediction;
+    double initialGlucose = 0.0;     // <= 0 picks a random 4-10 mmol/L start
+    int durationTicks = 12;          // Number of 5-minute readings to simulate
+    QSharedPointer<const CompiledScenario> scenario;   // Optional; sets the duration, start BG and profile
+    QString tracePath;               // Non-empty records a golden trace of the run to this file
+    QString exportDirectory;         // Non-empty writes the run's ticks there as Arrow files
+    int tickIntervalMs = 1000;       // Real time per simulated 5 minutes
+};
+
+// Immutable view of the simulation published once per change
+struct SimSnapshot {
+    quint64 session = 0;             // Increments on every simulation start (0 = never started)
+    bool running = false;
+    int simMinutes = 0;              // Simulated minutes since start
+
+    double glucose = 0.0;            // Latest BG (mmol/L)
+    double filteredGlucose = 0.0;    // Kalman estimate from the latest reading
+    double glucoseTrend = 0.0;       // mmol/L per minute
+    double glucoseVariance = 0.0;
+    double insulinOnBoard = 0.0;
+    double carbsOnBoard = 0.0;
+    double basalRate = 0.0;          // Current (possibly adjusted) basal rate
+    int batteryLevel = 100;
+    int reservoirLevel = 100;
+
+    QString statusText;
+    QString statusStyle;
+
+    QVector<QPointF> recentReadings; // Tail of (minute, BG) readings for this session
+    quint64 readingCount = 0;        // Readings produced this session
+    QVector<QPointF> prediction;     // Predicted BG line from the latest reading
+    QVector<QPointF> predictionLow;  // 10th/90th percentile band (empty for the linear predictor)
+    QVector<QPointF> predictionHigh;
+    QStringList recentLogs;          // Tail of log entries
+    quint64 logCount = 0;            // Log entries produced since launch
+
+    qint64 stageLastNs[TickPipeline::StageCount] = {};  // Cost of each stage in the last tick
+};
+
+// Runs CGM simulation ticks on its own thread and publishes snapshots.
+// All simulation state is owned here; the UI only reads snapshots() and
+// sends requests through queued calls. The worker is the pipeline's render stage.
+class SimulationWorker : public QObject, public RenderStage
+{
+    Q_OBJECT
+
+public:
+    // The controller must live on the same thread as the worker
+    explicit SimulationWorker(SafetyController *controller, QObject *parent = nullptr);
+
+    // Latest-state handoff read by the UI thread
+    TripleBuffer<SimSnapshot>& snapshots() { return m_snapshots; }
+
+    // Tick pipeline; stages may be swapped before a run starts
+    TickPipeline& pipeline() { return m_pipeline; }
+
+    // RenderStage: turns a tick's outputs into snapshot state
+    void render(const PatientState &patient, const TickFrame &frame) override;
+
+public slots:
+    // Start a new simulation run (replaces any run in progress)
+    void startSimulation(const SimConfig &config);
+
+    // Stop the current run
+    void stopSimulation();
+
+    // Update the user-editable values used by the next tick
+    void setInputs(const SimInputs &inputs);
+
+    // Publish the current state to the UI
+    void publishSnapshot();
+
+    // Restore controller and CGM state recovered by an open journal, then journal them
+    void attachJournal(PumpJournal *journal);
+
+    // Publish each tick's reading, prediction, basal changes and alerts on a telemetry ring
+    void startTelemetry(const QString &name);
+
+private slots:
+    // Advance the simulation by one 5-minute reading
+    void tick();
+
+private:
+    void runTick();
+    void finishTrace();
+    void finishExport();
+    void publishTelemetry(const TickFrame &frame);
+    void appendReading(double time, double glucoseLevel);
+    void appendLog(const QString &entry);
+    void setStatus(const QString &text, const QString &style);
+
+    SafetyController *m_controller;      // Battery, reservoir and basal state
+    CGMManager m_cgmManager;             // Glucose history and prediction model
+    QTimer m_tickTimer;                  // Drives tick() on the worker thread
+    TripleBuffer<SimSnapshot> m_snapshots;
+
+    // Default stages
+    SimulatedCgmSensor m_sensor;
+    CgmHistoryEstimator m_estimator;
+    LinearGlucosePredictor m_predictor;
+    ThresholdBasalController m_basalController;
+    PumpDelivery m_delivery;
+    TickPipeline m_pipeline;
+
+    // Physiological plants selectable per run
+    BergmanMinimalModel m_bergmanModel;
+    HovorkaModel m_hovorkaModel;
+    PhysiologicalCgmSensor m_bergmanSensor;
+    PhysiologicalCgmSensor m_hovorkaSensor;
+
+    MpcBasalController m_mpcController;
+    EnsembleGlucosePredictor m_ensemblePredictor;
+
+    QSharedPointer<const CompiledScenario> m_scenario;   // Of the current run, if any
+    ScenarioPlayer m_scenarioPlayer;
+
+    // Golden trace of the current run (see GoldenTrace.h)
+    QString m_tracePath;
+    GoldenTrace m_trace;
+    quint8 m_tickActions = 0;             // Scenario actions pending when the tick started
+    double m_tickScenarioBolus = 0.0;
+
+    RunExporter m_exporter;               // Arrow export of the current run, if requested
+
+    TelemetryServer m_telemetry;          // Live feed for out-of-process subscribers (see Telemetry.h)
+    double m_telemetryBasalRate = -1.0;   // Last basal published; -1 before the first
+    int m_telemetryAlert = 0;             // Last alert and critical flags published; none at first
+
+    PatientState m_patient;
+    TickFrame m_frame;
+    int m_elapsedTicks = 0;
+    int m_durationTicks = 0;
+    bool m_running = false;
+    quint64 m_session = 0;
+
+    QString m_statusText;
+    QString m_statusStyle;
+    QVector<QPointF> m_recentReadings;
+    quint64 m_readingCount = 0;
+    GlucoseEstimate m_estimate;           // From the latest tick
+    QVector<QPointF> m_prediction;
+    QVector<QPointF> m_predictionLow;
+    QVector<QPointF> m_predictionHigh;
+    QStringList m_recentLogs;
+    quint64 m_logCount = 0;
+};
+
+#endif // SIMULATIONWORKER_H
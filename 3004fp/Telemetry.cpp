@@ -0,0 +1,278 @@
+#include "Telemetry.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <cstring>
+#include <new>
+
+namespace {
+const int kHeaderBytes = 64;          // TelemetryRingHeader, padded to a cache line
+const int kTimeoutMs = 1000;          // Subscriber control requests
+
+static_assert(sizeof(TelemetryRecord) == 64, "TelemetryRecord should fill one cache line");
+static_assert(sizeof(TelemetryRingHeader) <= kHeaderBytes, "TelemetryRingHeader outgrew its padding");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Ring stamps are shared between processes");
+
+int roundUpToPowerOfTwo(int n) {
+    int power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+}
+
+TelemetryServer::TelemetryServer(QObject *parent)
+    : QObject(parent),
+      m_memory(this),
+      m_server(this)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &TelemetryServer::acceptConnections);
+}
+
+TelemetryServer::~TelemetryServer() {
+    stop();
+}
+
+bool TelemetryServer::start(const QString &name, int capacity, QString *error) {
+    stop();
+    const int slotCount = roundUpToPowerOfTwo(qMax(capacity, 2));
+    const int bytes = kHeaderBytes + slotCount * int(sizeof(TelemetrySlot));
+
+    // A ring left behind by a crashed producer is still registered; attaching
+    // and detaching releases it
+    m_memory.setKey(name + ".ring");
+    if (m_memory.attach()) {
+        m_memory.detach();
+    }
+    if (!m_memory.create(bytes)) {
+        *error = QString("cannot create shared memory %1: %2").arg(m_memory.key(), m_memory.errorString());
+        return false;
+    }
+
+    char *base = static_cast<char *>(m_memory.data());
+    std::memset(base, 0, size_t(bytes));
+    m_header = new (base) TelemetryRingHeader;
+    m_header->magic = TelemetryRingHeader::kMagic;
+    m_header->version = TelemetryRingHeader::kVersion;
+    m_header->slotCount = quint32(slotCount);
+    m_header->recordBytes = quint32(sizeof(TelemetryRecord));
+    m_header->producerPid = QCoreApplication::applicationPid();
+    m_header->writeSequence.store(0, std::memory_order_release);
+    m_slots = reinterpret_cast<TelemetrySlot *>(base + kHeaderBytes);
+    m_mask = quint64(slotCount - 1);
+    m_sequence = 0;
+    for (TelemetryRecord &latest : m_latest) {
+        latest = TelemetryRecord();
+    }
+
+    QLocalServer::removeServer(name);
+    if (!m_server.listen(name)) {
+        *error = QString("cannot listen on %1: %2").arg(name, m_server.errorString());
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void TelemetryServer::stop() {
+    for (QLocalSocket *client : m_clients) {
+        client->disconnect(this);
+        client->abort();
+        client->deleteLater();
+    }
+    m_clients.clear();
+    m_server.close();
+    if (m_memory.isAttached()) {
+        m_memory.detach();
+    }
+    m_header = nullptr;
+    m_slots = nullptr;
+}
+
+// The slot is stamped 0 while its record is copied in, so a reader racing
+// the write sees a stamp that does not match and drops what it copied
+void TelemetryServer::publish(TelemetryRecord record) {
+    if (!m_slots || record.kind > TelemetryRecord::Alert) return;
+
+    record.sequence = ++m_sequence;
+    if (record.timeMs == 0) {
+        record.timeMs = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    TelemetrySlot &slot = m_slots[record.sequence & m_mask];
+    slot.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.stamp.store(record.sequence, std::memory_order_release);
+    m_header->writeSequence.store(record.sequence, std::memory_order_release);
+
+    m_latest[record.kind] = record;
+}
+
+void TelemetryServer::acceptConnections() {
+    while (QLocalSocket *client = m_server.nextPendingConnection()) {
+        m_clients.append(client);
+        connect(client, &QLocalSocket::readyRead, this, &TelemetryServer::handleCommands);
+        connect(client, &QLocalSocket::disconnected, this, [this, client]() {
+            m_clients.removeAll(client);
+            client->deleteLater();
+        });
+    }
+}
+
+void TelemetryServer::handleCommands() {
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    if (!client) return;
+
+    while (client->canReadLine()) {
+        const QByteArray command = client->readLine().trimmed();
+        if (command == "HELLO") {
+            client->write("RING " + QByteArray::number(quint64(m_mask + 1)) + ' '
+                          + QByteArray::number(int(sizeof(TelemetryRecord))) + ' '
+                          + QByteArray::number(m_sequence) + ' ' + m_memory.key().toUtf8() + '\n');
+        } else if (command == "LATEST") {
+            QByteArray records;
+            int count = 0;
+            for (const TelemetryRecord &latest : m_latest) {
+                if (latest.sequence == 0) continue;
+                records.append(reinterpret_cast<const char *>(&latest), int(sizeof(latest)));
+                count++;
+            }
+            client->write("LATEST " + QByteArray::number(count) + '\n' + records);
+        } else if (command == "STATS") {
+            client->write("STATS " + QByteArray::number(m_clients.size()) + ' '
+                          + QByteArray::number(m_sequence) + '\n');
+        } else {
+            client->write("ERROR unknown command\n");
+        }
+    }
+}
+
+TelemetrySubscriber::~TelemetrySubscriber() {
+    detach();
+}
+
+bool TelemetrySubscriber::attach(const QString &name, bool fromOldest, QString *error) {
+    detach();
+    m_socket.connectToServer(name);
+    if (!m_socket.waitForConnected(kTimeoutMs)) {
+        *error = QString("cannot connect to %1: %2").arg(name, m_socket.errorString());
+        return false;
+    }
+
+    QByteArray reply;
+    if (!command("HELLO", &reply, error)) {
+        detach();
+        return false;
+    }
+    const QString hello = QString::fromUtf8(reply);
+    if (hello.section(' ', 0, 0) != "RING" || hello.section(' ', 2, 2).toInt() != int(sizeof(TelemetryRecord))) {
+        *error = QString("unexpected reply from %1: %2").arg(name, hello);
+        detach();
+        return false;
+    }
+
+    m_memory.setKey(hello.section(' ', 4));
+    if (!m_memory.attach(QSharedMemory::ReadOnly)) {
+        *error = QString("cannot map %1: %2").arg(m_memory.key(), m_memory.errorString());
+        detach();
+        return false;
+    }
+    const char *base = static_cast<const char *>(m_memory.constData());
+    m_header = reinterpret_cast<const TelemetryRingHeader *>(base);
+    const quint32 slotCount = m_header->slotCount;
+    if (m_header->magic != TelemetryRingHeader::kMagic || m_header->version != TelemetryRingHeader::kVersion
+        || slotCount == 0 || (slotCount & (slotCount - 1)) != 0
+        || m_memory.size() < kHeaderBytes + int(slotCount * sizeof(TelemetrySlot))) {
+        *error = QString("%1 is not a telemetry ring").arg(m_memory.key());
+        detach();
+        return false;
+    }
+    m_slots = reinterpret_cast<const TelemetrySlot *>(base + kHeaderBytes);
+    m_mask = slotCount - 1;
+
+    const quint64 written = m_header->writeSequence.load(std::memory_order_acquire);
+    if (fromOldest) {
+        m_next = written > m_mask ? written - m_mask : 1;
+    } else {
+        m_next = written + 1;
+    }
+    m_lost = 0;
+    return true;
+}
+
+void TelemetrySubscriber::detach() {
+    m_socket.abort();
+    if (m_memory.isAttached()) {
+        m_memory.detach();
+    }
+    m_header = nullptr;
+    m_slots = nullptr;
+}
+
+bool TelemetrySubscriber::fetchLatest(QVector<TelemetryRecord> *records, QString *error) {
+    QByteArray reply;
+    if (!command("LATEST", &reply, error)) return false;
+    const int count = reply.startsWith("LATEST ") ? reply.mid(7).toInt() : -1;
+    if (count < 0 || count > TelemetryRecord::Alert + 1) {
+        *error = QString("unexpected reply: %1").arg(QString::fromUtf8(reply));
+        return false;
+    }
+
+    const qint64 bytes = qint64(count) * qint64(sizeof(TelemetryRecord));
+    while (m_socket.bytesAvailable() < bytes) {
+        if (!m_socket.waitForReadyRead(kTimeoutMs)) {
+            *error = QString("no records from server: %1").arg(m_socket.errorString());
+            return false;
+        }
+    }
+    const QByteArray data = m_socket.read(bytes);
+    records->resize(count);
+    std::memcpy(records->data(), data.constData(), size_t(bytes));
+    return true;
+}
+
+// Readers never write to the ring: a record is taken only if its slot
+// carries the expected stamp both before and after the copy
+int TelemetrySubscriber::poll(QVector<TelemetryRecord> *out, int max) {
+    if (!m_slots) return 0;
+
+    const quint64 written = m_header->writeSequence.load(std::memory_order_acquire);
+    if (written > m_mask && m_next + m_mask < written) {
+        const quint64 oldest = written - m_mask;
+        m_lost += oldest - m_next;
+        m_next = oldest;
+    }
+
+    int count = 0;
+    while (m_next <= written && count < max) {
+        const quint64 expected = m_next++;
+        const TelemetrySlot &slot = m_slots[expected & m_mask];
+        const quint64 before = slot.stamp.load(std::memory_order_acquire);
+        const TelemetryRecord record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint64 after = slot.stamp.load(std::memory_order_relaxed);
+        if (before != expected || after != expected) {
+            m_lost++;                 // Overwritten while we were behind
+            continue;
+        }
+        out->append(record);
+        count++;
+    }
+    return count;
+}
+
+// Sends one command line and waits for its reply line
+bool TelemetrySubscriber::command(const QByteArray &line, QByteArray *reply, QString *error) {
+    m_socket.write(line + '\n');
+    if (!m_socket.waitForBytesWritten(kTimeoutMs)) {
+        *error = QString("cannot send %1: %2").arg(QString::fromUtf8(line), m_socket.errorString());
+        return false;
+    }
+    while (!m_socket.canReadLine()) {
+        if (!m_socket.waitForReadyRead(kTimeoutMs)) {
+            *error = QString("no reply to %1: %2").arg(QString::fromUtf8(line), m_socket.errorString());
+            return false;
+        }
+    }
+    *reply = m_socket.readLine().trimmed();
+    return true;
+}
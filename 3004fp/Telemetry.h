@@ -0,0 +1,137 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QSharedMemory>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <atomic>
+
+// One published event; 64 bytes so a record is one cache line in the ring.
+// Subscribers read the same bytes the producer wrote, so publishing costs
+// the same however many of them are attached.
+struct TelemetryRecord {
+    enum Kind : quint8 {
+        Reading,        // values: raw, filtered (mmol/L), trend (mmol/L/min), variance
+        Prediction,     // values: 30-min prediction, its 10th percentile, end of the 60-min curve
+        BasalChange,    // values: new rate, previous rate (u/h); code = ControlDecision::BasalAction
+        Alert           // values: filtered glucose; code = ControlDecision::GlucoseAlert (NoAlert once cleared), flags = critical low/high
+    };
+    enum Flag : quint8 { CriticalLow = 1, CriticalHigh = 2 };
+    static const int kValueCount = 8;
+
+    quint64 sequence = 0;        // 1-based, set by the server
+    qint64 timeMs = 0;           // Wall clock (ms since epoch)
+    qint32 simMinutes = 0;
+    quint16 pump = 0;            // Lets one ring carry several simulated pumps
+    Kind kind = Reading;
+    quint8 code = 0;
+    quint8 flags = 0;
+    quint8 reserved[7] = {};
+    float values[kValueCount] = {};
+};
+
+// Shared-memory ring: a header, then a power-of-two number of slots. Each
+// slot's stamp holds the sequence of the record in it (0 while being
+// written), so a reader can tell a complete record from a torn or lapped one
+// without any write access to the ring.
+struct TelemetryRingHeader {
+    static const quint32 kMagic = 0x4D4C4554;   // "TELM"
+    static const quint32 kVersion = 1;
+
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount;
+    quint32 recordBytes;
+    qint64 producerPid;
+    std::atomic<quint64> writeSequence;         // Last complete record
+};
+
+struct TelemetrySlot {
+    std::atomic<quint64> stamp;
+    quint64 padding[7];                         // Keeps records cache-line aligned
+    TelemetryRecord record;
+};
+
+// Single producer of a telemetry ring plus its control socket.
+//
+// Records go into shared memory (<name>.ring) with no per-subscriber work.
+// The local socket <name> serves control commands, one per line:
+//
+//   HELLO    -> "RING <slots> <record bytes> <write sequence> <shared memory key>"
+//   LATEST   -> "LATEST <n>" then n raw records: the newest of each kind, so a
+//               late joiner has current state even if the ring has moved on
+//   STATS    -> "STATS <subscribers> <write sequence>"
+//
+// The server must be used on one thread, the one that publishes.
+class TelemetryServer : public QObject {
+    Q_OBJECT
+
+public:
+    static const int kDefaultSlots = 4096;      // Over 1000 ticks at 3-4 records per tick
+
+    explicit TelemetryServer(QObject *parent = nullptr);
+    ~TelemetryServer() override;
+
+    // Creates the ring ('capacity' slots, rounded up to a power of two) and listens on 'name'
+    bool start(const QString &name, int capacity, QString *error);
+    void stop();
+    bool isRunning() const { return m_slots != nullptr; }
+
+    // Stamps and writes one record: a copy and two stores, no allocation or locking
+    void publish(TelemetryRecord record);
+
+    quint64 sequence() const { return m_sequence; }
+    int subscriberCount() const { return m_clients.size(); }
+
+private slots:
+    void acceptConnections();
+    void handleCommands();
+
+private:
+    QSharedMemory m_memory;
+    QLocalServer m_server;
+    QVector<QLocalSocket *> m_clients;
+    TelemetryRingHeader *m_header = nullptr;
+    TelemetrySlot *m_slots = nullptr;
+    quint64 m_mask = 0;
+    quint64 m_sequence = 0;
+    TelemetryRecord m_latest[TelemetryRecord::Alert + 1];   // Newest record of each kind
+};
+
+// Reader side for dashboards and recorders: attaches read-only to a
+// server's ring and copies out records it has not seen yet.
+class TelemetrySubscriber {
+public:
+    ~TelemetrySubscriber();
+
+    // Connects to the server called 'name' and maps its ring. With 'fromOldest'
+    // the first poll() also returns the backlog still in the ring.
+    bool attach(const QString &name, bool fromOldest, QString *error);
+    void detach();
+
+    // Newest record of each kind, as held by the server
+    bool fetchLatest(QVector<TelemetryRecord> *records, QString *error);
+
+    // Appends up to 'max' new records in order; returns how many
+    int poll(QVector<TelemetryRecord> *out, int max = 1024);
+
+    // Records overwritten before this subscriber got to them
+    quint64 lost() const { return m_lost; }
+
+private:
+    bool command(const QByteArray &line, QByteArray *reply, QString *error);
+
+    QLocalSocket m_socket;
+    QSharedMemory m_memory;
+    const TelemetryRingHeader *m_header = nullptr;
+    const TelemetrySlot *m_slots = nullptr;
+    quint64 m_mask = 0;
+    quint64 m_next = 1;                          // Next sequence to read
+    quint64 m_lost = 0;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,64 @@
+#include "TickArena.h"
+#include <cstdlib>
+
+TickArena::TickArena(int chunkBytes)
+    : m_chunkBytes(qMax(256, chunkBytes))
+{
+}
+
+TickArena::~TickArena() {
+    for (const Chunk &chunk : m_chunks) {
+        std::free(chunk.data);
+    }
+}
+
+void *TickArena::allocate(qint64 bytes, int alignment) {
+    Q_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    if (bytes <= 0) bytes = 1;
+
+    // The current chunk, or the next kept one it fits in, or a new one
+    while (m_current < m_chunks.size()) {
+        const Chunk &chunk = m_chunks[m_current];
+        const quintptr base = reinterpret_cast<quintptr>(chunk.data);
+        const qint64 start = qint64(((base + m_offset + alignment - 1) & ~quintptr(alignment - 1)) - base);
+        if (start + bytes <= chunk.size) {
+            m_offset = start + bytes;
+            return chunk.data + start;
+        }
+        m_filledBefore += m_offset;
+        m_offset = 0;
+        m_current++;
+    }
+
+    // Chunks double so a tick that outgrew the arena settles after a few resets
+    const qint64 previous = m_chunks.isEmpty() ? m_chunkBytes / 2 : m_chunks.last().size;
+    Chunk chunk;
+    chunk.size = qMax(2 * previous, bytes + alignment);
+    chunk.data = static_cast<char *>(std::malloc(size_t(chunk.size)));
+    Q_CHECK_PTR(chunk.data);
+    m_chunks.append(chunk);
+    return allocate(bytes, alignment);
+}
+
+void TickArena::reset() {
+    m_highWater = qMax(m_highWater, bytesUsed());
+    m_current = 0;
+    m_offset = 0;
+    m_filledBefore = 0;
+}
+
+qint64 TickArena::bytesUsed() const {
+    return m_filledBefore + m_offset;
+}
+
+qint64 TickArena::highWaterBytes() const {
+    return qMax(m_highWater, bytesUsed());
+}
+
+qint64 TickArena::capacity() const {
+    qint64 total = 0;
+    for (const Chunk &chunk : m_chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
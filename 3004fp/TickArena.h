@@ -0,0 +1,108 @@
+#ifndef TICKARENA_H
+#define TICKARENA_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+// Monotonic scratch memory for one pipeline tick.
+//
+// Stages take the memory behind the tick's outputs (prediction curves and
+// bands, projected points) from the arena instead of the heap, and the
+// pipeline calls reset() before the next tick, which only rewinds to the
+// first chunk. Chunks are kept, so once the arena has grown to the size of
+// a tick a steady-state tick allocates nothing. Nothing is destroyed on
+// reset, so only trivially destructible types can be stored.
+class TickArena {
+public:
+    static const int kDefaultChunkBytes = 16 * 1024;
+
+    explicit TickArena(int chunkBytes = kDefaultChunkBytes);
+    ~TickArena();
+
+    void *allocate(qint64 bytes, int alignment = alignof(std::max_align_t));
+
+    template <typename T> T *allocate(int count) {
+        static_assert(std::is_trivially_destructible<T>::value, "TickArena never runs destructors");
+        return static_cast<T *>(allocate(qint64(count) * qint64(sizeof(T)), int(alignof(T))));
+    }
+
+    // Releases everything allocated since the last reset; O(1), chunks are kept
+    void reset();
+
+    qint64 bytesUsed() const;             // Since the last reset, including alignment padding
+    qint64 highWaterBytes() const;        // Most used by any tick so far
+    qint64 capacity() const;
+    int chunkCount() const { return m_chunks.size(); }
+
+private:
+    Q_DISABLE_COPY(TickArena)
+
+    struct Chunk {
+        char *data;
+        qint64 size;
+    };
+
+    QVector<Chunk> m_chunks;
+    int m_chunkBytes;
+    int m_current = 0;                    // Chunk being filled
+    qint64 m_offset = 0;                  // Next free byte in it
+    qint64 m_filledBefore = 0;            // Bytes given out from earlier chunks this tick
+    qint64 m_highWater = 0;
+};
+
+// Fixed-capacity array in a TickArena. Copies share the elements, which stay
+// valid until the arena is reset, so anything kept past the tick must be
+// copied out (toVector()).
+template <typename T>
+class ArenaArray {
+public:
+    ArenaArray() {}
+    ArenaArray(TickArena &arena, int capacity)
+        : m_data(arena.allocate<T>(capacity)), m_capacity(capacity) {}
+
+    int size() const { return m_size; }
+    int capacity() const { return m_capacity; }
+    bool isEmpty() const { return m_size == 0; }
+
+    void append(const T &value) {
+        Q_ASSERT(m_size < m_capacity);
+        new (m_data + m_size++) T(value);
+    }
+
+    // Grows up to the capacity with value-initialised elements, or shrinks
+    void resize(int size) {
+        Q_ASSERT(size >= 0 && size <= m_capacity);
+        for (int i = m_size; i < size; ++i) {
+            new (m_data + i) T();
+        }
+        m_size = size;
+    }
+
+    T &operator[](int index) { Q_ASSERT(index >= 0 && index < m_size); return m_data[index]; }
+    const T &operator[](int index) const { Q_ASSERT(index >= 0 && index < m_size); return m_data[index]; }
+    const T &last() const { Q_ASSERT(m_size > 0); return m_data[m_size - 1]; }
+
+    T *data() { return m_data; }
+    const T *constData() const { return m_data; }
+    const T *begin() const { return m_data; }
+    const T *end() const { return m_data + m_size; }
+
+    QVector<T> toVector() const {
+        QVector<T> out;
+        out.reserve(m_size);
+        for (int i = 0; i < m_size; ++i) {
+            out.append(m_data[i]);
+        }
+        return out;
+    }
+
+private:
+    T *m_data = nullptr;
+    int m_size = 0;
+    int m_capacity = 0;
+};
+
+#endif // TICKARENA_H
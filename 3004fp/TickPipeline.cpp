@@ -0,0 +1,166 @@
+#include "TickPipeline.h"
+#include <QElapsedTimer>
+#include "Instrumentation.h"
+
+namespace {
+// Formats simulated minutes as hh:mm for log entries
+QString simTimeString(int minutes) {
+    return QString("%1:%2")
+        .arg(minutes / 60, 2, 10, QChar('0'))  // hours
+        .arg(minutes % 60, 2, 10, QChar('0')); // minutes
+}
+}
+
+QString DeliveryEvent::text() const {
+    const QString simTime = simTimeString(simMinutes);
+    switch (kind) {
+    case ReservoirRefilled:
+        return QString("[%1] Reservoir refilled").arg(simTime);
+    case ProfileSwitched:
+        return QString("[%1] Profile switched - basal %2 u/h").arg(simTime).arg(value, 0, 'f', 2);
+    case MealBolus:
+        return QString("[%1] Meal bolus: %2 u").arg(simTime).arg(value, 0, 'f', 2);
+    case CriticalLow:
+        return QString("[%1] CRITICAL: BG dangerously low!").arg(simTime);
+    case CriticalHigh:
+        return QString("[%1] CRITICAL: BG dangerously high!").arg(simTime);
+    case Reading: {
+        QString entry = QString("[%1] BG: %2 mmol/L").arg(simTime).arg(value, 0, 'f', 1);
+        if (advice == AdviseCorrection) {
+            entry += QString(" - Recommend correction: %1 u").arg(amount, 0, 'f', 2);
+        } else if (advice == AdviseCarbs) {
+            entry += " - Consider carb intake";
+        }
+        return entry;
+    }
+    case BasalSuspended:
+        return QString("[%1] Suspended due to predicted low BG").arg(simTime);
+    case BasalDecreased:
+        return QString("[%1] Basal rate decreased").arg(simTime);
+    case BasalIncreased:
+        return QString("[%1] Basal rate increased").arg(simTime);
+    case BasalSet:
+        return QString("[%1] Basal rate set to %2 u/h").arg(simTime).arg(value, 0, 'f', 2);
+    case AutoCorrection:
+        return QString("[%1] Auto correction bolus: %2 u").arg(simTime).arg(value, 0, 'f', 2);
+    case TempBasalStarted:
+        return QString("[%1] Temp basal %2 u/h for %3 min").arg(simTime).arg(value, 0, 'f', 2).arg(int(amount));
+    case TempBasalCancelled:
+        return QString("[%1] Temp basal cancelled").arg(simTime);
+    }
+    return QString();
+}
+
+void DeliveryReport::addEvent(const DeliveryEvent &event) {
+    Q_ASSERT(eventCount < kMaxEvents);
+    events[eventCount++] = event;
+}
+
+void DeliveryReport::addEvent(DeliveryEvent::Kind kind, int simMinutes, double value) {
+    DeliveryEvent event;
+    event.kind = kind;
+    event.simMinutes = simMinutes;
+    event.value = value;
+    addEvent(event);
+}
+
+QStringList DeliveryReport::logEntries() const {
+    QStringList entries;
+    for (int i = 0; i < eventCount; ++i) {
+        entries.append(events[i].text());
+    }
+    return entries;
+}
+
+TickPipeline::TickPipeline() {
+}
+
+// Applies each stage to every patient in turn and times each stage separately
+void TickPipeline::run(PatientState *patients, TickFrame *frames, int count) {
+    QElapsedTimer timer;
+    m_arena.reset();
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.sense");
+        timer.start();
+        m_sense->beginTick(patients, count);
+        for (int i = 0; i < count; ++i) {
+            frames[i].reading = m_sense->sense(patients[i]);
+        }
+        record(Sense, timer.nsecsElapsed());
+    }
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.estimate");
+        timer.start();
+        for (int i = 0; i < count; ++i) {
+            frames[i].estimate = m_estimate->estimate(patients[i], frames[i].reading);
+        }
+        record(Estimate, timer.nsecsElapsed());
+    }
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.predict");
+        timer.start();
+        for (int i = 0; i < count; ++i) {
+            frames[i].prediction = m_predict->predict(frames[i].reading, frames[i].estimate, m_arena);
+        }
+        record(Predict, timer.nsecsElapsed());
+    }
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.control");
+        timer.start();
+        m_control->beginTick(patients, count);
+        for (int i = 0; i < count; ++i) {
+            frames[i].decision = m_control->decide(patients[i], frames[i].estimate, frames[i].prediction);
+        }
+        record(Control, timer.nsecsElapsed());
+    }
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.deliver");
+        timer.start();
+        m_deliver->beginTick(patients, count);
+        for (int i = 0; i < count; ++i) {
+            frames[i].delivery = m_deliver->deliver(patients[i], frames[i]);
+        }
+        record(Deliver, timer.nsecsElapsed());
+    }
+
+    {
+        PUMP_TRACE_SCOPE("pipeline.render");
+        timer.start();
+        for (int i = 0; i < count; ++i) {
+            m_render->render(patients[i], frames[i]);
+        }
+        record(Render, timer.nsecsElapsed());
+    }
+}
+
+void TickPipeline::record(Stage stage, qint64 ns) {
+    StageTiming &timing = m_timings[stage];
+    timing.lastNs = ns;
+    timing.totalNs += ns;
+    if (ns > timing.maxNs) timing.maxNs = ns;
+    timing.runs++;
+}
+
+// Clears accumulated stage timings
+void TickPipeline::resetTimings() {
+    for (StageTiming &timing : m_timings) {
+        timing = StageTiming();
+    }
+}
+
+const char *TickPipeline::stageName(Stage stage) {
+    switch (stage) {
+    case Sense: return "sense";
+    case Estimate: return "estimate";
+    case Predict: return "predict";
+    case Control: return "control";
+    case Deliver: return "deliver";
+    case Render: return "render";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,229 @@
+#ifndef TICKPIPELINE_H
+#define TICKPIPELINE_H
+
+#include <QDateTime>
+#include <QVector>
+#include <QPointF>
+#include <QString>
+#include <QStringList>
+#include "TickArena.h"
+
+// User-editable values the simulation reads every tick
+struct SimInputs {
+    double insulinOnBoard = 0.0;     // Units
+    double carbsOnBoard = 0.0;       // Grams
+    double basalRate = 1.0;          // Programmed basal rate (u/h)
+    double correctionFactor = 1.0;   // mmol/L per unit
+    double carbRatio = 10.0;         // Grams per unit
+    double targetBG = 5.5;           // mmol/L
+};
+
+// Per-patient state carried from tick to tick
+struct PatientState {
+    SimInputs inputs;                    // IOB, COB and profile values
+    double glucose = 0.0;                // Plant BG (mmol/L)
+    int simMinutes = 0;                  // Simulated minutes since start
+    bool initialReadingPending = false;  // Next sense returns the start value without advancing
+    int lastAutoCorrectionMinute = -1;   // Rate limit for auto correction boluses (-1 = none yet)
+    double deliveredBasalRate = 1.0;     // Basal rate the pump is running (u/h)
+    double pendingBolus = 0.0;           // Units delivered since the last sense, not yet seen by the plant
+    double pendingBasal = 0.0;           // Basal pulses (units) delivered since the last sense, likewise
+
+    // Scenario effects, set by ScenarioPlayer before the tick
+    double exerciseIntensity = 0.0;      // 0-1; insulin acts harder while > 0
+    int exerciseEndMinute = 0;
+    double sensorBias = 0.0;             // mmol/L added to CGM readings during a sensor fault
+    int sensorFaultEndMinute = 0;
+    double scenarioBolus = 0.0;          // Meal boluses (units) not yet delivered by the deliver stage
+    bool profileChanged = false;         // Deliver stage reprograms the pump's basal rate
+    bool refillPending = false;          // Deliver stage refills the reservoir
+    bool tempBasalPending = false;       // Deliver stage starts (or, for 0 minutes, cancels) a temp basal
+    double tempBasalRate = 0.0;          // u/h
+    int tempBasalMinutes = 0;
+};
+
+// Sense: one CGM reading
+struct SensorReading {
+    int simMinutes = 0;
+    double glucose = 0.0;
+    bool initial = false;                // Reading taken at simulation start
+};
+
+// Estimate: best guess of the current metabolic state
+struct GlucoseEstimate {
+    double glucose = 0.0;                // Filtered BG (mmol/L)
+    double rawGlucose = 0.0;             // Reading it was filtered from
+    double trend = 0.0;                  // mmol/L per minute
+    double variance = 0.0;               // Of 'glucose'; 0 if unknown
+    double insulinOnBoard = 0.0;
+    double carbsOnBoard = 0.0;
+    double basalRate = 0.0;              // Programmed basal rate (u/h)
+    double correctionFactor = 1.0;       // mmol/L per unit
+    double carbRatio = 10.0;             // Grams per unit
+};
+
+// Predict: where BG is heading. The lines live in the pipeline's tick arena
+// and are valid until its next run().
+struct GlucosePrediction {
+    double predicted30min = 0.0;         // Used by the controller
+    double predicted30minLow = 0.0;      // Pessimistic (10th percentile) value for low-glucose suspend
+    ArenaArray<QPointF> curve;           // 60-minute line shown on the chart
+    ArenaArray<QPointF> lowerBand;       // 10th/90th percentile lines; empty for point predictors
+    ArenaArray<QPointF> upperBand;
+};
+
+// Control: what the pump should do about it
+struct ControlDecision {
+    enum BasalAction { KeepBasal, SuspendBasal, DecreaseBasal, IncreaseBasal, SetBasal };
+    enum GlucoseAlert { NoAlert, LowAlert, HighAlert };
+
+    GlucoseAlert alert = NoAlert;
+    bool criticalLow = false;
+    bool criticalHigh = false;
+    bool recommendCarbs = false;
+    double recommendedCorrection = 0.0;  // Units, 0 if none
+    BasalAction basalAction = KeepBasal;
+    double basalAdjustment = 0.0;        // u/h for Decrease/Increase
+    double basalRate = 0.0;              // u/h for SetBasal
+    double autoCorrection = 0.0;         // Units, 0 if none
+};
+
+// One entry of the pump's event log; the text is only built when it is shown
+struct DeliveryEvent {
+    enum Kind : quint8 {
+        ReservoirRefilled, ProfileSwitched, MealBolus, CriticalLow, CriticalHigh, Reading,
+        BasalSuspended, BasalDecreased, BasalIncreased, BasalSet, AutoCorrection,
+        TempBasalStarted, TempBasalCancelled
+    };
+    enum Advice : quint8 { NoAdvice, AdviseCorrection, AdviseCarbs };
+
+    Kind kind = Reading;
+    Advice advice = NoAdvice;            // Reading only
+    int simMinutes = 0;
+    double value = 0.0;                  // BG, units or u/h, depending on the kind
+    double amount = 0.0;                 // Reading: recommended correction (units); TempBasalStarted: minutes
+
+    QString text() const;
+};
+
+// Deliver: what was applied, in log order
+struct DeliveryReport {
+    static const int kMaxEvents = 12;
+
+    DeliveryEvent events[kMaxEvents];
+    int eventCount = 0;
+    double mealBolus = 0.0;              // Units delivered this tick, for the dose ledger
+    double correctionBolus = 0.0;
+    double basalUnits = 0.0;             // Basal pulses delivered since the last tick
+
+    void addEvent(const DeliveryEvent &event);
+    void addEvent(DeliveryEvent::Kind kind, int simMinutes, double value = 0.0);
+    QStringList logEntries() const;      // Every event's text, for the UI log
+};
+
+// Everything one tick produces for one patient
+struct TickFrame {
+    SensorReading reading;
+    GlucoseEstimate estimate;
+    GlucosePrediction prediction;
+    ControlDecision decision;
+    DeliveryReport delivery;
+};
+
+// Stage interfaces; implementations can be swapped independently
+class SenseStage {
+public:
+    virtual ~SenseStage() {}
+    // Called once per tick before sense(); batch plants advance all patients here
+    virtual void beginTick(PatientState *patients, int count) { Q_UNUSED(patients); Q_UNUSED(count); }
+    virtual SensorReading sense(PatientState &patient) = 0;
+};
+
+class EstimateStage {
+public:
+    virtual ~EstimateStage() {}
+    virtual GlucoseEstimate estimate(const PatientState &patient, const SensorReading &reading) = 0;
+};
+
+class PredictStage {
+public:
+    virtual ~PredictStage() {}
+    // Curves are allocated from 'arena'
+    virtual GlucosePrediction predict(const SensorReading &reading, const GlucoseEstimate &estimate,
+                                      TickArena &arena) = 0;
+};
+
+class ControlStage {
+public:
+    virtual ~ControlStage() {}
+    // Called once per tick before decide(); controllers keeping per-patient state map lanes here
+    virtual void beginTick(PatientState *patients, int count) { Q_UNUSED(patients); Q_UNUSED(count); }
+    virtual ControlDecision decide(const PatientState &patient, const GlucoseEstimate &estimate,
+                                   const GlucosePrediction &prediction) = 0;
+};
+
+class DeliverStage {
+public:
+    virtual ~DeliverStage() {}
+    // Called once per tick before deliver(); pumps keeping per-patient state map lanes here
+    virtual void beginTick(PatientState *patients, int count) { Q_UNUSED(patients); Q_UNUSED(count); }
+    virtual DeliveryReport deliver(PatientState &patient, const TickFrame &frame) = 0;
+};
+
+class RenderStage {
+public:
+    virtual ~RenderStage() {}
+    virtual void render(const PatientState &patient, const TickFrame &frame) = 0;
+};
+
+// Wall-clock cost of one stage, accumulated over all runs
+struct StageTiming {
+    qint64 lastNs = 0;       // Last run (all patients)
+    qint64 maxNs = 0;
+    qint64 totalNs = 0;
+    quint64 runs = 0;
+};
+
+// Runs sense -> estimate -> predict -> control -> deliver -> render.
+// Each stage is applied to every patient before the next stage starts,
+// so a stage's working set stays hot and its cost can be timed on its own.
+// Per-tick scratch comes from a TickArena reset at the start of every run,
+// so frames from one run stay valid until the next.
+class TickPipeline {
+public:
+    enum Stage { Sense, Estimate, Predict, Control, Deliver, Render, StageCount };
+
+    TickPipeline();
+
+    // Stages are not owned; all six must be set before run()
+    void setSenseStage(SenseStage *stage) { m_sense = stage; }
+    void setEstimateStage(EstimateStage *stage) { m_estimate = stage; }
+    void setPredictStage(PredictStage *stage) { m_predict = stage; }
+    void setControlStage(ControlStage *stage) { m_control = stage; }
+    void setDeliverStage(DeliverStage *stage) { m_deliver = stage; }
+    void setRenderStage(RenderStage *stage) { m_render = stage; }
+
+    // Run one tick for 'count' patients; frames[i] receives patient i's outputs
+    void run(PatientState *patients, TickFrame *frames, int count);
+
+    const StageTiming &timing(Stage stage) const { return m_timings[stage]; }
+    const TickArena &arena() const { return m_arena; }
+    void resetTimings();
+
+    static const char *stageName(Stage stage);
+
+private:
+    SenseStage *m_sense = nullptr;
+    EstimateStage *m_estimate = nullptr;
+    PredictStage *m_predict = nullptr;
+    ControlStage *m_control = nullptr;
+    DeliverStage *m_deliver = nullptr;
+    RenderStage *m_render = nullptr;
+
+    StageTiming m_timings[StageCount];
+    TickArena m_arena;
+
+    void record(Stage stage, qint64 ns);
+};
+
+#endif // TICKPIPELINE_H
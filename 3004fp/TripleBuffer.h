@@ -0,0 +1,50 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer handoff of the latest value.
+// The writer fills back() and calls publish(); the reader calls update() at
+// its own pace and then reads front(). Neither side ever blocks the other,
+// and the reader always sees a complete value (intermediate ones may be skipped).
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_middle(1), m_back(0), m_front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer: slot to fill before the next publish()
+    T& back() { return m_buffers[m_back]; }
+
+    // Writer: hands the back slot to the reader and takes the spare one
+    void publish() {
+        int previous = m_middle.exchange(m_back | kDirty, std::memory_order_acq_rel);
+        m_back = previous & kIndexMask;
+    }
+
+    // Reader: swaps in the newest published value, returns false if nothing new
+    bool update() {
+        if (!(m_middle.load(std::memory_order_acquire) & kDirty)) {
+            return false;
+        }
+        int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & kIndexMask;
+        return true;
+    }
+
+    // Reader: the value obtained by the last successful update()
+    const T& front() const { return m_buffers[m_front]; }
+
+private:
+    static const int kIndexMask = 0x3;
+    static const int kDirty = 0x4;
+
+    T m_buffers[3];
+    std::atomic<int> m_middle;   // Shared slot index, plus dirty flag
+    int m_back;                  // Owned by the writer
+    int m_front;                 // Owned by the reader
+};
+
+#endif // TRIPLEBUFFER_H
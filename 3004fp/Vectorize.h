@@ -0,0 +1,22 @@
+#ifndef VECTORIZE_H
+#define VECTORIZE_H
+
+#include <cmath>
+
+// Loop hints shared by the batch kernels (cohort models, prediction ensembles).
+// Iterations of a marked loop are independent patients or samples, so the
+// compiler may vectorise it without runtime aliasing checks.
+#if defined(__clang__)
+#define PUMP_VECTORIZE_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define PUMP_VECTORIZE_LOOP _Pragma("GCC ivdep")
+#else
+#define PUMP_VECTORIZE_LOOP
+#endif
+
+// max(v, 0) without a branch, so it vectorises
+inline double positivePart(double v) {
+    return 0.5 * (v + std::fabs(v));
+}
+
+#endif // VECTORIZE_H
@@ -0,0 +1,201 @@
+#include "WhatIfExplorer.h"
+#include <QRunnable>
+#include <QThread>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include "Instrumentation.h"
+
+namespace {
+const double kInsulinActionMinutes = 55.0;   // Insulin time to peak
+const double kCarbAbsorptionMinutes = 40.0;  // Carb time to peak
+const double kRangeLow = 3.9;
+const double kRangeHigh = 10.0;
+
+// Fraction of a subcutaneous dose that has acted after t minutes
+// (two-compartment absorption with time-to-peak tau)
+double actedFraction(double t, double tau) {
+    if (t <= 0.0) return 0.0;
+    return 1.0 - (1.0 + t / tau) * std::exp(-t / tau);
+}
+
+}
+
+// One strategy of one exploration, run on the explorer's pool
+class WhatIfJob : public QRunnable {
+public:
+    WhatIfJob(WhatIfExplorer *explorer, const std::atomic<quint64> &current, quint64 generation,
+              const WhatIfInputs &inputs, const WhatIfStrategy &strategy, int index)
+        : m_explorer(explorer), m_current(current), m_generation(generation),
+          m_inputs(inputs), m_strategy(strategy), m_index(index) {}
+
+    void run() override {
+        if (m_current.load(std::memory_order_relaxed) != m_generation) return;
+
+        WhatIfResult result;
+        result.index = m_index;
+        if (!WhatIfExplorer::evaluate(m_inputs, m_strategy, m_current, m_generation, &result)) return;
+
+        // Hand the result to the explorer's thread; dropped there if it has gone stale
+        WhatIfExplorer *explorer = m_explorer;
+        QMetaObject::invokeMethod(explorer, [explorer, result]() { explorer->deliver(result); },
+                                  Qt::QueuedConnection);
+    }
+
+private:
+    WhatIfExplorer *m_explorer;
+    const std::atomic<quint64> &m_current;
+    quint64 m_generation;
+    WhatIfInputs m_inputs;
+    WhatIfStrategy m_strategy;
+    int m_index;
+};
+
+QString WhatIfStrategy::label() const {
+    QString text;
+    switch (delivery) {
+    case Now: text = "Bolus now"; break;
+    case Split: text = "Split 50/50 (+1 h)"; break;
+    case Extended: text = QString("Extended %1 h").arg(hours, 0, 'g', 2); break;
+    }
+    return correction ? text + " + correction" : text;
+}
+
+WhatIfExplorer::WhatIfExplorer(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));   // Leave a core for the UI
+}
+
+WhatIfExplorer::~WhatIfExplorer() {
+    cancel();
+    m_pool.waitForDone();
+}
+
+double WhatIfExplorer::insulinActed(double t) {
+    return actedFraction(t, kInsulinActionMinutes);
+}
+
+double WhatIfExplorer::carbsAbsorbed(double t) {
+    return actedFraction(t, kCarbAbsorptionMinutes);
+}
+
+QVector<WhatIfStrategy> WhatIfExplorer::strategies(const WhatIfInputs &inputs) {
+    QVector<double> hours = { 1.0, 2.0, 3.0, 4.0 };
+    if (inputs.extendedHours > 0.0 && !hours.contains(inputs.extendedHours)) {
+        hours.append(inputs.extendedHours);
+        std::sort(hours.begin(), hours.end());
+    }
+
+    QVector<WhatIfStrategy> grid;
+    const bool aboveTarget = inputs.glucose > inputs.targetBG;
+    for (int withCorrection = 0; withCorrection <= (aboveTarget ? 1 : 0); ++withCorrection) {
+        WhatIfStrategy strategy;
+        strategy.correction = withCorrection != 0;
+
+        strategy.delivery = WhatIfStrategy::Now;
+        grid.append(strategy);
+        strategy.delivery = WhatIfStrategy::Split;
+        grid.append(strategy);
+        strategy.delivery = WhatIfStrategy::Extended;
+        for (double h : hours) {
+            strategy.hours = h;
+            grid.append(strategy);
+        }
+    }
+    return grid;
+}
+
+// Dose schedule from the calculator's rules, then BG from carb absorption
+// minus the action of IOB and every scheduled dose
+bool WhatIfExplorer::evaluate(const WhatIfInputs &inputs, const WhatIfStrategy &strategy,
+                              const std::atomic<quint64> &current, quint64 generation, WhatIfResult *result) {
+    PUMP_TRACE_SCOPE("whatif.evaluate");
+    result->generation = generation;
+    result->strategy = strategy;
+
+    double carbBolus = inputs.carbRatio > 0.0 ? inputs.carbs / inputs.carbRatio : 0.0;
+    double correction = (strategy.correction && inputs.correctionFactor > 0.0)
+                        ? (inputs.glucose - inputs.targetBG) / inputs.correctionFactor : 0.0;
+    double total = qMax(0.0, carbBolus + correction - inputs.insulinOnBoard);
+
+    QVector<TimedDose<double>> doses;
+    switch (strategy.delivery) {
+    case WhatIfStrategy::Now:
+        doses.append({ 0.0, total });
+        result->immediateUnits = total;
+        break;
+    case WhatIfStrategy::Split:
+        doses.append({ 0.0, total * 0.5 });
+        doses.append({ double(kSplitDelayMinutes), total * 0.5 });
+        result->immediateUnits = total * 0.5;
+        result->laterUnits = total * 0.5;
+        break;
+    case WhatIfStrategy::Extended: {
+        double fraction = qBound(0.0, inputs.immediateFraction, 1.0);
+        result->immediateUnits = total * fraction;
+        result->laterUnits = total - result->immediateUnits;
+        doses.append({ 0.0, result->immediateUnits });
+
+        // Extended portion as equal pulses, one per step
+        int pulses = qMax(1, qRound(strategy.hours * 60.0 / kStepMinutes));
+        for (int p = 0; p < pulses; ++p) {
+            doses.append({ double(p * kStepMinutes), result->laterUnits / pulses });
+        }
+        break;
+    }
+    }
+
+    const double isf = inputs.correctionFactor;
+    const double carbRise = inputs.carbRatio > 0.0 ? isf * inputs.carbs / inputs.carbRatio : 0.0;
+    const int steps = kHorizonMinutes / kStepMinutes;
+
+    result->curve.reserve(steps + 1);
+    result->minGlucose = inputs.glucose;
+    result->maxGlucose = inputs.glucose;
+    int inRange = 0;
+
+    for (int k = 0; k <= steps; ++k) {
+        if (current.load(std::memory_order_relaxed) != generation) return false;
+
+        double t = k * kStepMinutes;
+        double glucose = glucoseAt(t, inputs.glucose, carbRise, isf, inputs.insulinOnBoard, doses);
+
+        result->curve.append(QPointF(t, glucose));
+        result->minGlucose = qMin(result->minGlucose, glucose);
+        result->maxGlucose = qMax(result->maxGlucose, glucose);
+        if (glucose >= kRangeLow && glucose <= kRangeHigh) inRange++;
+    }
+
+    result->finalGlucose = result->curve.last().y();
+    result->timeInRange = 100.0 * inRange / (steps + 1);
+    return true;
+}
+
+quint64 WhatIfExplorer::explore(const WhatIfInputs &inputs) {
+    // Older jobs that have not started are dropped; running ones see the new generation and stop
+    quint64 generation = ++m_generation;
+    m_pool.clear();
+
+    QVector<WhatIfStrategy> grid = strategies(inputs);
+    m_pending = grid.size();
+    for (int i = 0; i < grid.size(); ++i) {
+        m_pool.start(new WhatIfJob(this, m_generation, generation, inputs, grid[i], i));
+    }
+    return generation;
+}
+
+void WhatIfExplorer::cancel() {
+    ++m_generation;
+    m_pool.clear();
+    m_pending = 0;
+}
+
+void WhatIfExplorer::deliver(const WhatIfResult &result) {
+    if (result.generation != m_generation.load()) return;
+
+    emit resultReady(result);
+    if (--m_pending == 0) {
+        emit explorationFinished(result.generation);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef WHATIFEXPLORER_H
+#define WHATIFEXPLORER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QThreadPool>
+#include <atomic>
+
+// Calculator values a what-if exploration starts from
+struct WhatIfInputs {
+    double carbs = 0.0;              // Grams
+    double glucose = 0.0;            // Current BG (mmol/L)
+    double carbRatio = 10.0;         // Grams per unit
+    double correctionFactor = 1.0;   // mmol/L per unit
+    double targetBG = 5.5;
+    double insulinOnBoard = 0.0;     // Units
+    double immediateFraction = 0.6;  // Share delivered at once for extended boluses
+    double extendedHours = 3.0;      // Duration selected on the calculator
+};
+
+// One way of delivering the meal bolus
+struct WhatIfStrategy {
+    enum Delivery { Now, Split, Extended };
+
+    Delivery delivery = Now;
+    double hours = 0.0;              // Extension length (Extended only)
+    bool correction = false;         // Correction for BG above target included
+
+    QString label() const;
+};
+
+// Insulin given 'minute' minutes after the bolus; T is double, or Dual for gradients
+template <typename T>
+struct TimedDose {
+    double minute;
+    T units;
+};
+
+// Outcome of one strategy, curve every 5 minutes from the time of the bolus
+struct WhatIfResult {
+    quint64 generation = 0;          // Exploration this belongs to
+    int index = 0;                   // Position in strategies()
+    WhatIfStrategy strategy;
+
+    double immediateUnits = 0.0;
+    double laterUnits = 0.0;         // Split second dose or extended portion
+    QVector<QPointF> curve;          // (minute, BG)
+    double minGlucose = 0.0;
+    double maxGlucose = 0.0;
+    double finalGlucose = 0.0;       // At the end of the horizon
+    double timeInRange = 0.0;        // Percent of the curve within 3.9-10.0 mmol/L
+};
+
+// Evaluates a grid of bolus strategies (now, split, extended over 1-4 h, each
+// with and without correction) on a private worker pool.
+//
+// explore() returns at once. Every call starts a new generation: queued jobs
+// of older generations are dropped from the pool and running ones stop at
+// their next step, so only the latest inputs produce results. Results arrive
+// one by one through resultReady() on the explorer's thread, in completion
+// order, followed by explorationFinished().
+class WhatIfExplorer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int kHorizonMinutes = 360;
+    static const int kStepMinutes = 5;
+    static const int kSplitDelayMinutes = 60;   // Second half of a split bolus
+
+    explicit WhatIfExplorer(QObject *parent = nullptr);
+    ~WhatIfExplorer();
+
+    // Strategy grid for the given inputs; correction variants only when BG is above target
+    static QVector<WhatIfStrategy> strategies(const WhatIfInputs &inputs);
+
+    // Computes one strategy; returns false if 'current' moved past 'generation' meanwhile
+    static bool evaluate(const WhatIfInputs &inputs, const WhatIfStrategy &strategy,
+                         const std::atomic<quint64> &current, quint64 generation, WhatIfResult *result);
+
+    // Share of a dose (or of a meal's carbs) that has acted 't' minutes after it was given
+    static double insulinActed(double t);
+    static double carbsAbsorbed(double t);
+
+    // BG 't' minutes after the bolus: 'glucose' plus the carb rise absorbed by then, minus
+    // 'isf' times the IOB and doses that have acted. Never below zero.
+    template <typename T>
+    static T glucoseAt(double t, const T &glucose, const T &carbRise, const T &isf,
+                       const T &insulinOnBoard, const QVector<TimedDose<T>> &doses);
+
+    // Starts a new exploration and cancels the previous one; returns its generation
+    quint64 explore(const WhatIfInputs &inputs);
+
+    // Cancels the current exploration without starting another
+    void cancel();
+
+    quint64 generation() const { return m_generation.load(); }
+
+signals:
+    void resultReady(const WhatIfResult &result);
+    void explorationFinished(quint64 generation);
+
+private:
+    friend class WhatIfJob;
+
+    // Emits a finished job's result unless a newer exploration has started
+    void deliver(const WhatIfResult &result);
+
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation{0};
+    int m_pending = 0;               // Results still expected for the current generation
+};
+
+template <typename T>
+T WhatIfExplorer::glucoseAt(double t, const T &glucose, const T &carbRise, const T &isf,
+                            const T &insulinOnBoard, const QVector<TimedDose<T>> &doses) {
+    T acted = insulinOnBoard * insulinActed(t);
+    for (const TimedDose<T> &dose : doses) {
+        acted += dose.units * insulinActed(t - dose.minute);
+    }
+    return qMax(T(0.0), glucose + carbRise * carbsAbsorbed(t) - isf * acted);
+}
+
+#endif // WHATIFEXPLORER_H
@@ -0,0 +1,77 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Constant-initialized so allocations before main() are safe to count
+std::atomic<uint64_t> g_allocations(0);
+std::atomic<uint64_t> g_bytes(0);
+
+inline void countAllocation(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+}
+
+namespace AllocationCounter {
+
+Totals current() {
+    Totals totals;
+    totals.allocations = g_allocations.load(std::memory_order_relaxed);
+    totals.bytes = g_bytes.load(std::memory_order_relaxed);
+    return totals;
+}
+
+#if defined(__GLIBC__)
+bool countsMalloc() { return true; }
+#else
+bool countsMalloc() { return false; }
+#endif
+
+} // namespace AllocationCounter
+
+#if defined(__GLIBC__)
+
+// Interpose the C allocator; operator new goes through malloc on glibc
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+#else
+
+void *operator new(size_t size) {
+    countAllocation(size);
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    countAllocation(size);
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Counts heap allocations made by the whole process.
+// On glibc, malloc/calloc/realloc are interposed so Qt containers (which
+// allocate through malloc) are counted too; elsewhere only operator new is seen.
+namespace AllocationCounter {
+
+struct Totals {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+// Running totals since process start
+Totals current();
+
+// True when malloc-level interposition is active
+bool countsMalloc();
+
+} // namespace AllocationCounter
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,657 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QVector>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include "AllocationCounter.h"
+#include "BolusManager.h"
+#include "CGMManager.h"
+#include "CgmFusion.h"
+#include "UserProfile.h"
+#include "SafetyController.h"
+#include "TickPipeline.h"
+#include "PumpStages.h"
+#include "BasalDelivery.h"
+#include "PhysiologicalModel.h"
+#include "MpcBasalController.h"
+#include "EnsemblePredictor.h"
+#include "WhatIfExplorer.h"
+#include "GlucoseArchive.h"
+#include "GoldenTrace.h"
+#include "HistorySync.h"
+#include "ProfileCalibration.h"
+#include "ProfileSensitivity.h"
+#include "PumpJournal.h"
+#include "RunExport.h"
+#include "Scenario.h"
+#include "Telemetry.h"
+
+// Micro-benchmarks for the pump's hot paths.
+//
+//   bench [--filter <substring>] [--json <file>] [--min-time <seconds>]
+//
+// Each benchmark is calibrated to run for at least --min-time, then repeated
+// kRuns times; the median run is reported as ns/op plus heap allocations and
+// bytes allocated per op.
+
+namespace {
+
+const int kRuns = 5;                  // Timed repetitions per benchmark
+const int kMaxReadings = 288;         // CGMManager keeps 24h of 5-min readings
+
+// Keeps the optimiser from discarding benchmark results
+volatile double g_sink = 0.0;
+
+struct BenchResult {
+    QString name;
+    qint64 iterations = 0;
+    double nsPerOp = 0.0;
+    double allocsPerOp = 0.0;
+    double bytesPerOp = 0.0;
+};
+
+struct Benchmark {
+    QString name;
+    std::function<void()> setup;      // Optional, runs before every timed batch
+    std::function<void()> op;         // One operation
+};
+
+// Runs op() n times and returns elapsed ns and allocations
+BenchResult timeBatch(const Benchmark &bench, qint64 n) {
+    if (bench.setup) bench.setup();
+
+    AllocationCounter::Totals before = AllocationCounter::current();
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 i = 0; i < n; ++i) {
+        bench.op();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    AllocationCounter::Totals after = AllocationCounter::current();
+
+    BenchResult result;
+    result.name = bench.name;
+    result.iterations = n;
+    result.nsPerOp = static_cast<double>(elapsed) / n;
+    result.allocsPerOp = static_cast<double>(after.allocations - before.allocations) / n;
+    result.bytesPerOp = static_cast<double>(after.bytes - before.bytes) / n;
+    return result;
+}
+
+// Grows the batch until it takes minTimeNs, then reports the median of kRuns batches
+BenchResult runBenchmark(const Benchmark &bench, qint64 minTimeNs) {
+    qint64 n = 1;
+    for (;;) {
+        BenchResult probe = timeBatch(bench, n);
+        double total = probe.nsPerOp * n;
+        if (total >= minTimeNs || n >= (qint64(1) << 30)) break;
+        double scale = total > 0 ? 1.5 * minTimeNs / total : 100.0;
+        n = qMax(n + 1, static_cast<qint64>(n * qMin(scale, 100.0)));
+    }
+
+    QVector<BenchResult> runs;
+    for (int i = 0; i < kRuns; ++i) {
+        runs.append(timeBatch(bench, n));
+    }
+    std::sort(runs.begin(), runs.end(), [](const BenchResult &a, const BenchResult &b) {
+        return a.nsPerOp < b.nsPerOp;
+    });
+    return runs[kRuns / 2];
+}
+
+// Fills a CGMManager with a full day of plausible readings
+void fillHistory(CGMManager &cgm) {
+    for (int i = 0; i < kMaxReadings; ++i) {
+        cgm.addReading(6.0 + 2.0 * ((i % 24) - 12) / 12.0);
+    }
+}
+
+// Render stage that drops every frame
+class DiscardRender : public RenderStage {
+public:
+    void render(const PatientState &, const TickFrame &frame) override {
+        g_sink = g_sink + frame.prediction.predicted30min;
+    }
+};
+
+// Silence qDebug output from the code under test
+void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+    if (type != QtDebugMsg && type != QtInfoMsg) {
+        std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+    }
+}
+
+bool writeJson(const QString &path, const QVector<BenchResult> &results) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QByteArray json = "{\"allocationsCountMalloc\":";
+    json += AllocationCounter::countsMalloc() ? "true" : "false";
+    json += ",\"benchmarks\":[";
+    for (int i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results[i];
+        if (i) json += ',';
+        json += "\n{\"name\":\"";
+        json += r.name.toUtf8();
+        json += "\",\"iterations\":";
+        json += QByteArray::number(r.iterations);
+        json += ",\"nsPerOp\":";
+        json += QByteArray::number(r.nsPerOp, 'f', 2);
+        json += ",\"opsPerSec\":";
+        json += QByteArray::number(r.nsPerOp > 0 ? 1e9 / r.nsPerOp : 0.0, 'f', 0);
+        json += ",\"allocsPerOp\":";
+        json += QByteArray::number(r.allocsPerOp, 'f', 3);
+        json += ",\"bytesPerOp\":";
+        json += QByteArray::number(r.bytesPerOp, 'f', 1);
+        json += '}';
+    }
+    json += "\n]}\n";
+
+    return file.write(json) == json.size();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    qInstallMessageHandler(quietMessageHandler);
+
+    QString filter;
+    QString jsonPath;
+    double minTimeSeconds = 0.2;
+
+    QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "--filter" && i + 1 < args.size()) {
+            filter = args[++i];
+        } else if (args[i] == "--json" && i + 1 < args.size()) {
+            jsonPath = args[++i];
+        } else if (args[i] == "--min-time" && i + 1 < args.size()) {
+            minTimeSeconds = args[++i].toDouble();
+        } else {
+            std::fprintf(stderr, "usage: bench [--filter <substring>] [--json <file>] [--min-time <seconds>]\n");
+            return 2;
+        }
+    }
+
+    // Fixtures shared by the benchmarks below
+    BolusManager bolusManager;
+    CGMManager cgmManager(&bolusManager);
+    User user;
+    fillHistory(cgmManager);
+
+    SafetyController controller;
+    CGMManager tickCgm(&bolusManager);
+    SimulatedCgmSensor sensor;
+    CgmHistoryEstimator estimator(&tickCgm);
+    LinearGlucosePredictor predictor(&tickCgm);
+    ThresholdBasalController basalController;
+    PumpDelivery delivery(&controller);
+    DiscardRender render;
+
+    TickPipeline pipeline;
+    pipeline.setSenseStage(&sensor);
+    pipeline.setEstimateStage(&estimator);
+    pipeline.setPredictStage(&predictor);
+    pipeline.setControlStage(&basalController);
+    pipeline.setDeliverStage(&delivery);
+    pipeline.setRenderStage(&render);
+
+    PatientState patient;
+    TickFrame frame;
+
+    QVector<Benchmark> benchmarks;
+
+    benchmarks.append({"bolus.calculateBolus", nullptr, [&]() {
+        BolusResult r = bolusManager.calculateBolus(60.0, 9.4, 10.0, 2.0, 5.5, 1.2);
+        g_sink = g_sink + r.finalBolus;
+    }});
+
+    // Steady state: history is already at capacity so every add evicts the oldest
+    benchmarks.append({"cgm.addReading", nullptr, [&]() {
+        cgmManager.addReading(7.2);
+    }});
+
+    // One journaled reading: encode, write and flush a record, fold it, and a snapshot every 1024
+    const QString journalDir = QDir(QDir::tempPath()).filePath("pump-bench-journal");
+    QFile::remove(QDir(journalDir).filePath("pump.journal"));
+    QFile::remove(QDir(journalDir).filePath("pump.snapshot"));
+    PumpJournal journal;
+    QString journalError;
+    if (!journal.open(journalDir, &journalError)) {
+        std::fprintf(stderr, "journal: %s\n", journalError.toLocal8Bit().constData());
+        return 1;
+    }
+    double journalMinute = 0.0;
+    benchmarks.append({"journal.record", nullptr, [&]() {
+        journalMinute += CGMManager::kReadingIntervalMinutes;
+        journal.record(JournalEvent::make(JournalEvent::CgmReading, journalMinute, 7.2, 0.04));
+    }});
+
+    // One record into the shared-memory ring; the cost does not depend on how many subscribers read it
+    TelemetryServer telemetry;
+    QString telemetryError;
+    if (!telemetry.start(QString("pump-bench-%1").arg(QCoreApplication::applicationPid()),
+                         TelemetryServer::kDefaultSlots, &telemetryError)) {
+        std::fprintf(stderr, "telemetry: %s\n", telemetryError.toLocal8Bit().constData());
+        return 1;
+    }
+    TelemetryRecord telemetryRecord;
+    benchmarks.append({"telemetry.publish", nullptr, [&]() {
+        telemetryRecord.simMinutes += 5;
+        telemetryRecord.values[0] = 7.2f;
+        telemetry.publish(telemetryRecord);
+    }});
+
+    // One filter step on its own (included in cgm.addReading above)
+    GlucoseKalmanFilter kalman;
+    int kalmanStep = 0;
+    benchmarks.append({"kalman.update", nullptr, [&]() {
+        kalman.update(7.0 + 0.1 * (++kalmanStep & 7), CGMManager::kReadingIntervalMinutes);
+        g_sink = g_sink + kalman.trend();
+    }});
+
+    // One day of readings with jitter, a duplicate every 16th and a 40-minute dropout every 4 hours
+    QVector<ResampledPoint> resampled;
+    resampled.reserve(2 * kMaxReadings);
+    benchmarks.append({"resampler.day", nullptr, [&]() {
+        CgmResampler::Settings settings;
+        settings.lookahead = 2;
+        CgmResampler resampler(settings);
+        resampled.clear();
+        for (int i = 0; i < kMaxReadings; ++i) {
+            if (i % 48 >= 40) continue;
+            const double minute = i * 5.0 + 0.25 * ((i * 7) % 5 - 2);
+            const double glucose = 6.0 + 2.0 * ((i % 24) - 12) / 12.0;
+            resampler.push(minute, glucose, &resampled);
+            if ((i & 15) == 0) resampler.push(minute + 0.1, glucose, &resampled);
+        }
+        resampler.flush(&resampled);
+        g_sink = g_sink + resampled.size();
+    }});
+
+    // A day from a primary and an offset backup sensor plus a fingerstick every 4 hours
+    QVector<FusedReading> fused;
+    fused.reserve(2 * kMaxReadings);
+    benchmarks.append({"fusion.day", nullptr, [&]() {
+        CgmFusion fusion;
+        const int primary = fusion.addSource("primary", 0.4);
+        const int backup = fusion.addSource("backup", 0.8);
+        const int fingerstick = fusion.addSource("fingerstick", 0.15, CgmFusion::Calibration);
+        fused.clear();
+        for (int i = 0; i < kMaxReadings; ++i) {
+            const double glucose = 6.0 + 2.0 * ((i % 24) - 12) / 12.0;
+            fusion.push(primary, i * 5.0, glucose, &fused);
+            fusion.push(backup, i * 5.0 + 2.0, glucose + 0.3, &fused);
+            if (i % 48 == 0) fusion.push(fingerstick, i * 5.0 + 1.0, glucose - 0.1, &fused);
+            fusion.poll(&fused);
+        }
+        fusion.finish(&fused);
+        g_sink = g_sink + fused.size();
+    }});
+
+    benchmarks.append({"cgm.getGlucoseHistory/60", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.getGlucoseHistory(60).size();
+    }});
+
+    benchmarks.append({"cgm.getGlucoseHistory/1440", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.getGlucoseHistory(1440).size();
+    }});
+
+    benchmarks.append({"cgm.calculateGlucoseRateOfChange", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.calculateGlucoseRateOfChange(15);
+    }});
+
+    // Mean, SD, range, time in range and trend over the packed reading columns
+    benchmarks.append({"cgm.summarizeReadings/24h", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.summarizeReadings(24 * 60).sd;
+    }});
+
+    benchmarks.append({"cgm.predictGlucoseLevels/30", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.predictGlucoseLevels(7.2, 1.5, 20.0, 1.0, 30).size();
+    }});
+
+    benchmarks.append({"cgm.predictGlucoseLevels/60", nullptr, [&]() {
+        g_sink = g_sink + cgmManager.predictGlucoseLevels(7.2, 1.5, 20.0, 1.0, 60).size();
+    }});
+
+    // The same queries into a tick arena, as the pipeline stages make them
+    TickArena arena;
+    benchmarks.append({"cgm.getGlucoseHistory/60/arena", nullptr, [&]() {
+        arena.reset();
+        g_sink = g_sink + cgmManager.getGlucoseHistory(arena, 60).size();
+    }});
+
+    benchmarks.append({"cgm.predictGlucoseLevels/30/arena", nullptr, [&]() {
+        arena.reset();
+        g_sink = g_sink + cgmManager.predictGlucoseLevels(arena, 7.2, 1.5, 20.0, 1.0, 30).size();
+    }});
+
+    benchmarks.append({"user.getActiveProfile", nullptr, [&]() {
+        g_sink = g_sink + user.getActiveProfile()->basalRate;
+    }});
+
+    // One 5-minute advance (five RK4 steps) of a 1000-patient cohort
+    const int kCohortSize = 1000;
+    BergmanMinimalModel bergman;
+    HovorkaModel hovorka;
+    ModelCohort bergmanCohort;
+    ModelCohort hovorkaCohort;
+    Rk4Integrator integrator;
+
+    benchmarks.append({"model.bergman.advance5min/1000", [&]() {
+        bergmanCohort.reset(bergman, kCohortSize);
+        for (int i = 0; i < kCohortSize; ++i) bergman.initializeSteadyState(bergmanCohort, i, 7.0, 1.0);
+    }, [&]() {
+        integrator.advance(bergman, bergmanCohort, 5.0);
+    }});
+
+    benchmarks.append({"model.hovorka.advance5min/1000", [&]() {
+        hovorkaCohort.reset(hovorka, kCohortSize);
+        for (int i = 0; i < kCohortSize; ++i) hovorka.initializeSteadyState(hovorkaCohort, i, 7.0, 1.0);
+    }, [&]() {
+        integrator.advance(hovorka, hovorkaCohort, 5.0);
+    }});
+
+    // One warm-started QP solve for a patient above target
+    MpcBasalController mpc;
+    SimInputs mpcInputs;
+    double mpcPlan[MpcBasalController::kBlocks] = {};
+
+    benchmarks.append({"mpc.solve", [&]() {
+        std::fill(mpcPlan, mpcPlan + MpcBasalController::kBlocks, 0.0);
+    }, [&]() {
+        g_sink = g_sink + mpc.solve(9.0, 1.0, 15.0, mpcInputs, mpcPlan[0], mpcPlan);
+    }});
+
+    // One ensemble forecast (default sample count) from a reading with IOB and carbs
+    EnsembleGlucosePredictor ensemble;
+    SensorReading ensembleReading;
+    GlucoseEstimate ensembleEstimate;
+    ensembleEstimate.glucose = 7.0;
+    ensembleEstimate.insulinOnBoard = 1.5;
+    ensembleEstimate.carbsOnBoard = 20.0;
+
+    benchmarks.append({"predict.ensemble", nullptr, [&]() {
+        arena.reset();
+        g_sink = g_sink + ensemble.predict(ensembleReading, ensembleEstimate, arena).predicted30minLow;
+    }});
+
+    // Every strategy of one what-if exploration, evaluated inline (one pool job each in the app)
+    WhatIfInputs whatIfInputs;
+    whatIfInputs.carbs = 60.0;
+    whatIfInputs.glucose = 9.4;
+    whatIfInputs.correctionFactor = 2.0;
+    const QVector<WhatIfStrategy> whatIfGrid = WhatIfExplorer::strategies(whatIfInputs);
+    const std::atomic<quint64> whatIfGeneration(1);
+
+    benchmarks.append({"whatif.evaluateGrid", nullptr, [&]() {
+        for (const WhatIfStrategy &strategy : whatIfGrid) {
+            WhatIfResult result;
+            WhatIfExplorer::evaluate(whatIfInputs, strategy, whatIfGeneration, 1, &result);
+            g_sink = g_sink + result.minGlucose;
+        }
+    }});
+
+    // Gradients of TIR and hypo minutes over 90 days of meals (three a day)
+    QVector<MealEpisode> mealHistory;
+    for (int i = 0; i < 270; ++i) {
+        MealEpisode meal;
+        meal.carbs = 30.0 + (i * 17) % 60;
+        meal.glucose = 5.0 + (i * 7) % 60 / 10.0;
+        meal.insulinOnBoard = (i % 5) * 0.3;
+        mealHistory.append(meal);
+    }
+    const Profile sensitivityProfile = *user.getActiveProfile();
+    const PatientResponse sensitivityResponse = ProfileSensitivity::responseOf(sensitivityProfile);
+
+    benchmarks.append({"profile.sensitivity/90d", nullptr, [&]() {
+        const SensitivityReport report = ProfileSensitivity::analyze(sensitivityProfile, mealHistory,
+                                                                     sensitivityResponse);
+        g_sink = g_sink + report.timeInRange.carbRatio;
+    }});
+
+    // Fitting four segments' settings to six weeks of 5-minute history, one thread
+    CalibrationHistory calibrationHistory;
+    for (int i = 0; i < 42 * 288; ++i) {
+        HistoryStep step;
+        const int minute = (i * 5) % 1440;
+        step.glucose = float(7.0 + 2.5 * std::sin(i * 0.037) + ((i * 13) % 7) * 0.1);
+        step.basalRate = float(0.8 + 0.2 * ((i / 24) % 3));
+        if (minute == 450 || minute == 750 || minute == 1140) {
+            step.carbs = float(30 + (i * 17) % 50);
+            step.bolus = step.carbs / 10.0f;
+        }
+        calibrationHistory.steps.append(step);
+    }
+    const QVector<ProfileSegment> calibrationStart =
+        ProfileCalibrator::segmentsOf(sensitivityProfile, QVector<int>{0, 360, 660, 1020});
+    const ProfileCalibrator calibrator;
+
+    benchmarks.append({"profile.calibrate/6w", nullptr, [&]() {
+        const CalibrationResult result = calibrator.calibrate(calibrationHistory, calibrationStart);
+        g_sink = g_sink + result.error;
+    }});
+
+    // One 5-minute basal advance of 10,000 pumps, a quarter of them on a temp basal
+    const int kPumpCount = 10000;
+    BasalScheduler basal;
+    QVector<int> basalMinutes(kPumpCount, 0);
+    QVector<int> basalPulses(kPumpCount, 0);
+
+    benchmarks.append({"basal.advance/10k", [&]() {
+        basal.resize(0);
+        basal.resize(kPumpCount);
+        basalMinutes.fill(0);
+        for (int pump = 0; pump < kPumpCount; ++pump) {
+            basal.setRate(pump, 0.35 + 0.05 * (pump % 30));
+            if (pump % 4 == 0) basal.setTempBasal(pump, 0.2 * (pump % 9), 120);
+        }
+    }, [&]() {
+        for (int &minute : basalMinutes) minute += 5;
+        basal.advance(basalMinutes.constData(), basalPulses.data(), kPumpCount);
+        g_sink = g_sink + basalPulses[kPumpCount - 1];
+    }});
+
+    // One full sense→render tick with the default stages, journaling as the app does;
+    // the reservoir and patient are reset per batch so long runs stay in the normal range.
+    // Snapshots (timed in journal.record) are the journal's only allocation, so they are off here
+    const QString tickJournalDir = QDir(QDir::tempPath()).filePath("pump-bench-tick-journal");
+    QFile::remove(QDir(tickJournalDir).filePath("pump.journal"));
+    QFile::remove(QDir(tickJournalDir).filePath("pump.snapshot"));
+    PumpJournal tickJournal;
+    if (!tickJournal.open(tickJournalDir, &journalError)) {
+        std::fprintf(stderr, "journal: %s\n", journalError.toLocal8Bit().constData());
+        return 1;
+    }
+    tickJournal.setSnapshotInterval(0);
+    controller.setJournal(&tickJournal);
+    tickCgm.setJournal(&tickJournal);
+
+    benchmarks.append({"tick.full", [&]() {
+        controller.refillInsulin();
+        patient = PatientState();
+        patient.glucose = 7.0;
+        patient.inputs.insulinOnBoard = 1.0;
+        patient.inputs.carbsOnBoard = 15.0;
+        fillHistory(tickCgm);
+    }, [&]() {
+        if (patient.glucose <= 3.0 || patient.glucose >= 18.0) patient.glucose = 7.0;
+        pipeline.run(&patient, &frame, 1);
+    }});
+
+    // Two weeks of meals, exercise, a sensor fault, weekend profiles and refills
+    const QString scenarioText =
+        "name Two weeks\n"
+        "duration 14d\n"
+        "glucose 7.0\n"
+        "profile weekday basal=0.9 icr=10 cf=2.0 target=5.5\n"
+        "profile weekend basal=0.8 icr=12 cf=2.2 target=6.0\n"
+        "daily 07:30 meal 45\n"
+        "daily 12:30 meal 60\n"
+        "daily 19:00 meal 70\n"
+        "daily 17:00 exercise 45min 0.6\n"
+        "at 5d 00:00 profile weekend\n"
+        "at 7d 00:00 profile weekday\n"
+        "at 12d 00:00 profile weekend\n"
+        "at 3d 15:00 meal 30 missed\n"
+        "at 9d 02:00 sensor-fault 2h -2.0\n"
+        "at 4d 08:00 refill\n"
+        "at 11d 08:00 refill\n";
+    CompiledScenario scenario;
+    QString scenarioError;
+    if (!ScenarioCompiler::compile(scenarioText, &scenario, &scenarioError)) {
+        std::fprintf(stderr, "scenario: %s\n", scenarioError.toLocal8Bit().constData());
+        return 1;
+    }
+
+    benchmarks.append({"scenario.compile/14d", nullptr, [&]() {
+        CompiledScenario compiled;
+        QString error;
+        ScenarioCompiler::compile(scenarioText, &compiled, &error);
+        g_sink = g_sink + compiled.events.size();
+    }});
+
+    // The whole scenario through the default pipeline, as a batch run would
+    ScenarioPlayer player;
+    benchmarks.append({"scenario.run/14d", nullptr, [&]() {
+        controller.refillInsulin();
+        patient = PatientState();
+        patient.initialReadingPending = true;
+        player.start(&scenario, patient);
+        const int ticks = scenario.durationMinutes / 5;
+        for (int tick = 0; tick <= ticks; ++tick) {
+            player.advance(patient);
+            pipeline.run(&patient, &frame, 1);
+        }
+        g_sink = g_sink + patient.glucose;
+    }});
+
+    // Replaying a recorded run through fresh decision stages, as the golden gate does
+    const GoldenTrace golden = GoldenReplay::record(scenario, GoldenTrace::ThresholdController,
+                                                    GoldenTrace::LinearPredictor);
+    benchmarks.append({"golden.replay/14d", nullptr, [&]() {
+        const GoldenTrace replayed = GoldenReplay::replay(golden);
+        g_sink = g_sink + replayed.ticks.size();
+    }});
+
+    // 90 days of uploadable history framed for the wire and decoded again, without the socket
+    QVector<HistoryRecord> history;
+    for (int i = 0; i < 90 * kMaxReadings; ++i) {
+        HistoryRecord record;
+        record.sequence = quint32(history.size() + 1);
+        record.timeMs = 1700000000000LL + i * 300000LL;
+        record.a = i * 5.0;
+        record.b = 7.5 + 3.0 * std::sin(i * 0.02);
+        history.append(record);
+        if (i % 96 == 36) {
+            record.sequence++;
+            record.type = HistoryRecord::Bolus;
+            record.code = JournalEvent::BolusStarted;
+            record.a = 4.2;
+            record.b = 0.0;
+            history.append(record);
+        }
+    }
+    QVector<HistoryRecord> synced;
+    synced.reserve(history.size());
+    benchmarks.append({"sync.history/90d", nullptr, [&]() {
+        synced.clear();
+        QByteArray wire;
+        for (int i = 0; i < history.size(); i += HistoryProtocol::kDefaultBatchRecords) {
+            const int count = qMin(HistoryProtocol::kDefaultBatchRecords, history.size() - i);
+            wire.append(HistoryProtocol::frame(HistoryProtocol::Batch,
+                                               HistoryProtocol::encodeBatch(&history[i], count, history[i + count - 1].sequence)));
+        }
+        HistoryProtocol::FrameType type;
+        QByteArray payload;
+        QString error;
+        quint32 cursor = 0;
+        while (HistoryProtocol::takeFrame(&wire, &type, &payload, &error)) {
+            HistoryProtocol::decodeBatch(payload, &synced, &cursor);
+        }
+        g_sink = g_sink + synced.size();
+    }});
+
+    // 200 patients with 30 days of readings each, queried for lows lasting 15 minutes.
+    // 3.0 has an alarm bitmap per block; 3.3 makes the unskipped blocks be compared reading by reading
+    GlucoseArchive archive;
+    for (int p = 0; p < 200; ++p) {
+        archive.addPatient();
+        for (int i = 0; i < 30 * kMaxReadings; ++i) {
+            archive.append(p, 1700000000000LL + i * 300000LL,
+                           float(7.5 + 3.0 * std::sin(i * 0.02 + p) + 2.0 * std::sin(i * 0.13 + p * 0.7)));
+        }
+    }
+    ArchiveQuery hypoQuery;
+    hypoQuery.threshold = 3.0f;
+    hypoQuery.minDurationMs = 15 * 60000;
+    benchmarks.append({"archive.episodes/alarm", nullptr, [&]() {
+        g_sink = g_sink + archive.episodes(hypoQuery).size();
+    }});
+    ArchiveQuery lowQuery = hypoQuery;
+    lowQuery.threshold = 3.3f;
+    benchmarks.append({"archive.episodes/scan", nullptr, [&]() {
+        g_sink = g_sink + archive.episodes(lowQuery).size();
+    }});
+
+    // One tick of a 10,000-patient cohort into the Arrow files; the run restarts every
+    // 20 ticks to keep the files under 100 MB, so the cost includes the footers
+    const int cohortSize = 10000;
+    controller.refillInsulin();
+    patient = PatientState();
+    patient.initialReadingPending = true;
+    for (int tick = 0; tick < 12; ++tick) {
+        pipeline.run(&patient, &frame, 1);
+    }
+    // The pipeline does not run again, so the prediction curves in frame stay valid
+    QVector<PatientState> cohort(cohortSize, patient);
+    QVector<TickFrame> cohortFrames(cohortSize, frame);
+    const QString exportDir = QDir(QDir::tempPath()).filePath("pump-bench-export");
+    RunExporter exporter;
+    int exportTicks = 0;
+    benchmarks.append({"export.arrow/10k", nullptr, [&]() {
+        QString error;
+        if (exportTicks++ % 20 == 0 && !exporter.open(exportDir, 1700000000000LL, &error)) {
+            std::fprintf(stderr, "export: %s\n", error.toLocal8Bit().constData());
+        }
+        exporter.appendTick(cohort.constData(), cohortFrames.constData(), cohortSize);
+        g_sink = g_sink + exporter.rowCount(RunExporter::Readings);
+    }});
+
+    std::printf("%-36s %12s %12s %14s %12s %12s\n",
+                "benchmark", "iterations", "ns/op", "ops/s", "allocs/op", "bytes/op");
+
+    QVector<BenchResult> results;
+    qint64 minTimeNs = static_cast<qint64>(minTimeSeconds * 1e9);
+    for (const Benchmark &bench : benchmarks) {
+        if (!filter.isEmpty() && !bench.name.contains(filter)) continue;
+
+        BenchResult r = runBenchmark(bench, minTimeNs);
+        results.append(r);
+        std::printf("%-36s %12lld %12.1f %14.0f %12.2f %12.1f\n",
+                    r.name.toLocal8Bit().constData(), static_cast<long long>(r.iterations),
+                    r.nsPerOp, r.nsPerOp > 0 ? 1e9 / r.nsPerOp : 0.0,
+                    r.allocsPerOp, r.bytesPerOp);
+        std::fflush(stdout);
+    }
+
+    if (!AllocationCounter::countsMalloc()) {
+        std::printf("note: only operator new is counted on this platform; Qt container allocations are missed\n");
+    }
+
+    if (!jsonPath.isEmpty() && !writeJson(jsonPath, results)) {
+        std::fprintf(stderr, "could not write %s\n", jsonPath.toLocal8Bit().constData());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+QT = core network
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = bench
+
+# Benchmarks exercise the pump sources directly, without the UI
+INCLUDEPATH += ..
+
+SOURCES += \
+    AllocationCounter.cpp \
+    PumpBench.cpp \
+    ../ArrowIpc.cpp \
+    ../BasalDelivery.cpp \
+    ../BolusManager.cpp \
+    ../CGMManager.cpp \
+    ../CgmFusion.cpp \
+    ../CgmResampler.cpp \
+    ../EnsemblePredictor.cpp \
+    ../GlucoseArchive.cpp \
+    ../GlucoseColumns.cpp \
+    ../GlucoseKalmanFilter.cpp \
+    ../GoldenTrace.cpp \
+    ../HistorySync.cpp \
+    ../Instrumentation.cpp \
+    ../MpcBasalController.cpp \
+    ../PhysiologicalModel.cpp \
+    ../ProfileCalibration.cpp \
+    ../ProfileSensitivity.cpp \
+    ../PumpJournal.cpp \
+    ../PumpStages.cpp \
+    ../RunExport.cpp \
+    ../SafetyController.cpp \
+    ../Scenario.cpp \
+    ../Telemetry.cpp \
+    ../TickArena.cpp \
+    ../TickPipeline.cpp \
+    ../UserProfile.cpp \
+    ../WhatIfExplorer.cpp
+
+HEADERS += \
+    AllocationCounter.h \
+    ../ArrowIpc.h \
+    ../BasalDelivery.h \
+    ../GlucoseArchive.h \
+    ../GlucoseColumns.h \
+    ../HistorySync.h \
+    ../RunExport.h \
+    ../SafetyController.h \
+    ../Telemetry.h \
+    ../TickArena.h \
+    ../WhatIfExplorer.h
@@ -0,0 +1,192 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <cstdio>
+#include "GoldenTrace.h"
+#include "ProfileCalibration.h"
+#include "Scenario.h"
+
+// Golden-trace regression gate.
+//
+//   golden record <scenario> <out.trace> [--mpc] [--ensemble]
+//   golden verify <trace|directory>... [--threads <n>] [--tolerance-scale <x>]
+//   golden calibrate <trace|directory>... [--threads <n>] [--segments <minute,...>]
+//
+// record runs a scenario headless and saves its trace. verify replays every
+// trace (directories are searched for *.trace) through the current decision
+// stages in parallel and exits with 1 if any output moved out of tolerance.
+// calibrate fits basal, ICR and CF per segment to each trace, one trace per core.
+
+namespace {
+
+// Silence qDebug output from the code under test
+void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+    if (type != QtDebugMsg && type != QtInfoMsg) {
+        std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+    }
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: golden record <scenario> <out.trace> [--mpc] [--ensemble]\n"
+                         "       golden verify <trace|directory>... [--threads <n>] [--tolerance-scale <x>]\n"
+                         "       golden calibrate <trace|directory>... [--threads <n>] [--segments <minute,...>]\n");
+    return 2;
+}
+
+int record(const QStringList &args) {
+    QStringList files;
+    GoldenTrace::Controller controller = GoldenTrace::ThresholdController;
+    GoldenTrace::Predictor predictor = GoldenTrace::LinearPredictor;
+    for (int i = 2; i < args.size(); ++i) {
+        if (args[i] == "--mpc") controller = GoldenTrace::MpcController;
+        else if (args[i] == "--ensemble") predictor = GoldenTrace::EnsemblePredictor;
+        else files.append(args[i]);
+    }
+    if (files.size() != 2) return usage();
+
+    CompiledScenario scenario;
+    QString error;
+    if (!ScenarioCompiler::compileFile(files[0], &scenario, &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+    }
+    GoldenTrace trace = GoldenReplay::record(scenario, controller, predictor);
+    if (!trace.save(files[1], &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+    }
+    std::printf("recorded %d ticks to %s\n", trace.ticks.size(), files[1].toLocal8Bit().constData());
+    return 0;
+}
+
+// Adds a path, or every *.trace in it if it is a directory
+void addTracePaths(const QString &path, QStringList *paths) {
+    if (!QFileInfo(path).isDir()) {
+        paths->append(path);
+        return;
+    }
+    const QDir dir(path);
+    const QStringList filters("*.trace");
+    for (const QString &name : dir.entryList(filters, QDir::Files, QDir::Name)) {
+        paths->append(dir.filePath(name));
+    }
+}
+
+int verify(const QStringList &args) {
+    QStringList paths;
+    int threads = 0;
+    double scale = 1.0;
+    for (int i = 2; i < args.size(); ++i) {
+        if (args[i] == "--threads" && i + 1 < args.size()) {
+            threads = args[++i].toInt();
+        } else if (args[i] == "--tolerance-scale" && i + 1 < args.size()) {
+            scale = args[++i].toDouble();
+        } else {
+            addTracePaths(args[i], &paths);
+        }
+    }
+    if (paths.isEmpty()) return usage();
+
+    TraceTolerance tolerance;
+    tolerance.glucose *= scale;
+    tolerance.trend *= scale;
+    tolerance.insulin *= scale;
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<TraceDiff> results = GoldenReplay::verify(paths, tolerance, threads);
+    const qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+
+    int failed = 0;
+    qint64 ticks = 0;
+    for (const TraceDiff &diff : results) {
+        ticks += diff.ticks;
+        if (diff.passed()) continue;
+        failed++;
+        if (!diff.error.isEmpty()) {
+            std::printf("ERROR %s\n", diff.error.toLocal8Bit().constData());
+        } else {
+            std::printf("FAIL  %s: %d of %d ticks differ; first at tick %d, %s expected %.4f got %.4f\n",
+                        diff.path.toLocal8Bit().constData(), diff.mismatches, diff.ticks, diff.firstTick,
+                        diff.firstField.toLocal8Bit().constData(), diff.expected, diff.actual);
+        }
+    }
+
+    std::printf("%d traces, %d failed, %lld ticks in %lld ms (%.0f ticks/s)\n",
+                results.size(), failed, static_cast<long long>(ticks), static_cast<long long>(elapsedMs),
+                ticks * 1000.0 / elapsedMs);
+    return failed > 0 ? 1 : 0;
+}
+
+int calibrate(const QStringList &args) {
+    QStringList paths;
+    int threads = 0;
+    QVector<int> startMinutes = {0, 6 * 60, 11 * 60, 17 * 60};
+    for (int i = 2; i < args.size(); ++i) {
+        if (args[i] == "--threads" && i + 1 < args.size()) {
+            threads = args[++i].toInt();
+        } else if (args[i] == "--segments" && i + 1 < args.size()) {
+            startMinutes.clear();
+            for (const QString &minute : args[++i].split(',')) startMinutes.append(minute.toInt());
+            std::sort(startMinutes.begin(), startMinutes.end());
+        } else {
+            addTracePaths(args[i], &paths);
+        }
+    }
+    if (paths.isEmpty() || startMinutes.isEmpty()) return usage();
+
+    // Every trace starts from the default segment settings with its own starting basal
+    QVector<CalibrationHistory> histories;
+    QVector<QVector<ProfileSegment>> starts;
+    for (const QString &path : paths) {
+        GoldenTrace trace;
+        QString error;
+        if (!trace.load(path, &error)) {
+            std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        QVector<ProfileSegment> segments;
+        for (int minute : startMinutes) {
+            ProfileSegment segment;
+            segment.startMinute = minute;
+            segment.basalRate = trace.startBasalRate;
+            segments.append(segment);
+        }
+        histories.append(CalibrationHistory::fromTrace(trace));
+        starts.append(segments);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<CalibrationResult> results = ProfileCalibrator().calibrateCohort(histories, starts, threads);
+    const qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+
+    for (int i = 0; i < results.size(); ++i) {
+        const CalibrationResult &result = results[i];
+        std::printf("%s: %d windows, RMS error %.3f -> %.3f mmol/L%s\n", paths[i].toLocal8Bit().constData(),
+                    result.windows, result.startError, result.error, result.converged ? "" : " (not converged)");
+        for (const ProfileSegment &segment : result.segments) {
+            std::printf("  %02d:%02d  basal %.2f u/h  ICR %.1f g/u  CF %.2f mmol/L/u\n",
+                        segment.startMinute / 60, segment.startMinute % 60, segment.basalRate,
+                        segment.carbRatio, segment.correctionFactor);
+        }
+    }
+    std::printf("%d traces calibrated in %lld ms\n", results.size(), static_cast<long long>(elapsedMs));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    qInstallMessageHandler(quietMessageHandler);
+
+    QStringList args = app.arguments();
+    if (args.size() >= 2 && args[1] == "record") return record(args);
+    if (args.size() >= 2 && args[1] == "verify") return verify(args);
+    if (args.size() >= 2 && args[1] == "calibrate") return calibrate(args);
+    return usage();
+}
@@ -0,0 +1,40 @@
+QT = core
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = golden
+
+# Record/replay harness for the pump's decision stages, without the UI
+INCLUDEPATH += ..
+
+SOURCES += \
+    GoldenMain.cpp \
+    ../BasalDelivery.cpp \
+    ../BolusManager.cpp \
+    ../CGMManager.cpp \
+    ../CgmFusion.cpp \
+    ../CgmResampler.cpp \
+    ../EnsemblePredictor.cpp \
+    ../GlucoseColumns.cpp \
+    ../GlucoseKalmanFilter.cpp \
+    ../GoldenTrace.cpp \
+    ../Instrumentation.cpp \
+    ../MpcBasalController.cpp \
+    ../PhysiologicalModel.cpp \
+    ../ProfileCalibration.cpp \
+    ../PumpJournal.cpp \
+    ../PumpStages.cpp \
+    ../SafetyController.cpp \
+    ../Scenario.cpp \
+    ../TickArena.cpp \
+    ../TickPipeline.cpp \
+    ../WhatIfExplorer.cpp
+
+HEADERS += \
+    ../SafetyController.h \
+    ../WhatIfExplorer.h
+
+# make check replays the traces checked in with the tests
+check.commands = ./$$TARGET verify $$PWD/../tests/data/golden
+check.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += check
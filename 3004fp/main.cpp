@@ -1,11 +1,20 @@
 #include "mainwindow.h"
+#include "Instrumentation.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    Instrumentation::configureFromEnvironment(); // PUMP_PROFILE=1 / PUMP_TRACE=trace.json
+
     QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    int result;
+    {
+        MainWindow w;
+        w.show();
+        result = a.exec();
+    }
+
+    Instrumentation::shutdown(); // Latency summary (and trace file) after the simulation thread has stopped
+    return result;
 }
@@ -1,12 +1,32 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "Instrumentation.h"
+#include <QHeaderView>
+#include <QDir>
+#include <QFileDialog>
+#include <QSignalBlocker>
+#include <QStandardPaths>
+#include <cmath>
 
 QT_CHARTS_USE_NAMESPACE
 
+namespace {
+// CGM-style trend arrow for a rate of change in mmol/L per minute
+QString trendArrow(double trend) {
+    if (trend >= 0.11) return QString(QChar(0x21C8));    // Rising fast
+    if (trend >= 0.06) return QString(QChar(0x2191));
+    if (trend >= 0.03) return QString(QChar(0x2197));
+    if (trend <= -0.11) return QString(QChar(0x21CA));   // Falling fast
+    if (trend <= -0.06) return QString(QChar(0x2193));
+    if (trend <= -0.03) return QString(QChar(0x2198));
+    return QString(QChar(0x2192));
+}
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::MainWindow),
-      controller(new SafetyController(this))
+      controller(new SafetyController()) // No parent: moved to the simulation thread below
 {
     ui->setupUi(this);
 
@@ -24,59 +44,52 @@ MainWindow::MainWindow(QWidget *parent)
     ui->spinBox_ExtendedNow->setRange(0, 100);
     ui->spinBox_ExtendedLater->setRange(0, 100);
 
-    // CGM setup
-    cgmManager = new CGMManager(&bolusManager);
-    cgmSimulationTimer = new QTimer(this);
-    connect(cgmSimulationTimer, &QTimer::timeout, this, &MainWindow::updateCGMDisplay);
+    // CGM setup: the simulation and safety controller run on a worker thread
+    simThread = new QThread(this);
+    simWorker = new SimulationWorker(controller);
+    controller->moveToThread(simThread);
+    simWorker->moveToThread(simThread);
+    connect(simThread, &QThread::finished, simWorker, &QObject::deleteLater);
+    connect(simThread, &QThread::finished, controller, &QObject::deleteLater);
+    simThread->start();
+
+    // UI frame rate is independent of the simulation tick
+    frameTimer = new QTimer(this);
+    connect(frameTimer, &QTimer::timeout, this, &MainWindow::renderSimulationSnapshot);
+    frameTimer->start(33);
 
     connect(ui->pushButton_StartCGM, &QPushButton::clicked, this, &MainWindow::startCGMSimulation);
     connect(ui->pushButton_StopCGM, &QPushButton::clicked, this, [this]() {
-        cgmSimulationTimer->stop();
-        ui->label_CGMStatus->setText("CGM Monitoring: Stopped");
+        QMetaObject::invokeMethod(simWorker, [this]() { simWorker->stopSimulation(); });
     });
 
+    // Forward user edits of values the simulation reads every tick
+    connect(ui->doubleSpinBox_IOB, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+    connect(ui->doubleSpinBox_Carbs, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+    connect(ui->doubleSpinBox_CF, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+    connect(ui->doubleSpinBox_ICR, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+    connect(ui->doubleSpinBox_TargetBG, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+    connect(ui->spinBox_Basal, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::pushSimulationInputs);
+
     setupGlucoseChart(); // Initialize chart on startup
+    setupWhatIfPanel();
 
     // Battery progress bar setup
     ui->batteryProgressBar->setValue(100);
     ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: green; }");
 
-    // Battery level updates and visual cues
-    connect(controller, &SafetyController::batteryLevelUpdated, this, [=](int level) {
-        ui->batteryProgressBar->setValue(level);
-        if (level <= 20)
-            ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: red; }");
-        else if (level <= 50)
-            ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: orange; }");
-        else
-            ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: green; }");
-    });
-
+    // Battery and insulin levels are rendered from simulation snapshots; alerts arrive as queued signals
     connect(controller, &SafetyController::triggerBatteryAlert, this, [=]() {
         QMessageBox::warning(this, "Low Battery", "LOW BATTERY: Please recharge the pump.");
     });
 
-    connect(ui->chargeButton, &QPushButton::clicked, this, [=]() {
-        controller->rechargeBattery();
-    });
+    connect(ui->chargeButton, &QPushButton::clicked, controller, &SafetyController::rechargeBattery);
 
     connect(controller, &SafetyController::batteryDepleted, this, [=]() {
         QMessageBox::critical(this, "Shut down", "Device shutting down – NO BATTERY");
         QApplication::quit();
     });
 
-    // Insulin progress bar updates
-    connect(controller, &SafetyController::insulinLevelUpdated, this, [=](int level) {
-        qDebug() << "[UI] Updating insulinProgressBar:" << level << "units";
-        ui->insulinProgressBar->setValue(level);
-        if (level <= 50)
-            ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: red; }");
-        else if (level <= 100)
-            ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: orange; }");
-        else
-            ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: green; }");
-    });
-
     ui->insulinProgressBar->setRange(0, 200);
     ui->insulinProgressBar->setValue(100);
 
@@ -95,14 +108,128 @@ MainWindow::MainWindow(QWidget *parent)
     ui->doubleSpinBox_IOB->setValue(newIOB);
 
     // Refill insulin bar
-    connect(ui->pushButton_RefillInsulin, &QPushButton::clicked, this, [=]() {
-        controller->refillInsulin();
+    connect(ui->pushButton_RefillInsulin, &QPushButton::clicked, controller, &SafetyController::refillInsulin);
+
+    // Runtime toggle for latency histograms (summary is logged on exit)
+    QAction *profilingAction = ui->menuInsulin_Tandem->addAction("Latency Profiling");
+    profilingAction->setCheckable(true);
+    profilingAction->setChecked(Instrumentation::isEnabled());
+    connect(profilingAction, &QAction::toggled, this, [](bool checked) {
+        Instrumentation::setEnabled(checked);
     });
 
+    // Glucose dynamics used by the next simulation run
+    QMenu *modelMenu = ui->menuInsulin_Tandem->addMenu("Glucose Model");
+    QActionGroup *modelGroup = new QActionGroup(this);
+    const QPair<QString, SimConfig::Plant> plants[] = {
+        { "Linear (Classic)", SimConfig::LinearPlant },
+        { "Bergman Minimal Model", SimConfig::BergmanPlant },
+        { "Hovorka Model", SimConfig::HovorkaPlant },
+    };
+    for (const auto &plant : plants) {
+        QAction *action = modelMenu->addAction(plant.first);
+        action->setCheckable(true);
+        action->setChecked(plant.second == plantModel);
+        modelGroup->addAction(action);
+        SimConfig::Plant value = plant.second;
+        connect(action, &QAction::triggered, this, [this, value]() { plantModel = value; });
+    }
+
+    // Basal decision rule used by the next simulation run
+    QMenu *controlMenu = ui->menuInsulin_Tandem->addMenu("Basal Controller");
+    QActionGroup *controlGroup = new QActionGroup(this);
+    const QPair<QString, SimConfig::BasalControl> controls[] = {
+        { "Threshold (Classic)", SimConfig::ThresholdControl },
+        { "Model Predictive (MPC)", SimConfig::MpcControl },
+    };
+    for (const auto &control : controls) {
+        QAction *action = controlMenu->addAction(control.first);
+        action->setCheckable(true);
+        action->setChecked(control.second == basalControl);
+        controlGroup->addAction(action);
+        SimConfig::BasalControl value = control.second;
+        connect(action, &QAction::triggered, this, [this, value]() { basalControl = value; });
+    }
+
+    // BG forecast used for the chart and low-glucose suspend in the next run
+    QMenu *predictionMenu = ui->menuInsulin_Tandem->addMenu("Prediction");
+    QActionGroup *predictionGroup = new QActionGroup(this);
+    const QPair<QString, SimConfig::Prediction> predictions[] = {
+        { "Linear (Classic)", SimConfig::LinearPrediction },
+        { "Ensemble (10-90% Band)", SimConfig::EnsemblePrediction },
+    };
+    for (const auto &prediction : predictions) {
+        QAction *action = predictionMenu->addAction(prediction.first);
+        action->setCheckable(true);
+        action->setChecked(prediction.second == predictionModel);
+        predictionGroup->addAction(action);
+        SimConfig::Prediction value = prediction.second;
+        connect(action, &QAction::triggered, this, [this, value]() { predictionModel = value; });
+    }
+
+    // Scripted multi-day run (meals, exercise, sensor faults, profile switches, refills)
+    QMenu *scenarioMenu = ui->menuInsulin_Tandem->addMenu("Scenario");
+    QAction *loadScenarioAction = scenarioMenu->addAction("Load Scenario...");
+    QAction *clearScenarioAction = scenarioMenu->addAction("Clear Scenario");
+    clearScenarioAction->setEnabled(false);
+    connect(loadScenarioAction, &QAction::triggered, this, [this, clearScenarioAction]() {
+        QString path = QFileDialog::getOpenFileName(this, "Load Scenario", QString(),
+                                                    "Scenarios (*.scn *.txt);;All files (*)");
+        if (path.isEmpty()) return;
+
+        CompiledScenario compiled;
+        QString error;
+        if (!ScenarioCompiler::compileFile(path, &compiled, &error)) {
+            QMessageBox::warning(this, "Scenario", QString("Could not load scenario:\n%1").arg(error));
+            return;
+        }
+        scenario.reset(new CompiledScenario(compiled));
+        clearScenarioAction->setEnabled(true);
+        qDebug() << "Loaded scenario" << compiled.name << "with" << compiled.events.size() << "events";
+    });
+    connect(clearScenarioAction, &QAction::triggered, this, [this, clearScenarioAction]() {
+        scenario.reset();
+        clearScenarioAction->setEnabled(false);
+    });
+
+    // Golden trace of each run, for replay with the golden/ tool
+    QAction *traceAction = ui->menuInsulin_Tandem->addAction("Record Golden Trace...");
+    traceAction->setCheckable(true);
+    connect(traceAction, &QAction::toggled, this, [this, traceAction](bool checked) {
+        tracePath.clear();
+        if (!checked) return;
+        tracePath = QFileDialog::getSaveFileName(this, "Record Golden Trace", QString(),
+                                                 "Golden traces (*.trace);;All files (*)");
+        if (tracePath.isEmpty()) {
+            const QSignalBlocker blocker(traceAction);
+            traceAction->setChecked(false);
+        }
+    });
+
+    // Pump state survives restarts: latest snapshot plus the journal tail (PUMP_JOURNAL=dir overrides the location)
+    const QString journalDir = qEnvironmentVariable("PUMP_JOURNAL",
+                                                    QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    QString journalError;
+    if (journal.open(journalDir, &journalError)) {
+        bolusManager.restoreState(journal.state());
+        bolusManager.setJournal(&journal);
+        QMetaObject::invokeMethod(simWorker, [this]() { simWorker->attachJournal(&journal); });
+    } else {
+        qWarning() << "[PumpJournal]" << journalError << "- running without a journal";
+    }
+
+    // Live telemetry for external dashboards and recorders (PUMP_TELEMETRY=name, see Telemetry.h)
+    const QString telemetryName = qEnvironmentVariable("PUMP_TELEMETRY");
+    if (!telemetryName.isEmpty()) {
+        QMetaObject::invokeMethod(simWorker, [this, telemetryName]() { simWorker->startTelemetry(telemetryName); });
+    }
 }
 
 MainWindow::~MainWindow()
 {
+    // Worker and controller are deleted on the simulation thread as it finishes
+    simThread->quit();
+    simThread->wait();
     delete ui;
 }
 
@@ -213,8 +340,82 @@ void MainWindow::on_pushButton_ConfirmRequest_clicked() {
 }
 
 void MainWindow::on_pushButton_Calculate_clicked() {
-    // Recalculate bolus based on input values
+    // Recalculate bolus based on input values; strategies are compared in the background
     calculateBolus();
+    requestWhatIf();
+}
+
+// Strategy comparison table below the calculator
+void MainWindow::setupWhatIfPanel() {
+    whatIfTable = new QTableWidget(0, 7, ui->calculationpage);
+    whatIfTable->setGeometry(110, 330, 880, 170);
+    whatIfTable->setHorizontalHeaderLabels({ "Strategy", "Now (u)", "Later (u)", "Min BG",
+                                             "Max BG", "BG at 6 h", "In Range" });
+    whatIfTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    whatIfTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    whatIfTable->verticalHeader()->setVisible(false);
+    whatIfTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+    whatIfExplorer = new WhatIfExplorer(this);
+    connect(whatIfExplorer, &WhatIfExplorer::resultReady, this, &MainWindow::showWhatIfResult);
+
+    // Explore again whenever a calculator input changes; stale runs are cancelled
+    const QDoubleSpinBox *inputs[] = { ui->doubleSpinBox_Carbs, ui->doubleSpinBox_BG, ui->doubleSpinBox_ICR,
+                                       ui->doubleSpinBox_CF, ui->doubleSpinBox_TargetBG, ui->doubleSpinBox_IOB,
+                                       ui->doubleSpinBox_Hours };
+    for (const QDoubleSpinBox *input : inputs) {
+        connect(input, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::requestWhatIf);
+    }
+    connect(ui->spinBox_Immediate, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::requestWhatIf);
+
+    requestWhatIf();
+}
+
+// Starts a new exploration from the calculator values and resets the table rows
+void MainWindow::requestWhatIf() {
+    WhatIfInputs inputs;
+    inputs.carbs = ui->doubleSpinBox_Carbs->value();
+    inputs.glucose = ui->doubleSpinBox_BG->value();
+    inputs.carbRatio = ui->doubleSpinBox_ICR->value();
+    inputs.correctionFactor = ui->doubleSpinBox_CF->value();
+    inputs.targetBG = ui->doubleSpinBox_TargetBG->value();
+    inputs.insulinOnBoard = ui->doubleSpinBox_IOB->value();
+    inputs.immediateFraction = ui->spinBox_Immediate->value() / 100.0;
+    inputs.extendedHours = ui->doubleSpinBox_Hours->value();
+
+    QVector<WhatIfStrategy> grid = WhatIfExplorer::strategies(inputs);
+    whatIfTable->clearContents();
+    whatIfTable->setRowCount(grid.size());
+    for (int row = 0; row < grid.size(); ++row) {
+        whatIfTable->setItem(row, 0, new QTableWidgetItem(grid[row].label()));
+        for (int column = 1; column < whatIfTable->columnCount(); ++column) {
+            whatIfTable->setItem(row, column, new QTableWidgetItem("..."));
+        }
+    }
+
+    whatIfExplorer->explore(inputs);
+}
+
+// Fills one row as its result arrives
+void MainWindow::showWhatIfResult(const WhatIfResult &result) {
+    int row = result.index;
+    if (row >= whatIfTable->rowCount()) return;
+
+    const QString values[] = {
+        QString::number(result.immediateUnits, 'f', 2),
+        QString::number(result.laterUnits, 'f', 2),
+        QString::number(result.minGlucose, 'f', 1),
+        QString::number(result.maxGlucose, 'f', 1),
+        QString::number(result.finalGlucose, 'f', 1),
+        QString("%1%").arg(result.timeInRange, 0, 'f', 0),
+    };
+    for (int column = 1; column < whatIfTable->columnCount(); ++column) {
+        whatIfTable->item(row, column)->setText(values[column - 1]);
+    }
+
+    // Flag predicted lows and highs
+    whatIfTable->item(row, 3)->setForeground(result.minGlucose < 3.9 ? QBrush(Qt::red) : QBrush());
+    whatIfTable->item(row, 4)->setForeground(result.maxGlucose > 10.0 ? QBrush(QColor(200, 120, 0)) : QBrush());
 }
 
 void MainWindow::on_pushButton_ConfirmBolus_clicked() {
@@ -405,7 +606,7 @@ void MainWindow::on_pushButton_FinalDeliver_3_clicked() {
     // Simulate delivery after 3 sec
     QTimer::singleShot(3000, this, [=]() {
         if (!cancelExtendedBolus) {
-            controller->registerInsulinDelivery(-totalUnits);
+            QMetaObject::invokeMethod(controller, [=]() { controller->registerInsulinDelivery(-totalUnits); });
 
             QMessageBox *msg = new QMessageBox(this);
             msg->setIcon(QMessageBox::Information);
@@ -456,6 +657,16 @@ void MainWindow::setupGlucoseChart() {
     // Create chart and add series
     glucoseChart = new QChart();
     glucoseChart->setTitle("Glucose Levels Over Time");
+
+    // Shaded 10-90% range of the ensemble prediction, behind the lines
+    predictionLowSeries = new QLineSeries(glucoseChart);
+    predictionHighSeries = new QLineSeries(glucoseChart);
+    predictionBand = new QAreaSeries(predictionHighSeries, predictionLowSeries);
+    predictionBand->setName("Prediction 10-90%");
+    predictionBand->setColor(QColor(100, 100, 255, 50));
+    predictionBand->setBorderColor(QColor(100, 100, 255, 0));
+    glucoseChart->addSeries(predictionBand);
+
     glucoseChart->addSeries(glucoseSeries);
     glucoseChart->addSeries(predictionSeries);
 
@@ -468,6 +679,12 @@ void MainWindow::setupGlucoseChart() {
     glucoseChart->addAxis(glucoseAxisX, Qt::AlignBottom);
     glucoseSeries->attachAxis(glucoseAxisX);
     predictionSeries->attachAxis(glucoseAxisX);
+    predictionBand->attachAxis(glucoseAxisX);
+
+    // Re-decimate the glucose line whenever the visible range changes (zoom/scroll)
+    connect(glucoseAxisX, &QValueAxis::rangeChanged, this, [this](qreal, qreal) {
+        refreshGlucoseSeries();
+    });
 
     // Y-axis: Glucose level (mmol/L)
     glucoseAxisY = new QValueAxis();
@@ -477,6 +694,7 @@ void MainWindow::setupGlucoseChart() {
     glucoseChart->addAxis(glucoseAxisY, Qt::AlignLeft);
     glucoseSeries->attachAxis(glucoseAxisY);
     predictionSeries->attachAxis(glucoseAxisY);
+    predictionBand->attachAxis(glucoseAxisY);
 
     // Add green dotted target low line at 4.0 mmol/L
     double targetLow = 4.0;
@@ -509,6 +727,7 @@ void MainWindow::setupGlucoseChart() {
     // Create chart view with antialiasing
     chartView = new QChartView(glucoseChart);
     chartView->setRenderHint(QPainter::Antialiasing);
+    chartView->setRubberBand(QChartView::HorizontalRubberBand); // Drag to zoom into a time range
 
     // Show legend at the bottom
     glucoseChart->legend()->setVisible(true);
@@ -530,114 +749,152 @@ void MainWindow::setupGlucoseChart() {
 
 // CGM Monitoring
 void MainWindow::startCGMSimulation() {
-    timeElapsed = 0;
-
-    simulatedMinutesElapsed = 0;
-    simulatedStartTime = QTime(0, 0); // Start at 00:00
-
     // Initialize chart if needed
     if (!glucoseChart) {
         setupGlucoseChart();
     }
 
-    // Clear chart data
-    glucoseSeries->clear();
-    predictionSeries->clear();
-
-    // Use BG input or generate random initial value
-    double initialGlucose = ui->doubleSpinBox_BG->value();
-    if (initialGlucose <= 0.0) {
-        initialGlucose = 4.0 + (QRandomGenerator::global()->generateDouble() * 6.0); // 4–10 mmol/L
-        initialGlucose = qRound(initialGlucose * 10) / 10.0;
-        qDebug() << "Generated initial glucose:" << initialGlucose;
-    }
-
-    // Start at time = 0 minutes
-    double currentTime = 0;
-    updateGlucoseChart(currentTime, initialGlucose);
-    handleCGMReading(initialGlucose); // Process reading (alerts, logging, etc.)
-
-    // Simulate CGM: 1 update per 5 seconds = 5 minutes real-time
-    //cgmSimulationTimer->start(5000);
-
     // Determine user-selected duration
+    SimConfig config;
     QString selected = ui->comboBox_CGM_Duration->currentText();
-    if (selected == "1 hour") cgmSimDuration = 12;
-    else if (selected == "3 hours") cgmSimDuration = 36;
-    else if (selected == "6 hours") cgmSimDuration = 72;
-    else cgmSimDuration = 12; // fallback default
+    if (selected == "1 hour") config.durationTicks = 12;
+    else if (selected == "3 hours") config.durationTicks = 36;
+    else if (selected == "6 hours") config.durationTicks = 72;
+    else config.durationTicks = 12; // fallback default
+
+    // Use BG input or let the simulation generate a random initial value
+    config.initialGlucose = ui->doubleSpinBox_BG->value();
+    config.inputs.insulinOnBoard = ui->doubleSpinBox_IOB->value();
+    config.inputs.carbsOnBoard = ui->doubleSpinBox_Carbs->value();
+    config.inputs.basalRate = ui->spinBox_Basal->value();
+    config.inputs.correctionFactor = ui->doubleSpinBox_CF->value();
+    config.inputs.carbRatio = ui->doubleSpinBox_ICR->value();
+    config.inputs.targetBG = ui->doubleSpinBox_TargetBG->value();
+    config.tickIntervalMs = 1000; // 1 real second = 5 min simulated
+    config.plant = plantModel;
+    config.basalControl = basalControl;
+    config.prediction = predictionModel;
+    config.scenario = scenario;   // Overrides the duration when set
+    config.tracePath = tracePath;
+
+    // PUMP_EXPORT=<dir> writes every run's ticks as Arrow files under <dir>/run-<start time>
+    const QString exportRoot = qEnvironmentVariable("PUMP_EXPORT");
+    if (!exportRoot.isEmpty()) {
+        config.exportDirectory = QDir(exportRoot).filePath("run-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    }
 
-    cgmSimElapsed = 0;
-    cgmSimulationTimer->start(1000); // 1 real second = 5 min simulated
+    QMetaObject::invokeMethod(simWorker, [this, config]() { simWorker->startSimulation(config); });
 
-    // UI updates
-    ui->label_CGMStatus->setText("CGM Monitoring: Active");
-    ui->label_CGMStatus->setStyleSheet("");
     ui->stackedWidget->setCurrentWidget(ui->cgmPage);
-
-    // Log simulation start
-    ui->plainTextEdit_CGMLogs->appendPlainText(
-        QString("[%1] CGM Monitoring Started - Initial BG: %2 mmol/L")
-        .arg(QDateTime::currentDateTime().toString("hh:mm:ss"))
-        .arg(initialGlucose, 0, 'f', 1)
-    );
-
-    QTimer *insulinUseTimer = new QTimer(this);
-    connect(insulinUseTimer, &QTimer::timeout, this, [=]() {
-        controller->registerInsulinDelivery(3);  // arbitrary insulin drop per interval
-    });
-    insulinUseTimer->start(1000); // 1 sec = 5 min sim
-
 }
 
-void MainWindow::updateCGMDisplay() {
-    // Stops display after duration has fully passed
-    cgmSimElapsed++;
-    if (cgmSimElapsed > cgmSimDuration) {
-        cgmSimulationTimer->stop();
-        ui->label_CGMStatus->setText("CGM Simulation Complete");
-        return;
-    }
-
-    double currentBG = ui->doubleSpinBox_BG->value();
-
-    double insulinEffect = ui->doubleSpinBox_IOB->value() * 0.08;
-    double carbEffect = ui->doubleSpinBox_Carbs->value() * 0.008;
+// Sends the current spinbox values to the simulation thread
+void MainWindow::pushSimulationInputs() {
+    SimInputs inputs;
+    inputs.insulinOnBoard = ui->doubleSpinBox_IOB->value();
+    inputs.carbsOnBoard = ui->doubleSpinBox_Carbs->value();
+    inputs.basalRate = ui->spinBox_Basal->value();
+    inputs.correctionFactor = ui->doubleSpinBox_CF->value();
+    inputs.carbRatio = ui->doubleSpinBox_ICR->value();
+    inputs.targetBG = ui->doubleSpinBox_TargetBG->value();
+
+    QMetaObject::invokeMethod(simWorker, [this, inputs]() { simWorker->setInputs(inputs); });
+}
 
-    // Decay logic
-    double newIOB = qMax(0.0, ui->doubleSpinBox_IOB->value() - 0.1);
-    ui->doubleSpinBox_IOB->setValue(newIOB);
+// Called every frame: draws the newest simulation snapshot, if there is one
+void MainWindow::renderSimulationSnapshot() {
+    if (!simWorker->snapshots().update()) return;
+    PUMP_TRACE_SCOPE("ui.renderSnapshot");
+    const SimSnapshot &snapshot = simWorker->snapshots().front();
 
-    double newCarbs = qMax(0.0, ui->doubleSpinBox_Carbs->value() - 0.2);
-    ui->doubleSpinBox_Carbs->setValue(newCarbs);
+    if (snapshot.batteryLevel != renderedBatteryLevel) {
+        updateBatteryDisplay(snapshot.batteryLevel);
+    }
+    if (snapshot.reservoirLevel != renderedReservoirLevel) {
+        updateInsulinDisplay(snapshot.reservoirLevel);
+    }
 
-    double randomVariation = ((QRandomGenerator::global()->bounded(60) - 30) * 0.01);
+    // Append log entries produced since the last frame
+    quint64 newLogs = snapshot.logCount - renderedLogCount;
+    int firstLog = snapshot.recentLogs.size() - static_cast<int>(qMin<quint64>(newLogs, snapshot.recentLogs.size()));
+    for (int i = firstLog; i < snapshot.recentLogs.size(); ++i) {
+        ui->plainTextEdit_CGMLogs->appendPlainText(snapshot.recentLogs[i]);
+    }
+    renderedLogCount = snapshot.logCount;
+
+    if (snapshot.session == 0) return; // CGM has never been started
+
+    // New session: start the chart over
+    if (snapshot.session != renderedSession) {
+        renderedSession = snapshot.session;
+        renderedReadingCount = 0;
+        glucoseHistory.clear();
+        glucoseSeries->clear();
+        predictionSeries->clear();
+        predictionLowSeries->clear();
+        predictionHighSeries->clear();
+        glucoseAxisX->setRange(0, 60);
+    }
 
-    // Compute new BG value
-    double newBG = currentBG + carbEffect - insulinEffect + randomVariation;
+    ui->label_CGMStatus->setText(snapshot.statusText);
+    ui->label_CGMStatus->setStyleSheet(snapshot.statusStyle);
 
-    // Clamp to safe physiological bounds
-    if (newBG < 2.5) newBG = 2.5;
-    if (newBG > 20.0) newBG = 20.0;
+    quint64 newReadings = snapshot.readingCount - renderedReadingCount;
+    if (newReadings == 0) return;
 
-    // Advance time
-    timeElapsed += 5;
-    simulatedMinutesElapsed += 5; // Each update = 5 minutes of simulated time
+    int firstReading = snapshot.recentReadings.size() - static_cast<int>(qMin<quint64>(newReadings, snapshot.recentReadings.size()));
+    for (int i = firstReading; i < snapshot.recentReadings.size(); ++i) {
+        updateGlucoseChart(snapshot.recentReadings[i].x(), snapshot.recentReadings[i].y());
+    }
+    renderedReadingCount = snapshot.readingCount;
 
     // Extend chart if needed
-    if (timeElapsed >= glucoseAxisX->max()) {
+    if (snapshot.simMinutes >= glucoseAxisX->max()) {
         glucoseAxisX->setRange(0, glucoseAxisX->max() + 30);
     }
+    refreshGlucoseSeries();
+    predictionSeries->replace(snapshot.prediction);
+    predictionLowSeries->replace(snapshot.predictionLow);
+    predictionHighSeries->replace(snapshot.predictionHigh);
+
+    // Reflect simulated values without echoing them back to the worker
+    const QSignalBlocker blockBG(ui->doubleSpinBox_BG);
+    const QSignalBlocker blockIOB(ui->doubleSpinBox_IOB);
+    const QSignalBlocker blockCarbs(ui->doubleSpinBox_Carbs);
+    ui->doubleSpinBox_BG->setValue(snapshot.glucose);
+    ui->doubleSpinBox_IOB->setValue(snapshot.insulinOnBoard);
+    ui->doubleSpinBox_Carbs->setValue(snapshot.carbsOnBoard);
+    ui->label_CurrentBG->setText(QString("%1 mmol/L %2").arg(snapshot.glucose, 0, 'f', 1)
+                                 .arg(trendArrow(snapshot.glucoseTrend)));
+    ui->label_CurrentBG->setToolTip(QString("Filtered: %1 +/- %2 mmol/L, trend %3 mmol/L/min")
+                                    .arg(snapshot.filteredGlucose, 0, 'f', 1)
+                                    .arg(std::sqrt(snapshot.glucoseVariance), 0, 'f', 2)
+                                    .arg(snapshot.glucoseTrend, 0, 'f', 3));
+}
 
-    // Simulate basal insulin use
-    int drop = (timeElapsed / 5) % 12; // simulate 12 values
-    int simDrop = (drop == 4 || drop == 8 || drop == 12) ? 3 : 3;
-    controller->registerInsulinDelivery(-simDrop);
+// Battery level visual cues
+void MainWindow::updateBatteryDisplay(int level) {
+    renderedBatteryLevel = level;
+    ui->batteryProgressBar->setValue(level);
+    if (level <= 20)
+        ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: red; }");
+    else if (level <= 50)
+        ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: orange; }");
+    else
+        ui->batteryProgressBar->setStyleSheet("QProgressBar::chunk { background-color: green; }");
+}
 
-    // Update displayed BG and chart
-    ui->doubleSpinBox_BG->setValue(newBG);
-    updateGlucoseChart(timeElapsed, newBG);
-    handleCGMReading(newBG); // Check for alerts
+// Insulin progress bar updates
+void MainWindow::updateInsulinDisplay(int level) {
+    renderedReservoirLevel = level;
+    qDebug() << "[UI] Updating insulinProgressBar:" << level << "units";
+    ui->insulinProgressBar->setValue(level);
+    if (level <= 50)
+        ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: red; }");
+    else if (level <= 100)
+        ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: orange; }");
+    else
+        ui->insulinProgressBar->setStyleSheet("QProgressBar::chunk { background-color: green; }");
 }
 
 bool MainWindow::canAutoCorrect() {
@@ -651,120 +908,11 @@ bool MainWindow::canAutoCorrect() {
     return true;
 }
 
-void MainWindow::handleCGMReading(double glucoseLevel) {
-
-    double newBG = glucoseLevel;
-    double IOB = ui->doubleSpinBox_IOB->value();
-    double carbs = ui->doubleSpinBox_Carbs->value();
-    double basalRate = ui->spinBox_Basal->value();
-    double CF = ui->doubleSpinBox_CF->value(); // correction factor
-    QDateTime now = QDateTime::currentDateTime();
-
-    ui->label_CurrentBG->setText(QString("%1 mmol/L").arg(glucoseLevel, 0, 'f', 1));
-
-    // Log raw values used for decision making
-    double targetBG = ui->doubleSpinBox_TargetBG->value();
-    double cf = ui->doubleSpinBox_CF->value();
-    QString simTime = QString("%1:%2")
-        .arg(timeElapsed / 60, 2, 10, QChar('0'))  // hours
-        .arg(timeElapsed % 60, 2, 10, QChar('0')); // minutes
-
-
-    qDebug() << "[DEBUG] BG =" << glucoseLevel
-             << "| Target BG =" << targetBG
-             << "| CF =" << cf;
-
-    // Alert Label Logic
-    if (glucoseLevel <= 3.9) {
-        ui->label_CGMStatus->setText("ALERT: Low Glucose");
-        ui->label_CGMStatus->setStyleSheet("color: red; font-weight: bold;");
-    } else if (glucoseLevel >= 10.0) {
-        ui->label_CGMStatus->setText("ALERT: High Glucose");
-        ui->label_CGMStatus->setStyleSheet("color: red; font-weight: bold;");
-    } else {
-        ui->label_CGMStatus->setText("CGM Monitoring: Active");
-        ui->label_CGMStatus->setStyleSheet("");
-    }
-
-    QString logEntry = QString("[%1] BG: %2 mmol/L").arg(simTime).arg(glucoseLevel, 0, 'f', 1);
-
-    // Recommend Correction
-    if (cf > 0.0 && glucoseLevel > targetBG + 2.0) {
-        double correction = (glucoseLevel - targetBG) / cf;
-        correction = std::round(correction * 100.0) / 100.0;
-
-        qDebug() << "[DEBUG] Triggering Correction | Correction Dose:" << correction;
-
-        logEntry += QString(" - Recommend correction: %1 u").arg(correction, 0, 'f', 2);
-
-        int correctionUnits = static_cast<int>(correction);
-        controller->registerInsulinDelivery(correctionUnits);
-
-        ui->plainTextEdit_CGMLogs->appendPlainText(
-            QString("[%1] Insulin Delivered (Auto): %2 u").arg(simTime).arg(correctionUnits)
-        );
-        ui->plainTextEdit_CGMLogs->appendPlainText("Recommended Correction Dose Administered");
-    }
-    // Recommend Carbs
-    else if (glucoseLevel < targetBG - 1.0) {
-        qDebug() << "[DEBUG] BG below target - recommending carbs.";
-        logEntry += " - Consider carb intake";
-    }
-    // No action
-    else {
-        qDebug() << "[DEBUG] BG within acceptable range - no action taken.";
-    }
-
-    // CRITICAL warning logs
-    if (glucoseLevel <= 2.8)
-        ui->plainTextEdit_CGMLogs->appendPlainText(QString("[%1] CRITICAL: BG dangerously low!").arg(simTime));
-    if (glucoseLevel >= 15.0)
-        ui->plainTextEdit_CGMLogs->appendPlainText(QString("[%1] CRITICAL: BG dangerously high!").arg(simTime));
-
-    // Final event log
-    qDebug() << "[CGM] LogEntry Created:" << logEntry;
-    ui->plainTextEdit_CGMLogs->appendPlainText(logEntry);
-
-    double predictedBG30min = cgmManager->predictGlucoseLevels(newBG, IOB, carbs, basalRate, 30).last().second;
-
-    if (predictedBG30min <= 3.9) {
-        controller->setBasalRate(0.0);
-        ui->plainTextEdit_CGMLogs->appendPlainText(QString("[%1] Suspended due to predicted low BG").arg(simTime));
-    }
-    else if (predictedBG30min <= 5.0) {
-        controller->adjustBasalRate(-0.3);
-        ui->plainTextEdit_CGMLogs->appendPlainText(QString("[%1] Basal rate decreased").arg(simTime));
-    }
-    else if (predictedBG30min >= 8.9) {
-        controller->adjustBasalRate(+0.3);
-        ui->plainTextEdit_CGMLogs->appendPlainText(QString("[%1] Basal rate increased").arg(simTime));
-    }
-
-    QDateTime timeNow = QDateTime::currentDateTime();
-    int minsSinceLastAuto = lastAutoCorrectionTime.isValid() ? lastAutoCorrectionTime.secsTo(timeNow) / 60 : 999;
-
-    if (predictedBG30min >= 10.0 && minsSinceLastAuto >= 60) {
-        double correction = (predictedBG30min - targetBG) / CF;
-        if (correction > 6.0) correction = 6.0;
-
-        int correctionUnits = static_cast<int>(correction);
-        controller->registerInsulinDelivery(correctionUnits);
-
-        lastAutoCorrectionTime = timeNow;
-
-        ui->plainTextEdit_CGMLogs->appendPlainText(
-            QString("[%1] Auto correction bolus: %2 u").arg(simTime).arg(correctionUnits)
-        );
-    }
-
-
-}
-
 
 void MainWindow::updateGlucoseChart(double time, double glucoseLevel) {
     if (!glucoseSeries) return;
 
-    glucoseSeries->append(time, glucoseLevel); // Plot new data point
+    glucoseHistory.append(time, glucoseLevel); // Store new data point (plotted by refreshGlucoseSeries)
 
     // Update axis limits based on current reading
     double maxY = qMax(glucoseAxisY->max(), glucoseLevel + 1.0);
@@ -775,47 +923,20 @@ void MainWindow::updateGlucoseChart(double time, double glucoseLevel) {
     if (minY > 3.0) minY = 3.0;
     glucoseAxisY->setRange(qMax(2.0, minY - 0.5), qMin(20.0, maxY + 1.0));
     //glucoseAxisY->setRange(minY, maxY);
-
-    updatePredictions(time, glucoseLevel); // Refresh prediction line
 }
 
-void MainWindow::updatePredictions(double currentTime, double currentGlucose) {
-    predictionSeries->clear();
-    predictionSeries->append(currentTime, currentGlucose);
-
-    double insulinOnBoard = ui->doubleSpinBox_IOB->value();
-    double carbsOnBoard = ui->doubleSpinBox_Carbs->value();
-
-    double insulinDecayRate = 0.15;
-    double carbDecayRate = 0.015;
-
-    for (int i = 5; i <= 60; i += 5) {
-        double timePoint = currentTime + i;
+// Replaces the plotted line with about one point per horizontal pixel of the visible range
+void MainWindow::refreshGlucoseSeries() {
+    if (!glucoseSeries || !glucoseAxisX || !chartView) return;
+    PUMP_TRACE_SCOPE("ui.chart.refreshGlucoseSeries");
 
-        // Linear decay of insulin & carbs
-        double insulinEffect = insulinOnBoard * insulinDecayRate * (1.0 - (i / 60.0));
-        double carbEffect = carbsOnBoard * carbDecayRate * (1.0 - (i / 60.0));
-
-        if (insulinEffect < 0) insulinEffect = 0;
-        if (carbEffect < 0) carbEffect = 0;
-
-        double predictedGlucose = currentGlucose + carbEffect - insulinEffect;
-
-        // Small smoothing oscillation
-        double hoverOffset = 0.1 * std::sin(timePoint / 60.0 * 2 * M_PI);
-        predictedGlucose += hoverOffset;
-
-        // Clamp prediction
-        if (predictedGlucose < 2.5)
-            predictedGlucose = 2.5;
-        else if (predictedGlucose > 15.0)
-            predictedGlucose = 15.0;
-
-        predictionSeries->append(timePoint, predictedGlucose);
-    }
+    // Plot area is empty until the chart is first laid out
+    qreal plotWidth = glucoseChart->plotArea().width();
+    if (plotWidth < 1.0) plotWidth = chartView->width();
+    int pixelWidth = qMax(1, static_cast<int>(plotWidth));
+    glucoseSeries->replace(glucoseHistory.visiblePoints(glucoseAxisX->min(), glucoseAxisX->max(), pixelWidth));
 }
 
-
 void MainWindow::on_pushButton_StopDelivery_clicked() {
     ui->plainTextEdit_CGMLogs->appendPlainText("Manual bolus delivery stopped by user.");
     ui->stackedWidget->setCurrentWidget(ui->calculationpage); // Return to calculator
@@ -4,17 +4,23 @@
 #include <QMainWindow>
 #include <QtCharts/QChartView>
 #include <QtCharts/QLineSeries>
+#include <QtCharts/QAreaSeries>
 #include <QtCharts/QChart>
 #include "UserProfile.h"
 #include <QtCharts/QValueAxis>
 #include "BolusManager.h"
 #include <QDebug>
 #include <QVBoxLayout>
-#include "CGMManager.h"
 #include <QTimer>
+#include <QThread>
 #include <QRandomGenerator>
 #include "SafetyController.h"
+#include "GlucoseSeriesStore.h"
+#include "SimulationWorker.h"
 #include <QMessageBox>
+#include <QActionGroup>
+#include <QTableWidget>
+#include "WhatIfExplorer.h"
 
 QT_CHARTS_USE_NAMESPACE
 
@@ -92,35 +98,55 @@ private:
     double insulinOnBoard;
 
     BolusManager bolusManager;       // Bolus calculation/delivery logic
+    PumpJournal journal;             // Pump state changes; recovered at startup
     User user;                       // Current user account
-    CGMManager *cgmManager;         // Continuous Glucose Monitor logic
 
     // Glucose chart components
     QChart *glucoseChart = nullptr;
     QLineSeries *glucoseSeries = nullptr;
     QLineSeries *predictionSeries = nullptr;
+    QLineSeries *predictionLowSeries = nullptr;    // 10-90% band edges, drawn as predictionBand
+    QLineSeries *predictionHighSeries = nullptr;
+    QAreaSeries *predictionBand = nullptr;
     QValueAxis *glucoseAxisX = nullptr;
     QValueAxis *glucoseAxisY = nullptr;
     QChartView *chartView = nullptr;
+    GlucoseSeriesStore glucoseHistory;   // Multi-resolution store behind glucoseSeries
+
+    // What-if comparison of bolus strategies on the calculation page
+    WhatIfExplorer *whatIfExplorer = nullptr;
+    QTableWidget *whatIfTable = nullptr;
+    void setupWhatIfPanel();
+    void requestWhatIf();
+    void showWhatIfResult(const WhatIfResult &result);
 
     // Chart and CGM data management
     void setupGlucoseChart();
     void updateGlucoseChart(double time, double glucoseLevel);
-    void updateCGMDisplay();
-    void handleCGMReading(double glucoseLevel);
+    void refreshGlucoseSeries();
     void startCGMSimulation();
-    void updatePredictions(double currentTime, double currentGlucose);
-    int cgmSimElapsed = 0;     // How many seconds have passed
-    int cgmSimDuration = 0;    // Total seconds to simulate
-    int simulatedMinutesElapsed = 0;
-    QTime simulatedStartTime;
+    void pushSimulationInputs();
+    void renderSimulationSnapshot();
+    void updateBatteryDisplay(int level);
+    void updateInsulinDisplay(int level);
     int correctionUnits;
-    QDateTime lastAutoCorrectionTime;
-    int timeElapsed = 5; // Simulated minutes (starts at 5)
     int insulinLevel;
     bool lowInsulinWarned;
 
-    QTimer *cgmSimulationTimer;     // Timer to simulate CGM readings
+    // Simulation runs on its own thread; the UI renders its latest snapshot each frame
+    QThread *simThread;
+    SimulationWorker *simWorker;
+    QTimer *frameTimer;
+    quint64 renderedSession = 0;       // Session of the readings currently plotted
+    quint64 renderedReadingCount = 0;  // Readings of that session already plotted
+    quint64 renderedLogCount = 0;      // Log entries already appended
+    int renderedBatteryLevel = -1;
+    int renderedReservoirLevel = -1;
+    SimConfig::Plant plantModel = SimConfig::LinearPlant;   // Chosen from the Glucose Model menu
+    SimConfig::BasalControl basalControl = SimConfig::ThresholdControl;   // Chosen from the Basal Controller menu
+    SimConfig::Prediction predictionModel = SimConfig::LinearPrediction;  // Chosen from the Prediction menu
+    QSharedPointer<const CompiledScenario> scenario;                      // Loaded from the Scenario menu
+    QString tracePath;                                                    // Golden trace file; each run overwrites it
 
     // Safety and warning mechanisms
     SafetyController *controller;
@@ -0,0 +1,338 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QtMath>
+#include <cstdio>
+#include "BolusManager.h"
+#include "CGMManager.h"
+#include "GlucoseArchive.h"
+#include "HistorySync.h"
+#include "PumpJournal.h"
+
+// Bulk history upload over a local socket.
+//
+//   pumpsync serve <name> [--journal <dir>]... [--devices <n>] [--days <d>]
+//   pumpsync fetch <name> [<serial>...] [--cursor-file <file>] [--threads <n>] [--batch <records>] [--dump]
+//   pumpsync query <name> [<serial>...] [--below <mmol/L> | --above <mmol/L>] [--min-minutes <m>]
+//                  [--last-days <d>] [--threads <n>] [--list]
+//
+// serve emulates pumps: each --journal directory is one device (serial =
+// directory name), and --devices adds generated ones with --days (default
+// 90) of readings, boluses and alerts journaled by CGMManager and
+// BolusManager. fetch downloads every named device (default: the first) in
+// parallel. With --cursor-file, each device's cursor is read from and saved
+// to the file ("<serial> <cursor>" per line), so a rerun only fetches what
+// is new and an interrupted sync resumes after its last complete batch.
+// --batch sets the records per batch (default 4096, capped to what fits one frame).
+// query downloads the named devices' full histories into a GlucoseArchive,
+// one patient per device, and reports the episodes past the threshold
+// (default: below 3.0 for at least 15 minutes). Reading times are sensor
+// minutes, so --last-days counts back from the newest reading.
+
+namespace {
+
+// Silence the CGM alert logging of the generated devices
+void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+    if (type != QtDebugMsg && type != QtInfoMsg) {
+        std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+    }
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: pumpsync serve <name> [--journal <dir>]... [--devices <n>] [--days <d>]\n"
+                         "       pumpsync fetch <name> [<serial>...] [--cursor-file <file>] [--threads <n>] [--batch <records>]\n"
+                         "                      [--dump]\n"
+                         "       pumpsync query <name> [<serial>...] [--below <mmol/L> | --above <mmol/L>] [--min-minutes <m>]\n"
+                         "                      [--last-days <d>] [--threads <n>] [--list]\n");
+    return 2;
+}
+
+// Journals 'days' of 5-minute readings with three meal boluses a day; each
+// device gets its own phase and amplitude so histories differ
+bool generateDevice(const QString &serial, int index, int days, DeviceHistory *device, QString *error) {
+    const QString directory = QDir(QDir::tempPath()).filePath("pumpsync-" + serial);
+    QFile::remove(QDir(directory).filePath("pump.journal"));
+    QFile::remove(QDir(directory).filePath("pump.snapshot"));
+
+    PumpJournal journal;
+    if (!journal.open(directory, error)) return false;
+    BolusManager bolusManager;
+    CGMManager cgmManager(&bolusManager);
+    bolusManager.setJournal(&journal);
+    cgmManager.setJournal(&journal);
+
+    const int readingsPerDay = 24 * 60 / CGMManager::kReadingIntervalMinutes;
+    const double swing = 3.0 + 0.5 * (index % 5);
+    for (int i = 0; i < days * readingsPerDay; ++i) {
+        const double minute = i * double(CGMManager::kReadingIntervalMinutes);
+        const double dayPhase = 2.0 * M_PI * (i % readingsPerDay) / readingsPerDay;
+        const double glucose = 7.5 + swing * std::sin(3.0 * dayPhase + index) + 0.3 * std::sin(0.7 * i);
+        cgmManager.addReadingAt(minute, glucose);
+        if (i % (readingsPerDay / 3) == 36) {
+            const BolusResult bolus = bolusManager.calculateBolus(45.0 + 5 * (i % 7), glucose, 10.0, 2.0, 6.0, 0.5);
+            bolusManager.deliverBolus(bolus, (i / readingsPerDay) % 4 == 0);
+        }
+    }
+    journal.close();
+
+    device->serial = serial;
+    return device->loadJournal(directory, error);
+}
+
+int serve(const QStringList &args) {
+    if (args.size() < 3) return usage();
+    QVector<DeviceHistory> devices;
+    int generated = 0;
+    int days = 90;
+    QString error;
+    for (int i = 3; i < args.size(); ++i) {
+        if (args[i] == "--journal" && i + 1 < args.size()) {
+            DeviceHistory device;
+            if (!device.loadJournal(args[++i], &error)) {
+                std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+                return 1;
+            }
+            devices.append(device);
+        } else if (args[i] == "--devices" && i + 1 < args.size()) {
+            generated = args[++i].toInt();
+        } else if (args[i] == "--days" && i + 1 < args.size()) {
+            days = qMax(1, args[++i].toInt());
+        } else {
+            return usage();
+        }
+    }
+    if (devices.isEmpty() && generated == 0) generated = 1;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < generated; ++i) {
+        DeviceHistory device;
+        if (!generateDevice(QString("EMU%1").arg(i + 1, 4, 10, QChar('0')), i, days, &device, &error)) {
+            std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        devices.append(device);
+    }
+
+    HistoryDeviceServer server;
+    for (const DeviceHistory &device : devices) {
+        server.addDevice(device);
+        std::printf("%s: %d records\n", device.serial.toLocal8Bit().constData(), device.records.size());
+    }
+    if (!server.listen(args[2], &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+    }
+    std::printf("serving %d devices on %s (ready in %lld ms)\n", server.deviceCount(),
+                args[2].toLocal8Bit().constData(), static_cast<long long>(timer.elapsed()));
+    std::fflush(stdout);
+    return QCoreApplication::exec();
+}
+
+const char *describe(const HistoryRecord &record, char *text, int size) {
+    switch (record.type) {
+    case HistoryRecord::Reading:
+        std::snprintf(text, size, "reading %.2f mmol/L at sensor minute %.1f", record.b, record.a);
+        break;
+    case HistoryRecord::Bolus:
+        std::snprintf(text, size, "bolus %s %.3f u (extended %.3f u)",
+                      record.code == JournalEvent::BolusStarted ? "started"
+                      : record.code == JournalEvent::BolusCancelled ? "cancelled" : "interrupted",
+                      record.a, record.b);
+        break;
+    case HistoryRecord::Alert:
+        std::snprintf(text, size, "alert %s at %.2f mmol/L",
+                      record.code == 0 ? "cleared" : record.code == 1 ? "low" : "high", record.a);
+        break;
+    }
+    return text;
+}
+
+int fetch(const QStringList &args) {
+    if (args.size() < 3) return usage();
+    QStringList serials;
+    QString cursorFile;
+    int threads = 0;
+    int batchRecords = HistoryProtocol::kDefaultBatchRecords;
+    bool dump = false;
+    for (int i = 3; i < args.size(); ++i) {
+        if (args[i] == "--cursor-file" && i + 1 < args.size()) cursorFile = args[++i];
+        else if (args[i] == "--threads" && i + 1 < args.size()) threads = args[++i].toInt();
+        else if (args[i] == "--batch" && i + 1 < args.size()) batchRecords = args[++i].toInt();
+        else if (args[i] == "--dump") dump = true;
+        else serials.append(args[i]);
+    }
+    if (serials.isEmpty()) serials.append(QString());
+
+    QVector<quint32> cursors(serials.size(), 0);
+    QStringList saved;
+    QFile in(cursorFile);
+    if (!cursorFile.isEmpty() && in.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        for (const QString &line : QString::fromUtf8(in.readAll()).split('\n')) {
+            if (line.isEmpty()) continue;
+            saved.append(line);
+            const int index = serials.indexOf(line.section(' ', 0, 0));
+            if (index >= 0) cursors[index] = line.section(' ', 1, 1).toUInt();
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<HistorySyncClient::Result> results =
+        HistorySyncClient::syncAll(args[2], serials, cursors, threads, batchRecords);
+    const qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+
+    int failed = 0;
+    qint64 records = 0;
+    qint64 bytes = 0;
+    char text[128];
+    for (const HistorySyncClient::Result &result : results) {
+        records += result.records.size();
+        bytes += result.wireBytes;
+        if (dump) {
+            for (const HistoryRecord &record : result.records) {
+                std::printf("%s #%u %s\n", result.serial.toLocal8Bit().constData(), record.sequence,
+                            describe(record, text, sizeof(text)));
+            }
+        }
+        std::printf("%-10s %7d records in %3d batches, %8lld bytes, %6.2f ms, cursor %u -> %u%s%s\n",
+                    result.serial.isEmpty() ? "(default)" : result.serial.toLocal8Bit().constData(),
+                    result.records.size(), result.batches, static_cast<long long>(result.wireBytes),
+                    result.elapsedUs / 1000.0, cursors[&result - results.constData()], result.cursor,
+                    result.error.isEmpty() ? "" : "  ERROR ", result.error.toLocal8Bit().constData());
+        if (!result.error.isEmpty()) failed++;
+    }
+    std::printf("%d devices, %lld records, %lld bytes in %.2f ms\n", results.size(),
+                static_cast<long long>(records), static_cast<long long>(bytes), elapsedUs / 1000.0);
+
+    // Cursors advance even for failed syncs, up to their last complete batch
+    if (!cursorFile.isEmpty()) {
+        for (const HistorySyncClient::Result &result : results) {
+            const QString entry = QString("%1 %2").arg(result.serial).arg(result.cursor);
+            bool replaced = false;
+            for (QString &line : saved) {
+                if (line.section(' ', 0, 0) == result.serial) {
+                    line = entry;
+                    replaced = true;
+                }
+            }
+            if (!replaced) saved.append(entry);
+        }
+        QSaveFile out(cursorFile);
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            std::fprintf(stderr, "cannot write %s\n", cursorFile.toLocal8Bit().constData());
+            return 1;
+        }
+        out.write(saved.join('\n').toUtf8() + '\n');
+        if (!out.commit()) {
+            std::fprintf(stderr, "cannot write %s\n", cursorFile.toLocal8Bit().constData());
+            return 1;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+int query(const QStringList &args) {
+    if (args.size() < 3) return usage();
+    QStringList serials;
+    ArchiveQuery query;
+    query.minDurationMs = 15 * 60000;
+    int lastDays = 0;
+    bool list = false;
+    for (int i = 3; i < args.size(); ++i) {
+        if (args[i] == "--below" && i + 1 < args.size()) {
+            query.comparison = ArchiveQuery::Below;
+            query.threshold = args[++i].toFloat();
+        } else if (args[i] == "--above" && i + 1 < args.size()) {
+            query.comparison = ArchiveQuery::Above;
+            query.threshold = args[++i].toFloat();
+        } else if (args[i] == "--min-minutes" && i + 1 < args.size()) {
+            query.minDurationMs = qint64(args[++i].toDouble() * 60000);
+        } else if (args[i] == "--last-days" && i + 1 < args.size()) {
+            lastDays = args[++i].toInt();
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            query.threads = args[++i].toInt();
+        } else if (args[i] == "--list") {
+            list = true;
+        } else {
+            serials.append(args[i]);
+        }
+    }
+    if (serials.isEmpty()) serials.append(QString());
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<HistorySyncClient::Result> results =
+        HistorySyncClient::syncAll(args[2], serials, QVector<quint32>(serials.size(), 0), query.threads);
+    const qint64 syncUs = timer.nsecsElapsed() / 1000;
+
+    GlucoseArchive archive;
+    int dropped = 0;
+    for (const HistorySyncClient::Result &result : results) {
+        if (!result.error.isEmpty()) {
+            std::fprintf(stderr, "%s: %s\n", result.serial.toLocal8Bit().constData(),
+                         result.error.toLocal8Bit().constData());
+            return 1;
+        }
+        const int patient = archive.addPatient();
+        for (const HistoryRecord &record : result.records) {
+            if (record.type != HistoryRecord::Reading) continue;
+            if (!archive.append(patient, qint64(record.a * 60000), float(record.b))) dropped++;
+        }
+    }
+    if (lastDays > 0) {
+        query.fromMs = archive.newestMs() - qint64(lastDays) * 24 * 3600 * 1000;
+    }
+
+    timer.restart();
+    ArchiveQueryStats stats;
+    const QVector<GlucoseEpisode> episodes = archive.episodes(query, &stats);
+    const qint64 queryUs = timer.nsecsElapsed() / 1000;
+
+    QVector<int> counts(results.size(), 0);
+    QVector<qint64> minutes(results.size(), 0);
+    for (const GlucoseEpisode &episode : episodes) {
+        counts[episode.patient]++;
+        minutes[episode.patient] += episode.durationMs() / 60000;
+        if (list) {
+            std::printf("%-10s day %3lld %02lld:%02lld  %4lld min  %2d readings  %s %.1f\n",
+                        results[episode.patient].serial.toLocal8Bit().constData(),
+                        static_cast<long long>(episode.startMs / 86400000),
+                        static_cast<long long>(episode.startMs / 3600000 % 24),
+                        static_cast<long long>(episode.startMs / 60000 % 60),
+                        static_cast<long long>(episode.durationMs() / 60000), episode.readings,
+                        query.comparison == ArchiveQuery::Below ? "min" : "max", episode.extreme);
+        }
+    }
+    for (int patient = 0; patient < results.size(); ++patient) {
+        std::printf("%-10s %7d readings, %4d episodes, %6lld min\n",
+                    results[patient].serial.isEmpty() ? "(default)" : results[patient].serial.toLocal8Bit().constData(),
+                    archive.readingCount(patient), counts[patient], static_cast<long long>(minutes[patient]));
+    }
+    std::printf("%d episodes in %.2f ms (sync %.2f ms); %lld of %lld blocks skipped, %lld full, %lld from bitmaps, "
+                "%lld readings compared\n",
+                episodes.size(), queryUs / 1000.0, syncUs / 1000.0,
+                static_cast<long long>(stats.skippedBlocks), static_cast<long long>(stats.blocks),
+                static_cast<long long>(stats.fullBlocks), static_cast<long long>(stats.bitmapBlocks),
+                static_cast<long long>(stats.scannedReadings));
+    if (dropped > 0) {
+        std::printf("%d readings dropped: older than the device's previous reading\n", dropped);
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    qInstallMessageHandler(quietMessageHandler);
+
+    QStringList args = app.arguments();
+    if (args.size() >= 2 && args[1] == "serve") return serve(args);
+    if (args.size() >= 2 && args[1] == "fetch") return fetch(args);
+    if (args.size() >= 2 && args[1] == "query") return query(args);
+    return usage();
+}
@@ -0,0 +1,26 @@
+QT = core network
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = pumpsync
+
+# History upload emulator and host client, without the UI
+INCLUDEPATH += ..
+
+SOURCES += \
+    PumpSync.cpp \
+    ../BolusManager.cpp \
+    ../CGMManager.cpp \
+    ../CgmFusion.cpp \
+    ../CgmResampler.cpp \
+    ../GlucoseArchive.cpp \
+    ../GlucoseColumns.cpp \
+    ../GlucoseKalmanFilter.cpp \
+    ../HistorySync.cpp \
+    ../Instrumentation.cpp \
+    ../PumpJournal.cpp
+
+HEADERS += \
+    ../GlucoseArchive.h \
+    ../GlucoseColumns.h \
+    ../HistorySync.h
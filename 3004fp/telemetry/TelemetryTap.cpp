@@ -0,0 +1,100 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QStringList>
+#include <QThread>
+#include <cstdio>
+#include "Telemetry.h"
+
+// Prints a running pump's telemetry.
+//
+//   pumptap <name> [--latest] [--from-oldest] [--count <n>] [--interval <ms>]
+//
+// --latest prints the newest record of each kind first, so the current state
+// is known straight away. --from-oldest also prints the backlog still in the
+// ring. Stops after --count records (default: runs until killed); polls
+// every --interval ms (default 50).
+
+namespace {
+
+int usage() {
+    std::fprintf(stderr, "usage: pumptap <name> [--latest] [--from-oldest] [--count <n>] [--interval <ms>]\n");
+    return 2;
+}
+
+const char *kindName(TelemetryRecord::Kind kind) {
+    switch (kind) {
+    case TelemetryRecord::Reading: return "reading";
+    case TelemetryRecord::Prediction: return "prediction";
+    case TelemetryRecord::BasalChange: return "basal";
+    case TelemetryRecord::Alert: return "alert";
+    }
+    return "?";
+}
+
+void print(const TelemetryRecord &record) {
+    const QByteArray time = QDateTime::fromMSecsSinceEpoch(record.timeMs).toString("hh:mm:ss.zzz").toLocal8Bit();
+    std::printf("%8llu %s pump %u t=%4d min %-10s code %u flags %u  %.2f %.2f %.3f %.3f\n",
+                static_cast<unsigned long long>(record.sequence), time.constData(), record.pump,
+                record.simMinutes, kindName(record.kind), record.code, record.flags,
+                record.values[0], record.values[1], record.values[2], record.values[3]);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+
+    QString name;
+    bool latest = false;
+    bool fromOldest = false;
+    qint64 count = -1;
+    int intervalMs = 50;
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "--latest") latest = true;
+        else if (args[i] == "--from-oldest") fromOldest = true;
+        else if (args[i] == "--count" && i + 1 < args.size()) count = args[++i].toLongLong();
+        else if (args[i] == "--interval" && i + 1 < args.size()) intervalMs = qMax(1, args[++i].toInt());
+        else if (name.isEmpty()) name = args[i];
+        else return usage();
+    }
+    if (name.isEmpty()) return usage();
+
+    TelemetrySubscriber subscriber;
+    QString error;
+    if (!subscriber.attach(name, fromOldest, &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+    }
+    if (latest) {
+        QVector<TelemetryRecord> records;
+        if (!subscriber.fetchLatest(&records, &error)) {
+            std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        for (const TelemetryRecord &record : records) {
+            print(record);
+        }
+        std::fflush(stdout);
+    }
+
+    QVector<TelemetryRecord> records;
+    quint64 lost = 0;
+    qint64 printed = 0;
+    while (count < 0 || printed < count) {
+        records.clear();
+        subscriber.poll(&records);
+        for (const TelemetryRecord &record : records) {
+            print(record);
+            if (++printed == count) break;
+        }
+        if (subscriber.lost() != lost) {
+            std::fprintf(stderr, "lost %llu records (reader too slow)\n",
+                         static_cast<unsigned long long>(subscriber.lost() - lost));
+            lost = subscriber.lost();
+        }
+        std::fflush(stdout);
+        if (records.isEmpty()) QThread::msleep(intervalMs);
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+QT = core network
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = pumptap
+
+# Subscriber for a running pump's telemetry ring (PUMP_TELEMETRY=<name>)
+INCLUDEPATH += ..
+
+SOURCES += \
+    TelemetryTap.cpp \
+    ../Telemetry.cpp
+
+HEADERS += \
+    ../Telemetry.h
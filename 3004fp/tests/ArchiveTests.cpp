@@ -0,0 +1,251 @@
+#include "PumpTest.h"
+#include <QVector>
+#include "GlucoseArchive.h"
+
+// GlucoseArchive queries compared with a brute-force scan of the same readings,
+// over series sized around the word (64) and block (1024) boundaries, with
+// runs that cross them, gaps, repeated times and readings exactly at a threshold.
+
+namespace {
+
+// Small deterministic generator, so a failure reproduces
+class Lcg {
+public:
+    explicit Lcg(quint64 seed) : m_state(seed) {}
+    quint32 next() {
+        m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return quint32(m_state >> 33);
+    }
+    int below(int bound) { return int(next() % quint32(bound)); }
+
+private:
+    quint64 m_state;
+};
+
+struct Series {
+    QVector<qint64> timeMs;
+    QVector<float> glucose;
+};
+
+const qint64 kStartMs = 1700000000000LL;
+
+// Stretches of steady low, in-range and high readings joined by random walks
+Series makeSeries(int readings, quint64 seed) {
+    Lcg random(seed);
+    Series series;
+    qint64 time = kStartMs;
+    float glucose = 6.0f;
+    int stretch = 0;
+    int mode = 0;
+    for (int i = 0; i < readings; ++i) {
+        if (stretch-- <= 0) {
+            mode = random.below(5);
+            stretch = 1 + random.below(random.below(4) == 0 ? 1500 : 150);
+        }
+        switch (mode) {
+        case 0: glucose = 2.0f + 0.1f * random.below(9); break;      // Low throughout
+        case 1: glucose = 14.0f + 0.1f * random.below(40); break;    // Very high throughout
+        case 2: glucose = 6.0f + 0.1f * random.below(20); break;     // In range
+        case 3: glucose = 3.0f; break;                               // Exactly at the urgent-low level
+        default:
+            glucose = qBound(1.5f, glucose + 0.1f * (random.below(21) - 10), 22.0f);
+            break;
+        }
+
+        series.timeMs.append(time);
+        series.glucose.append(glucose);
+        const int step = random.below(400);
+        time += step < 4 ? 0 : step < 6 ? 25 * 60000 : step < 8 ? 11 * 60000 : 5 * 60000;
+    }
+    return series;
+}
+
+bool matches(const ArchiveQuery &query, qint64 time, float glucose) {
+    if (time < query.fromMs || time > query.toMs) return false;
+    return query.comparison == ArchiveQuery::Below ? glucose < query.threshold : glucose > query.threshold;
+}
+
+// Reading by reading, with the episode rules written out plainly; 'crossings'
+// counts the episodes spanning a block boundary
+QVector<GlucoseEpisode> bruteEpisodes(const QVector<Series> &patients, const ArchiveQuery &query, qint64 *count,
+                                      qint64 *crossings = nullptr) {
+    QVector<int> order = query.patients;
+    if (order.isEmpty()) {
+        for (int p = 0; p < patients.size(); ++p) order.append(p);
+    }
+
+    QVector<GlucoseEpisode> out;
+    *count = 0;
+    for (int patient : order) {
+        const Series &series = patients[patient];
+        GlucoseEpisode episode;
+        episode.patient = patient;
+        bool open = false;
+        int first = -1;
+        int last = -1;
+        auto close = [&]() {
+            if (open && episode.durationMs() >= query.minDurationMs) {
+                out.append(episode);
+                if (crossings && first / GlucoseArchive::kBlockReadings != last / GlucoseArchive::kBlockReadings) {
+                    ++*crossings;
+                }
+            }
+            open = false;
+        };
+        for (int i = 0; i < series.glucose.size(); ++i) {
+            const float glucose = series.glucose[i];
+            if (!matches(query, series.timeMs[i], glucose)) {
+                close();
+                continue;
+            }
+            ++*count;
+            if (open && last == i - 1 && series.timeMs[i] - series.timeMs[i - 1] <= query.maxGapMs) {
+                episode.endMs = series.timeMs[i];
+                episode.extreme = query.comparison == ArchiveQuery::Below ? qMin(episode.extreme, glucose)
+                                                                          : qMax(episode.extreme, glucose);
+                episode.readings++;
+            } else {
+                close();
+                open = true;
+                first = i;
+                episode.startMs = episode.endMs = series.timeMs[i];
+                episode.extreme = glucose;
+                episode.readings = 1;
+            }
+            last = i;
+        }
+        close();
+    }
+    return out;
+}
+
+bool sameEpisodes(const QVector<GlucoseEpisode> &a, const QVector<GlucoseEpisode> &b) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].patient != b[i].patient || a[i].startMs != b[i].startMs || a[i].endMs != b[i].endMs
+            || a[i].extreme != b[i].extreme || a[i].readings != b[i].readings) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+PUMP_TEST(archiveQueriesMatchBruteForce) {
+    // Sizes around word and block boundaries, plus a few blocks' worth
+    const int sizes[] = {0, 1, 63, 64, 65, 1023, 1024, 1025, 2047, 2048, 2113, 5000, 9000};
+    QVector<Series> patients;
+    GlucoseArchive archive;
+    for (int i = 0; i < int(sizeof(sizes) / sizeof(sizes[0])); ++i) {
+        const Series series = makeSeries(sizes[i], 1000 + i);
+        const int patient = archive.addPatient();
+        for (int r = 0; r < series.glucose.size(); ++r) {
+            PUMP_CHECK(archive.append(patient, series.timeMs[r], series.glucose[r]));
+        }
+        patients.append(series);
+    }
+
+    // One low run from reading 1000 to 2100, across two block boundaries
+    Series crossing;
+    for (int r = 0; r < 3000; ++r) {
+        crossing.timeMs.append(kStartMs + r * 300000LL);
+        crossing.glucose.append(r >= 1000 && r <= 2100 ? 2.5f + 0.001f * (r % 7) : 6.0f);
+    }
+    const int crossingPatient = archive.addPatient();
+    for (int r = 0; r < crossing.glucose.size(); ++r) {
+        archive.append(crossingPatient, crossing.timeMs[r], crossing.glucose[r]);
+    }
+    patients.append(crossing);
+
+    // Time ranges: everything, and cuts falling mid-word and mid-block
+    const qint64 minute = 60000;
+    const QVector<QPair<qint64, qint64>> ranges = {
+        {std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max()},
+        {kStartMs + 37 * 5 * minute, kStartMs + 1500 * 5 * minute},
+        {kStartMs + 1000 * 5 * minute + 2 * minute, kStartMs + 1100 * 5 * minute},
+        {kStartMs + 4000 * 5 * minute, kStartMs + 4000 * 5 * minute},
+        // Starting at the last reading of a block and ending at the first of another
+        {crossing.timeMs[1023], crossing.timeMs[2048]},
+    };
+    const QVector<QPair<ArchiveQuery::Comparison, float>> thresholds = {
+        {ArchiveQuery::Below, 3.0f},       // Alarm levels: answered from the bitmaps
+        {ArchiveQuery::Below, 3.9f},
+        {ArchiveQuery::Above, 10.0f},
+        {ArchiveQuery::Above, 13.9f},
+        {ArchiveQuery::Below, 3.05f},      // Others: compared reading by reading
+        {ArchiveQuery::Below, 1.0f},
+        {ArchiveQuery::Above, 7.0f},
+        {ArchiveQuery::Above, 30.0f},
+    };
+
+    ArchiveQueryStats covered;
+    qint64 crossingEpisodes = 0;
+    for (const auto &range : ranges) {
+        for (const auto &threshold : thresholds) {
+            for (qint64 minDuration : {qint64(0), 15 * minute}) {
+                for (qint64 maxGap : {10 * minute, 4 * minute}) {
+                    for (int threads : {1, 3}) {
+                        ArchiveQuery query;
+                        query.fromMs = range.first;
+                        query.toMs = range.second;
+                        query.comparison = threshold.first;
+                        query.threshold = threshold.second;
+                        query.minDurationMs = minDuration;
+                        query.maxGapMs = maxGap;
+                        query.threads = threads;
+
+                        qint64 expectedCount = 0;
+                        const QVector<GlucoseEpisode> expected =
+                            bruteEpisodes(patients, query, &expectedCount, &crossingEpisodes);
+                        ArchiveQueryStats stats;
+                        PUMP_CHECK(sameEpisodes(archive.episodes(query, &stats), expected));
+                        PUMP_CHECK(archive.countReadings(query) == expectedCount);
+                        PUMP_CHECK(stats.matchingReadings == expectedCount);
+                        covered.add(stats);
+                    }
+                }
+            }
+        }
+    }
+
+    // Every path of the query was taken
+    PUMP_CHECK(covered.skippedBlocks > 0);
+    PUMP_CHECK(covered.fullBlocks > 0);
+    PUMP_CHECK(covered.bitmapBlocks > 0);
+    PUMP_CHECK(covered.scannedReadings > 0);
+    PUMP_CHECK(crossingEpisodes > 0);
+}
+
+PUMP_TEST(archiveQueriesFollowPatientOrder) {
+    GlucoseArchive archive;
+    QVector<Series> patients;
+    for (int i = 0; i < 5; ++i) {
+        const Series series = makeSeries(700 + 300 * i, 77 + i);
+        const int patient = archive.addPatient();
+        for (int r = 0; r < series.glucose.size(); ++r) {
+            archive.append(patient, series.timeMs[r], series.glucose[r]);
+        }
+        patients.append(series);
+    }
+
+    ArchiveQuery query;
+    query.threshold = 3.9f;
+    query.patients = {4, 1, 3};
+    query.threads = 2;
+    qint64 expectedCount = 0;
+    const QVector<GlucoseEpisode> expected = bruteEpisodes(patients, query, &expectedCount);
+    PUMP_CHECK(!expected.isEmpty());
+    PUMP_CHECK(sameEpisodes(archive.episodes(query), expected));
+    PUMP_CHECK(archive.countReadings(query) == expectedCount);
+}
+
+PUMP_TEST(archiveRefusesOutOfOrderReadings) {
+    GlucoseArchive archive;
+    const int patient = archive.addPatient();
+    PUMP_CHECK(archive.append(patient, 1000, 5.0f));
+    PUMP_CHECK(archive.append(patient, 1000, 5.1f));
+    PUMP_CHECK(!archive.append(patient, 999, 5.2f));
+    PUMP_CHECK(!archive.append(patient, 2000, std::numeric_limits<float>::quiet_NaN()));
+    PUMP_CHECK(archive.readingCount(patient) == 2);
+}
@@ -0,0 +1,141 @@
+#include "PumpTest.h"
+#include <QDir>
+#include <QFile>
+#include "ArrowIpc.h"
+#include "RunExport.h"
+#include "TickArena.h"
+
+// Arrow files compared byte for byte with reference files in tests/data/arrow.
+// The references were read back with pyarrow by tests/data/arrow/validate_arrow.py,
+// which also checks their values; rerun it whenever a reference is replaced.
+
+namespace {
+
+QByteArray readFile(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+// Reports the first differing byte, so a format change is easy to locate
+void compareWithReference(const char *file, int line, const QString &written, const QString &reference) {
+    const QByteArray actual = readFile(written);
+    const QByteArray expected = readFile(PumpTest::dataPath(reference));
+    if (expected.isEmpty()) {
+        PumpTest::fail(file, line, QString("missing reference %1").arg(reference));
+        return;
+    }
+    if (actual == expected) return;
+
+    int offset = 0;
+    while (offset < actual.size() && offset < expected.size() && actual[offset] == expected[offset]) ++offset;
+    PumpTest::fail(file, line, QString("%1 differs from %2 at byte %3 (%4 vs %5 bytes)")
+                   .arg(written, reference).arg(offset).arg(actual.size()).arg(expected.size()));
+}
+
+} // namespace
+
+PUMP_TEST(arrowWriterMatchesReference) {
+    const QVector<ArrowField> schema = {
+        {"flag", ArrowField::Bool},
+        {"small", ArrowField::Int8},
+        {"count", ArrowField::Int32},
+        {"big", ArrowField::Int64},
+        {"ratio", ArrowField::Float32},
+        {"value", ArrowField::Float64},
+        {"time", ArrowField::TimestampMs},
+    };
+
+    const QString path = QDir(PumpTest::scratchDir("arrow-writer")).filePath("all-types.arrow");
+    ArrowFileWriter writer;
+    QString error;
+    PUMP_CHECK(writer.open(path, schema, &error));
+
+    // Two batches: 10 rows, so the Bool bitmap spans two bytes, then 3 rows
+    ArrowBatch batch(schema, 16);
+    int row = 0;
+    for (int rows : {10, 3}) {
+        batch.clear();
+        batch.setRows(rows);
+        for (int i = 0; i < rows; ++i, ++row) {
+            batch.setBool(0, i, row % 3 == 0);
+            batch.column<qint8>(1)[i] = qint8(row * 13 - 60);
+            batch.column<qint32>(2)[i] = row * 100000 - 7;
+            batch.column<qint64>(3)[i] = (qint64(1) << 40) * (row - 6);
+            batch.column<float>(4)[i] = 0.25f * row;
+            batch.column<double>(5)[i] = 5.5 + row / 8.0;
+            batch.column<qint64>(6)[i] = 1700000000000LL + row * 300000LL;
+        }
+        PUMP_CHECK(writer.write(batch, &error));
+    }
+    PUMP_CHECK(writer.batchCount() == 2);
+    PUMP_CHECK(writer.rowCount() == 13);
+    PUMP_CHECK(writer.close(&error));
+
+    compareWithReference(__FILE__, __LINE__, path, "arrow/all-types.arrow");
+}
+
+PUMP_TEST(runExportMatchesReference) {
+    const QString dir = PumpTest::scratchDir("arrow-export");
+    RunExporter exporter;
+    QString error;
+    PUMP_CHECK(exporter.open(dir, 1700000000000LL, &error));
+
+    // Two patients over three ticks; patient 1 has a banded prediction
+    TickArena arena;
+    PatientState patients[2];
+    TickFrame frames[2];
+    for (int tick = 0; tick < 3; ++tick) {
+        arena.reset();
+        for (int p = 0; p < 2; ++p) {
+            PatientState &patient = patients[p];
+            TickFrame &frame = frames[p];
+            const int minute = tick * 5;
+            patient.simMinutes = minute;
+            patient.deliveredBasalRate = 0.8 + 0.1 * p;
+            patient.inputs.insulinOnBoard = 1.5 - 0.25 * tick;
+            patient.inputs.carbsOnBoard = 20.0 - 5.0 * tick;
+
+            frame = TickFrame();
+            frame.reading.simMinutes = minute;
+            frame.reading.glucose = 6.0 + p + 0.5 * tick;
+            frame.reading.initial = tick == 0;
+            frame.estimate.glucose = frame.reading.glucose - 0.1;
+            frame.estimate.trend = 0.02 * (tick - 1);
+            frame.estimate.variance = 0.04;
+
+            frame.prediction.predicted30min = frame.reading.glucose + 0.6;
+            frame.prediction.predicted30minLow = frame.reading.glucose - 0.3;
+            frame.prediction.curve = ArenaArray<QPointF>(arena, 3);
+            if (p == 1) {
+                frame.prediction.lowerBand = ArenaArray<QPointF>(arena, 3);
+                frame.prediction.upperBand = ArenaArray<QPointF>(arena, 3);
+            }
+            for (int k = 0; k < 3; ++k) {
+                const double x = minute + 5.0 * k;
+                frame.prediction.curve.append(QPointF(x, frame.reading.glucose + 0.2 * k));
+                if (p == 1) {
+                    frame.prediction.lowerBand.append(QPointF(x, frame.reading.glucose - 0.3 * k));
+                    frame.prediction.upperBand.append(QPointF(x, frame.reading.glucose + 0.5 * k));
+                }
+            }
+
+            frame.decision.alert = p == 1 && tick == 2 ? ControlDecision::HighAlert : ControlDecision::NoAlert;
+            frame.decision.recommendCarbs = tick == 1;
+            frame.decision.recommendedCorrection = p == 1 ? 0.75 : 0.0;
+            frame.decision.basalAction = tick == 2 ? ControlDecision::IncreaseBasal : ControlDecision::KeepBasal;
+            frame.decision.basalAdjustment = tick == 2 ? 0.3 : 0.0;
+
+            frame.delivery.basalUnits = tick == 0 ? 0.0 : 0.05 * (p + 1);
+            frame.delivery.mealBolus = tick == 1 && p == 0 ? 4.5 : 0.0;
+            frame.delivery.correctionBolus = tick == 2 && p == 1 ? 1.2 : 0.0;
+        }
+        exporter.appendTick(patients, frames, 2);
+    }
+    PUMP_CHECK(exporter.close(&error));
+
+    for (int table = 0; table < RunExporter::TableCount; ++table) {
+        const QString name = RunExporter::fileName(RunExporter::Table(table));
+        compareWithReference(__FILE__, __LINE__, QDir(dir).filePath(name), "arrow/run/" + name);
+    }
+}
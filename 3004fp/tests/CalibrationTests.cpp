@@ -0,0 +1,157 @@
+#include "PumpTest.h"
+#include <QVector>
+#include "ProfileCalibration.h"
+#include "WhatIfExplorer.h"
+
+// ProfileCalibrator on a history generated from known per-segment settings
+// with the same what-if model it fits, so the true settings fit exactly.
+
+namespace {
+
+const int kStepMinutes = 5;
+
+quint32 nextRandom(quint32 *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Uniform in [low, high)
+double uniform(quint32 *state, double low, double high) {
+    return low + (high - low) * (nextRandom(state) % 10000) / 10000.0;
+}
+
+int segmentAt(const QVector<ProfileSegment> &segments, int minuteOfDay) {
+    int segment = segments.size() - 1;
+    for (int s = 0; s < segments.size() && segments[s].startMinute <= minuteOfDay; ++s) {
+        segment = s;
+    }
+    return segment;
+}
+
+QVector<ProfileSegment> trueSettings() {
+    QVector<ProfileSegment> segments(4);
+    const int starts[] = { 0, 360, 660, 1020 };
+    const double basal[] = { 0.7, 1.1, 0.9, 1.0 };
+    const double carbRatio[] = { 14.0, 8.0, 11.0, 10.0 };
+    const double correctionFactor[] = { 2.6, 1.6, 2.0, 2.2 };
+    for (int s = 0; s < 4; ++s) {
+        segments[s].startMinute = starts[s];
+        segments[s].basalRate = basal[s];
+        segments[s].carbRatio = carbRatio[s];
+        segments[s].correctionFactor = correctionFactor[s];
+    }
+    return segments;
+}
+
+// Three weeks of meals, mis-sized boluses, corrections and varying basal, with
+// glucose following the what-if model under 'settings'
+CalibrationHistory syntheticHistory(const QVector<ProfileSegment> &settings) {
+    const int steps = 21 * 24 * 60 / kStepMinutes;
+    const double stepHours = kStepMinutes / 60.0;
+    const double half = kStepMinutes / 2.0;
+    quint32 random = 2024;
+
+    CalibrationHistory history;
+    history.steps.resize(steps);
+    for (int j = 0; j < steps; ++j) {
+        HistoryStep &step = history.steps[j];
+        const int minute = (j * kStepMinutes) % (24 * 60);
+        const ProfileSegment &segment = settings[segmentAt(settings, minute)];
+        if (minute == 120 || minute == 450 || minute == 750 || minute == 1140) {
+            step.carbs = float(uniform(&random, 10.0, 80.0));
+            step.bolus = float(step.carbs / segment.carbRatio * uniform(&random, 0.6, 1.3));
+        } else if (nextRandom(&random) % 60 == 0) {
+            step.bolus = float(uniform(&random, 0.5, 2.0));
+        }
+        step.basalRate = float(segment.basalRate * uniform(&random, 0.5, 1.5));
+    }
+
+    // Glucose change step j has caused 'age' minutes later
+    const auto effect = [&](int j, double age) {
+        const HistoryStep &step = history.steps[j];
+        const ProfileSegment &segment = settings[segmentAt(settings, (j * kStepMinutes) % (24 * 60))];
+        const double cf = segment.correctionFactor;
+        return cf / segment.carbRatio * step.carbs * WhatIfExplorer::carbsAbsorbed(age)
+               - cf * step.bolus * WhatIfExplorer::insulinActed(age)
+               + cf * (segment.basalRate - step.basalRate) * stepHours * WhatIfExplorer::insulinActed(age - half);
+    };
+
+    // Steps more than 1000 minutes back have fully acted; their effect is kept in 'settled'
+    const int acting = 200;
+    QVector<double> glucose(steps, 0.0);
+    double settled = 0.0;
+    double lowest = 0.0;
+    for (int b = 1; b < steps; ++b) {
+        if (b > acting) settled += effect(b - acting - 1, 1e9);
+        glucose[b] = settled;
+        for (int j = qMax(0, b - acting); j < b; ++j) {
+            glucose[b] += effect(j, (b - j) * kStepMinutes);
+        }
+        lowest = qMin(lowest, glucose[b]);
+    }
+    for (int j = 0; j < steps; ++j) {
+        history.steps[j].glucose = float(glucose[j] - lowest + 5.0);
+    }
+    return history;
+}
+
+QVector<ProfileSegment> scaled(const QVector<ProfileSegment> &segments, double factor) {
+    QVector<ProfileSegment> result = segments;
+    for (ProfileSegment &segment : result) {
+        segment.basalRate *= factor;
+        segment.carbRatio /= factor;
+        segment.correctionFactor *= factor;
+    }
+    return result;
+}
+
+} // namespace
+
+PUMP_TEST(calibrationRecoversKnownSettings) {
+    const QVector<ProfileSegment> truth = trueSettings();
+    const CalibrationHistory history = syntheticHistory(truth);
+
+    // No pull toward the start, so the exact fit is the minimum
+    CalibrationSettings settings;
+    settings.prior = 0.0;
+    settings.tolerance = 1e-12;
+    settings.maxEvaluations = 20000;
+    const CalibrationResult result = ProfileCalibrator(settings).calibrate(history, scaled(truth, 1.3));
+
+    PUMP_CHECK(result.windows > 900);
+    PUMP_CHECK(result.startError > 1.0);
+    PUMP_CHECK(result.error < 0.05);
+    PUMP_CHECK(result.segments.size() == truth.size());
+    for (int s = 0; s < truth.size(); ++s) {
+        PUMP_CHECK(result.segments[s].startMinute == truth[s].startMinute);
+        PUMP_CHECK_NEAR(result.segments[s].basalRate, truth[s].basalRate, 0.01 * truth[s].basalRate);
+        PUMP_CHECK_NEAR(result.segments[s].carbRatio, truth[s].carbRatio, 0.01 * truth[s].carbRatio);
+        PUMP_CHECK_NEAR(result.segments[s].correctionFactor, truth[s].correctionFactor,
+                        0.01 * truth[s].correctionFactor);
+    }
+}
+
+PUMP_TEST(calibrationDoesNotDependOnThreadCount) {
+    const QVector<ProfileSegment> truth = trueSettings();
+    const CalibrationHistory history = syntheticHistory(truth);
+    const QVector<ProfileSegment> start = scaled(truth, 0.8);
+    const ProfileCalibrator calibrator;
+
+    const CalibrationResult serial = calibrator.calibrate(history, start, 1);
+    const CalibrationResult parallel = calibrator.calibrate(history, start, 4);
+
+    // The parallel run evaluates speculative candidates too, but makes the same moves
+    PUMP_CHECK(serial.iterations == parallel.iterations);
+    PUMP_CHECK(serial.converged == parallel.converged);
+    PUMP_CHECK(serial.error == parallel.error);
+    for (int s = 0; s < start.size(); ++s) {
+        PUMP_CHECK(serial.segments[s].basalRate == parallel.segments[s].basalRate);
+        PUMP_CHECK(serial.segments[s].carbRatio == parallel.segments[s].carbRatio);
+        PUMP_CHECK(serial.segments[s].correctionFactor == parallel.segments[s].correctionFactor);
+    }
+
+    // Candidates that could not be used were stopped early
+    PUMP_CHECK(serial.abandoned > 0);
+    PUMP_CHECK(parallel.abandoned > 0);
+    PUMP_CHECK(parallel.evaluations > serial.evaluations);
+}
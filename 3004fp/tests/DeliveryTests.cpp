@@ -0,0 +1,274 @@
+#include "PumpTest.h"
+#include "BasalDelivery.h"
+#include "BolusManager.h"
+#include "InsulinUnits.h"
+#include "PhysiologicalModel.h"
+#include "PumpStages.h"
+#include "SafetyController.h"
+
+// Dosing: pump-step rounding, the bolus calculator, basal pulses and what the deliver stage debits
+
+PUMP_TEST(insulinUnitsRoundToPumpStep) {
+    PUMP_CHECK(InsulinUnits::fromUnits(0.93).toPumpStep() == InsulinUnits::fromTicks(900));
+    PUMP_CHECK(InsulinUnits::fromUnits(0.925).roundedToPumpStep() == InsulinUnits::fromTicks(950));
+    PUMP_CHECK(InsulinUnits::fromUnits(-0.93).toPumpStep() == InsulinUnits::fromTicks(-900));
+    PUMP_CHECK(InsulinUnits::fromUnits(1e12).ticks() == 2147483647);
+    PUMP_CHECK((-InsulinUnits::fromUnits(1e12)).ticks() == -2147483647);
+}
+
+PUMP_TEST(bolusCalculatorSubtractsIobAndRoundsDown) {
+    BolusManager bolus;
+    // 60 g at 1:10 is 6 u, (9.5 - 5.5) / 2 is 2 u, less 1.03 u on board
+    const BolusResult result = bolus.calculateBolus(60.0, 9.5, 10.0, 2.0, 5.5, 1.03, 0.6, 2);
+    PUMP_CHECK_NEAR(result.carbBolus, 6.0, 1e-9);
+    PUMP_CHECK_NEAR(result.correctionBolus, 2.0, 1e-9);
+    PUMP_CHECK_NEAR(result.totalBolus, 8.0, 1e-9);
+    PUMP_CHECK_NEAR(result.finalBolus, 6.95, 1e-9);
+    // Both parts are whole pump steps and add up to the final bolus
+    PUMP_CHECK_NEAR(result.immediateBolus, 4.15, 1e-9);
+    PUMP_CHECK_NEAR(result.extendedBolus, 2.8, 1e-9);
+    PUMP_CHECK_NEAR(result.hourlyRate, 1.4, 1e-9);
+}
+
+PUMP_TEST(reservoirDeliversOnlyWhatRemains) {
+    SafetyController controller;
+    controller.refillInsulin();
+    PUMP_CHECK(controller.deliverInsulin(InsulinUnits::fromUnits(199.5)) == InsulinUnits::fromUnits(199.5));
+    PUMP_CHECK(controller.deliverInsulin(InsulinUnits::fromWholeUnits(2)) == InsulinUnits::fromUnits(0.5));
+    PUMP_CHECK(controller.getReservoir().isZero());
+    PUMP_CHECK(controller.deliverInsulin(InsulinUnits::fromWholeUnits(1)).isZero());
+}
+
+PUMP_TEST(basalPulsesCarryAcrossRateChanges) {
+    BasalScheduler basal;
+    basal.resize(1);
+    basal.setRate(0, 0.9);
+    int pulses = 0;
+    for (int minute = 5; minute <= 60; minute += 5) pulses += basal.advance(0, minute);
+    PUMP_CHECK(pulses == 18);
+
+    // 0.3 u/h leaves 0.025 u after 5 minutes; it is not lost when the rate goes up
+    basal.restart(0, 0);
+    basal.setRate(0, 0.3);
+    PUMP_CHECK(basal.advance(0, 5) == 0);
+    PUMP_CHECK(basal.carry(0) == InsulinUnits::fromUnits(0.025));
+    basal.setRate(0, 0.9);
+    PUMP_CHECK(basal.advance(0, 10) == 2);
+    PUMP_CHECK(basal.carry(0).isZero());
+}
+
+PUMP_TEST(tempBasalRunsThenReturnsToProgrammedRate) {
+    BasalScheduler basal;
+    basal.resize(1);
+    basal.setRate(0, 1.2);
+    basal.setTempBasal(0, 0.0, 30);
+    PUMP_CHECK(basal.tempBasalActive(0));
+    PUMP_CHECK(basal.advance(0, 30) == 0);
+    PUMP_CHECK(!basal.tempBasalActive(0));
+    PUMP_CHECK(basal.advance(0, 90) == 24);
+}
+
+namespace {
+
+// One deliver() call for a patient at 'minute' with the given decision
+DeliveryReport deliverAt(PumpDelivery &delivery, PatientState &patient, int minute,
+                         const ControlDecision &decision) {
+    TickFrame frame;
+    frame.reading.simMinutes = minute;
+    frame.reading.glucose = 12.0;
+    frame.decision = decision;
+    patient.simMinutes = minute;
+    delivery.beginTick(&patient, 1);
+    return delivery.deliver(patient, frame);
+}
+
+} // namespace
+
+PUMP_TEST(recommendedCorrectionIsAdvisory) {
+    SafetyController controller;
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    const InsulinUnits before = controller.getReservoir();
+
+    ControlDecision decision;
+    decision.recommendedCorrection = 3.0;
+    const DeliveryReport report = deliverAt(delivery, patient, 0, decision);
+
+    PUMP_CHECK(controller.getReservoir() == before);
+    PUMP_CHECK(patient.pendingBolus == 0.0);
+    PUMP_CHECK(report.correctionBolus == 0.0);
+    PUMP_CHECK(report.eventCount == 1);
+    PUMP_CHECK(report.events[0].kind == DeliveryEvent::Reading);
+    PUMP_CHECK(report.events[0].advice == DeliveryEvent::AdviseCorrection);
+    PUMP_CHECK_NEAR(report.events[0].amount, 3.0, 1e-12);
+}
+
+PUMP_TEST(autoCorrectionIsDosedInPumpSteps) {
+    SafetyController controller;
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    const InsulinUnits before = controller.getReservoir();
+
+    ControlDecision decision;
+    decision.autoCorrection = 1.23;
+    const DeliveryReport report = deliverAt(delivery, patient, 0, decision);
+
+    PUMP_CHECK(before - controller.getReservoir() == InsulinUnits::fromUnits(1.2));
+    PUMP_CHECK_NEAR(patient.pendingBolus, 1.2, 1e-12);
+    PUMP_CHECK_NEAR(report.correctionBolus, 1.2, 1e-12);
+    PUMP_CHECK(patient.lastAutoCorrectionMinute == 0);
+}
+
+PUMP_TEST(linearPlantTakesDeliveredCorrection) {
+    SafetyController controller;
+    PumpDelivery delivery(&controller);
+    SimulatedCgmSensor sensor;
+    PatientState patient;
+    patient.glucose = 14.0;
+    patient.inputs.insulinOnBoard = 0.5;
+
+    ControlDecision decision;
+    decision.autoCorrection = 2.0;
+    deliverAt(delivery, patient, 0, decision);
+    PUMP_CHECK_NEAR(patient.pendingBolus, 2.0, 1e-12);
+
+    // The next step acts on it and reports it as IOB (less one step of decay),
+    // so the hourly netting sees it
+    sensor.sense(patient);
+    PUMP_CHECK(patient.pendingBolus == 0.0);
+    PUMP_CHECK_NEAR(patient.inputs.insulinOnBoard, 2.4, 1e-12);
+}
+
+PUMP_TEST(autoCorrectionIsNetOfInsulinOnBoard) {
+    ThresholdBasalController control;
+    PatientState patient;
+    patient.inputs.targetBG = 6.0;
+    patient.inputs.correctionFactor = 2.0;
+    patient.simMinutes = 120;
+    GlucoseEstimate estimate;
+    estimate.glucose = 8.0;
+    GlucosePrediction prediction;
+    prediction.predicted30min = 12.0;
+    prediction.predicted30minLow = 11.0;
+
+    estimate.insulinOnBoard = 1.0;
+    PUMP_CHECK_NEAR(control.decide(patient, estimate, prediction).autoCorrection, 2.0, 1e-12);
+
+    estimate.insulinOnBoard = 4.0;
+    PUMP_CHECK(control.decide(patient, estimate, prediction).autoCorrection == 0.0);
+
+    // At most once an hour
+    estimate.insulinOnBoard = 0.0;
+    patient.lastAutoCorrectionMinute = 90;
+    PUMP_CHECK(control.decide(patient, estimate, prediction).autoCorrection == 0.0);
+}
+
+PUMP_TEST(basalSuspensionIsLoggedOnce) {
+    SafetyController controller;
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    controller.setBasalRate(0.9);
+    ControlDecision decision;
+    decision.basalAction = ControlDecision::SuspendBasal;
+
+    int suspendedEvents = 0;
+    for (int minute = 0; minute <= 60; minute += 5) {
+        const DeliveryReport report = deliverAt(delivery, patient, minute, decision);
+        for (int i = 0; i < report.eventCount; ++i) {
+            if (report.events[i].kind == DeliveryEvent::BasalSuspended) ++suspendedEvents;
+        }
+    }
+    PUMP_CHECK(suspendedEvents == 1);
+    PUMP_CHECK(controller.getBasalRate() == 0.0);
+}
+
+PUMP_TEST(mealBolusJoinsIobOnlyAsDelivered) {
+    SafetyController controller;
+    controller.deliverInsulin(controller.getReservoir() - InsulinUnits::fromWholeUnits(1));
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    patient.inputs.insulinOnBoard = 0.5;
+    patient.scenarioBolus = 4.0;
+
+    const DeliveryReport report = deliverAt(delivery, patient, 0, ControlDecision());
+    PUMP_CHECK_NEAR(report.mealBolus, 1.0, 1e-12);
+    PUMP_CHECK_NEAR(patient.inputs.insulinOnBoard, 1.5, 1e-12);
+    PUMP_CHECK(patient.scenarioBolus == 0.0);
+    PUMP_CHECK(controller.getReservoir().isZero());
+}
+
+PUMP_TEST(plantReceivesDeliveredBasal) {
+    SafetyController controller;
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    controller.setBasalRate(0.9);
+    patient.deliveredBasalRate = 0.9;
+    deliverAt(delivery, patient, 0, ControlDecision());
+
+    // An hour of 0.9 u/h is 18 pulses
+    patient.pendingBasal = 0.0;
+    const DeliveryReport report = deliverAt(delivery, patient, 60, ControlDecision());
+    PUMP_CHECK_NEAR(report.basalUnits, 0.9, 1e-12);
+    PUMP_CHECK_NEAR(patient.pendingBasal, 0.9, 1e-12);
+
+    // An empty reservoir delivers nothing, and the plant sees nothing
+    controller.deliverInsulin(controller.getReservoir());
+    patient.pendingBasal = 0.0;
+    deliverAt(delivery, patient, 120, ControlDecision());
+    PUMP_CHECK(patient.pendingBasal == 0.0);
+}
+
+namespace {
+
+// Insulin on board and plant glucose each tick of a run at a constant 1 u/h basal
+struct SteadyBasalRun {
+    double maxIob = 0.0;
+    double minGlucose = 100.0;
+    double maxGlucose = 0.0;
+};
+
+SteadyBasalRun runSteadyBasal(const GlucoseModel &model, double exerciseIntensity) {
+    SafetyController controller;
+    controller.setBasalRate(1.0);
+    PhysiologicalCgmSensor sensor(&model);
+    PumpDelivery delivery(&controller);
+    PatientState patient;
+    patient.glucose = 7.0;
+    patient.deliveredBasalRate = 1.0;
+    patient.initialReadingPending = true;
+
+    SteadyBasalRun run;
+    for (int tick = 0; tick <= 72; ++tick) {
+        patient.exerciseIntensity = tick >= 24 && tick < 36 ? exerciseIntensity : 0.0;
+        sensor.beginTick(&patient, 1);
+        TickFrame frame;
+        frame.reading = sensor.sense(patient);
+        delivery.beginTick(&patient, 1);
+        delivery.deliver(patient, frame);
+
+        run.maxIob = qMax(run.maxIob, patient.inputs.insulinOnBoard);
+        const double glucose = model.glucose(sensor.cohort(), 0);
+        run.minGlucose = qMin(run.minGlucose, glucose);
+        run.maxGlucose = qMax(run.maxGlucose, glucose);
+    }
+    return run;
+}
+
+} // namespace
+
+PUMP_TEST(insulinOnBoardStaysSteadyAtConstantBasal) {
+    // Pulses alternate between 1 and 2 per tick at 1 u/h; none of that is IOB, and the plant stays put
+    HovorkaModel hovorka;
+    BergmanMinimalModel bergman;
+    const SteadyBasalRun hovorkaRun = runSteadyBasal(hovorka, 0.0);
+    const SteadyBasalRun bergmanRun = runSteadyBasal(bergman, 0.0);
+    PUMP_CHECK(hovorkaRun.maxIob <= 0.02);
+    PUMP_CHECK(bergmanRun.maxIob <= 0.02);
+    PUMP_CHECK(hovorkaRun.minGlucose > 6.8 && hovorkaRun.maxGlucose < 7.2);
+    PUMP_CHECK(bergmanRun.minGlucose > 6.8 && bergmanRun.maxGlucose < 7.2);
+
+    // Exercise lowers glucose without showing up as insulin on board
+    const SteadyBasalRun exerciseRun = runSteadyBasal(hovorka, 0.6);
+    PUMP_CHECK(exerciseRun.maxIob <= 0.02);
+    PUMP_CHECK(exerciseRun.minGlucose < 6.5);
+}
@@ -0,0 +1,73 @@
+#include "PumpTest.h"
+#include <QDir>
+#include "GoldenTrace.h"
+#include "Scenario.h"
+
+// The checked-in golden traces, replayed through the current decision stages.
+// After an intended behaviour change, re-record them with golden/ (see README).
+
+namespace {
+
+QStringList goldenTraces() {
+    QDir dir(PumpTest::dataPath("golden"));
+    QStringList paths;
+    for (const QString &name : dir.entryList(QStringList("*.trace"), QDir::Files, QDir::Name)) {
+        paths.append(dir.filePath(name));
+    }
+    return paths;
+}
+
+} // namespace
+
+PUMP_TEST(goldenTracesMatchReplay) {
+    const QStringList paths = goldenTraces();
+    PUMP_CHECK(paths.size() >= 2);
+
+    const QVector<TraceDiff> diffs = GoldenReplay::verify(paths, TraceTolerance());
+    PUMP_CHECK(diffs.size() == paths.size());
+    for (const TraceDiff &diff : diffs) {
+        PUMP_CHECK(diff.error.isEmpty());
+        PUMP_CHECK(diff.ticks > 0);
+        PUMP_CHECK(diff.passed());
+    }
+}
+
+PUMP_TEST(goldenTracesComeFromCheckedInScenario) {
+    CompiledScenario scenario;
+    QString error;
+    PUMP_CHECK(ScenarioCompiler::compileFile(PumpTest::dataPath("golden/two-days.scenario"), &scenario, &error));
+
+    for (const QString &path : goldenTraces()) {
+        GoldenTrace trace;
+        PUMP_CHECK(trace.load(path, &error));
+        PUMP_CHECK(trace.ticks.size() == scenario.durationMinutes / 5 + 1);
+        PUMP_CHECK(trace.ticks.first().initial == 1);
+        PUMP_CHECK_NEAR(trace.ticks.first().glucose, scenario.initialGlucose, 1e-6);
+        PUMP_CHECK_NEAR(trace.ticks.first().carbRatio, scenario.profiles.first().carbRatio, 1e-6);
+        PUMP_CHECK_NEAR(trace.ticks.first().correctionFactor, scenario.profiles.first().correctionFactor, 1e-6);
+        PUMP_CHECK(trace.ticks.last().simMinutes - trace.ticks.first().simMinutes == scenario.durationMinutes);
+    }
+}
+
+PUMP_TEST(goldenReplayCatchesChangedDecision) {
+    GoldenTrace recorded;
+    QString error;
+    PUMP_CHECK(recorded.load(PumpTest::dataPath("golden/two-days.trace"), &error));
+    const GoldenTrace replayed = GoldenReplay::replay(recorded);
+    PUMP_CHECK(GoldenReplay::compare(recorded, replayed, TraceTolerance()).mismatches == 0);
+
+    // An auto correction one step larger than the stages now decide
+    int changed = -1;
+    for (int i = 0; i < recorded.ticks.size() && changed < 0; ++i) {
+        if (recorded.ticks[i].autoCorrection > 0.0f) {
+            changed = i;
+        }
+    }
+    PUMP_CHECK(changed >= 0);
+    recorded.ticks[changed].autoCorrection += 0.05f;
+
+    const TraceDiff diff = GoldenReplay::compare(recorded, replayed, TraceTolerance());
+    PUMP_CHECK(diff.mismatches == 1);
+    PUMP_CHECK(diff.firstTick == changed);
+    PUMP_CHECK(diff.firstField == "autoCorrection");
+}
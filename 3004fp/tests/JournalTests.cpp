@@ -0,0 +1,130 @@
+#include "PumpTest.h"
+#include <QDir>
+#include <QFile>
+#include "HistorySync.h"
+#include "PumpJournal.h"
+#include "SafetyController.h"
+
+// Journal recovery and the history sync wire format
+
+PUMP_TEST(journalRecoversStateAfterReopen) {
+    const QString dir = PumpTest::scratchDir("journal-reopen");
+    QString error;
+    {
+        PumpJournal journal;
+        PUMP_CHECK(journal.open(dir, &error));
+        SafetyController controller;
+        controller.setJournal(&journal);
+        controller.refillInsulin();
+        controller.deliverInsulin(InsulinUnits::fromUnits(1.35));
+        controller.setBasalRate(0.8);
+    }
+
+    // Closing snapshots, so nothing is replayed
+    PumpJournal journal;
+    PUMP_CHECK(journal.open(dir, &error));
+    PUMP_CHECK(journal.recoveryStats().snapshotSequence == 3);
+    PUMP_CHECK(journal.recoveryStats().replayedEvents == 0);
+    PumpState state = journal.state();
+    PUMP_CHECK(state.sequence == 3);
+    PUMP_CHECK(state.insulinLevel == InsulinUnits::fromUnits(198.65));
+    PUMP_CHECK_NEAR(state.basalRate, 0.8, 1e-12);
+    journal.close();
+
+    // Without the snapshot the same state comes from replaying the journal
+    PUMP_CHECK(QFile::remove(QDir(dir).filePath("pump.snapshot")));
+    PUMP_CHECK(journal.open(dir, &error));
+    PUMP_CHECK(journal.recoveryStats().snapshotSequence == 0);
+    PUMP_CHECK(journal.recoveryStats().replayedEvents == 3);
+    PUMP_CHECK(journal.recoveryStats().droppedBytes == 0);
+    state = journal.state();
+    PUMP_CHECK(state.sequence == 3);
+    PUMP_CHECK(state.insulinLevel == InsulinUnits::fromUnits(198.65));
+    PUMP_CHECK_NEAR(state.basalRate, 0.8, 1e-12);
+}
+
+PUMP_TEST(journalDropsTornTail) {
+    const QString dir = PumpTest::scratchDir("journal-torn");
+    QString error;
+    {
+        PumpJournal journal;
+        PUMP_CHECK(journal.open(dir, &error));
+        SafetyController controller;
+        controller.setJournal(&journal);
+        controller.refillInsulin();
+        controller.deliverInsulin(InsulinUnits::fromWholeUnits(5));
+    }
+
+    // Half a record, as a crash mid-write leaves it
+    QFile file(QDir(dir).filePath("pump.journal"));
+    PUMP_CHECK(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    const char partial[20] = {1, 2, 3};
+    file.write(partial, sizeof(partial));
+    file.close();
+
+    PumpJournal journal;
+    PUMP_CHECK(journal.open(dir, &error));
+    PUMP_CHECK(journal.recoveryStats().droppedBytes == 20);
+    PUMP_CHECK(journal.state().sequence == 2);
+    PUMP_CHECK(journal.state().insulinLevel == InsulinUnits::fromWholeUnits(195));
+}
+
+PUMP_TEST(historyBatchRoundTripsAtWireResolution) {
+    QVector<HistoryRecord> records;
+    for (int i = 0; i < 50; ++i) {
+        HistoryRecord record;
+        record.sequence = 10 + 2 * i;
+        record.timeMs = 1700000000000LL + i * 300123LL;
+        if (i % 10 == 7) {
+            record.type = HistoryRecord::Bolus;
+            record.code = JournalEvent::BolusStarted;
+            record.a = 2.35;
+            record.b = 1.005;
+        } else if (i % 10 == 9) {
+            record.type = HistoryRecord::Alert;
+            record.code = 1;
+            record.a = 3.47;
+        } else {
+            record.a = 5.0 * i + 0.4;
+            record.b = 6.0 + 0.137 * (i % 13);
+        }
+        records.append(record);
+    }
+
+    const QByteArray payload = HistoryProtocol::encodeBatch(records.constData(), records.size(), 1234);
+    QVector<HistoryRecord> decoded;
+    quint32 cursor = 0;
+    PUMP_CHECK(HistoryProtocol::decodeBatch(payload, &decoded, &cursor));
+    PUMP_CHECK(cursor == 1234);
+    PUMP_CHECK(decoded.size() == records.size());
+    for (int i = 0; i < records.size(); ++i) {
+        PUMP_CHECK(decoded[i].sequence == records[i].sequence);
+        PUMP_CHECK(decoded[i].timeMs == records[i].timeMs);
+        PUMP_CHECK(decoded[i].type == records[i].type);
+        PUMP_CHECK(decoded[i].code == records[i].code);
+        const double resolution = records[i].type == HistoryRecord::Bolus ? 0.0005 : 0.005;
+        const double minuteResolution = records[i].type == HistoryRecord::Reading ? 1.0 / 120 : resolution;
+        PUMP_CHECK_NEAR(decoded[i].a, records[i].a, minuteResolution);
+        if (records[i].type != HistoryRecord::Alert) PUMP_CHECK_NEAR(decoded[i].b, records[i].b, resolution);
+    }
+}
+
+PUMP_TEST(largestBatchFitsOneFrame) {
+    // Records as far apart as they can be, so every field takes its longest varint
+    QVector<HistoryRecord> records(HistoryProtocol::kMaxBatchRecords);
+    for (int i = 0; i < records.size(); ++i) {
+        HistoryRecord &record = records[i];
+        record.sequence = (i % 2) ? 0xffffffffu : 0;
+        record.timeMs = (i % 2) ? (qint64(1) << 61) : -(qint64(1) << 61);
+        record.type = HistoryRecord::Bolus;
+        record.code = JournalEvent::BolusInterrupted;
+        record.a = (i % 2) ? 9e15 : -9e15;
+        record.b = -record.a;
+    }
+
+    const QByteArray one = HistoryProtocol::encodeBatch(records.constData() + 1, 1, 0);
+    PUMP_CHECK(one.size() - 6 <= HistoryProtocol::kMaxRecordBytes);
+    const QByteArray frame = HistoryProtocol::frame(
+        HistoryProtocol::Batch, HistoryProtocol::encodeBatch(records.constData(), records.size(), 0));
+    PUMP_CHECK(frame.size() - 6 <= HistoryProtocol::kMaxFrameBytes);
+}
@@ -0,0 +1,108 @@
+#include "PumpTest.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QVector>
+#include <cstdio>
+
+// Behaviour tests for the pump sources; timing lives in bench/.
+//
+//   tests [<substring>]
+//
+// Runs every test whose name contains the substring (all by default) and
+// exits 1 if any check failed.
+
+namespace {
+
+struct Entry {
+    const char *name;
+    PumpTest::Function function;
+};
+
+// Function-local so registration from other translation units is safe
+QVector<Entry> &registry() {
+    static QVector<Entry> entries;
+    return entries;
+}
+
+bool g_failed = false;
+bool g_skipped = false;
+QString g_skipReason;
+
+// Silence qDebug output from the code under test
+void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+    if (type != QtDebugMsg && type != QtInfoMsg) {
+        std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+    }
+}
+
+} // namespace
+
+bool PumpTest::add(const char *name, Function function) {
+    registry().append({name, function});
+    return true;
+}
+
+void PumpTest::fail(const char *file, int line, const QString &message) {
+    g_failed = true;
+    std::fprintf(stderr, "  %s:%d: %s\n", file, line, message.toLocal8Bit().constData());
+}
+
+void PumpTest::skip(const QString &reason) {
+    g_skipped = true;
+    g_skipReason = reason;
+}
+
+QString PumpTest::dataPath(const QString &relative) {
+    return QDir(QString(PUMP_TEST_DATA)).filePath(relative);
+}
+
+QString PumpTest::scratchDir(const QString &name) {
+    const QString path = QDir(QDir::tempPath()).filePath("pump-tests-" + name);
+    QDir dir(path);
+    if (dir.exists()) {
+        for (const QString &file : dir.entryList(QDir::Files)) {
+            QFile::remove(dir.filePath(file));
+        }
+    }
+    QDir().mkpath(path);
+    return path;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    qInstallMessageHandler(quietMessageHandler);
+
+    const QStringList args = app.arguments();
+    if (args.size() > 2) {
+        std::fprintf(stderr, "usage: tests [<substring>]\n");
+        return 2;
+    }
+    const QString filter = args.size() == 2 ? args[1] : QString();
+
+    int passed = 0;
+    int failed = 0;
+    int skipped = 0;
+    for (const Entry &entry : registry()) {
+        if (!filter.isEmpty() && !QString(entry.name).contains(filter)) continue;
+
+        g_failed = false;
+        g_skipped = false;
+        entry.function();
+        if (g_failed) {
+            std::printf("FAIL %s\n", entry.name);
+            ++failed;
+        } else if (g_skipped) {
+            std::printf("SKIP %s (%s)\n", entry.name, g_skipReason.toLocal8Bit().constData());
+            ++skipped;
+        } else {
+            std::printf("PASS %s\n", entry.name);
+            ++passed;
+        }
+        std::fflush(stdout);
+    }
+
+    std::printf("%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    return failed > 0 ? 1 : 0;
+}
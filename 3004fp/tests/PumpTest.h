@@ -0,0 +1,51 @@
+#ifndef PUMPTEST_H
+#define PUMPTEST_H
+
+#include <QString>
+#include <cmath>
+
+// Minimal test registry for the tests binary.
+//
+//   PUMP_TEST(name) { PUMP_CHECK(a == b); PUMP_CHECK_NEAR(x, 1.0, 1e-9); }
+//
+// Tests register themselves at static initialisation and run in
+// registration order. A failed check reports file and line and ends the
+// test; the other tests still run.
+namespace PumpTest {
+
+typedef void (*Function)();
+
+bool add(const char *name, Function function);
+void fail(const char *file, int line, const QString &message);
+void skip(const QString &reason);
+
+// Path of a file under tests/data
+QString dataPath(const QString &relative);
+
+// Empty scratch directory for this test, under the system temp directory
+QString scratchDir(const QString &name);
+
+} // namespace PumpTest
+
+#define PUMP_TEST(name) \
+    static void name(); \
+    static const bool name##_registered = PumpTest::add(#name, name); \
+    static void name()
+
+#define PUMP_CHECK(condition) \
+    do { \
+        if (!(condition)) { PumpTest::fail(__FILE__, __LINE__, QString(#condition)); return; } \
+    } while (0)
+
+#define PUMP_CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        const double pumpActual = (actual); \
+        const double pumpExpected = (expected); \
+        if (!(std::fabs(pumpActual - pumpExpected) <= (tolerance))) { \
+            PumpTest::fail(__FILE__, __LINE__, QString("%1 is %2, expected %3") \
+                .arg(#actual).arg(pumpActual, 0, 'g', 10).arg(pumpExpected, 0, 'g', 10)); \
+            return; \
+        } \
+    } while (0)
+
+#endif // PUMPTEST_H
@@ -0,0 +1,138 @@
+#include "PumpTest.h"
+#include <QVector>
+#include <cmath>
+#include "BolusManager.h"
+#include "ProfileSensitivity.h"
+#include "WhatIfExplorer.h"
+
+// ProfileSensitivity's Dual<3> gradients compared with central finite
+// differences of the same smoothed metrics, computed here on plain doubles.
+
+namespace {
+
+struct SmoothedMetrics {
+    double timeInRange = 0.0;    // Percent
+    double hypoMinutes = 0.0;
+};
+
+double logistic(double x) {
+    return 1.0 / (1.0 + std::exp(-x));
+}
+
+// The metrics analyze() differentiates: every reading of every meal counted with logistic edges
+SmoothedMetrics smoothedMetrics(const Profile &profile, const QVector<MealEpisode> &history,
+                                const PatientResponse &response, double smoothing) {
+    const int steps = WhatIfExplorer::kHorizonMinutes / WhatIfExplorer::kStepMinutes;
+    double inRange = 0.0;
+    double hypo = 0.0;
+    QVector<TimedDose<double>> doses(1);
+    for (const MealEpisode &meal : history) {
+        doses[0].minute = 0.0;
+        doses[0].units = BolusManager::bolusTerms(meal.carbs, meal.glucose, profile.carbRatio,
+                                                  profile.correctionFactor, profile.targetBG,
+                                                  meal.insulinOnBoard).finalBolus;
+        for (int k = 0; k <= steps; ++k) {
+            const double g = WhatIfExplorer::glucoseAt(double(k * WhatIfExplorer::kStepMinutes), meal.glucose,
+                                                       response.carbRise * meal.carbs, response.insulinSensitivity,
+                                                       meal.insulinOnBoard, doses);
+            inRange += logistic((g - 3.9) / smoothing) * logistic((10.0 - g) / smoothing);
+            hypo += logistic((3.9 - g) / smoothing);
+        }
+    }
+    SmoothedMetrics metrics;
+    metrics.timeInRange = inRange * 100.0 / (double(history.size()) * (steps + 1));
+    metrics.hypoMinutes = hypo * WhatIfExplorer::kStepMinutes;
+    return metrics;
+}
+
+// Meals whose boluses stay positive, so no setting sits on the calculator's zero floor
+QVector<MealEpisode> mealHistory() {
+    QVector<MealEpisode> history;
+    for (int i = 0; i < 40; ++i) {
+        MealEpisode meal;
+        meal.carbs = 30.0 + (i * 17) % 60;
+        meal.glucose = 5.0 + ((i * 7) % 60) / 10.0;
+        meal.insulinOnBoard = (i % 5) * 0.2;
+        history.append(meal);
+    }
+    return history;
+}
+
+Profile withSetting(Profile profile, int parameter, double delta) {
+    switch (parameter) {
+    case ProfileSensitivity::CarbRatio: profile.carbRatio += delta; break;
+    case ProfileSensitivity::CorrectionFactor: profile.correctionFactor += delta; break;
+    case ProfileSensitivity::TargetBG: profile.targetBG += delta; break;
+    }
+    return profile;
+}
+
+double component(const ProfileGradient &gradient, int parameter) {
+    switch (parameter) {
+    case ProfileSensitivity::CarbRatio: return gradient.carbRatio;
+    case ProfileSensitivity::CorrectionFactor: return gradient.correctionFactor;
+    default: return gradient.targetBG;
+    }
+}
+
+} // namespace
+
+PUMP_TEST(sensitivityGradientsMatchFiniteDifferences) {
+    const QVector<MealEpisode> history = mealHistory();
+    // A patient more sensitive than the profile assumes, so some meals end low and some high
+    PatientResponse response;
+    response.insulinSensitivity = 2.6;
+    response.carbRise = 0.24;
+    const Profile profile = {"test", 1.0, 10.0, 2.0, 5.5};
+
+    int nonZero = 0;
+    for (double smoothing : {0.25, 1.0}) {
+        const SensitivityReport report = ProfileSensitivity::analyze(profile, history, response, smoothing);
+        for (int parameter = 0; parameter < ProfileSensitivity::ParameterCount; ++parameter) {
+            const double h = 1e-5;
+            const SmoothedMetrics up = smoothedMetrics(withSetting(profile, parameter, h), history, response, smoothing);
+            const SmoothedMetrics down = smoothedMetrics(withSetting(profile, parameter, -h), history, response, smoothing);
+            const double timeInRange = (up.timeInRange - down.timeInRange) / (2 * h);
+            const double hypoMinutes = (up.hypoMinutes - down.hypoMinutes) / (2 * h);
+
+            const double tirGradient = component(report.timeInRange, parameter);
+            const double hypoGradient = component(report.hypoMinutes, parameter);
+            PUMP_CHECK_NEAR(tirGradient, timeInRange, 1e-5 * (1.0 + std::fabs(timeInRange)));
+            PUMP_CHECK_NEAR(hypoGradient, hypoMinutes, 1e-5 * (1.0 + std::fabs(hypoMinutes)));
+            if (std::fabs(tirGradient) > 1e-3) ++nonZero;
+            if (std::fabs(hypoGradient) > 1e-3) ++nonZero;
+        }
+    }
+    // Every gradient component carries signal, so the comparison means something
+    PUMP_CHECK(nonZero == 2 * 2 * ProfileSensitivity::ParameterCount);
+}
+
+PUMP_TEST(sensitivityValuesAreExactCounts) {
+    const QVector<MealEpisode> history = mealHistory();
+    PatientResponse response;
+    response.insulinSensitivity = 2.6;
+    response.carbRise = 0.24;
+    const Profile profile = {"test", 1.0, 10.0, 2.0, 5.5};
+
+    // Tiny edges turn the smoothed counts into the exact ones
+    const SmoothedMetrics exact = smoothedMetrics(profile, history, response, 1e-9);
+    const SensitivityReport report = ProfileSensitivity::analyze(profile, history, response);
+    PUMP_CHECK(report.episodes == history.size());
+    PUMP_CHECK_NEAR(report.timeInRange.value, exact.timeInRange, 1e-9);
+    PUMP_CHECK_NEAR(report.hypoMinutes.value, exact.hypoMinutes, 1e-9);
+    PUMP_CHECK(report.hypoMinutes.value > 0.0);
+    PUMP_CHECK(report.timeInRange.value < 100.0);
+}
+
+PUMP_TEST(bolusTermsDerivativesAreAnalytic) {
+    typedef ProfileSensitivity::Value Value;
+    const Value icr = Value::variable(12.0, ProfileSensitivity::CarbRatio);
+    const Value cf = Value::variable(2.5, ProfileSensitivity::CorrectionFactor);
+    const Value target = Value::variable(6.0, ProfileSensitivity::TargetBG);
+    const Value bolus = BolusManager::bolusTerms(Value(60.0), Value(11.0), icr, cf, target, Value(0.5)).finalBolus;
+
+    PUMP_CHECK_NEAR(bolus.value(), 60.0 / 12.0 + 5.0 / 2.5 - 0.5, 1e-12);
+    PUMP_CHECK_NEAR(bolus.derivative(ProfileSensitivity::CarbRatio), -60.0 / (12.0 * 12.0), 1e-12);
+    PUMP_CHECK_NEAR(bolus.derivative(ProfileSensitivity::CorrectionFactor), -5.0 / (2.5 * 2.5), 1e-12);
+    PUMP_CHECK_NEAR(bolus.derivative(ProfileSensitivity::TargetBG), -1.0 / 2.5, 1e-12);
+}
@@ -0,0 +1,133 @@
+#include "PumpTest.h"
+#include "AllocationCounter.h"
+#include "BasalDelivery.h"
+#include "BolusManager.h"
+#include "CGMManager.h"
+#include "PumpJournal.h"
+#include "PumpStages.h"
+#include "SafetyController.h"
+#include "TickArena.h"
+#include "TickPipeline.h"
+
+// Steady-state ticks must not touch the heap (README "Tick Memory").
+// Only meaningful where malloc itself is counted; elsewhere these are skipped.
+
+namespace {
+
+// Render stage that drops every frame
+class DiscardRender : public RenderStage {
+public:
+    void render(const PatientState &, const TickFrame &frame) override {
+        m_sink += frame.prediction.predicted30min;
+    }
+    double m_sink = 0.0;
+};
+
+quint64 allocationsSince(const AllocationCounter::Totals &before) {
+    return AllocationCounter::current().allocations - before.allocations;
+}
+
+} // namespace
+
+PUMP_TEST(steadyStateTickDoesNotAllocate) {
+    if (!AllocationCounter::countsMalloc()) {
+        PumpTest::skip("malloc is not counted on this platform");
+        return;
+    }
+
+    BolusManager bolusManager;
+    CGMManager cgm(&bolusManager);
+    SafetyController controller;
+    SimulatedCgmSensor sensor;
+    CgmHistoryEstimator estimator(&cgm);
+    LinearGlucosePredictor predictor(&cgm);
+    ThresholdBasalController basalController;
+    PumpDelivery delivery(&controller);
+    DiscardRender render;
+
+    TickPipeline pipeline;
+    pipeline.setSenseStage(&sensor);
+    pipeline.setEstimateStage(&estimator);
+    pipeline.setPredictStage(&predictor);
+    pipeline.setControlStage(&basalController);
+    pipeline.setDeliverStage(&delivery);
+    pipeline.setRenderStage(&render);
+
+    // Journaling as the app does; snapshots are the journal's one allocation, so they are off
+    PumpJournal journal;
+    QString error;
+    PUMP_CHECK(journal.open(PumpTest::scratchDir("tick-journal"), &error));
+    journal.setSnapshotInterval(0);
+    controller.setJournal(&journal);
+    cgm.setJournal(&journal);
+
+    PatientState patient;
+    patient.initialReadingPending = true;
+    patient.glucose = 7.0;
+    patient.inputs.insulinOnBoard = 1.0;
+    patient.inputs.carbsOnBoard = 15.0;
+    TickFrame frame;
+
+    // Warm up past the reading window, so the history has reached its steady size
+    auto tick = [&]() {
+        if (patient.glucose <= 3.0 || patient.glucose >= 18.0) patient.glucose = 7.0;
+        if (controller.getReservoir() < InsulinUnits::fromWholeUnits(50)) controller.refillInsulin();
+        pipeline.run(&patient, &frame, 1);
+    };
+    for (int i = 0; i < 4 * PumpState::kReadingWindow; ++i) tick();
+
+    const AllocationCounter::Totals before = AllocationCounter::current();
+    for (int i = 0; i < 1000; ++i) tick();
+    PUMP_CHECK(allocationsSince(before) == 0);
+}
+
+PUMP_TEST(basalAdvanceDoesNotAllocate) {
+    if (!AllocationCounter::countsMalloc()) {
+        PumpTest::skip("malloc is not counted on this platform");
+        return;
+    }
+
+    const int kPumpCount = 1000;
+    BasalScheduler basal;
+    basal.resize(kPumpCount);
+    for (int pump = 0; pump < kPumpCount; ++pump) {
+        basal.setRate(pump, 0.35 + 0.05 * (pump % 30));
+        if (pump % 4 == 0) basal.setTempBasal(pump, 0.2 * (pump % 9), 120);
+    }
+    QVector<int> minutes(kPumpCount, 0);
+    QVector<int> pulses(kPumpCount, 0);
+
+    const AllocationCounter::Totals before = AllocationCounter::current();
+    for (int tick = 0; tick < 100; ++tick) {
+        for (int &minute : minutes) minute += 5;
+        basal.advance(minutes.constData(), pulses.data(), kPumpCount);
+    }
+    PUMP_CHECK(allocationsSince(before) == 0);
+}
+
+PUMP_TEST(arenaCgmQueriesDoNotAllocate) {
+    if (!AllocationCounter::countsMalloc()) {
+        PumpTest::skip("malloc is not counted on this platform");
+        return;
+    }
+
+    BolusManager bolusManager;
+    CGMManager cgm(&bolusManager);
+    for (int i = 0; i < PumpState::kReadingWindow; ++i) {
+        cgm.addReading(6.0 + 2.0 * ((i % 24) - 12) / 12.0);
+    }
+    TickArena arena;
+    arena.reset();
+    cgm.getGlucoseHistory(arena, 60);
+    cgm.predictGlucoseLevels(arena, 7.2, 1.5, 20.0, 1.0, 30);
+
+    int points = 0;
+    const AllocationCounter::Totals before = AllocationCounter::current();
+    for (int i = 0; i < 100; ++i) {
+        arena.reset();
+        points += cgm.getGlucoseHistory(arena, 60).size();
+        points += cgm.predictGlucoseLevels(arena, 7.2, 1.5, 20.0, 1.0, 30).size();
+    }
+    PUMP_CHECK(allocationsSince(before) == 0);
+    PUMP_CHECK(points > 0);
+}
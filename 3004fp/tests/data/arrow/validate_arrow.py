@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Reads the reference Arrow files with pyarrow and checks their contents.
+
+The tests compare what ArrowFileWriter and RunExporter write with these files
+byte for byte; this script is what shows the references are valid Arrow with
+the intended values. Run it after replacing a reference, with pyarrow
+installed (pip install pyarrow):
+
+    python3 validate_arrow.py
+"""
+
+import math
+import os
+import sys
+
+import pyarrow as pa
+import pyarrow.ipc as ipc
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+START_MS = 1700000000000
+
+
+def read(name):
+    reader = ipc.open_file(os.path.join(HERE, name))
+    table = reader.read_all()
+    table.validate(full=True)
+    return reader.num_record_batches, table
+
+
+def ms(table, column):
+    return table.column(column).cast(pa.int64()).to_pylist()
+
+
+def close(actual, expected):
+    if len(actual) != len(expected):
+        return False
+    for a, e in zip(actual, expected):
+        if math.isnan(e):
+            if not math.isnan(a):
+                return False
+        elif abs(a - e) > 1e-9:
+            return False
+    return True
+
+
+def check(condition, message):
+    if not condition:
+        print("FAIL " + message)
+        sys.exit(1)
+
+
+def all_types():
+    batches, t = read("all-types.arrow")
+    rows = range(13)
+    check(batches == 2, "all-types: 2 batches")
+    check(t.schema.types == [pa.bool_(), pa.int8(), pa.int32(), pa.int64(), pa.float32(), pa.float64(),
+                             pa.timestamp("ms", tz="UTC")], "all-types: schema")
+    check(t.column("flag").to_pylist() == [r % 3 == 0 for r in rows], "all-types: flag")
+    check(t.column("small").to_pylist() == [r * 13 - 60 for r in rows], "all-types: small")
+    check(t.column("count").to_pylist() == [r * 100000 - 7 for r in rows], "all-types: count")
+    check(t.column("big").to_pylist() == [(1 << 40) * (r - 6) for r in rows], "all-types: big")
+    check(close(t.column("ratio").to_pylist(), [0.25 * r for r in rows]), "all-types: ratio")
+    check(close(t.column("value").to_pylist(), [5.5 + r / 8.0 for r in rows]), "all-types: value")
+    check(ms(t, "time") == [START_MS + r * 300000 for r in rows], "all-types: time")
+
+
+def run():
+    ticks = [(tick, p) for tick in range(3) for p in range(2)]
+    glucose = [6.0 + p + 0.5 * tick for tick, p in ticks]
+
+    _, t = read("run/readings.arrow")
+    check(t.column("patient").to_pylist() == [p for _, p in ticks], "readings: patient")
+    check(t.column("minute").to_pylist() == [5 * tick for tick, _ in ticks], "readings: minute")
+    check(ms(t, "time") == [START_MS + 300000 * tick for tick, _ in ticks], "readings: time")
+    check(close(t.column("glucose").to_pylist(), glucose), "readings: glucose")
+    check(close(t.column("filtered").to_pylist(), [g - 0.1 for g in glucose]), "readings: filtered")
+    check(close(t.column("trend").to_pylist(), [0.02 * (tick - 1) for tick, _ in ticks]), "readings: trend")
+    check(t.column("initial").to_pylist() == [tick == 0 for tick, _ in ticks], "readings: initial")
+
+    _, t = read("run/predictions.arrow")
+    points = [(tick, p, k) for tick, p in ticks for k in range(3)]
+    nan = float("nan")
+    check(t.column("horizon").to_pylist() == [5 * k for _, _, k in points], "predictions: horizon")
+    check(close(t.column("glucose").to_pylist(), [6.0 + p + 0.5 * tick + 0.2 * k for tick, p, k in points]),
+          "predictions: glucose")
+    check(close(t.column("lower").to_pylist(),
+                [6.0 + p + 0.5 * tick - 0.3 * k if p == 1 else nan for tick, p, k in points]), "predictions: lower")
+    check(close(t.column("upper").to_pylist(),
+                [6.0 + p + 0.5 * tick + 0.5 * k if p == 1 else nan for tick, p, k in points]), "predictions: upper")
+
+    _, t = read("run/decisions.arrow")
+    check(t.column("alert").to_pylist() == [2 if (tick, p) == (2, 1) else 0 for tick, p in ticks], "decisions: alert")
+    check(t.column("recommend_carbs").to_pylist() == [tick == 1 for tick, _ in ticks], "decisions: recommend_carbs")
+    check(t.column("basal_action").to_pylist() == [3 if tick == 2 else 0 for tick, _ in ticks], "decisions: basal_action")
+    check(close(t.column("insulin_on_board").to_pylist(), [1.5 - 0.25 * tick for tick, _ in ticks]),
+          "decisions: insulin_on_board")
+
+    _, t = read("run/doses.arrow")
+    check(t.column("kind").to_pylist() == [0, 0, 0, 1, 0, 0, 0, 2], "doses: kind")
+    check(close(t.column("units").to_pylist(), [0.0, 0.0, 0.05, 4.5, 0.1, 0.05, 0.1, 1.2]), "doses: units")
+    check(close(t.column("rate").to_pylist(), [0.8, 0.9, 0.8, 0.0, 0.9, 0.8, 0.9, 0.0]), "doses: rate")
+
+
+if __name__ == "__main__":
+    all_types()
+    run()
+    print("reference Arrow files are valid")
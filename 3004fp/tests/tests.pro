@@ -0,0 +1,64 @@
+QT = core network
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = tests
+
+# Behaviour tests for the pump sources, without the UI; timing stays in bench/
+INCLUDEPATH += .. ../bench
+DEFINES += PUMP_TEST_DATA=\\\"$$PWD/data\\\"
+
+SOURCES += \
+    PumpTest.cpp \
+    ArchiveTests.cpp \
+    ArrowTests.cpp \
+    CalibrationTests.cpp \
+    DeliveryTests.cpp \
+    GoldenTests.cpp \
+    JournalTests.cpp \
+    SensitivityTests.cpp \
+    TickTests.cpp \
+    ../bench/AllocationCounter.cpp \
+    ../ArrowIpc.cpp \
+    ../BasalDelivery.cpp \
+    ../BolusManager.cpp \
+    ../CGMManager.cpp \
+    ../CgmFusion.cpp \
+    ../CgmResampler.cpp \
+    ../EnsemblePredictor.cpp \
+    ../GlucoseArchive.cpp \
+    ../GlucoseColumns.cpp \
+    ../GlucoseKalmanFilter.cpp \
+    ../GoldenTrace.cpp \
+    ../HistorySync.cpp \
+    ../Instrumentation.cpp \
+    ../MpcBasalController.cpp \
+    ../PhysiologicalModel.cpp \
+    ../ProfileCalibration.cpp \
+    ../ProfileSensitivity.cpp \
+    ../PumpJournal.cpp \
+    ../PumpStages.cpp \
+    ../RunExport.cpp \
+    ../SafetyController.cpp \
+    ../Scenario.cpp \
+    ../TickArena.cpp \
+    ../TickPipeline.cpp \
+    ../WhatIfExplorer.cpp
+
+HEADERS += \
+    PumpTest.h \
+    ../bench/AllocationCounter.h \
+    ../ArrowIpc.h \
+    ../GlucoseArchive.h \
+    ../GoldenTrace.h \
+    ../HistorySync.h \
+    ../ProfileCalibration.h \
+    ../RunExport.h \
+    ../SafetyController.h \
+    ../Scenario.h \
+    ../WhatIfExplorer.h
+
+# make check runs every test
+check.commands = ./$$TARGET
+check.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += check